@@ -0,0 +1,387 @@
+/*
+ * Headless benchmark: runs frames uncapped with the chosen video and audio
+ * output and reports the speed as JSON, optionally checked against a baseline.
+ * Built with the performance counters, their per-frame averages are added.
+ */
+
+#include "machine.h"
+#include "deferredrenderer.h"
+#include "memorybackend.h"
+#include "threadpool.h"
+#include "hostclock.h"
+#include "loader.h"
+#include "movie.h"
+#include "log.h"
+#include "testrom.h"
+
+#include <algorithm>
+#include <cctype>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace
+{
+
+// Samples are mixed and resampled as for playback, then dropped
+class NullPlaybackBackend: public PlaybackBackend
+{
+public:
+    void init() noexcept override
+    {
+    }
+
+    uint getPlaybackFrequency() const noexcept override
+    {
+        return 48000u;
+    }
+
+    void beginFrame(uint) noexcept override
+    {
+    }
+
+    void queueSample(float v) noexcept override
+    {
+        m_sum += v;
+    }
+
+    void queueSamples(const float *pSamples, uint n) noexcept override
+    {
+        for (uint i = 0u; i < n; i++)
+            m_sum += pSamples[i];
+    }
+
+    void endFrame() noexcept override
+    {
+    }
+
+private:
+    float m_sum = 0.0f;
+};
+
+struct Result
+{
+    uint frames;
+    double seconds,
+           fps,
+           nsMean,
+           nsP50,
+           nsP90,
+           nsP99,
+           nsMax,
+           instructionsPerSec,
+           cyclesPerSec,
+           hostPerGuestCycle;
+    uint64_t memoryHash;
+};
+
+double percentile(const std::vector<double> &sorted, double q)
+{
+    const auto i = static_cast<size_t>(q * static_cast<double>(sorted.size()));
+    return sorted[std::min(i, sorted.size() - 1u)];
+}
+
+std::string hostCPU()
+{
+    std::ifstream in { "/proc/cpuinfo" };
+    std::string line;
+    while (std::getline(in, line))
+    {
+        if (line.compare(0, 10, "model name") == 0)
+        {
+            const size_t pos = line.find(':');
+            if (pos != std::string::npos && pos + 2u <= line.size())
+                return line.substr(pos + 2u);
+        }
+    }
+    return "unknown";
+}
+
+std::string jsonString(const std::string &s)
+{
+    std::string out = "\"";
+    for (char c: s)
+    {
+        if (c == '"' || c == '\\')
+            out += '\\';
+        if (static_cast<unsigned char>(c) >= 0x20u)
+            out += c;
+    }
+    return out + "\"";
+}
+
+// Value of a key of the flat JSON written below, empty if there's none
+std::string jsonValue(const std::string &text, const char *key)
+{
+    const std::string quoted = std::string { "\"" } + key + "\"";
+    size_t pos = text.find(quoted);
+    if (pos == std::string::npos)
+        return { };
+    pos = text.find(':', pos + quoted.size());
+    if (pos == std::string::npos)
+        return { };
+    pos = text.find_first_not_of(" \t\r\n", pos + 1u);
+    if (pos == std::string::npos)
+        return { };
+    if (text[pos] == '"')
+    {
+        const size_t end = text.find('"', pos + 1u);
+        return end == std::string::npos ? std::string { } : text.substr(pos + 1u, end - pos - 1u);
+    }
+    const size_t end = text.find_first_of(",}\r\n", pos);
+    return text.substr(pos, end == std::string::npos ? std::string::npos : end - pos);
+}
+
+} // namespace
+
+int main(int argc, char **argv)
+{
+    const char *romPath = nullptr,
+               *moviePath = nullptr,
+               *video = "none",
+               *audio = "none",
+               *jsonPath = nullptr,
+               *baselinePath = nullptr;
+    std::string label;
+    int nFrames = 3000,
+        nWarmup = 120;
+    double tolerance = 10.0;
+    for (int i = 1; i < argc; i++)
+    {
+        if (strcmp(argv[i], "--frames") == 0 && i + 1 < argc)
+            nFrames = std::max(atoi(argv[++i]), 1);
+        else if (strcmp(argv[i], "--warmup") == 0 && i + 1 < argc)
+            nWarmup = std::max(atoi(argv[++i]), 0);
+        else if (strcmp(argv[i], "--video") == 0 && i + 1 < argc)
+            video = argv[++i];
+        else if (strcmp(argv[i], "--audio") == 0 && i + 1 < argc)
+            audio = argv[++i];
+        else if (strcmp(argv[i], "--movie") == 0 && i + 1 < argc)
+            moviePath = argv[++i];
+        else if (strcmp(argv[i], "--label") == 0 && i + 1 < argc)
+            label = argv[++i];
+        else if (strcmp(argv[i], "--json") == 0 && i + 1 < argc)
+            jsonPath = argv[++i];
+        else if (strcmp(argv[i], "--baseline") == 0 && i + 1 < argc)
+            baselinePath = argv[++i];
+        else if (strcmp(argv[i], "--tolerance") == 0 && i + 1 < argc)
+            tolerance = atof(argv[++i]);
+        else if (argv[i][0] != '-' && !romPath)
+            romPath = argv[i];
+        else
+        {
+            fprintf(stderr, "Usage: %s [<ROM-file>] [--frames <n>] [--warmup <n>] [--video none|memory|deferred]\n"
+                            "       [--audio none|mix] [--movie <file>] [--label <name>] [--json <file>]\n"
+                            "       [--baseline <file> [--tolerance <percent>]]\n",
+                    argv[0]);
+            return 2;
+        }
+    }
+
+    const bool drawn = strcmp(video, "none") != 0,
+               deferred = strcmp(video, "deferred") == 0,
+               mixed = strcmp(audio, "mix") == 0;
+    if ((drawn && !deferred && strcmp(video, "memory") != 0) || (!mixed && strcmp(audio, "none") != 0))
+    {
+        fprintf(stderr, "Unknown video or audio mode\n");
+        return 2;
+    }
+    if (label.empty())
+        label = std::string { romPath ? "rom" : "builtin" } + "-" + video + "-" + audio;
+
+    auto &logCfg = Log::instance().config();
+    logCfg.pOutput = &std::cerr;
+    logCfg.filter = Log::LVL_ERROR | Log::LVL_WARNING;
+
+    std::unique_ptr<Machine> pMachine;
+    MemoryRenderingBackend rbe;
+    NullPlaybackBackend pbe;
+    std::unique_ptr<ThreadPool> pPool;
+    std::unique_ptr<DeferredRenderer> pRenderer;
+    std::unique_ptr<MoviePlayer> pPlayer;
+    try
+    {
+        pMachine.reset(new Machine { romPath ? ROMLoader::readNES(romPath) : testROMImage(), OutputMode::NTSC });
+        if (moviePath)
+        {
+            pPlayer.reset(new MoviePlayer { pMachine->bus() });
+            pPlayer->start(moviePath);
+        }
+    }
+    catch (const Exception &ex)
+    {
+        fprintf(stderr, "Error: %s\n", ex.message());
+        return 2;
+    }
+
+    Machine &m = *pMachine;
+    m.ppu().setBackend(&rbe);
+    if (deferred)
+    {
+        pPool.reset(new ThreadPool { });
+        pRenderer.reset(new DeferredRenderer { *pPool });
+        m.ppu().setDeferredRenderer(pRenderer.get());
+    }
+    if (mixed)
+        m.apu().setBackend(&pbe);
+    const uint output = (drawn ? Bus::FRAME_VIDEO : 0u) | (mixed ? Bus::FRAME_AUDIO : 0u);
+
+    // Input runs out with the movie, the rest of the frames go on without
+    auto runFrame = [&]()
+    {
+        if (pPlayer)
+            pPlayer->beforeFrame();
+        m.runFrame(output);
+    };
+
+    for (int i = 0; i < nWarmup; i++)
+        runFrame();
+
+    using Clock = std::chrono::steady_clock;
+    std::vector<double> frameNs(static_cast<size_t>(nFrames));
+    const uint64_t cycles0 = m.cpu().cycles(),
+                   instructions0 = m.cpu().instructionCount(),
+                   host0 = hostCycles();
+#ifdef ENABLE_PERF_COUNTERS
+    PerfCounters perf = { };
+#endif
+    const auto t0 = Clock::now();
+    auto tFrame = t0;
+    for (int i = 0; i < nFrames; i++)
+    {
+        runFrame();
+#ifdef ENABLE_PERF_COUNTERS
+        perf += m.bus().perfCounters();
+#endif
+        const auto t = Clock::now();
+        frameNs[static_cast<size_t>(i)] = std::chrono::duration<double, std::nano>(t - tFrame).count();
+        tFrame = t;
+    }
+    const uint64_t hostSpent = hostCycles() - host0;
+    const double sec = std::chrono::duration<double>(tFrame - t0).count();
+    const auto guestCycles = static_cast<double>(m.cpu().cycles() - cycles0);
+
+    // Whatever was drawn in the overlapped mode is out before the renderer goes
+    m.ppu().setDeferredRenderer(nullptr);
+
+    Result r;
+    r.frames = static_cast<uint>(nFrames);
+    r.seconds = sec;
+    r.fps = nFrames / sec;
+    r.nsMean = sec * 1e9 / nFrames;
+    std::sort(frameNs.begin(), frameNs.end());
+    r.nsP50 = percentile(frameNs, 0.5);
+    r.nsP90 = percentile(frameNs, 0.9);
+    r.nsP99 = percentile(frameNs, 0.99);
+    r.nsMax = frameNs.back();
+    r.instructionsPerSec = static_cast<double>(m.cpu().instructionCount() - instructions0) / sec;
+    r.cyclesPerSec = guestCycles / sec;
+    r.hostPerGuestCycle = static_cast<double>(hostSpent) / guestCycles;
+    r.memoryHash = m.bus().memoryHash();
+
+#ifdef __OPTIMIZE__
+    const bool optimized = true;
+#else
+    const bool optimized = false;
+#endif
+
+    std::ostringstream json;
+    char buf[64];
+    auto num = [&buf](double v, int prec) -> const char*
+    {
+        snprintf(buf, sizeof(buf), "%.*f", prec, v);
+        return buf;
+    };
+    json << "{\n"
+         << "  \"label\": " << jsonString(label) << ",\n"
+         << "  \"rom\": " << jsonString(romPath ? romPath : "builtin") << ",\n"
+         << "  \"video\": " << jsonString(video) << ",\n"
+         << "  \"audio\": " << jsonString(audio) << ",\n"
+         << "  \"frames\": " << r.frames << ",\n"
+         << "  \"warmup_frames\": " << nWarmup << ",\n"
+         << "  \"optimized\": " << (optimized ? "true" : "false") << ",\n"
+         << "  \"host_cpu\": " << jsonString(hostCPU()) << ",\n"
+         << "  \"host_threads\": " << std::thread::hardware_concurrency() << ",\n"
+         << "  \"host_clock\": " << jsonString(hostCyclesAreTSC() ? "tsc" : "ns") << ",\n"
+         << "  \"seconds\": " << num(r.seconds, 4) << ",\n"
+         << "  \"fps\": " << num(r.fps, 1) << ",\n"
+         << "  \"ns_per_frame_mean\": " << num(r.nsMean, 0) << ",\n"
+         << "  \"ns_per_frame_p50\": " << num(r.nsP50, 0) << ",\n"
+         << "  \"ns_per_frame_p90\": " << num(r.nsP90, 0) << ",\n"
+         << "  \"ns_per_frame_p99\": " << num(r.nsP99, 0) << ",\n"
+         << "  \"ns_per_frame_max\": " << num(r.nsMax, 0) << ",\n"
+         << "  \"guest_instructions_per_sec\": " << num(r.instructionsPerSec, 0) << ",\n"
+         << "  \"guest_cycles_per_sec\": " << num(r.cyclesPerSec, 0) << ",\n"
+         << "  \"host_cycles_per_guest_cycle\": " << num(r.hostPerGuestCycle, 2) << ",\n";
+#ifdef ENABLE_PERF_COUNTERS
+    // Counters slow the run down a bit, speed of such a build isn't compared with one without
+    json << "  \"perf_per_frame\": {";
+    auto perfKey = [&](std::string key, uint64_t total, bool last = false)
+    {
+        std::transform(key.begin(), key.end(), key.begin(), [](char c) { return static_cast<char>(tolower(c)); });
+        json << "\n    " << jsonString(key) << ": " << num(static_cast<double>(total) / nFrames, 1) << (last ? "" : ",");
+    };
+    perfKey("instructions", perf.instructions);
+    perfKey("cycles", perf.cycles);
+    for (int i = 0; i < PerfCounters::NUM_REGIONS; i++)
+    {
+        perfKey(std::string { "reads_" } + PerfCounters::regionName(i), perf.reads[i]);
+        perfKey(std::string { "writes_" } + PerfCounters::regionName(i), perf.writes[i]);
+    }
+    perfKey("bank_switches", perf.bankSwitches);
+    perfKey("sprite_lines", perf.spriteLines);
+    for (int i = 0; i < PerfCounters::NUM_SECTIONS; i++)
+        perfKey(std::string { "host_" } + PerfCounters::sectionName(i), perf.hostTime[i], i + 1 == PerfCounters::NUM_SECTIONS);
+    json << "\n  },\n";
+#endif
+    snprintf(buf, sizeof(buf), "%016llx", static_cast<unsigned long long>(r.memoryHash));
+    const std::string hash = buf;
+    json << "  \"memory_hash\": \"" << hash << "\"\n"
+         << "}\n";
+
+    if (jsonPath)
+    {
+        std::ofstream out { jsonPath };
+        out << json.str();
+        if (!out)
+        {
+            fprintf(stderr, "Error: failed to write %s\n", jsonPath);
+            return 2;
+        }
+    }
+    else
+        std::cout << json.str();
+
+    if (!baselinePath)
+        return 0;
+
+    std::ifstream in { baselinePath };
+    std::stringstream text;
+    text << in.rdbuf();
+    const std::string baseFps = jsonValue(text.str(), "fps"),
+                      baseHash = jsonValue(text.str(), "memory_hash");
+    if (!in || baseFps.empty())
+    {
+        fprintf(stderr, "Error: no fps in the baseline %s\n", baselinePath);
+        return 2;
+    }
+
+    // Speed is compared on the same work only
+    if (baseHash != hash)
+        fprintf(stderr, "Warning: the baseline ran to another state (memory hash %s), "
+                        "the ROM, input or frame count differ\n", baseHash.c_str());
+
+    const double ratio = r.fps / atof(baseFps.c_str());
+    const bool regressed = ratio < 1.0 - tolerance / 100.0;
+    fprintf(stderr, "%s: %.1f FPS, %.3fx the baseline%s\n", label.c_str(), r.fps, ratio,
+            regressed ? " - REGRESSION" : "");
+    return regressed ? 1 : 0;
+}
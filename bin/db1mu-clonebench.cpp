@@ -0,0 +1,79 @@
+/*
+ * Benchmark of Machine::clone(): a running machine is cloned into a preallocated
+ * one over and over, compared with a round trip through a state file image.
+ */
+
+#include "machine.h"
+#include "loader.h"
+#include "log.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <vector>
+
+int main(int argc, char **argv)
+{
+    if (argc < 2)
+    {
+        fprintf(stderr, "Usage: %s <ROM-file> [<clones>]\n", argv[0]);
+        return 2;
+    }
+    const uint nClones = argc > 2 ? static_cast<uint>(atoi(argv[2])) : 1000000u;
+
+    Log::instance().config().filter = Log::LEVEL_SILENT;
+
+    using Clock = std::chrono::steady_clock;
+    try
+    {
+        const RomImage::Ptr pImage = ROMLoader::readNES(argv[1]);
+        Machine src { pImage, OutputMode::NTSC },
+                dst { pImage, OutputMode::NTSC };
+
+        // Get past the power on state
+        for (int i = 0; i < 60; i++)
+            src.runFrame(Bus::FRAME_NO_OUTPUT);
+
+        auto t0 = Clock::now();
+        for (uint i = 0u; i < nClones; i++)
+            src.clone(dst);
+        const double cloneSec = std::chrono::duration<double>(Clock::now() - t0).count();
+
+        // What branching took before: a state file image built and loaded
+        const uint nFiles = std::max(nClones / 100u, 1u);
+        SnapshotBuffer snapshot { src.bus().snapshotSize() };
+        std::vector<uint8_t> image(Bus::stateFileSize(snapshot.size()));
+        t0 = Clock::now();
+        for (uint i = 0u; i < nFiles; i++)
+        {
+            src.bus().snapshot(snapshot.data());
+            Bus::buildStateFile(snapshot.data(), snapshot.size(), image.data());
+            dst.bus().loadState(image.data(), image.size());
+        }
+        const double fileSec = std::chrono::duration<double>(Clock::now() - t0).count();
+
+        // The clone has to go on exactly like the original
+        src.clone(dst);
+        std::unique_ptr<Machine> pNew = src.clone();
+        for (int i = 0; i < 60; i++)
+        {
+            src.runFrame(Bus::FRAME_NO_OUTPUT);
+            dst.runFrame(Bus::FRAME_NO_OUTPUT);
+            pNew->runFrame(Bus::FRAME_NO_OUTPUT);
+        }
+        const bool same = src.bus().memoryHash() == dst.bus().memoryHash() &&
+                          src.bus().memoryHash() == pNew->bus().memoryHash();
+
+        printf("state size      %zu bytes\n", snapshot.size());
+        printf("clone           %12.0f /s\n", nClones / cloneSec);
+        printf("state file      %12.0f /s\n", nFiles / fileSec);
+        printf("clone diverged  %s\n", same ? "no" : "YES");
+        return same ? 0 : 1;
+    }
+    catch (const Exception &ex)
+    {
+        fprintf(stderr, "Error: %s\n", ex.message());
+        return 1;
+    }
+}
@@ -1,29 +1,16 @@
 #include <thread>
 #include "cpu6502.h"
 #include "PPU.h"
+#include "APU.h"
 #include "Cartridge.h"
+#include "gamepad.h"
+#include "memorybackend.h"
 #include "debugger.h"
 #include "loader.h"
 #include "log.h"
 #include <iostream>
 #include <fstream>
 
-class DummyBackend: public PPU::RenderingBackend
-{
-public:
-    void setBackground(c6502_byte_t color) override
-    {
-    }
-
-    void setSymbol(Layer l, int x, int y, c6502_byte_t colorData[64]) override
-    {
-    }
-
-    void draw() override
-    {
-    }
-};
-
 int main(int argc, char **argv)
 {
     if (argc < 2)
@@ -41,9 +28,15 @@ int main(int argc, char **argv)
     Bus systemBus { OutputMode::NTSC };
     CPU6502 cpu;
     systemBus.setCPU(&cpu);
-    DummyBackend db;
-    PPU ppu { &db };
+    MemoryRenderingBackend rbe;
+    PPU ppu;
+    ppu.setBackend(&rbe);
     systemBus.setPPU(&ppu);
+    APU apu;
+    systemBus.setAPU(&apu);
+    Gamepad pads[2];
+    systemBus.setGamePad(0, &pads[0]);
+    systemBus.setGamePad(1, &pads[1]);
     Cartrige cartrige;
     ROMLoader loader(cartrige);
     try
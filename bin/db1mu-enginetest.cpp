@@ -0,0 +1,220 @@
+/*
+ * Regression checks of engine paths the other tools don't go through.
+ * Every check is run by name and exits with 0 when it passes.
+ */
+
+#include "bus.h"
+#include "cpu6502.h"
+#include "PPU.h"
+#include "APU.h"
+#include "Cartridge.h"
+#include "gamepad.h"
+#include "loader.h"
+#include "machine.h"
+#include "memorybackend.h"
+#include "checksum.h"
+#include "log.h"
+#include "testrom.h"
+
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <vector>
+
+namespace
+{
+
+// Machine parts wired the way the frontends do it, drawing into memory
+struct Console
+{
+    Bus bus { OutputMode::NTSC };
+    CPU6502 cpu;
+    PPU ppu;
+    APU apu;
+    Cartrige cart;
+    Gamepad pads[2];
+    MemoryRenderingBackend rbe;
+
+    Console()
+    {
+        ppu.setBackend(&rbe);
+        bus.setCPU(&cpu);
+        bus.setPPU(&ppu);
+        bus.setAPU(&apu);
+        bus.setGamePad(0, &pads[0]);
+        bus.setGamePad(1, &pads[1]);
+    }
+};
+
+// A raw data block has no CHR of its own, the PPU still has patterns to fetch
+bool checkRawData(int argc, char **argv)
+{
+    if (argc < 1)
+    {
+        std::cerr << "rawdata: no data file given" << std::endl;
+        return false;
+    }
+
+    std::ifstream in { argv[0], std::ios_base::in | std::ios_base::binary };
+    if (!in)
+    {
+        std::cerr << "rawdata: failed to open " << argv[0] << std::endl;
+        return false;
+    }
+
+    // The test block is a program for the upper bank, with its reset vector
+    Console c;
+    ROMLoader { c.cart }.loadRawData(in, 0xC000u);
+    c.bus.injectCartrige(&c.cart);
+    if (c.cart.numVROMs() != 1)
+    {
+        std::cerr << "rawdata: " << c.cart.numVROMs() << " CHR banks instead of one" << std::endl;
+        return false;
+    }
+
+    // Background and sprites on, so every line is composed from the patterns
+    c.bus.writeMem(0x2001u, 0x1Eu);
+    c.bus.runFrame();
+    return true;
+}
+
+// Offsets in a chunked state file, see the format in bus.cpp
+constexpr size_t STATE_TOC_OFFSET = 0x40u,
+                 STATE_TOC_ENTRY_SIZE = 0x20u;
+
+uint32_t getLE32(const uint8_t *p) noexcept
+{
+    return p[0] | p[1] << 8u | p[2] << 16u | static_cast<uint32_t>(p[3]) << 24u;
+}
+
+void putLE32(uint8_t *p, uint32_t v) noexcept
+{
+    for (int i = 0; i < 4; i++, v >>= 8u)
+        p[i] = static_cast<uint8_t>(v);
+}
+
+// Change a table of contents entry of the state file and seal it again
+void patchStateChunk(std::vector<uint8_t> &file, const char *id, void (*patch)(uint8_t *pEntry))
+{
+    const uint32_t nTOC = getLE32(file.data() + 0x0Cu);
+    uint8_t *pTOC = file.data() + STATE_TOC_OFFSET;
+    for (uint32_t i = 0u; i < nTOC; i++)
+        if (memcmp(pTOC + i * STATE_TOC_ENTRY_SIZE, id, 4u) == 0)
+            patch(pTOC + i * STATE_TOC_ENTRY_SIZE);
+
+    putLE32(file.data() + 0x20u, crc32c(pTOC, nTOC * STATE_TOC_ENTRY_SIZE));
+    putLE32(file.data() + 0x24u, crc32c(file.data(), 0x24u));
+}
+
+// Expect the state to be refused and the machine left as it was
+bool expectRefused(Machine &m, const std::vector<uint8_t> &file, const char *what)
+{
+    const uint64_t hash = m.bus().memoryHash();
+    try
+    {
+        m.bus().loadState(file.data(), file.size());
+    }
+    catch (const Exception &ex)
+    {
+        if (ex.code() != Exception::IllegalFormat)
+        {
+            std::cerr << "statechunks: " << what << " refused with " << ex.message() << std::endl;
+            return false;
+        }
+        if (m.bus().memoryHash() != hash)
+        {
+            std::cerr << "statechunks: " << what << " changed the machine" << std::endl;
+            return false;
+        }
+        return true;
+    }
+    std::cerr << "statechunks: " << what << " loaded" << std::endl;
+    return false;
+}
+
+// Chunks of another version or missing ones can't be loaded, unknown ones are skipped
+bool checkStateChunks(int, char **)
+{
+    Machine src { testROMImage(), OutputMode::NTSC },
+            dst { testROMImage(), OutputMode::NTSC };
+    for (int i = 0; i < 60; i++)
+        src.runFrame(Bus::FRAME_NO_OUTPUT);
+    dst.runFrame(Bus::FRAME_NO_OUTPUT);
+
+    SnapshotBuffer ss(src.bus().snapshotSize());
+    src.bus().snapshot(ss.data());
+    std::vector<uint8_t> file(Bus::stateFileSize(ss.size()));
+    Bus::buildStateFile(ss.data(), ss.size(), file.data());
+
+    std::vector<uint8_t> bumped = file;
+    patchStateChunk(bumped, "APU ", [](uint8_t *pEntry) { pEntry[0x04u]++; });
+    if (!expectRefused(dst, bumped, "state with a newer APU chunk"))
+        return false;
+
+    std::vector<uint8_t> missing = file;
+    patchStateChunk(missing, "PPU ", [](uint8_t *pEntry) { memcpy(pEntry, "XPPU", 4u); });
+    if (!expectRefused(dst, missing, "state without a PPU chunk"))
+        return false;
+
+    dst.bus().loadState(file.data(), file.size());
+    if (dst.bus().memoryHash() != src.bus().memoryHash())
+    {
+        std::cerr << "statechunks: the intact state didn't load" << std::endl;
+        return false;
+    }
+    return true;
+}
+
+struct Check
+{
+    const char *name;
+    bool (*run)(int argc, char **argv);
+};
+
+const Check s_checks[] =
+{
+    { "rawdata", checkRawData },
+    { "statechunks", checkStateChunks }
+};
+
+} // namespace
+
+int main(int argc, char **argv)
+{
+    if (argc < 2)
+    {
+        std::cerr << "Usage: " << argv[0] << " <check> [arguments]" << std::endl
+                  << "Checks:";
+        for (const auto &check: s_checks)
+            std::cerr << ' ' << check.name;
+        std::cerr << std::endl;
+        return 2;
+    }
+
+    auto &logCfg = Log::instance().config();
+    logCfg.pOutput = &std::cerr;
+    logCfg.filter = Log::LVL_ERROR | Log::LVL_WARNING;
+
+    for (const auto &check: s_checks)
+    {
+        if (strcmp(argv[1], check.name) != 0)
+            continue;
+
+        try
+        {
+            if (!check.run(argc - 2, argv + 2))
+                return 1;
+        }
+        catch (const Exception &ex)
+        {
+            std::cerr << check.name << ": " << ex.message() << std::endl;
+            return 1;
+        }
+        std::cout << check.name << ": ok" << std::endl;
+        return 0;
+    }
+
+    std::cerr << "Unknown check " << argv[1] << std::endl;
+    return 2;
+}
@@ -0,0 +1,689 @@
+/*
+ * Lockstep determinism checker: the reference configuration of the engine and
+ * the optimized ones run the same ROM with the same input side by side, and
+ * their states are compared every few frames. At a difference the frames since
+ * the last check are run again one at a time to find the first differing one,
+ * then that frame once more with instruction traces to find the first
+ * instruction the runs part at.
+ */
+
+#include "machine.h"
+#include "batchcpu.h"
+#include "deferredrenderer.h"
+#include "memorybackend.h"
+#include "threadpool.h"
+#include "loader.h"
+#include "movie.h"
+#include "log.h"
+#include "testrom.h"
+
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace
+{
+
+using Input = std::array<Gamepad::Input, 2>;
+using Trace = std::vector<CPU6502::TraceEntry>;
+
+void setInput(Machine &m, const Input &in) noexcept
+{
+    m.pad(0).setInput(in[0]);
+    m.pad(1).setInput(in[1]);
+}
+
+// Configuration of the engine run against the reference
+class Runner
+{
+public:
+    explicit Runner(const char *name):
+        m_name { name }
+    {
+    }
+
+    virtual ~Runner() = default;
+
+    const char *name() const noexcept
+    {
+        return m_name;
+    }
+
+    /// Machine compared with the reference
+    virtual Machine &machine() noexcept = 0;
+
+    virtual void runFrame(const Input &in) = 0;
+
+    /// Video output of the last frame, nullptr if the frames aren't drawn.
+    virtual const c6502_byte_t *picture() const noexcept
+    {
+        return nullptr;
+    }
+
+    /// Keep the state rewind() returns to.
+    virtual void save()
+    {
+        Machine &m = machine();
+        m_saved.resize(m.bus().snapshotSize());
+        m.bus().snapshot(m_saved.data());
+    }
+
+    virtual void rewind()
+    {
+        machine().bus().restore(m_saved.data());
+    }
+
+    /// Hash the parts of the compared machine, see Bus::setFrameHashing().
+    virtual void setFrameHashing(uint components) noexcept
+    {
+        machine().bus().setFrameHashing(components);
+    }
+
+    /// Record the instructions of the compared machine, nullptr stops.
+    virtual void setTrace(Trace *pTrace) noexcept
+    {
+        machine().cpu().setTrace(pTrace);
+    }
+
+private:
+    const char *m_name;
+    SnapshotBuffer m_saved;
+};
+
+// Bus::runFrame drawing into memory, what everything is compared with
+class ReferenceRunner: public Runner
+{
+public:
+    explicit ReferenceRunner(const RomImage::Ptr &pImage):
+        Runner { "reference" },
+        m_machine { pImage, OutputMode::NTSC }
+    {
+        m_machine.ppu().setBackend(&m_rbe);
+    }
+
+    Machine &machine() noexcept override
+    {
+        return m_machine;
+    }
+
+    void runFrame(const Input &in) override
+    {
+        setInput(m_machine, in);
+        m_machine.runFrame(Bus::FRAME_VIDEO);
+    }
+
+    const c6502_byte_t *picture() const noexcept override
+    {
+        return m_rbe.frame();
+    }
+
+private:
+    Machine m_machine;
+    MemoryRenderingBackend m_rbe;
+};
+
+// Frames without any output
+class HeadlessRunner: public Runner
+{
+public:
+    explicit HeadlessRunner(const RomImage::Ptr &pImage):
+        Runner { "headless" },
+        m_machine { pImage, OutputMode::NTSC }
+    {
+    }
+
+    Machine &machine() noexcept override
+    {
+        return m_machine;
+    }
+
+    void runFrame(const Input &in) override
+    {
+        setInput(m_machine, in);
+        m_machine.runFrame(Bus::FRAME_NO_OUTPUT);
+    }
+
+private:
+    Machine m_machine;
+};
+
+// Lines composed by the DeferredRenderer on worker threads
+class DeferredRunner: public Runner
+{
+public:
+    explicit DeferredRunner(const RomImage::Ptr &pImage):
+        Runner { "deferred" },
+        m_machine { pImage, OutputMode::NTSC },
+        m_pool { 2u },
+        m_renderer { m_pool }
+    {
+        m_machine.ppu().setBackend(&m_rbe);
+        m_machine.ppu().setDeferredRenderer(&m_renderer);
+    }
+
+    ~DeferredRunner() override
+    {
+        m_machine.ppu().setDeferredRenderer(nullptr);
+    }
+
+    Machine &machine() noexcept override
+    {
+        return m_machine;
+    }
+
+    void runFrame(const Input &in) override
+    {
+        setInput(m_machine, in);
+        m_machine.runFrame(Bus::FRAME_VIDEO);
+    }
+
+    const c6502_byte_t *picture() const noexcept override
+    {
+        return m_rbe.frame();
+    }
+
+private:
+    Machine m_machine;
+    MemoryRenderingBackend m_rbe;
+    ThreadPool m_pool;
+    DeferredRenderer m_renderer;
+};
+
+// BatchCPU lanes; the first one gets the input, the others are pressed at random
+// so that the lanes part and meet again, only the first one is compared
+class BatchRunner: public Runner
+{
+public:
+    BatchRunner(const RomImage::Ptr &pImage, uint nLanes):
+        Runner { "batch" }
+    {
+        std::vector<Bus*> buses;
+        for (uint l = 0u; l < nLanes; l++)
+        {
+            m_lanes.emplace_back(new Lane { pImage });
+            buses.push_back(&m_lanes.back()->machine.bus());
+        }
+        m_pBatch.reset(new BatchCPU { buses.data(), nLanes });
+    }
+
+    Machine &machine() noexcept override
+    {
+        return m_lanes[0]->machine;
+    }
+
+    void runFrame(const Input &in) override
+    {
+        setInput(m_lanes[0]->machine, in);
+        for (size_t l = 1u; l < m_lanes.size(); l++)
+        {
+            Machine &m = m_lanes[l]->machine;
+            const auto frame = static_cast<uint>(m.bus().currentFrame());
+            Input other = { };
+            other[0].pressed = static_cast<uint16_t>((((frame / 8u) * 2654435761u + l * 40503u) >> 8u) & 0xFFu);
+            setInput(m, other);
+        }
+        m_pBatch->runFrame(Bus::FRAME_VIDEO);
+    }
+
+    const c6502_byte_t *picture() const noexcept override
+    {
+        return m_lanes[0]->rbe.frame();
+    }
+
+    void save() override
+    {
+        for (auto &pLane: m_lanes)
+        {
+            Machine &m = pLane->machine;
+            pLane->saved.resize(m.bus().snapshotSize());
+            m.bus().snapshot(pLane->saved.data());
+        }
+    }
+
+    void rewind() override
+    {
+        for (auto &pLane: m_lanes)
+            pLane->machine.bus().restore(pLane->saved.data());
+    }
+
+private:
+    struct Lane
+    {
+        Machine machine;
+        MemoryRenderingBackend rbe;
+        SnapshotBuffer saved;
+
+        explicit Lane(const RomImage::Ptr &pImage):
+            machine { pImage, OutputMode::NTSC }
+        {
+            machine.ppu().setBackend(&rbe);
+        }
+    };
+
+    std::vector<std::unique_ptr<Lane>> m_lanes;
+    std::unique_ptr<BatchCPU> m_pBatch;
+};
+
+// Every frame runs on a clone of the machine that ran the previous one
+class CloneRunner: public Runner
+{
+public:
+    explicit CloneRunner(const RomImage::Ptr &pImage):
+        Runner { "clone" },
+        m_a { pImage, OutputMode::NTSC },
+        m_b { pImage, OutputMode::NTSC }
+    {
+    }
+
+    Machine &machine() noexcept override
+    {
+        return *m_pCurrent;
+    }
+
+    void runFrame(const Input &in) override
+    {
+        Machine &next = m_pCurrent == &m_a ? m_b : m_a;
+        m_pCurrent->clone(next);
+        m_pCurrent = &next;
+        setInput(next, in);
+        next.runFrame(Bus::FRAME_NO_OUTPUT);
+    }
+
+    void setFrameHashing(uint components) noexcept override
+    {
+        m_a.bus().setFrameHashing(components);
+        m_b.bus().setFrameHashing(components);
+    }
+
+    void setTrace(Trace *pTrace) noexcept override
+    {
+        m_a.cpu().setTrace(pTrace);
+        m_b.cpu().setTrace(pTrace);
+    }
+
+private:
+    Machine m_a,
+            m_b;
+    Machine *m_pCurrent = &m_a;
+};
+
+// Parts of the compared machines that differ
+std::vector<std::string> compare(Runner &ref, Runner &cand)
+{
+    std::vector<std::string> parts;
+    Machine &a = ref.machine(),
+            &b = cand.machine();
+
+    const FrameHashes &ha = a.bus().frameHashes(),
+                      &hb = b.bus().frameHashes();
+    if (ha.picture != hb.picture)
+        parts.push_back("picture");
+    if (ha.ram != hb.ram)
+        parts.push_back("RAM");
+    if (ha.vram != hb.vram)
+        parts.push_back("VRAM");
+    if (ha.oam != hb.oam)
+        parts.push_back("OAM");
+    if (ha.audio != hb.audio)
+        parts.push_back("audio");
+    if (a.bus().memoryHash() != b.bus().memoryHash())
+        parts.push_back("memory");
+
+    if (ref.picture() && cand.picture() &&
+        memcmp(ref.picture(), cand.picture(), MemoryRenderingBackend::WIDTH * MemoryRenderingBackend::HEIGHT) != 0)
+    {
+        parts.push_back("framebuffer");
+    }
+
+    const CPU6502::Reg &ra = a.cpu().registerStates(),
+                       &rb = b.cpu().registerStates();
+    if (ra.a != rb.a || ra.x != rb.x || ra.y != rb.y || ra.s != rb.s || ra.p != rb.p || ra.pc != rb.pc)
+        parts.push_back("CPU registers");
+    if (a.cpu().cycles() != b.cpu().cycles())
+        parts.push_back("CPU cycles");
+
+    const PPU::State &sa = a.ppu().currentState(),
+                     &sb = b.ppu().currentState();
+#define COMPARE_STATE(field) \
+    if (sa.field != sb.field) \
+        parts.push_back("PPU " #field);
+
+    COMPARE_STATE(enableNMI)
+    COMPARE_STATE(bigSprites)
+    COMPARE_STATE(spritesVisible)
+    COMPARE_STATE(backgroundVisible)
+    COMPARE_STATE(allSpritesVisible)
+    COMPARE_STATE(fullBacgroundVisible)
+    COMPARE_STATE(vblank)
+    COMPARE_STATE(sprite0)
+    COMPARE_STATE(enableWrite)
+    COMPARE_STATE(over8sprites)
+    COMPARE_STATE(baBkgnd)
+    COMPARE_STATE(baSprites)
+    COMPARE_STATE(addrIncr)
+    COMPARE_STATE(vramAddr)
+    COMPARE_STATE(tmpAddr)
+    COMPARE_STATE(fineX)
+    COMPARE_STATE(sprmemAddr)
+    COMPARE_STATE(vramReadBuf)
+    COMPARE_STATE(w)
+#undef COMPARE_STATE
+
+    return parts;
+}
+
+bool sameEntry(const CPU6502::TraceEntry &a, const CPU6502::TraceEntry &b) noexcept
+{
+    return a.cycle == b.cycle && a.pc == b.pc && a.kind == b.kind &&
+           a.regs.a == b.regs.a && a.regs.x == b.regs.x && a.regs.y == b.regs.y &&
+           a.regs.s == b.regs.s && a.regs.p == b.regs.p && a.regs.pc == b.regs.pc;
+}
+
+void printEntry(const char *who, const Trace &trace, size_t i)
+{
+    if (i >= trace.size())
+    {
+        printf("  %-10s  (no more instructions in the frame)\n", who);
+        return;
+    }
+
+    static const char *const KINDS[] = { "", "IRQ", "NMI" };
+    const CPU6502::TraceEntry &e = trace[i];
+    printf("  %-10s  #%-6zu cycle %-10llu %04X %-3s  A=%02X X=%02X Y=%02X S=%02X P=%02X  next %04X\n",
+           who, i, static_cast<unsigned long long>(e.cycle), e.pc, KINDS[e.kind],
+           e.regs.a, e.regs.x, e.regs.y, e.regs.s, e.regs.p, e.regs.pc);
+}
+
+/// Index of the first entry the traces differ at, SIZE_MAX if they don't.
+size_t firstDivergence(const Trace &ref, const Trace &cand) noexcept
+{
+    const size_t n = std::min(ref.size(), cand.size());
+    size_t i = 0u;
+    while (i < n && sameEntry(ref[i], cand[i]))
+        i++;
+    return i == ref.size() && i == cand.size() ? SIZE_MAX : i;
+}
+
+void printDivergence(const Trace &ref, const Trace &cand, size_t i, const char *name)
+{
+    constexpr size_t CONTEXT = 8u;
+
+    printf("first divergent instruction, #%zu of the frame; the same before it:\n", i);
+    for (size_t k = i > CONTEXT ? i - CONTEXT : 0u; k < i; k++)
+        printEntry("", ref, k);
+    printEntry("reference", ref, i);
+    printEntry(name, cand, i);
+}
+
+void printParts(const std::vector<std::string> &parts)
+{
+    for (size_t i = 0u; i < parts.size(); i++)
+        printf("%s%s", i > 0u ? ", " : " ", parts[i].c_str());
+    printf("\n");
+}
+
+/// Frames since the last check are run again one at a time, from the states saved there,
+/// and the first differing one once more with instruction traces.
+void locate(Runner &ref, Runner &cand, const std::vector<Input> &inputs, int firstFrame)
+{
+    ref.rewind();
+    cand.rewind();
+    for (size_t i = 0u; i < inputs.size(); i++)
+    {
+        ref.save();
+        cand.save();
+        ref.runFrame(inputs[i]);
+        cand.runFrame(inputs[i]);
+
+        const std::vector<std::string> parts = compare(ref, cand);
+        if (parts.empty())
+            continue;
+
+        printf("first differing frame %d:", firstFrame + static_cast<int>(i));
+        printParts(parts);
+
+        Trace refTrace, candTrace;
+        ref.rewind();
+        cand.rewind();
+        ref.setTrace(&refTrace);
+        cand.setTrace(&candTrace);
+        ref.runFrame(inputs[i]);
+        cand.runFrame(inputs[i]);
+        ref.setTrace(nullptr);
+        cand.setTrace(nullptr);
+
+        const size_t at = firstDivergence(refTrace, candTrace);
+        if (at != SIZE_MAX)
+            printDivergence(refTrace, candTrace, at, cand.name());
+        else
+            printf("instruction traces of the frame are the same (%zu entries), the state parted outside the CPU\n",
+                   refTrace.size());
+        return;
+    }
+
+    // Differences that don't repeat are not deterministic either
+    printf("the frames since the last check ran the same when repeated\n");
+}
+
+// Random input, held for a few frames like a player would
+class RandomInput
+{
+public:
+    explicit RandomInput(uint32_t seed):
+        m_state { seed | 1u }
+    {
+    }
+
+    Input next() noexcept
+    {
+        if (m_hold == 0u)
+        {
+            m_in[0].pressed = static_cast<uint16_t>(random() & 0xFFu);
+            m_in[1].pressed = static_cast<uint16_t>(random() & 0xFFu);
+            m_hold = 1u + random() % 16u;
+        }
+        m_hold--;
+        return m_in;
+    }
+
+private:
+    uint32_t m_state;
+    uint m_hold = 0u;
+    Input m_in = { };
+
+    uint32_t random() noexcept
+    {
+        m_state = m_state * 1664525u + 1013904223u;
+        return m_state >> 8u;
+    }
+};
+
+} // namespace
+
+int main(int argc, char **argv)
+{
+    if (argc < 2)
+    {
+        fprintf(stderr, "Usage: %s <ROM-file> | --builtin [--movie <file>] [--frames <n>] [--every <n>]\n"
+                        "       [--config batch|deferred|headless|clone|all] [--lanes <n>] [--trace] [--seed <n>]\n",
+                argv[0]);
+        return 2;
+    }
+
+    const char *romPath = nullptr,
+               *moviePath = nullptr,
+               *config = "all";
+    int nFrames = -1;
+    uint every = 1u,
+         nLanes = 4u;
+    uint32_t seed = 1u;
+    bool traceAll = false;
+    for (int i = 1; i < argc; i++)
+    {
+        if (strcmp(argv[i], "--builtin") == 0)
+            romPath = nullptr;
+        else if (strcmp(argv[i], "--movie") == 0 && i + 1 < argc)
+            moviePath = argv[++i];
+        else if (strcmp(argv[i], "--frames") == 0 && i + 1 < argc)
+            nFrames = atoi(argv[++i]);
+        else if (strcmp(argv[i], "--every") == 0 && i + 1 < argc)
+            every = static_cast<uint>(std::max(atoi(argv[++i]), 1));
+        else if (strcmp(argv[i], "--config") == 0 && i + 1 < argc)
+            config = argv[++i];
+        else if (strcmp(argv[i], "--lanes") == 0 && i + 1 < argc)
+            nLanes = static_cast<uint>(std::max(atoi(argv[++i]), 1));
+        else if (strcmp(argv[i], "--trace") == 0)
+            traceAll = true;
+        else if (strcmp(argv[i], "--seed") == 0 && i + 1 < argc)
+            seed = static_cast<uint32_t>(strtoul(argv[++i], nullptr, 0));
+        else if (argv[i][0] != '-' && !romPath)
+            romPath = argv[i];
+        else
+        {
+            fprintf(stderr, "Unknown option %s\n", argv[i]);
+            return 2;
+        }
+    }
+
+    auto &logCfg = Log::instance().config();
+    logCfg.pOutput = &std::cerr;
+    logCfg.filter = Log::LVL_ERROR | Log::LVL_WARNING;
+
+    std::unique_ptr<ReferenceRunner> pRef;
+    std::vector<std::unique_ptr<Runner>> candidates;
+    std::unique_ptr<MoviePlayer> pPlayer;
+    try
+    {
+        const RomImage::Ptr pImage = romPath ? ROMLoader::readNES(romPath) : testROMImage();
+        pRef.reset(new ReferenceRunner { pImage });
+
+        const bool all = strcmp(config, "all") == 0;
+        if (all || strcmp(config, "batch") == 0)
+            candidates.emplace_back(new BatchRunner { pImage, std::min(nLanes, BatchCPU::LANES) });
+        if (all || strcmp(config, "deferred") == 0)
+            candidates.emplace_back(new DeferredRunner { pImage });
+        if (all || strcmp(config, "headless") == 0)
+            candidates.emplace_back(new HeadlessRunner { pImage });
+        if (all || strcmp(config, "clone") == 0)
+            candidates.emplace_back(new CloneRunner { pImage });
+        if (candidates.empty())
+        {
+            fprintf(stderr, "Unknown configuration %s\n", config);
+            return 2;
+        }
+
+        // The movie brings the reference to its start, the others follow
+        if (moviePath)
+        {
+            pPlayer.reset(new MoviePlayer { pRef->machine().bus() });
+            pPlayer->start(moviePath);
+            for (auto &pCand: candidates)
+                pRef->machine().clone(pCand->machine());
+            if (nFrames < 0)
+                nFrames = static_cast<int>(pPlayer->frameCount());
+        }
+    }
+    catch (const Exception &ex)
+    {
+        fprintf(stderr, "Error: %s\n", ex.message());
+        return 2;
+    }
+    if (nFrames < 0)
+        nFrames = 600;
+
+    std::vector<Runner*> runners { pRef.get() };
+    for (auto &pCand: candidates)
+        runners.push_back(pCand.get());
+    for (Runner *pRunner: runners)
+    {
+        pRunner->setFrameHashing(Bus::HASH_ALL);
+        pRunner->save();
+    }
+
+    std::vector<Trace> traces(runners.size());
+    if (traceAll)
+    {
+        for (size_t i = 0u; i < runners.size(); i++)
+            runners[i]->setTrace(&traces[i]);
+    }
+
+    RandomInput random { seed };
+    std::vector<Input> inputs;      // since the last check
+    int checkedFrames = 0,
+        frame = 0;
+    bool ok = true;
+    for (; frame < nFrames && ok; frame++)
+    {
+        Input in;
+        if (pPlayer)
+        {
+            if (!pPlayer->beforeFrame())
+                break;
+            in = { pRef->machine().pad(0).input(), pRef->machine().pad(1).input() };
+        }
+        else
+            in = random.next();
+        inputs.push_back(in);
+
+        for (Runner *pRunner: runners)
+            pRunner->runFrame(in);
+
+        // Instructions of every frame, when traced
+        for (size_t i = 1u; i < runners.size() && ok && traceAll; i++)
+        {
+            const size_t k = firstDivergence(traces[0], traces[i]);
+            if (k != SIZE_MAX)
+            {
+                printf("%s: instructions of frame %d differ\n", runners[i]->name(), frame);
+                printDivergence(traces[0], traces[i], k, runners[i]->name());
+                ok = false;
+            }
+        }
+        for (Trace &t: traces)
+            t.clear();
+        if (!ok)
+            break;
+
+        if ((frame + 1) % static_cast<int>(every) != 0 && frame + 1 != nFrames)
+            continue;
+
+        for (size_t i = 1u; i < runners.size() && ok; i++)
+        {
+            const std::vector<std::string> parts = compare(*runners[0], *runners[i]);
+            if (parts.empty())
+                continue;
+
+            printf("%s: differs from the reference at frame %d:", runners[i]->name(), frame);
+            printParts(parts);
+            for (Runner *pRunner: runners)
+                pRunner->setTrace(nullptr);
+            locate(*runners[0], *runners[i], inputs, checkedFrames);
+            ok = false;
+        }
+
+        if (ok)
+        {
+            for (Runner *pRunner: runners)
+                pRunner->save();
+            inputs.clear();
+            checkedFrames = frame + 1;
+        }
+    }
+
+    if (ok)
+    {
+        const FrameHashes &h = pRef->machine().bus().frameHashes();
+        printf("%d frames, %zu configurations the same as the reference, picture %016llx, RAM %016llx\n",
+               frame, candidates.size(),
+               static_cast<unsigned long long>(h.picture), static_cast<unsigned long long>(h.ram));
+    }
+    printf("%s\n", ok ? "PASSED" : "FAILED");
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,600 @@
+/*
+ * Micro-benchmarks of the hot paths of the engine, each on a synthetic
+ * machine state: bus accesses by region, CPU instruction classes, PPU lines,
+ * APU frames, RGBA conversion of lines and the audio ring buffer.
+ */
+
+#include "machine.h"
+#include "hostclock.h"
+#include "loader.h"
+#include "log.h"
+#include "ringbuffer.h"
+#include "testrom.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace
+{
+
+volatile uint64_t g_sink;
+
+// Runs a sample of the benchmark, returns the number of operations done
+using Body = std::function<uint64_t()>;
+
+struct Bench
+{
+    const char *name,
+               *unit;
+    std::function<Body()> prepare;  // sets up the state, the body runs on it
+};
+
+struct Stats
+{
+    uint64_t ops;       // per sample
+    double mean,
+           stddev,
+           min,
+           median;
+};
+
+// Short bodies are repeated within a sample, so that the clock reads don't count
+constexpr uint64_t MIN_SAMPLE_TIME = 200000u;
+
+double sample(const Body &body, uint64_t &ops)
+{
+    ops = 0u;
+    const uint64_t t0 = hostCycles();
+    uint64_t t;
+    do
+    {
+        ops += body();
+        t = hostCycles() - t0;
+    }
+    while (t < MIN_SAMPLE_TIME);
+
+    return static_cast<double>(t) / static_cast<double>(ops);
+}
+
+Stats measure(const Body &body, int nWarmup, int nSamples)
+{
+    Stats st;
+    for (int i = 0; i < nWarmup; i++)
+        sample(body, st.ops);
+
+    std::vector<double> perOp(static_cast<size_t>(nSamples));
+    for (double &v: perOp)
+        v = sample(body, st.ops);
+
+    double sum = 0.0;
+    for (double v: perOp)
+        sum += v;
+    st.mean = sum / nSamples;
+    double sq = 0.0;
+    for (double v: perOp)
+        sq += (v - st.mean) * (v - st.mean);
+    st.stddev = nSamples > 1 ? std::sqrt(sq / (nSamples - 1)) : 0.0;
+    std::sort(perOp.begin(), perOp.end());
+    st.min = perOp.front();
+    st.median = perOp[perOp.size() / 2u];
+    return st;
+}
+
+// Lines are dropped, only what the PPU does for them is measured.
+// Gives access to the RGBA8 conversion the backends share.
+class SinkRenderingBackend: public RenderingBackend
+{
+public:
+    void setLine(const int, const c6502_byte_t*, const c6502_byte_t) noexcept override
+    {
+    }
+
+    void draw() noexcept override
+    {
+    }
+
+    void drawIdle() noexcept override
+    {
+    }
+
+    static void toRGBA8(uint8_t *dst, int n, const c6502_byte_t *pColorData, c6502_byte_t bgColor) noexcept
+    {
+        setLineToBuf_RGBA8(dst, n, pColorData, bgColor);
+    }
+
+    static constexpr int WIDTH = TEX_WIDTH,
+                         HEIGHT = TEX_HEIGHT;
+};
+
+class NullPlaybackBackend: public PlaybackBackend
+{
+public:
+    void init() noexcept override
+    {
+    }
+
+    uint getPlaybackFrequency() const noexcept override
+    {
+        return 48000u;
+    }
+
+    void beginFrame(uint) noexcept override
+    {
+    }
+
+    void queueSample(float v) noexcept override
+    {
+        m_sum += v;
+    }
+
+    void queueSamples(const float *pSamples, uint n) noexcept override
+    {
+        for (uint i = 0u; i < n; i++)
+            m_sum += pSamples[i];
+    }
+
+    void endFrame() noexcept override
+    {
+    }
+
+private:
+    float m_sum = 0.0f;
+};
+
+std::shared_ptr<Machine> nromMachine()
+{
+    return std::make_shared<Machine>(testROMImage(), OutputMode::NTSC);
+}
+
+// The test program on MMC3, for PRG RAM and bank switching
+std::shared_ptr<Machine> mmc3Machine()
+{
+    const RomImage::Ptr pNROM = testROMImage();
+    std::vector<c6502_byte_t> data(pNROM->data(), pNROM->data() + pNROM->size());
+    data[6] |= 0x40u;
+    return std::make_shared<Machine>(std::make_shared<const RomImage>(std::move(data), NES_HEADER_SIZE, 1, 1),
+                                     OutputMode::NTSC);
+}
+
+constexpr uint64_t BUS_OPS = 1u << 16u;
+
+template <typename F>
+Bench busBench(const char *name, std::shared_ptr<Machine> (*make)(), F access)
+{
+    return { name, "access", [make, access]() -> Body
+    {
+        std::shared_ptr<Machine> pMachine = make();
+        return [pMachine, access]() -> uint64_t
+        {
+            Bus &bus = pMachine->bus();
+            uint64_t sum = 0u;
+            for (uint i = 0u; i < BUS_OPS; i++)
+                sum += access(bus, i);
+            g_sink = sum;
+            return BUS_OPS;
+        };
+    } };
+}
+
+/*
+ * Code of one instruction class repeated over the RAM from 0x0200 and a jump
+ * back, run with interrupts disabled. X and Y stay 0, stores go to the zero page.
+ */
+
+constexpr c6502_word_t CODE_START = 0x0200u,
+                       CODE_END = 0x07F8u,  // the jump back goes here
+                       SUBROUTINE = 0x07FCu;
+
+Bench cpuBench(const char *name, std::vector<c6502_byte_t> pattern)
+{
+    return { name, "instr", [pattern]() -> Body
+    {
+        std::shared_ptr<Machine> pMachine = nromMachine();
+        Bus &bus = pMachine->bus();
+        c6502_word_t addr = CODE_START;
+        while (addr + pattern.size() <= CODE_END)
+            for (c6502_byte_t b: pattern)
+                bus.writeMem(addr++, b);
+        const c6502_byte_t jump[] = { 0x4Cu, lo_byte(CODE_START), hi_byte(CODE_START) };
+        for (c6502_byte_t b: jump)
+            bus.writeMem(addr++, b);
+        bus.writeMem(SUBROUTINE, 0x60u);
+
+        // Pointers for the indirect modes
+        bus.writeMem(0x20u, 0x60u);
+        bus.writeMem(0x21u, 0x00u);
+        bus.writeMem(0x22u, 0x70u);
+        bus.writeMem(0x23u, 0x00u);
+
+        CPU6502::Snapshot ss;
+        pMachine->cpu().snapshot(ss);
+        ss.regs = { 0u, 0u, 0u, 0xFDu, 0x24u, CODE_START };
+        ss.state = CPU6502::STATE_RUN;
+        ss.penalty = 0;
+        pMachine->cpu().restore(ss);
+
+        return [pMachine]() -> uint64_t
+        {
+            CPU6502 &cpu = pMachine->cpu();
+            const uint64_t n0 = cpu.instructionCount();
+            cpu.run(static_cast<int>(pMachine->bus().clocksPerFrame()));
+            return cpu.instructionCount() - n0;
+        };
+    } };
+}
+
+enum class Scene
+{
+    Background,     // background only, no scrolling
+    Sprites,        // 64 sprites 8x16 packed so that 8 cover every line in the middle
+    Scrolled        // background crossing the nametables both ways, fine X scroll
+};
+
+void setupScene(Bus &bus, Scene scene)
+{
+    bus.writeMem(0x2000u, 0u);
+    bus.writeMem(0x2001u, 0u);
+
+    bus.readMem(0x2002u);
+    bus.writeMem(0x2006u, 0x3Fu);
+    bus.writeMem(0x2006u, 0x00u);
+    for (uint i = 0u; i < 32u; i++)
+        bus.writeMem(0x2007u, static_cast<c6502_byte_t>((i * 0x13u + 1u) & 0x3Fu));
+
+    // Both nametables, opaque tiles and varying attributes
+    bus.writeMem(0x2006u, 0x20u);
+    bus.writeMem(0x2006u, 0x00u);
+    for (uint i = 0u; i < 0x800u; i++)
+        bus.writeMem(0x2007u, static_cast<c6502_byte_t>((i & 0x3FFu) < 0x3C0u ? (i * 7u) & 0x7Fu : i * 0x1Bu));
+
+    for (uint i = 0u; i < 64u; i++)
+    {
+        const bool on = scene == Scene::Sprites;
+        const c6502_word_t oam = static_cast<c6502_word_t>(0x0200u + i * 4u);
+        bus.writeMem(oam, static_cast<c6502_byte_t>(on ? 16u + i * 2u : 0xF0u));
+        bus.writeMem(oam + 1u, static_cast<c6502_byte_t>(i * 2u));
+        bus.writeMem(oam + 2u, static_cast<c6502_byte_t>((i & 3u) | ((i & 4u) << 3u) | ((i & 0x18u) << 3u)));
+        bus.writeMem(oam + 3u, static_cast<c6502_byte_t>(i * 29u));
+    }
+    bus.writeMem(0x2003u, 0u);
+    bus.writeMem(0x4014u, 0x02u);
+
+    const bool scrolled = scene == Scene::Scrolled;
+    bus.readMem(0x2002u);
+    bus.writeMem(0x2005u, scrolled ? 0x85u : 0u);
+    bus.writeMem(0x2005u, scrolled ? 0x64u : 0u);
+    bus.writeMem(0x2000u, static_cast<c6502_byte_t>((scene == Scene::Sprites ? 0x20u : 0u) | (scrolled ? 0x01u : 0u)));
+    bus.writeMem(0x2001u, scene == Scene::Sprites ? 0x1Eu : 0x0Au);
+}
+
+Bench ppuBench(const char *name, Scene scene, bool output)
+{
+    return { name, "line", [scene, output]() -> Body
+    {
+        std::shared_ptr<Machine> pMachine = nromMachine();
+        std::shared_ptr<SinkRenderingBackend> pBackend = std::make_shared<SinkRenderingBackend>();
+        pMachine->ppu().setBackend(pBackend.get());
+        setupScene(pMachine->bus(), scene);
+
+        return [pMachine, pBackend, output]() -> uint64_t
+        {
+            PPU &ppu = pMachine->ppu();
+            ppu.startFrame();
+            for (uint i = 0u; i < 240u; i++)
+                ppu.drawNextLine(output);
+            return 240u;
+        };
+    } };
+}
+
+enum class Mixing
+{
+    None,       // nothing is heard, only the frame sequencer runs
+    Levels,     // channel levels are generated to be hashed
+    Playback    // levels mixed and resampled for a playback backend
+};
+
+Bench apuBench(const char *name, Mixing mixing)
+{
+    return { name, "frame", [mixing]() -> Body
+    {
+        std::shared_ptr<Machine> pMachine = nromMachine();
+        std::shared_ptr<NullPlaybackBackend> pBackend = std::make_shared<NullPlaybackBackend>();
+        APU &apu = pMachine->apu();
+        if (mixing == Mixing::Playback)
+            apu.setBackend(pBackend.get());
+        apu.setLevelHashing(mixing == Mixing::Levels);
+
+        // Pulses, triangle and noise sounding with halted length counters
+        Bus &bus = pMachine->bus();
+        const c6502_word_t regs[] = { 0x4015u, 0x4000u, 0x4001u, 0x4002u, 0x4003u, 0x4004u, 0x4006u, 0x4007u,
+                                      0x4008u, 0x400Au, 0x400Bu, 0x400Cu, 0x400Eu, 0x400Fu, 0x4017u };
+        const c6502_byte_t vals[] = { 0x0Fu, 0xBFu, 0x08u, 0xC9u, 0x00u, 0x7Au, 0x54u, 0x01u,
+                                      0xFFu, 0x60u, 0x01u, 0x3Cu, 0x05u, 0x08u, 0x40u };
+        for (size_t i = 0u; i < sizeof(regs) / sizeof(regs[0]); i++)
+            bus.writeMem(regs[i], vals[i]);
+
+        return [pMachine, pBackend]() -> uint64_t
+        {
+            pMachine->apu().runFrame(true);
+            return 1u;
+        };
+    } };
+}
+
+Bench rgbaBench()
+{
+    return { "rgba/line", "line", []() -> Body
+    {
+        std::shared_ptr<std::vector<uint8_t>> pTex =
+            std::make_shared<std::vector<uint8_t>>(SinkRenderingBackend::WIDTH * SinkRenderingBackend::HEIGHT * 4u);
+
+        // Every tenth pixel transparent, as over the background color
+        std::shared_ptr<std::vector<c6502_byte_t>> pLine =
+            std::make_shared<std::vector<c6502_byte_t>>(static_cast<size_t>(SinkRenderingBackend::WIDTH));
+        for (size_t i = 0u; i < pLine->size(); i++)
+            (*pLine)[i] = i % 10u == 0u ? PPU::TRANSPARENT_PXL : static_cast<c6502_byte_t>((i * 7u) & 0x3Fu);
+
+        return [pTex, pLine]() -> uint64_t
+        {
+            for (int n = 0; n < SinkRenderingBackend::HEIGHT; n++)
+                SinkRenderingBackend::toRGBA8(pTex->data(), n, pLine->data(), 0x0Fu);
+            g_sink = (*pTex)[pTex->size() / 2u];
+            return static_cast<uint64_t>(SinkRenderingBackend::HEIGHT);
+        };
+    } };
+}
+
+// Capacity isn't a power of two, like the audio buffers sized by sample rate
+constexpr uint RING_CAPACITY = 4000u,
+               RING_CHUNK = 800u,
+               RING_OPS = 1u << 16u;
+
+Bench ringBench(const char *name, bool ranges)
+{
+    return { name, "sample", [ranges]() -> Body
+    {
+        std::shared_ptr<RingBuffer<float>> pRing = std::make_shared<RingBuffer<float>>(RING_CAPACITY);
+        std::shared_ptr<std::vector<float>> pChunk = std::make_shared<std::vector<float>>(RING_CHUNK, 0.5f);
+
+        // A sample enqueued and dequeued is an operation
+        return [pRing, pChunk, ranges]() -> uint64_t
+        {
+            RingBuffer<float> &ring = *pRing;
+            float *pData = pChunk->data();
+            float sum = 0.0f;
+            for (uint done = 0u; done < RING_OPS; done += RING_CHUNK)
+            {
+                if (ranges)
+                {
+                    ring.enqueueRange(pData, RING_CHUNK);
+                    ring.dequeueRange(pData, RING_CHUNK);
+                    sum += pData[RING_CHUNK - 1u];
+                }
+                else
+                {
+                    for (uint i = 0u; i < RING_CHUNK; i++)
+                        ring.enqueue(pData[i]);
+                    for (uint i = 0u; i < RING_CHUNK; i++)
+                        sum += ring.dequeue();
+                }
+            }
+            g_sink = static_cast<uint64_t>(sum);
+            return RING_OPS / RING_CHUNK * RING_CHUNK;
+        };
+    } };
+}
+
+std::vector<Bench> benchmarks()
+{
+    std::vector<Bench> v;
+
+    v.push_back(busBench("bus/read-ram", nromMachine, [](Bus &bus, uint i)
+    {
+        return bus.readMem(static_cast<c6502_word_t>(i & 0x1FFFu));
+    }));
+    v.push_back(busBench("bus/write-ram", nromMachine, [](Bus &bus, uint i)
+    {
+        bus.writeMem(static_cast<c6502_word_t>(i & 0x1FFFu), static_cast<c6502_byte_t>(i));
+        return 0u;
+    }));
+    // Status, OAM and VRAM data; the addresses go back to the start now and then
+    v.push_back(busBench("bus/read-ppu", nromMachine, [](Bus &bus, uint i)
+    {
+        static const c6502_word_t regs[4] = { 0x2002u, 0x2004u, 0x2007u, 0x2007u };
+        if ((i & 0xFFu) == 0u)
+        {
+            bus.writeMem(0x2006u, 0x20u);
+            bus.writeMem(0x2006u, 0x00u);
+            bus.writeMem(0x2003u, 0x00u);
+        }
+        return bus.readMem(regs[i & 3u]);
+    }));
+
+    // Address, two VRAM bytes, scroll and OAM: the data writes stay in the nametables
+    v.push_back(busBench("bus/write-ppu", nromMachine, [](Bus &bus, uint i)
+    {
+        static const c6502_word_t regs[8] = { 0x2006u, 0x2006u, 0x2007u, 0x2007u, 0x2005u, 0x2005u, 0x2003u, 0x2004u };
+        const c6502_word_t reg = regs[i & 7u];
+        bus.writeMem(reg, static_cast<c6502_byte_t>(reg == 0x2006u && (i & 1u) == 0u ? 0x20u | ((i >> 3u) & 3u) : i));
+        return 0u;
+    }));
+    v.push_back(busBench("bus/read-apu-pads", nromMachine, [](Bus &bus, uint i)
+    {
+        return bus.readMem(static_cast<c6502_word_t>(0x4015u + i % 3u));
+    }));
+    v.push_back(busBench("bus/write-apu", nromMachine, [](Bus &bus, uint i)
+    {
+        bus.writeMem(static_cast<c6502_word_t>(0x4000u + i % 0x14u), static_cast<c6502_byte_t>(i & 0x7Fu));
+        return 0u;
+    }));
+    v.push_back(busBench("bus/read-prg-nrom", nromMachine, [](Bus &bus, uint i)
+    {
+        return bus.readMem(static_cast<c6502_word_t>(0x8000u | ((i * 0x101u) & 0x7FFFu)));
+    }));
+    v.push_back(busBench("bus/read-prg-mmc3", mmc3Machine, [](Bus &bus, uint i)
+    {
+        return bus.readMem(static_cast<c6502_word_t>(0x8000u | ((i * 0x101u) & 0x7FFFu)));
+    }));
+    v.push_back(busBench("bus/read-prgram-mmc3", mmc3Machine, [](Bus &bus, uint i)
+    {
+        return bus.readMem(static_cast<c6502_word_t>(0x6000u | (i & 0x1FFFu)));
+    }));
+    v.push_back(busBench("bus/write-prgram-mmc3", mmc3Machine, [](Bus &bus, uint i)
+    {
+        bus.writeMem(static_cast<c6502_word_t>(0x6000u | (i & 0x1FFFu)), static_cast<c6502_byte_t>(i));
+        return 0u;
+    }));
+
+    // Bank select and bank data in turns, every data write switches a bank
+    v.push_back(busBench("bus/write-bank-mmc3", mmc3Machine, [](Bus &bus, uint i)
+    {
+        if (i & 1u)
+            bus.writeMem(0x8001u, static_cast<c6502_byte_t>(i >> 4u));
+        else
+            bus.writeMem(0x8000u, static_cast<c6502_byte_t>((i >> 1u) & 7u));
+        return 0u;
+    }));
+
+    // Instruction classes
+    v.push_back(cpuBench("cpu/implied", { 0xE8u, 0x88u, 0xAAu, 0x98u, 0x18u, 0x38u, 0xEAu, 0xCAu }));
+    v.push_back(cpuBench("cpu/immediate", { 0xA9u, 0x12u, 0x69u, 0x34u, 0x29u, 0x7Fu, 0x09u, 0x01u,
+                                            0x49u, 0x55u, 0xC9u, 0x40u, 0xA2u, 0x00u, 0xC0u, 0x01u }));
+    v.push_back(cpuBench("cpu/zeropage", { 0xA5u, 0x10u, 0x85u, 0x11u, 0x65u, 0x12u, 0xA6u, 0x13u,
+                                           0x84u, 0x14u, 0xC5u, 0x15u, 0x24u, 0x16u }));
+    v.push_back(cpuBench("cpu/absolute", { 0xADu, 0x30u, 0x00u, 0x8Du, 0x31u, 0x00u, 0x6Du, 0x32u, 0x00u,
+                                           0xAEu, 0x33u, 0x00u, 0x8Cu, 0x34u, 0x00u, 0xCDu, 0x35u, 0x00u }));
+    v.push_back(cpuBench("cpu/indexed", { 0xBDu, 0x40u, 0x00u, 0x99u, 0x41u, 0x00u, 0xB1u, 0x20u,
+                                          0xA1u, 0x22u, 0xB5u, 0x10u, 0x95u, 0x11u }));
+    v.push_back(cpuBench("cpu/rmw", { 0xE6u, 0x10u, 0xC6u, 0x11u, 0x06u, 0x12u, 0x6Eu, 0x13u, 0x00u,
+                                      0x36u, 0x14u, 0x4Au }));
+    v.push_back(cpuBench("cpu/branch", { 0x18u, 0x90u, 0x00u, 0x38u, 0x90u, 0x00u, 0xD0u, 0x00u, 0xF0u, 0x00u }));
+    v.push_back(cpuBench("cpu/stack", { 0x48u, 0x68u, 0x08u, 0x28u }));
+    v.push_back(cpuBench("cpu/call", { 0x20u, lo_byte(SUBROUTINE), hi_byte(SUBROUTINE) }));
+
+    v.push_back(ppuBench("ppu/line-background", Scene::Background, true));
+    v.push_back(ppuBench("ppu/line-sprites", Scene::Sprites, true));
+    v.push_back(ppuBench("ppu/line-scrolled", Scene::Scrolled, true));
+    v.push_back(ppuBench("ppu/line-sprites-headless", Scene::Sprites, false));
+
+    v.push_back(apuBench("apu/frame-headless", Mixing::None));
+    v.push_back(apuBench("apu/frame-levels", Mixing::Levels));
+    v.push_back(apuBench("apu/frame-playback", Mixing::Playback));
+
+    v.push_back(rgbaBench());
+
+    v.push_back(ringBench("ring/single", false));
+    v.push_back(ringBench("ring/range", true));
+
+    return v;
+}
+
+} // namespace
+
+int main(int argc, char **argv)
+{
+    const char *jsonPath = nullptr;
+    std::vector<std::string> filters;
+    int nSamples = 50,
+        nWarmup = 5;
+    bool list = false;
+    for (int i = 1; i < argc; i++)
+    {
+        if (strcmp(argv[i], "--samples") == 0 && i + 1 < argc)
+            nSamples = std::max(atoi(argv[++i]), 1);
+        else if (strcmp(argv[i], "--warmup") == 0 && i + 1 < argc)
+            nWarmup = std::max(atoi(argv[++i]), 0);
+        else if (strcmp(argv[i], "--json") == 0 && i + 1 < argc)
+            jsonPath = argv[++i];
+        else if (strcmp(argv[i], "--list") == 0)
+            list = true;
+        else if (argv[i][0] != '-')
+            filters.push_back(argv[i]);
+        else
+        {
+            fprintf(stderr, "Usage: %s [<name-part> ...] [--samples <n>] [--warmup <n>] [--json <file>] [--list]\n",
+                    argv[0]);
+            return 2;
+        }
+    }
+
+    auto &logCfg = Log::instance().config();
+    logCfg.pOutput = &std::cerr;
+    logCfg.filter = Log::LVL_ERROR | Log::LVL_WARNING;
+
+    // Benchmarks whose names contain any of the given parts
+    std::vector<Bench> selected;
+    for (Bench &b: benchmarks())
+    {
+        bool match = filters.empty();
+        for (const std::string &f: filters)
+            match = match || strstr(b.name, f.c_str()) != nullptr;
+        if (match)
+            selected.push_back(std::move(b));
+    }
+
+    if (list)
+    {
+        for (const Bench &b: selected)
+            printf("%s\n", b.name);
+        return 0;
+    }
+
+    const char *clockUnit = hostCyclesAreTSC() ? "TSC cycles" : "ns";
+    printf("%-28s %-7s %10s %10s %10s %10s %7s\n", "benchmark", "per", "mean", "median", "min", "stddev", "cv %");
+    std::vector<Stats> results;
+    for (const Bench &b: selected)
+    {
+        Stats st;
+        try
+        {
+            st = measure(b.prepare(), nWarmup, nSamples);
+        }
+        catch (const Exception &ex)
+        {
+            fprintf(stderr, "Error: %s: %s\n", b.name, ex.message());
+            return 2;
+        }
+        results.push_back(st);
+        printf("%-28s %-7s %10.2f %10.2f %10.2f %10.2f %7.1f\n", b.name, b.unit, st.mean, st.median, st.min,
+               st.stddev, st.mean > 0.0 ? st.stddev / st.mean * 100.0 : 0.0);
+        fflush(stdout);
+    }
+    printf("(%s per operation, %d samples after %d warmup)\n", clockUnit, nSamples, nWarmup);
+
+    if (!jsonPath)
+        return 0;
+
+    std::ofstream out { jsonPath };
+    out << "{\n  \"host_clock\": \"" << (hostCyclesAreTSC() ? "tsc" : "ns") << "\",\n"
+        << "  \"samples\": " << nSamples << ",\n"
+        << "  \"warmup\": " << nWarmup << ",\n"
+        << "  \"results\": [\n";
+    char buf[256];
+    for (size_t i = 0u; i < selected.size(); i++)
+    {
+        const Stats &st = results[i];
+        snprintf(buf, sizeof(buf),
+                 "    { \"name\": \"%s\", \"unit\": \"%s\", \"ops_per_sample\": %llu, "
+                 "\"mean\": %.3f, \"median\": %.3f, \"min\": %.3f, \"stddev\": %.3f }%s\n",
+                 selected[i].name, selected[i].unit, static_cast<unsigned long long>(st.ops),
+                 st.mean, st.median, st.min, st.stddev, i + 1u < selected.size() ? "," : "");
+        out << buf;
+    }
+    out << "  ]\n}\n";
+    if (!out)
+    {
+        fprintf(stderr, "Error: failed to write %s\n", jsonPath);
+        return 2;
+    }
+    return 0;
+}
@@ -0,0 +1,67 @@
+/*
+ * ROM pack tool: builds a pack of NES files or lists the contents of one.
+ */
+
+#include "rompack.h"
+#include "log.h"
+
+#include <cinttypes>
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+
+static const char *mirroringName(Mirroring m)
+{
+    switch (m)
+    {
+        case Mirroring::SingleLower:
+            return "single-lower";
+        case Mirroring::SingleUpper:
+            return "single-upper";
+        case Mirroring::Horizontal:
+            return "horizontal";
+        case Mirroring::Vertical:
+            return "vertical";
+        case Mirroring::FourScreen:
+            return "four-screen";
+    }
+    return "?";
+}
+
+int main(int argc, char **argv)
+{
+    if (argc < 3)
+    {
+        std::cerr << "Usage: " << argv[0] << " <pack-file> <ROM-file>..." << std::endl
+                  << "       " << argv[0] << " -l <pack-file>" << std::endl;
+        return 2;
+    }
+
+    auto &logCfg = Log::instance().config();
+    logCfg.pOutput = &std::cerr;
+    logCfg.filter = Log::LVL_ERROR | Log::LVL_WARNING | Log::LVL_INFO;
+
+    try
+    {
+        if (strcmp(argv[1], "-l") == 0)
+        {
+            const RomPack pack { argv[2] };
+            for (uint i = 0u; i < pack.size(); i++)
+            {
+                const RomPack::Entry e = pack.entry(i);
+                printf("%016" PRIx64 "  mapper %3u  PRG %4d kB  CHR %4d kB  %-12s %s  %s\n",
+                       e.hash, e.mapper, e.nROMs * 16, e.nVROMs * 8,
+                       mirroringName(e.mirroring), e.isPal ? "PAL " : "NTSC", e.name.c_str());
+            }
+        }
+        else
+            RomPack::build(argv[1], std::vector<std::string>(argv + 2, argv + argc));
+    }
+    catch (const Exception &ex)
+    {
+        std::cerr << "Error: " << ex.message() << std::endl;
+        return 1;
+    }
+
+    return 0;
+}
@@ -0,0 +1,89 @@
+/*
+ * Scaling benchmark of EmulatorPool: the same batch of instances is stepped
+ * with 1 to 64 worker threads, each instance on its own and in lockstep groups.
+ * Throughput is in instances x frames per second.
+ */
+
+#include "emulatorpool.h"
+#include "log.h"
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <vector>
+
+int main(int argc, char **argv)
+{
+    if (argc < 2)
+    {
+        fprintf(stderr, "Usage: %s <ROM-file> [<instances> [<frames> [--pin]]]\n", argv[0]);
+        return 2;
+    }
+    const uint nInstances = argc > 2 ? static_cast<uint>(atoi(argv[2])) : 256u,
+               nFrames = argc > 3 ? static_cast<uint>(atoi(argv[3])) : 120u;
+    const bool pin = argc > 4;
+
+    Log::instance().config().filter = Log::LEVEL_SILENT;
+
+    std::vector<c6502_byte_t> actions(nInstances);
+
+    // Frames per second and the state hash afterwards
+    const auto run = [&](uint nThreads, bool lockstep, uint64_t &hash)
+    {
+        EmulatorPool pool { argv[1], { nInstances, nThreads, pin, OutputMode::NTSC, lockstep } };
+
+        // Same pseudo-random input sequence for every run
+        uint32_t seed = 12345u;
+        const auto t0 = std::chrono::steady_clock::now();
+        for (uint f = 0u; f < nFrames; f++)
+        {
+            for (auto &a: actions)
+            {
+                seed = seed * 1664525u + 1013904223u;
+                a = static_cast<c6502_byte_t>(seed >> 24u);
+            }
+            pool.step(actions.data());
+        }
+        const double sec = std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+
+        hash = 0u;
+        for (uint i = 0u; i < pool.size(); i++)
+            hash = hash * 31u + pool.bus(i).memoryHash();
+        return static_cast<double>(nInstances) * nFrames / sec;
+    };
+
+    double baseFps = 0.0;
+    uint64_t baseHash = 0u;
+
+    printf("%8s %12s %10s %12s %10s %18s\n", "threads", "frames/s", "speedup", "lockstep", "ratio", "state hash");
+    for (uint nThreads = 1u; nThreads <= 64u; nThreads *= 2u)
+    {
+        try
+        {
+            uint64_t h, hLockstep;
+            const double fps = run(nThreads, false, h),
+                         fpsLockstep = run(nThreads, true, hLockstep);
+            if (nThreads == 1u)
+            {
+                baseFps = fps;
+                baseHash = h;
+            }
+            printf("%8u %12.0f %10.2f %12.0f %10.2f %18llx\n", nThreads, fps, fps / baseFps,
+                   fpsLockstep, fpsLockstep / fps, static_cast<unsigned long long>(h));
+
+            // Results must not depend on the thread count or the mode
+            if (h != baseHash || hLockstep != baseHash)
+            {
+                fprintf(stderr, "Error: state hash differs (lockstep %llx)\n", static_cast<unsigned long long>(hLockstep));
+                return 1;
+            }
+        }
+        catch (const Exception &ex)
+        {
+            fprintf(stderr, "Error: %s\n", ex.message());
+            return 1;
+        }
+    }
+
+    return 0;
+}
@@ -0,0 +1,184 @@
+/*
+ * Headless movie replayer: plays a recorded input movie at full speed
+ * without rendering and checks the memory hashes stored in it.
+ * Frames can be captured into files on the way, and the hashes of every
+ * frame written out to compare against a golden list.
+ * Built with the performance counters, it prints their per-frame averages.
+ */
+
+#include "bus.h"
+#include "cpu6502.h"
+#include "PPU.h"
+#include "APU.h"
+#include "Cartridge.h"
+#include "gamepad.h"
+#include "loader.h"
+#include "movie.h"
+#include "memorybackend.h"
+#include "framecapture.h"
+#include "log.h"
+
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+
+int main(int argc, char **argv)
+{
+    if (argc < 3)
+    {
+        std::cerr << "Usage: " << argv[0] << " <ROM-file> <movie-file> [--keep-going] [--capture <path> png|raw|y4m]"
+                  << " [--hashes <file>]"
+                  << std::endl;
+        return 2;
+    }
+
+    bool keepGoing = false;
+    const char *capturePath = nullptr,
+               *hashesPath = nullptr;
+    FrameCapture::Format captureFmt = FrameCapture::Format::PNG;
+    for (int i = 3; i < argc; i++)
+    {
+        if (strcmp(argv[i], "--keep-going") == 0)
+            keepGoing = true;
+        else if (strcmp(argv[i], "--capture") == 0 && i + 2 < argc)
+        {
+            capturePath = argv[++i];
+            const char *fmt = argv[++i];
+            if (strcmp(fmt, "png") == 0)
+                captureFmt = FrameCapture::Format::PNG;
+            else if (strcmp(fmt, "raw") == 0)
+                captureFmt = FrameCapture::Format::RAW;
+            else if (strcmp(fmt, "y4m") == 0)
+                captureFmt = FrameCapture::Format::Y4M;
+            else
+            {
+                std::cerr << "Unknown capture format " << fmt << std::endl;
+                return 2;
+            }
+        }
+        else if (strcmp(argv[i], "--hashes") == 0 && i + 1 < argc)
+            hashesPath = argv[++i];
+        else
+        {
+            std::cerr << "Unknown option " << argv[i] << std::endl;
+            return 2;
+        }
+    }
+
+    auto &logCfg = Log::instance().config();
+    logCfg.pOutput = &std::cerr;
+    logCfg.filter = Log::LVL_ERROR | Log::LVL_WARNING;
+
+    Bus bus { OutputMode::NTSC };
+    CPU6502 cpu;
+    PPU ppu;
+    APU apu;
+    Cartrige cart;
+    Gamepad pads[2];
+    MemoryRenderingBackend rbe;
+    FrameCapture capture;
+
+    ppu.setBackend(&rbe);
+    bus.setCPU(&cpu);
+    bus.setPPU(&ppu);
+    bus.setAPU(&apu);
+    bus.setGamePad(0, &pads[0]);
+    bus.setGamePad(1, &pads[1]);
+
+    MoviePlayer player { bus };
+    try
+    {
+        ROMLoader loader { cart };
+        loader.loadNES(argv[1]);
+        bus.injectCartrige(&cart);
+        player.start(argv[2]);
+
+        // Every frame is written, the replay waits for the writer if needed
+        if (capturePath)
+        {
+            capture.start(capturePath, captureFmt, 60u, 8u, true);
+            rbe.setCapture(&capture);
+        }
+    }
+    catch (const Exception &ex)
+    {
+        std::cerr << "Error: " << ex.message() << std::endl;
+        return 2;
+    }
+
+    // Frame, picture, RAM, VRAM, OAM and audio hashes per line
+    FILE *pHashes = nullptr;
+    if (hashesPath)
+    {
+        pHashes = fopen(hashesPath, "w");
+        if (!pHashes)
+        {
+            std::cerr << "Error: failed to create " << hashesPath << std::endl;
+            return 2;
+        }
+        bus.setFrameHashing(Bus::HASH_ALL);
+    }
+
+#ifdef ENABLE_PERF_COUNTERS
+    PerfCounters perf = { };
+#endif
+
+    const auto t0 = std::chrono::steady_clock::now();
+    bool ok = true;
+    while (player.beforeFrame())
+    {
+        bus.runFrame(capturePath ? Bus::FRAME_VIDEO : Bus::FRAME_NO_OUTPUT);
+#ifdef ENABLE_PERF_COUNTERS
+        perf += bus.perfCounters();
+#endif
+        if (pHashes)
+        {
+            const FrameHashes &h = bus.frameHashes();
+            fprintf(pHashes, "%d %016llx %016llx %016llx %016llx %016llx\n", h.frame,
+                    static_cast<unsigned long long>(h.picture), static_cast<unsigned long long>(h.ram),
+                    static_cast<unsigned long long>(h.vram), static_cast<unsigned long long>(h.oam),
+                    static_cast<unsigned long long>(h.audio));
+        }
+        if (!player.afterFrame())
+        {
+            ok = false;
+            std::cerr << "Memory hash mismatch at frame " << player.framesPlayed() << std::endl;
+            if (!keepGoing)
+                break;
+        }
+    }
+    capture.stop();
+    if (pHashes)
+        fclose(pHashes);
+    const double sec = std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+
+    if (player.framesPlayed() != player.frameCount() && ok)
+    {
+        ok = false;
+        std::cerr << "Movie input ended at frame " << player.framesPlayed()
+                  << " of " << player.frameCount() << std::endl;
+    }
+
+    std::cout << player.framesPlayed() << " frames in " << sec << " s ("
+              << (sec > 0.0 ? player.framesPlayed() / sec : 0.0) << " FPS), "
+              << player.checkpointsPassed() << " of " << player.checkpointCount() << " checkpoints passed"
+              << std::endl;
+
+#ifdef ENABLE_PERF_COUNTERS
+    if (player.framesPlayed() > 0)
+    {
+        const double n = player.framesPlayed();
+        printf("Per frame: %.0f instructions, %.0f cycles, %.1f bank switches, %.1f sprite lines\n",
+               perf.instructions / n, perf.cycles / n, perf.bankSwitches / n, perf.spriteLines / n);
+        for (int r = 0; r < PerfCounters::NUM_REGIONS; r++)
+            printf("  %-8s %10.1f reads %10.1f writes\n", PerfCounters::regionName(r), perf.reads[r] / n, perf.writes[r] / n);
+        for (int s = 0; s < PerfCounters::NUM_SECTIONS; s++)
+            printf("  %-8s %10.0f %s\n", PerfCounters::sectionName(s), perf.hostTime[s] / n,
+                   hostCyclesAreTSC() ? "host cycles" : "ns");
+    }
+#endif
+    std::cout << (ok ? "PASSED" : "FAILED") << std::endl;
+
+    return ok ? 0 : 1;
+}
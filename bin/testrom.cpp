@@ -0,0 +1,87 @@
+#include "testrom.h"
+#include "loader.h"
+
+#include <cstring>
+#include <vector>
+
+// test/lockcheck.asm assembled at $C000 of a 16K NROM
+static const c6502_byte_t s_program[] = {
+    0x78, 0xD8, 0xA2, 0xFF, 0x9A, 0xA9, 0x00, 0x8D, 0x00, 0x20, 0x8D, 0x01, 0x20, 0x8D, 0x10, 0x40,
+    0xA9, 0x40, 0x8D, 0x17, 0x40, 0x2C, 0x02, 0x20, 0x10, 0xFB, 0xA9, 0x00, 0xAA, 0x95, 0x00, 0x9D,
+    0x00, 0x03, 0xE8, 0xD0, 0xF8, 0xA9, 0xA7, 0x85, 0x03, 0xA2, 0x00, 0x8A, 0x9D, 0x00, 0x02, 0xA9,
+    0x01, 0x9D, 0x01, 0x02, 0x8A, 0x29, 0x03, 0x9D, 0x02, 0x02, 0x8A, 0x49, 0x5A, 0x9D, 0x03, 0x02,
+    0xE8, 0xE8, 0xE8, 0xE8, 0xD0, 0xE5, 0xA9, 0x30, 0x8D, 0x00, 0x02, 0x8D, 0x03, 0x02, 0x2C, 0x02,
+    0x20, 0x10, 0xFB, 0xA9, 0x3F, 0x8D, 0x06, 0x20, 0xA9, 0x00, 0x8D, 0x06, 0x20, 0xA2, 0x00, 0xBD,
+    0x3C, 0xC2, 0x8D, 0x07, 0x20, 0xE8, 0xE0, 0x20, 0xD0, 0xF5, 0xA9, 0x20, 0x8D, 0x06, 0x20, 0xA9,
+    0x00, 0x8D, 0x06, 0x20, 0xA2, 0x08, 0xA0, 0x00, 0x20, 0xC8, 0xC1, 0x29, 0x7F, 0x8D, 0x07, 0x20,
+    0xC8, 0xD0, 0xF5, 0xCA, 0xD0, 0xF2, 0xA9, 0x0F, 0x8D, 0x15, 0x40, 0xA9, 0xBF, 0x8D, 0x00, 0x40,
+    0xA9, 0x08, 0x8D, 0x01, 0x40, 0xA9, 0xC9, 0x8D, 0x02, 0x40, 0xA9, 0x00, 0x8D, 0x03, 0x40, 0xA9,
+    0xFF, 0x8D, 0x08, 0x40, 0xA9, 0x60, 0x8D, 0x0A, 0x40, 0xA9, 0x01, 0x8D, 0x0B, 0x40, 0xA9, 0x3C,
+    0x8D, 0x0C, 0x40, 0xA9, 0x05, 0x8D, 0x0E, 0x40, 0xA9, 0x08, 0x8D, 0x0F, 0x40, 0xA9, 0x00, 0x8D,
+    0x17, 0x40, 0x58, 0xA9, 0x00, 0x8D, 0x05, 0x20, 0x8D, 0x05, 0x20, 0xA9, 0x88, 0x8D, 0x00, 0x20,
+    0xA9, 0x1E, 0x8D, 0x01, 0x20, 0x20, 0x71, 0xC1, 0xA5, 0x01, 0xF0, 0xFC, 0xA9, 0x00, 0x85, 0x01,
+    0xA2, 0x00, 0xA0, 0x00, 0x2C, 0x02, 0x20, 0x50, 0x06, 0x88, 0xD0, 0xF8, 0xCA, 0xD0, 0xF5, 0x2C,
+    0x02, 0x20, 0x70, 0x09, 0x88, 0xD0, 0xF8, 0xCA, 0xD0, 0xF5, 0x4C, 0x09, 0xC1, 0xA5, 0x07, 0x8D,
+    0x05, 0x20, 0xA9, 0x00, 0x8D, 0x05, 0x20, 0xE6, 0x09, 0xA9, 0x01, 0x8D, 0x16, 0x40, 0xA9, 0x00,
+    0x8D, 0x16, 0x40, 0xA2, 0x08, 0xAD, 0x16, 0x40, 0x4A, 0x26, 0x02, 0xAD, 0x17, 0x40, 0x4A, 0x26,
+    0x0A, 0xCA, 0xD0, 0xF1, 0xA5, 0x02, 0x29, 0x01, 0xF0, 0x02, 0xE6, 0x07, 0xA5, 0x02, 0x29, 0x02,
+    0xF0, 0x02, 0xC6, 0x07, 0xA2, 0x04, 0xBD, 0x03, 0x02, 0x18, 0x65, 0x02, 0x9D, 0x03, 0x02, 0xBD,
+    0x00, 0x02, 0x38, 0xE5, 0x0A, 0x9D, 0x00, 0x02, 0x8A, 0x29, 0x1C, 0xD0, 0x03, 0xFE, 0x01, 0x02,
+    0xE8, 0xE8, 0xE8, 0xE8, 0xD0, 0xE0, 0xA5, 0x00, 0x8D, 0x02, 0x40, 0x20, 0xC8, 0xC1, 0x29, 0x0F,
+    0x8D, 0x0E, 0x40, 0xA5, 0x00, 0x29, 0x0F, 0xD0, 0x05, 0xA9, 0x01, 0x8D, 0x03, 0x40, 0x4C, 0xD5,
+    0xC0, 0xA9, 0x00, 0x85, 0x0B, 0xA9, 0x03, 0x85, 0x0C, 0xA0, 0x00, 0x84, 0x08, 0xB1, 0x0B, 0x18,
+    0x65, 0x08, 0x2A, 0x85, 0x08, 0x45, 0x02, 0x91, 0x0B, 0xC8, 0xD0, 0xF1, 0xA2, 0x10, 0x8A, 0x48,
+    0xCA, 0xD0, 0xFB, 0xA2, 0x10, 0x68, 0x45, 0x03, 0x9D, 0x00, 0x03, 0xCA, 0xD0, 0xF7, 0xA2, 0x00,
+    0xBD, 0x00, 0x03, 0x38, 0xFD, 0x01, 0x03, 0x6A, 0x9D, 0x80, 0x03, 0xA5, 0x08, 0x75, 0x10, 0x85,
+    0x08, 0xE8, 0xE0, 0x7F, 0xD0, 0xEA, 0xA2, 0x04, 0xA1, 0x01, 0x8D, 0xFF, 0x03, 0x20, 0xC8, 0xC1,
+    0x24, 0x08, 0x50, 0x03, 0x20, 0xC8, 0xC1, 0x60, 0xA5, 0x03, 0x0A, 0x90, 0x02, 0x49, 0x1D, 0x85,
+    0x03, 0x60, 0x48, 0x8A, 0x48, 0x98, 0x48, 0xA9, 0x00, 0x8D, 0x03, 0x20, 0xA9, 0x02, 0x8D, 0x14,
+    0x40, 0xAD, 0x02, 0x20, 0xA5, 0x06, 0x29, 0x07, 0x09, 0x20, 0x8D, 0x06, 0x20, 0xA5, 0x05, 0x8D,
+    0x06, 0x20, 0xA5, 0x00, 0x29, 0x7F, 0x8D, 0x07, 0x20, 0xA5, 0x05, 0x18, 0x69, 0x21, 0x85, 0x05,
+    0xA5, 0x06, 0x69, 0x00, 0x29, 0x03, 0x85, 0x06, 0xA9, 0x3F, 0x8D, 0x06, 0x20, 0xA9, 0x01, 0x8D,
+    0x06, 0x20, 0xA5, 0x00, 0x4A, 0x4A, 0x29, 0x3F, 0x8D, 0x07, 0x20, 0xA9, 0x00, 0x8D, 0x05, 0x20,
+    0x8D, 0x05, 0x20, 0xA9, 0x88, 0x8D, 0x00, 0x20, 0xE6, 0x00, 0xA9, 0x01, 0x85, 0x01, 0x68, 0xA8,
+    0x68, 0xAA, 0x68, 0x40, 0x48, 0xAD, 0x15, 0x40, 0xE6, 0x04, 0x68, 0x40, 0x0F, 0x16, 0x27, 0x38,
+    0x0F, 0x11, 0x21, 0x31, 0x0F, 0x1A, 0x2A, 0x3A, 0x0F, 0x14, 0x24, 0x34, 0x0F, 0x06, 0x17, 0x28,
+    0x0F, 0x02, 0x12, 0x22, 0x0F, 0x0B, 0x1B, 0x2B, 0x0F, 0x05, 0x15, 0x25,
+};
+
+static constexpr c6502_word_t PROGRAM_ORG = 0xC000u,
+                              NMI_ENTRY = 0xC1D2u,
+                              RESET_ENTRY = 0xC000u,
+                              IRQ_ENTRY = 0xC234u;
+
+RomImage::Ptr testROMImage()
+{
+    constexpr size_t PRG_SIZE = RomImage::PRG_BANK_SIZE,
+                     CHR_SIZE = RomImage::CHR_BANK_SIZE;
+    std::vector<c6502_byte_t> data(NES_HEADER_SIZE + PRG_SIZE + CHR_SIZE, 0u);
+
+    // One PRG and one CHR bank, vertical mirroring, mapper 0
+    const c6502_byte_t header[] = { 'N', 'E', 'S', 0x1Au, 1u, 1u, 1u, 0u };
+    memcpy(data.data(), header, sizeof(header));
+
+    c6502_byte_t *pPRG = &data[NES_HEADER_SIZE];
+    const size_t orgOffset = PROGRAM_ORG & (PRG_SIZE - 1u);
+    memcpy(pPRG + orgOffset, s_program, sizeof(s_program));
+    const c6502_word_t vectors[] = { NMI_ENTRY, RESET_ENTRY, IRQ_ENTRY };
+    for (size_t i = 0u; i < 3u; i++)
+    {
+        pPRG[PRG_SIZE - 6u + i * 2u] = lo_byte(vectors[i]);
+        pPRG[PRG_SIZE - 5u + i * 2u] = hi_byte(vectors[i]);
+    }
+
+    // Tiles 0x00-0x7F of both tables have no transparent pixels, the rest have some
+    c6502_byte_t *pCHR = pPRG + PRG_SIZE;
+    for (uint t = 0u; t < 512u; t++)
+    {
+        for (uint r = 0u; r < 8u; r++)
+        {
+            const auto lo = static_cast<c6502_byte_t>((t * 37u) ^ (r * 0x1Bu));
+            pCHR[t * 16u + r] = lo;
+            pCHR[t * 16u + 8u + r] = static_cast<c6502_byte_t>((t & 0x80u) ? lo >> 1u : ~lo | (t << r));
+        }
+    }
+
+    return std::make_shared<const RomImage>(std::move(data), NES_HEADER_SIZE, 1, 1);
+}
@@ -0,0 +1,15 @@
+/*
+ * Test program the tools run when no ROM is given.
+ */
+
+#ifndef TESTROM_H
+#define TESTROM_H
+
+#include "romimage.h"
+
+/// NROM image of test/lockcheck.asm: NMI and frame IRQ handlers, OAM DMA,
+/// VBLANK nametable and palette writes, a sprite 0 split, pads, sound
+/// and RAM work, running on forever. CHR is generated.
+RomImage::Ptr testROMImage();
+
+#endif
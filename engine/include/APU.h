@@ -3,6 +3,9 @@
 
 #include "common.h"
 #include "bus.h"
+#include "mixer.h"
+#include "audiocapture.h"
+#include <vector>
 
 // Interface that wraps platform-dependent playback subsystem
 class PlaybackBackend
@@ -18,6 +21,13 @@ public:
     virtual void beginFrame(uint nSamples) noexcept = 0;
     virtual void queueSample(float v) noexcept = 0;
     virtual void endFrame() noexcept = 0;
+
+    // Queue a block of samples; backends may override it to avoid per-sample calls
+    virtual void queueSamples(const float *pSamples, uint n) noexcept
+    {
+        for (uint i = 0u; i < n; i++)
+            queueSample(pSamples[i]);
+    }
 };
 
 // Envelope unit, common for Pulse and Noise channels
@@ -108,6 +118,33 @@ public:
         }
     }
 
+    struct Snapshot
+    {
+        bool enabled,
+             lenCntHalt;
+        uint lenCnt,
+             timerPeriod,
+             timerCnt;
+    };
+
+    void snapshot(Snapshot &ss) const noexcept
+    {
+        ss.enabled = m_enabled;
+        ss.lenCntHalt = m_lenCntHalt;
+        ss.lenCnt = m_lenCnt;
+        ss.timerPeriod = m_timerPeriod;
+        ss.timerCnt = m_timerCnt;
+    }
+
+    void restore(const Snapshot &ss) noexcept
+    {
+        m_enabled = ss.enabled;
+        m_lenCntHalt = ss.lenCntHalt;
+        m_lenCnt = ss.lenCnt;
+        m_timerPeriod = ss.timerPeriod;
+        m_timerCnt = ss.timerCnt;
+    }
+
 protected:
     virtual void onTimeout() noexcept = 0;
 
@@ -185,6 +222,24 @@ public:
 
     uint sample() noexcept;
 
+    struct Snapshot
+    {
+        APUChannel::Snapshot base;
+        Envelope envelope;
+        uint duty,
+             seqIndex;
+        bool swpReload,
+             swpEnabled,
+             swpNegate;
+        uint swpPeriod,
+             swpCounter,
+             swpShift,
+             swpTargetPeriod;
+    };
+
+    void snapshot(Snapshot &ss) const noexcept;
+    void restore(const Snapshot &ss) noexcept;
+
 protected:
     void onTimeout() noexcept override;
 };
@@ -225,6 +280,19 @@ public:
     void clockLinearCounter() noexcept;
     uint sample() noexcept;
 
+    struct Snapshot
+    {
+        APUChannel::Snapshot base;
+        bool linCntReload,
+             linCntControl;
+        uint seqIndex,
+             linCntSet,
+             linCnt;
+    };
+
+    void snapshot(Snapshot &ss) const noexcept;
+    void restore(const Snapshot &ss) noexcept;
+
 protected:
     void onTimeout() noexcept override;
 };
@@ -264,6 +332,18 @@ public:
 
     uint sample() noexcept;
 
+    struct Snapshot
+    {
+        APUChannel::Snapshot base;
+        Envelope envelope;
+        OutputMode mode;
+        uint shift;
+        bool loop;
+    };
+
+    void snapshot(Snapshot &ss) const noexcept;
+    void restore(const Snapshot &ss) noexcept;
+
 protected:
     void onTimeout() noexcept override;
 };
@@ -307,17 +387,64 @@ public:
     c6502_byte_t readRegister(c6502_word_t reg);
     void writeRegister(c6502_word_t reg, c6502_byte_t val);
 
-    void runFrame();
+    /// @param output false to only advance the state, nothing is played or captured.
+    void runFrame(bool output = true);
 
+    /// Set playback backend. Without a backend the APU runs headless:
+    /// no samples are generated, only the state visible to the guest
+    /// (length counters, status bits) is maintained.
     void setBackend(PlaybackBackend *ppbe) noexcept
     {
         m_pBackend = ppbe;
     }
 
+    bool isHeadless() const noexcept
+    {
+        return m_pBackend == nullptr;
+    }
+
+    /// Attach multitrack capture, levels of every frame are handed over to it
+    /// while it is running, with or without a playback backend.
+    void setCapture(AudioCapture *pCap) noexcept
+    {
+        m_pCapture = pCap;
+    }
+
+    /// Hash the channel levels of every frame. The levels are generated then
+    /// even without output, like for the capture.
+    void setLevelHashing(bool enable) noexcept
+    {
+        m_hashLevels = enable;
+    }
+
+    /// XXH64 of the levels of the last frame, channel after channel, a byte per APU clock.
+    uint64_t levelHash() const noexcept
+    {
+        return m_levelHash;
+    }
+
     void reset() noexcept;
 
+    struct alignas(64) Snapshot
+    {
+        bool fiveStep,
+             irqInhibit;
+        uint64_t seqStartCycle;
+        PulseChannel::Snapshot pulse1,
+                               pulse2;
+        TriangleChannel::Snapshot tri;
+        NoiseChannel::Snapshot noise;
+        APUChannel::Snapshot dmc;
+    };
+
+    void snapshot(Snapshot &ss) const noexcept;
+    void restore(const Snapshot &ss) noexcept;
+
 private:
     PlaybackBackend *m_pBackend = nullptr;
+    AudioCapture *m_pCapture = nullptr;
+    bool m_hashLevels = false;
+    uint64_t m_levelHash = 0u;
 
     bool m_5step = false,
          m_irqInhibit = false;
@@ -327,6 +454,19 @@ private:
     TriangleChannel m_tri;
     NoiseChannel m_noise;
     DMChannel m_dmc;
+
+    // CPU cycle the frame sequence was last restarted at (reset or $4017 write)
+    uint64_t m_seqStartCycle = 0u;
+
+    void clockSequencer(int step) noexcept;
+    uint64_t nextFrameIRQCycle() const noexcept;
+    void scheduleFrameIRQ() noexcept;
+
+    // Output stage
+    LevelStream m_levels;
+    Resampler m_resampler;
+    std::vector<float> m_mixBuf,
+                       m_outBuf;
 };
 
 #endif
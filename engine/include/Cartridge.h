@@ -2,6 +2,7 @@
 #define	CARTRIDGE_H
 
 #include "storage.h"
+#include "romimage.h"
 #include <type_traits>
 
 enum class Mirroring
@@ -13,7 +14,7 @@ enum class Mirroring
     FourScreen
 };
 
-class Mapper
+class Mapper: public Component
 {
 public:
     /// Known mappers
@@ -107,29 +108,44 @@ public:
     {
         RAM = 0u,
         NAMETABLE_MAPPING,
-        SOUND_GENERATION
+        SOUND_GENERATION,
+        SCANLINE_COUNTER
     };
 
     using FeatSet = std::underlying_type<Feature>::type;
 
     // Bank sizes
-    static constexpr c6502_d_word_t ROM_SIZE = 16 * 1024,
-                                    VROM_SIZE = 8 * 1024,
+    static constexpr c6502_d_word_t ROM_SIZE = RomImage::PRG_BANK_SIZE,
+                                    VROM_SIZE = RomImage::CHR_BANK_SIZE,
                                     RAM_SIZE = 8 * 1024;
 
-    typedef Storage<ROM_SIZE> ROM_BANK;
     typedef Storage<VROM_SIZE> VROM_BANK;
     typedef Storage<RAM_SIZE> RAM_BANK;
 
     virtual ~Mapper();
 
-    void setROMBank(int n, const c6502_byte_t *p);
-    void setVROMBank(int n, const c6502_byte_t *p);
+    const RomImage::Ptr &romImage() const noexcept
+    {
+        return m_pImage;
+    }
 
     virtual c6502_byte_t readMem(c6502_word_t addr) = 0;
 
     virtual c6502_byte_t readVideoMem(c6502_word_t addr) = 0;
 
+    /// Copy the pattern tables as seen by the PPU (0x2000 bytes). Reads them
+    /// byte by byte, mappers knowing their banks copy them at once.
+    virtual void readPatterns(c6502_byte_t *pDst);
+
+    /// ROM seen at the 8K page of the CPU address space holding @a addr (0x8000 and above),
+    /// for reading code directly. Valid until the next write to the mapper.
+    /// @return nullptr if the mapper doesn't tell, reads go through readMem() then.
+    virtual const c6502_byte_t *romPage(c6502_word_t addr) const noexcept
+    {
+        (void)addr;
+        return nullptr;
+    }
+
     /* N.B.: some addresses control mapper behaviour (i. e.
      * force bank switching) so, despite the memory itself is r/o,
      * this operation with the mapper is legal.
@@ -148,8 +164,25 @@ public:
         return cur;
     }
 
+    /// Called by the Bus once per line at the moment PPU address line A12 rises,
+    /// only for mappers having SCANLINE_COUNTER feature.
+    virtual void onA12Rise() noexcept
+    {
+    }
+
+    /// Size of the mapper state block: RAM banks and whatever the concrete mapper adds
+    virtual size_t stateSize() const noexcept
+    {
+        return m_nRAMs * RAM_SIZE;
+    }
+
+    /// Copy the state into the block of stateSize() bytes
+    virtual void snapshot(void *pDst) const noexcept;
+    virtual void restore(const void *pSrc) noexcept;
+
 protected:
-    Mapper(int nROMs, int nVROMs, int nRAMs);
+    /// ROM banks are not copied, the mapper keeps a reference to the image
+    Mapper(RomImage::Ptr pImage, int nRAMs);
 
     int numROMs() const noexcept
     {
@@ -166,16 +199,16 @@ protected:
         return m_nRAMs;
     }
 
-    ROM_BANK &romBank(int i) noexcept
+    const c6502_byte_t *romBank(int i) const noexcept
     {
         assert(i >= 0 && i < m_nROMs);
-        return m_pROM[i];
+        return m_pPRG + i * ROM_SIZE;
     }
 
-    VROM_BANK &vromBank(int i) noexcept
+    const c6502_byte_t *vromBank(int i) const noexcept
     {
         assert(i >= 0 && i < m_nVROMs);
-        return m_pVROM[i];
+        return m_pCHR + i * VROM_SIZE;
     }
 
     RAM_BANK &ramBank(int i) noexcept
@@ -184,6 +217,19 @@ protected:
         return m_pRAM[i];
     }
 
+    // Registers of the concrete mapper are stored after the common part
+    template <typename T>
+    void snapshotRegisters(void *pDst, const T &regs) const noexcept
+    {
+        memcpy(static_cast<uint8_t*>(pDst) + Mapper::stateSize(), &regs, sizeof(T));
+    }
+
+    template <typename T>
+    void restoreRegisters(const void *pSrc, T &regs) const noexcept
+    {
+        memcpy(&regs, static_cast<const uint8_t*>(pSrc) + Mapper::stateSize(), sizeof(T));
+    }
+
     template <Feature F>
     void setFeature(bool b) noexcept
     {
@@ -195,10 +241,12 @@ protected:
     }
 
 private:
+    const RomImage::Ptr m_pImage;
     const int m_nROMs, m_nVROMs, m_nRAMs;
 
-    ROM_BANK *m_pROM = nullptr;
-    VROM_BANK *m_pVROM = nullptr;
+    // Bank data of the image, cached for the read paths
+    const c6502_byte_t *m_pPRG = nullptr,
+                       *m_pCHR = nullptr;
     RAM_BANK *m_pRAM = nullptr;
 
     // Set of supported features
@@ -230,11 +278,17 @@ public:
         return m_pMapper;
     }
 
+    /// @param pImage ROM contents, shared with whoever else holds the pointer.
     void setMapper(uint8_t type,
-                   int nROMs = 2,
-                   int nVROMs = 1,
+                   RomImage::Ptr pImage,
                    int nRAMs = 0);
 
+    const RomImage::Ptr &romImage() const
+    {
+        assert(m_pMapper);
+        return m_pMapper->m_pImage;
+    }
+
     const c6502_byte_t *trainer() const
     {
         return m_pTrainer;
@@ -255,6 +309,11 @@ public:
         m_mirr = m;
     }
 
+    Mirroring currentMirroring() const noexcept
+    {
+        return m_mirr;
+    }
+
     int numRAMs() const
     {
         assert(m_pMapper);
@@ -272,6 +331,14 @@ public:
         assert(m_pMapper);
         return m_pMapper->m_nVROMs;
     }
+
+    /// Fingerprint of the PRG and CHR ROM contents: XXH64 of the PRG ROM,
+    /// used as the seed of XXH64 of the CHR ROM.
+    uint64_t romHash() const noexcept
+    {
+        assert(m_pMapper);
+        return m_pMapper->m_pImage->hash();
+    }
 };
 
 #endif // CARTRIDGE_H
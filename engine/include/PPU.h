@@ -3,6 +3,8 @@
 
 #include "storage.h"
 
+class DeferredRenderer;
+
 /// Abstract class that must be implemented using a concrete rendering system (e.g. Open GL ES)
 class RenderingBackend
 {
@@ -90,11 +92,85 @@ public:
         }
     };
 
+    /// State a visible line is composed with, taken when the line starts
+    struct LineState
+    {
+        int line;
+        c6502_word_t vramAddr,
+                     fineX,
+                     baBkgnd,
+                     baSprites;
+        bool skip,
+             backgroundVisible,
+             fullBackgroundVisible,
+             spritesVisible,
+             allSpritesVisible,
+             bigSprites;
+    };
+
+    /// Copy of the memory lines are composed from, instead of reading it through the bus
+    struct VideoMemory
+    {
+        c6502_byte_t nametables[0x1000],
+                     palettes[0x20],
+                     sprites[256];
+        const c6502_byte_t *pPatterns;  // 0x2000 bytes
+
+        c6502_byte_t readVideoMem(c6502_word_t addr) const noexcept
+        {
+            if (addr >= 0x3F00u)
+                return palettes[addr & 0x1Fu];
+            else if (addr >= 0x2000u)
+                return nametables[addr & 0xFFFu];
+            else
+                return pPatterns[addr];
+        }
+
+        c6502_byte_t readSpriteMem(c6502_word_t addr) const noexcept
+        {
+            return sprites[addr];
+        }
+    };
+
+    /// Compose a line from the copy of the memory.
+    /// @param pColorData Receives 256 pixels.
+    /// @return Background color of the line.
+    static c6502_byte_t composeLine(const LineState &ls,
+                                    const VideoMemory &mem,
+                                    c6502_byte_t *pColorData) noexcept;
+
     void setBackend(RenderingBackend *rbe) noexcept
     {
         m_pBackend = rbe;
     }
 
+    RenderingBackend *backend() const noexcept
+    {
+        return m_pBackend;
+    }
+
+    /// Compose lines of the frames with output after the frame instead of at each line,
+    /// see DeferredRenderer. Sprite 0 hit and overflow are still evaluated at each line.
+    /// @param pDR nullptr to compose lines as they are reached.
+    void setDeferredRenderer(DeferredRenderer *pDR) noexcept;
+
+    /// Pass the frame the deferred renderer still works on to the backend.
+    void flush() noexcept;
+
+    /// Hash the picture of every frame. Lines not drawn here (no output, deferred
+    /// rendering) are composed for the hash, which costs as much as drawing them.
+    void setPictureHashing(bool enable) noexcept
+    {
+        m_hashPicture = enable;
+    }
+
+    /// XXH64 of the lines of the last frame, 256 color indices each with the background
+    /// resolved; every line is seeded with the hash of the lines above.
+    uint64_t pictureHash() const noexcept
+    {
+        return m_pictureHash;
+    }
+
     void writeRegister(c6502_word_t n, c6502_byte_t val) noexcept;
     c6502_byte_t readRegister(c6502_word_t n) noexcept;
 
@@ -106,10 +182,11 @@ public:
     void onBeginVblank() noexcept;
     void onEndVblank() noexcept;
 
-    // Per-line drawing interface
+    // Per-line drawing interface. With output off lines are still rendered
+    // for the sprite 0 hit and overflow flags, but not passed to the backend.
     void startFrame() noexcept;
-    void drawNextLine() noexcept;
-    void endFrame() noexcept;
+    void drawNextLine(bool output = true) noexcept;
+    void endFrame(bool output = true) noexcept;
 
     void reset() noexcept
     {
@@ -121,30 +198,66 @@ public:
         return m_st;
     }
 
+    /// Whether PPU address line A12 rises once during the current line. That happens
+    /// when rendering is on and background and sprites use different pattern tables
+    /// (8x16 sprites are assumed to use both).
+    bool isA12Rising() const noexcept
+    {
+        return (m_st.backgroundVisible || m_st.spritesVisible) &&
+               (m_st.bigSprites || m_st.baBkgnd != m_st.baSprites);
+    }
+
+    /// PPU dot of the line the A12 rises at: sprite fetches from 0x1000
+    /// start at ~260, otherwise it's the fetch of the next line's background at ~324.
+    int a12RiseDot() const noexcept
+    {
+        return m_st.baSprites != 0u || m_st.bigSprites ? 260 : 324;
+    }
+
+    static constexpr int DOTS_PER_LINE = 341;
+
     static constexpr c6502_byte_t TRANSPARENT_PXL = 0x80u;
 
     size_t saveState(std::ostream &out) override;
     size_t loadState(std::istream &in) override;
 
+    struct alignas(64) Snapshot
+    {
+        State st;
+        int currLine;
+    };
+
+    void snapshot(Snapshot &ss) const noexcept
+    {
+        ss.st = m_st;
+        ss.currLine = m_currLine;
+    }
+
+    void restore(const Snapshot &ss) noexcept
+    {
+        m_st = ss.st;
+        m_currLine = ss.currLine;
+    }
+
 private:
     static constexpr int PPR = 256,
                          PPC = 240;
 
     RenderingBackend *m_pBackend = nullptr;
+    DeferredRenderer *m_pDeferred = nullptr;
 
     State m_st;
     int m_currLine = 0;
+    bool m_isRecording = false;
+
+    bool m_hashPicture = false;
+    uint64_t m_pictureHash = 0u;
 
-    void readCharacterLine(c6502_byte_t *line,
-                           const c6502_word_t charInd,
-                           const c6502_word_t lineInd,
-                           const c6502_word_t baseAddr,
-                           const bool fliph,
-                           const bool flipv) noexcept;
+    LineState lineState() const noexcept;
 
-    void expandColor(c6502_byte_t *p,
-                     c6502_byte_t clrHi,
-                     const c6502_word_t palAddr) noexcept;
+    /// Set the sprite flags for the line without composing it, unless sprite 0 is on it
+    void evaluateSprites(const LineState &ls) noexcept;
+    void hashLine(const c6502_byte_t *pColorData, c6502_byte_t bgColor) noexcept;
 };
 
 #endif	/* PPU_H */
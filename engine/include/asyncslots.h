@@ -0,0 +1,158 @@
+/*
+ * Bounded queue of slots filled by one thread and written out by
+ * a background thread.
+ */
+
+#ifndef ASYNCSLOTS_H
+#define ASYNCSLOTS_H
+
+#include "common.h"
+#include <cassert>
+#include <condition_variable>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+
+/*!
+ * The producer fills slots in place and publishes them in order, the writer
+ * thread passes every published slot to the handler and hands it back.
+ * Slots are taken round robin, so a slot still queued means the whole ring is.
+ *
+ * Only the producer moves the write position and only the writer clears the
+ * full flags, the flags are the only state shared under the lock.
+ */
+template <typename Slot>
+class AsyncSlots
+{
+public:
+    /// Called on the writer thread for every published slot, must not throw.
+    using Handler = std::function<void(const Slot&)>;
+
+    AsyncSlots() = default;
+
+    ~AsyncSlots()
+    {
+        stop();
+    }
+
+    AsyncSlots(const AsyncSlots&) = delete;
+    AsyncSlots &operator=(const AsyncSlots&) = delete;
+
+    /// Empty the ring (reallocated if the size changes) and start the writer thread.
+    void start(uint nSlots, Handler handler)
+    {
+        assert(!m_writer.joinable() && nSlots > 0u);
+        if (m_nSlots != nSlots)
+        {
+            m_entries.reset(new Entry[nSlots]);
+            m_nSlots = nSlots;
+        }
+        for (uint i = 0u; i < m_nSlots; i++)
+            m_entries[i].full = false;
+
+        m_writeSlot = m_readSlot = 0u;
+        m_stopRequested = false;
+        m_handler = std::move(handler);
+        m_writer = std::thread { &AsyncSlots::writerLoop, this };
+    }
+
+    /// Write out the published slots and join the writer thread.
+    void stop()
+    {
+        if (!m_writer.joinable())
+            return;
+
+        {
+            std::lock_guard<std::mutex> lk { m_lock };
+            m_stopRequested = true;
+        }
+        m_fullCond.notify_one();
+        m_writer.join();
+    }
+
+    bool isRunning() const noexcept
+    {
+        return m_writer.joinable();
+    }
+
+    /// Producer: the slot to fill next.
+    /// @param wait Block until the writer frees the slot instead of returning nullptr.
+    Slot *acquire(bool wait = false)
+    {
+        Entry &e = m_entries[m_writeSlot];
+        std::unique_lock<std::mutex> lk { m_lock };
+        if (wait)
+            m_freeCond.wait(lk, [&e] { return !e.full; });
+        else if (e.full)
+            return nullptr;
+        return &e.slot;
+    }
+
+    /// Producer: queue the slot returned by acquire().
+    void publish()
+    {
+        {
+            std::lock_guard<std::mutex> lk { m_lock };
+            m_entries[m_writeSlot].full = true;
+        }
+        m_fullCond.notify_one();
+        m_writeSlot = (m_writeSlot + 1u) % m_nSlots;
+    }
+
+    /// Block until every published slot is written.
+    void drain()
+    {
+        std::unique_lock<std::mutex> lk { m_lock };
+        m_freeCond.wait(lk, [this] {
+            for (uint i = 0u; i < m_nSlots; i++)
+                if (m_entries[i].full)
+                    return false;
+            return true;
+        });
+    }
+
+private:
+    struct Entry
+    {
+        Slot slot;
+        bool full = false;
+    };
+
+    std::unique_ptr<Entry[]> m_entries;
+    uint m_nSlots = 0u,
+         m_writeSlot = 0u,
+         m_readSlot = 0u;
+
+    std::mutex m_lock;
+    std::condition_variable m_fullCond,
+                            m_freeCond;
+    std::thread m_writer;
+    bool m_stopRequested = false;
+    Handler m_handler;
+
+    void writerLoop()
+    {
+        for (;;)
+        {
+            Entry &e = m_entries[m_readSlot];
+            {
+                std::unique_lock<std::mutex> lk { m_lock };
+                m_fullCond.wait(lk, [this, &e] { return e.full || m_stopRequested; });
+                if (!e.full)
+                    break;
+            }
+
+            m_handler(e.slot);
+
+            {
+                std::lock_guard<std::mutex> lk { m_lock };
+                e.full = false;
+            }
+            m_freeCond.notify_all();
+            m_readSlot = (m_readSlot + 1u) % m_nSlots;
+        }
+    }
+};
+
+#endif
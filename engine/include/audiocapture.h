@@ -0,0 +1,108 @@
+/*
+ * Multitrack capture of the APU output: every channel and the final mix
+ * are written to separate files by a background thread.
+ */
+
+#ifndef AUDIO_CAPTURE_H
+#define AUDIO_CAPTURE_H
+
+#include "mixer.h"
+#include "asyncslots.h"
+#include <atomic>
+#include <fstream>
+
+class AudioCapture
+{
+public:
+    enum class Format
+    {
+        WAV,    // 32-bit float mono WAV, header is patched as data grows
+        RAW     // headerless 32-bit float mono samples
+    };
+
+    enum Stream
+    {
+        PULSE1,
+        PULSE2,
+        TRIANGLE,
+        NOISE,
+        DMC,
+        MIX,
+        STREAM_COUNT
+    };
+
+    // Largest number of APU clocks per frame that fits the buffer (PAL is ~33k)
+    static constexpr uint MAX_FRAME_CLOCKS = 40000u;
+
+    AudioCapture() = default;
+    ~AudioCapture();
+
+    AudioCapture(const AudioCapture&) = delete;
+    AudioCapture &operator=(const AudioCapture&) = delete;
+
+    /// Create the output files <prefix>_<stream>.wav (or .raw) and start the writer thread.
+    void start(const std::string &prefix, uint sampleRate = 44100u, Format fmt = Format::WAV);
+
+    /// Flush pending frames, finalize headers and close the files.
+    void stop();
+
+    bool isRunning() const noexcept
+    {
+        return m_running;
+    }
+
+    /// Hand over the channel levels of one frame. Called from the emulation thread,
+    /// only copies the levels; the frame is dropped if the writer is still busy
+    /// with both buffers.
+    void submit(const LevelStream &ls, uint nClocks, uint clockRate) noexcept;
+
+    uint droppedFrames() const noexcept
+    {
+        return m_nDropped;
+    }
+
+    static const char *streamName(Stream s) noexcept;
+
+private:
+    struct Slot
+    {
+        c6502_byte_t levels[LevelStream::CHANNEL_COUNT][MAX_FRAME_CLOCKS];
+        uint nClocks = 0u,
+             clockRate = 0u;
+    };
+
+    class Track
+    {
+    public:
+        void open(const std::string &fileName, uint sampleRate, Format fmt);
+        void write(const float *pSamples, uint n);
+        void close();
+
+    private:
+        std::ofstream m_out;
+        Format m_fmt = Format::WAV;
+        uint m_nSamples = 0u,
+             m_nUnpatched = 0u,
+             m_sampleRate = 0u;
+
+        void writeHeader();
+    };
+
+    AsyncSlots<Slot> m_slots;
+    std::atomic<bool> m_running { false };
+    std::atomic<uint> m_nDropped { 0u };
+    std::atomic<bool> m_failed { false };
+    std::string m_error;
+
+    // Touched by the writer thread only while running
+    Track m_tracks[STREAM_COUNT];
+    Resampler m_resamplers[STREAM_COUNT];
+    std::vector<float> m_inBuf,
+                       m_outBuf;
+    uint m_sampleRate = 0u;
+
+    void processSlot(const Slot &slot) noexcept;
+    void writeSlot(const Slot &slot);
+};
+
+#endif
@@ -0,0 +1,130 @@
+/*
+ * Experimental lockstep interpreter: CPUs of several machines execute
+ * the same instructions together, registers kept as a structure of arrays.
+ */
+
+#ifndef BATCHCPU_H
+#define BATCHCPU_H
+
+#include "bus.h"
+#include "cpu6502.h"
+
+/*!
+ * Runs frames on up to LANES machines at once, the way Bus::runFrame does for
+ * each of them. Every machine is a lane; at the start of a CPU run the registers
+ * of all lanes are gathered into arrays, and a single decoded instruction is
+ * executed for every lane at the same PC with loops over the lane arrays
+ * that the compiler turns into vector code. Lanes that differ in PC run as
+ * separate groups, the one furthest behind in time goes first, so lanes
+ * meet again when their paths join.
+ *
+ * Only instructions touching the internal RAM or reading the cartridge are
+ * executed in the lanes; everything else (registers of the PPU, APU, pads and
+ * mapper, interrupts, BRK / RTI) is handed to the lane's own CPU6502. Lanes
+ * keep their memory in their Bus, so snapshots, hashes and DMA work as usual,
+ * and the result is exactly the same as with Bus::runFrame.
+ *
+ * Made for many instances of one game; lanes running different code
+ * are correct, just not faster.
+ */
+class BatchCPU
+{
+public:
+    static constexpr uint LANES = 16u;
+
+    struct Stats
+    {
+        uint64_t groupSteps,    // instructions executed for a group of lanes
+                 laneSteps,     // lanes in these groups, summed
+                 scalarSteps;   // instructions and interrupts run by CPU6502
+    };
+
+    /// @param ppBuses Machines to run, with CPUs, PPUs and APUs set and the same output mode.
+    /// @param n Number of machines, 1 to LANES.
+    BatchCPU(Bus *const *ppBuses, uint n);
+
+    BatchCPU(const BatchCPU&) = delete;
+    BatchCPU &operator=(const BatchCPU&) = delete;
+
+    // Plain new only guarantees 16 bytes before C++17, the lane arrays need 64
+    static void *operator new(size_t size);
+    static void operator delete(void *p) noexcept;
+
+    uint size() const noexcept
+    {
+        return m_n;
+    }
+
+    /// Emulate one frame on every machine.
+    /// @param output Combination of Bus::FrameOutput flags.
+    void runFrame(uint output = Bus::FRAME_ALL);
+
+    const Stats &stats() const noexcept
+    {
+        return m_stats;
+    }
+
+private:
+    using AM = CPU6502::AM;
+
+    enum class Op: uint8_t;
+    struct Decoded;
+
+    static const Decoded *decodeTable() noexcept;
+
+    uint m_n;
+    Bus *m_pBuses[LANES];
+    CPU6502 *m_pCPUs[LANES];
+    c6502_byte_t *m_pRAM[LANES];
+    const c6502_byte_t *m_pROM[LANES][4];  // 8K pages at 0x8000, nullptr - read through the Bus
+    const Decoded *m_pDecode;
+
+    // Registers, valid during a run
+    alignas(64) c6502_byte_t m_a[LANES];
+    alignas(64) c6502_byte_t m_x[LANES];
+    alignas(64) c6502_byte_t m_y[LANES];
+    alignas(64) c6502_byte_t m_s[LANES];
+    alignas(64) c6502_byte_t m_p[LANES];
+    alignas(64) c6502_word_t m_pc[LANES];
+    alignas(64) uint64_t m_cycles[LANES];
+    alignas(64) uint64_t m_instructions[LANES];
+
+    // Clocks left in the run, lanes with false m_active have stopped
+    alignas(64) int m_clk[LANES];
+    bool m_active[LANES];
+
+    // Some CPU has an instruction trace attached
+    bool m_traced = false;
+
+    // Instruction in flight: lanes of the group (0xFF / 0), operands, addresses
+    alignas(64) c6502_byte_t m_group[LANES];
+    alignas(64) c6502_word_t m_operand[LANES];
+    alignas(64) c6502_word_t m_ea[LANES];
+    alignas(64) c6502_byte_t m_val[LANES];
+    alignas(64) c6502_byte_t m_penalty[LANES];
+
+    Stats m_stats = { };
+
+    /// Run the CPUs of the lanes in the mask for the given (fractional) clocks, like Bus::runCPU.
+    void runCPUs(const float *clk, uint32_t laneMask) noexcept;
+
+    /// Execute the instruction at the PC of the leader, on all the lanes at the same PC.
+    void stepGroup(uint leader) noexcept;
+
+    /// Lane instruction run by its CPU6502.
+    /// @param banksKept The instruction doesn't write to the mapper.
+    void stepScalar(uint l, bool banksKept = false) noexcept;
+
+    void execute(const Decoded &d) noexcept;
+
+    /// Read without side effects: internal RAM, ROM or cartridge RAM.
+    c6502_byte_t readLane(uint l, c6502_word_t addr) noexcept;
+
+    /// Mapper may have switched the ROM pages.
+    void updateBanks(uint l) noexcept;
+
+    void loadLane(uint l) noexcept;
+    void storeLane(uint l) noexcept;
+};
+
+#endif
@@ -2,28 +2,56 @@
 #define BUS_H
 
 #include "storage.h"
+#include "perfcounters.h"
 
 class CPU6502;
 class PPU;
 class APU;
 class Cartrige;
 class Gamepad;
+class DeferredRenderer;
 
 enum class OutputMode
 {
     PAL, NTSC
 };
 
+// Devices that can pull down the shared IRQ line
+enum class IRQSource
+{
+    APU_FRAME,
+    APU_DMC,
+    MAPPER,
+    COUNT
+};
+
+// Hashes of the machine parts at the end of a frame, see Bus::setFrameHashing
+struct FrameHashes
+{
+    int frame;
+    uint64_t picture,
+             ram,
+             vram,
+             oam,
+             audio;
+};
+
 // Palettes location in VROM - 0x2000
 static constexpr c6502_word_t PAL_BG = 0x3F00u,
                               PAL_SPR = 0x3F10u;
 
+// Alignment of the buffers passed to Bus::snapshot / Bus::restore
+static constexpr size_t SNAPSHOT_ALIGNMENT = 64u;
+using SnapshotBuffer = AlignedBuffer<SNAPSHOT_ALIGNMENT>;
+
 /*!
  * System bus, controls communication between all units, manages main memory.
  * Object of this class must be created prior to everything else.
  */
 class Bus
 {
+    friend class BatchCPU;
+
     /*** 6502 MEMORY MAP ***/
     // Internal RAM: 0x0000 ~ 0x2000.
     // 0x0000 ~ 0x0100 is a z-page, have special meaning for addressing.
@@ -48,15 +76,59 @@ class Bus
     // Gamepad strobing register
     c6502_byte_t m_strobeReg = 0u;
 
+    // Set by the PPU while a frame is recorded for deferred rendering
+    DeferredRenderer *m_pFrameRecorder = nullptr;
+
     OutputMode m_mode;
 
     int m_nFrame = 0;
     float m_remClk = 0.0f;
 
+    // IRQ line. Every source schedules the CPU cycle its output gets asserted at,
+    // the CPU compares only against the earliest one.
+    static constexpr uint64_t NO_IRQ = UINT64_MAX;
+    struct IRQEvent
+    {
+        uint64_t at,    // assertion cycle, the source is pending once it is passed
+                 next;  // reassertion queued while the source is still pending
+    };
+    IRQEvent m_irq[static_cast<int>(IRQSource::COUNT)];
+    uint64_t m_nextIRQ = NO_IRQ;
+
+    void updateNextIRQ() noexcept;
+
+    // Per-frame hashes, components are flags of FrameHash
+    uint m_hashed = 0u;
+    FrameHashes m_hashes = { };
+
+    void hashFrame() noexcept;
+
+#ifdef ENABLE_PERF_COUNTERS
+    PerfMeter m_perf;
+#endif
+
+    void runCPU(float clk) noexcept;
+
+    // Frame timing of the output mode
+    float cyclesPerLine() const noexcept;
+    int nmiLines() const noexcept;
+
+    // Layout of the snapshot block, defined in bus.cpp
+    struct MachineState;
+
+    // Parts of the snapshot block stored as save state file chunks
+    struct StateChunk;
+    static constexpr uint NUM_STATE_CHUNKS = 10u;
+    static void stateChunks(size_t snapshotSize, StateChunk *pChunks) noexcept;
+
+    void loadLegacyState(std::istream &fin);
+
 public:
     Bus(OutputMode m):
         m_mode { m }
     {
+        for (auto &e: m_irq)
+            e.at = e.next = NO_IRQ;
     }
 
     Bus(const Bus&) = delete;
@@ -106,17 +178,103 @@ public:
 
     void triggerNMI() noexcept;
 
-    void runFrame();
+    /// Assert IRQ from the given source at the given CPU cycle. The source
+    /// stays pending until acknowledged; a time scheduled while an assertion
+    /// is pending or not reached yet takes effect after the acknowledgement.
+    void scheduleIRQ(IRQSource src, uint64_t cycle) noexcept;
+
+    /// Drop the assertions of the source not reached yet, keep a pending one.
+    void unscheduleIRQ(IRQSource src) noexcept;
+
+    /// Release the IRQ output of the source (e.g. status register read).
+    void acknowledgeIRQ(IRQSource src) noexcept;
+
+    /// Release the IRQ output and drop everything scheduled by the source.
+    void cancelIRQ(IRQSource src) noexcept;
+
+    bool isIRQPending(IRQSource src) const noexcept;
+
+    /// Cycle at which IRQ line gets asserted, or is asserted since.
+    uint64_t nextIRQCycle() const noexcept
+    {
+        return m_nextIRQ;
+    }
+
+    /// Number of CPU cycles passed since reset.
+    uint64_t currentCycle() const noexcept;
+
+    // Frame outputs, can be suppressed for frames that are not presented
+    enum FrameOutput: uint
+    {
+        FRAME_NO_OUTPUT = 0u,
+        FRAME_VIDEO = 1u,
+        FRAME_AUDIO = 2u,
+        FRAME_ALL = FRAME_VIDEO | FRAME_AUDIO
+    };
+
+    /// Emulate one frame.
+    /// @param output Combination of FrameOutput flags; the emulation is the same for any.
+    void runFrame(uint output = FRAME_ALL);
 
     int currentFrame() const noexcept
     {
         return m_nFrame;
     }
 
+    // Parts of the machine hashed at the end of a frame
+    enum FrameHash: uint
+    {
+        HASH_NONE = 0u,
+        HASH_PICTURE = 1u,  // color indices of the lines
+        HASH_RAM = 2u,      // internal RAM
+        HASH_VRAM = 4u,     // nametables and palettes
+        HASH_OAM = 8u,      // sprite memory
+        HASH_AUDIO = 16u,   // APU channel levels, before mixing
+        HASH_ALL = 31u
+    };
+
+    /// Hash the components at the end of every frame, with XXH64. The emulation
+    /// doesn't depend on it, but the picture and audio are generated for
+    /// the hash if the frame has no such output. PPU and APU must be set.
+    /// @param components Combination of FrameHash flags.
+    void setFrameHashing(uint components) noexcept;
+
+    uint frameHashing() const noexcept
+    {
+        return m_hashed;
+    }
+
+    /// Hashes of the last frame, 0 for the components not hashed.
+    const FrameHashes &frameHashes() const noexcept
+    {
+        return m_hashes;
+    }
+
+#ifdef ENABLE_PERF_COUNTERS
+    /// Counters of the last complete frame: CPU instructions and cycles, bus accesses
+    /// by region, bank switches, sprite lines and host time by part of the machine.
+    const PerfCounters &perfCounters() const noexcept
+    {
+        return m_perf.lastFrame();
+    }
+
+    /// Counters of the running frame, for the components.
+    PerfMeter &perfMeter() noexcept
+    {
+        return m_perf;
+    }
+#endif
+
     int currentTimeMs() const noexcept;
 
     void setGamePad(int n, Gamepad *pad) noexcept;
 
+    Gamepad *getGamePad(int n) const noexcept
+    {
+        assert(n >= 0 && n < 2);
+        return m_pGamePads[n];
+    }
+
     // CPU address space memory requests dispatching functions
     c6502_byte_t readMem(c6502_word_t addr) noexcept;
     void writeMem(c6502_word_t addr, c6502_byte_t val) noexcept;
@@ -130,15 +288,62 @@ public:
         return m_spriteMem.Read(addr);
     }
 
-    void writeSpriteMem(c6502_word_t addr, c6502_byte_t val) noexcept
+    void writeSpriteMem(c6502_word_t addr, c6502_byte_t val) noexcept;
+
+    /// Log writes to the video and sprite memory into the recorder, nullptr to stop.
+    void setFrameRecorder(DeferredRenderer *pRecorder) noexcept
     {
-        m_spriteMem.Write(addr, val);
+        m_pFrameRecorder = pRecorder;
     }
 
+    /// Copy the nametables (0x1000 bytes), palettes (0x20 bytes) and sprite memory (256 bytes).
+    void copyVideoMemory(c6502_byte_t *pNametables,
+                         c6502_byte_t *pPalettes,
+                         c6502_byte_t *pSprites) const noexcept;
+
+    /// Copy the pattern tables (0x2000 bytes) as currently mapped by the cartridge.
+    void readPatternTables(c6502_byte_t *pDst) const noexcept;
+
     void saveState(const char *fileName);
+
+    /// Load a state file, either chunked or of the old sequential format.
     void loadState(const char *fileName);
 
+    /// Load a state file image, chunked or compressed. Nothing is changed if it is malformed,
+    /// has chunks of other versions or was saved with another cartridge.
+    void loadState(const void *pData, size_t size);
+
+    /// Size of the state file image made of a snapshot of the given size.
+    static size_t stateFileSize(size_t snapshotSize) noexcept;
+
+    /// Pack a block filled by snapshot() into a chunked state file image.
+    /// Doesn't touch the machine, so it can be done in another thread.
+    /// @param pOut Buffer of stateFileSize() bytes.
+    static void buildStateFile(const void *pSnapshot, size_t snapshotSize, uint8_t *pOut) noexcept;
+
+    /// Worst case size of a compressed state file.
+    static size_t maxCompressedStateSize(size_t imageSize) noexcept;
+
+    /// Compress a state file image made by buildStateFile().
+    /// @param pOut Buffer of maxCompressedStateSize() bytes.
+    /// @return Compressed file size.
+    static size_t compressStateFile(const uint8_t *pImage, size_t size, uint8_t *pOut) noexcept;
+
+    /// Size of the buffer required for the snapshot of the whole machine.
+    /// Depends on the inserted cartridge.
+    size_t snapshotSize() const noexcept;
+
+    /// Copy state of all components, memory and mapper into a contiguous block.
+    /// @param pBuf Buffer of snapshotSize() bytes aligned to SNAPSHOT_ALIGNMENT.
+    void snapshot(void *pBuf) const noexcept;
+
+    /// Bring the machine back to the snapshot taken with the same cartridge.
+    void restore(const void *pBuf) noexcept;
+
     int clocksPerFrame() const noexcept;
+
+    /// XXH64 of the internal RAM, sprite memory, nametables and palettes.
+    uint64_t memoryHash() const noexcept;
 };
 
 #endif
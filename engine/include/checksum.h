@@ -0,0 +1,25 @@
+/*
+ * Checksums used by the save state and other on-disk formats.
+ */
+
+#ifndef CHECKSUM_H
+#define CHECKSUM_H
+
+#include "common.h"
+
+/// CRC-32C (Castagnoli). Uses the SSE 4.2 instruction when the processor has it.
+/// @param crc Value returned for the preceding data, to checksum in parts.
+uint32_t crc32c(const void *pData, size_t size, uint32_t crc = 0u) noexcept;
+
+/// CRC-32 of zlib and PNG (ISO-HDLC).
+/// @param crc Value returned for the preceding data, to checksum in parts.
+uint32_t crc32(const void *pData, size_t size, uint32_t crc = 0u) noexcept;
+
+/// Adler-32 of zlib streams.
+/// @param adler Value returned for the preceding data, 1 to start.
+uint32_t adler32(const void *pData, size_t size, uint32_t adler = 1u) noexcept;
+
+/// XXH64 hash, for fingerprints of ROMs and machine state.
+uint64_t xxhash64(const void *pData, size_t size, uint64_t seed = 0u) noexcept;
+
+#endif
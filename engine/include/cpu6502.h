@@ -6,6 +6,7 @@
 #include <tuple>
 #include <array>
 #include <type_traits>
+#include <vector>
 
 #ifdef ENABLE_CPU_TRACE
 #include "log.h"
@@ -17,6 +18,7 @@
 class CPU6502: public Component
 {
     friend class Debugger;
+    friend class BatchCPU;
 
 public:
     enum State
@@ -44,6 +46,22 @@ public:
         C = 0, Z = 1, I = 2, D = 3, B = 4, V = 6, N = 7
     };
 
+    enum TraceKind: c6502_byte_t
+    {
+        TRACE_STEP,
+        TRACE_IRQ,
+        TRACE_NMI
+    };
+
+    /// Instruction run or interrupt taken, see setTrace()
+    struct TraceEntry
+    {
+        uint64_t cycle;     // clocks since reset when it started
+        c6502_word_t pc;    // address of the instruction, return address of an interrupt
+        TraceKind kind;
+        Reg regs;           // registers after it
+    };
+
     CPU6502();
 
     CPU6502(const CPU6502&) = delete;
@@ -78,6 +96,26 @@ public:
         return m_rtiCount;
     }
 
+    /// Number of clocks spent since reset
+    uint64_t cycles() const noexcept
+    {
+        return m_cycles;
+    }
+
+    /// Instructions executed since power on, interrupts not included.
+    /// A statistic, snapshots don't carry it.
+    uint64_t instructionCount() const noexcept
+    {
+        return m_nInstructions;
+    }
+
+    /// Append an entry for every instruction and interrupt to the vector, nullptr stops.
+    /// For finding where two runs part, the emulation is the same either way.
+    void setTrace(std::vector<TraceEntry> *pTrace) noexcept
+    {
+        m_pTrace = pTrace;
+    }
+
     template <Flag FLG>
     c6502_byte_t getFlag() const noexcept
     {
@@ -88,6 +126,20 @@ public:
     size_t saveState(std::ostream &out) override;
     size_t loadState(std::istream &in) override;
 
+    // Plain copy of the whole processor state
+    struct alignas(64) Snapshot
+    {
+        Reg regs;
+        State state;
+        int penalty,
+            nmiCount,
+            rtiCount;
+        uint64_t cycles;
+    };
+
+    void snapshot(Snapshot &ss) const noexcept;
+    void restore(const Snapshot &ss) noexcept;
+
 private:
     Reg m_regs;
 
@@ -98,6 +150,11 @@ private:
     int m_nmiCount = 0,
         m_rtiCount = 0;
 
+    uint64_t m_cycles = 0u,
+             m_nInstructions = 0u;
+
+    std::vector<TraceEntry> *m_pTrace = nullptr;
+
     using OpHandler = void (CPU6502::*)(void);
     using OpData = std::tuple<OpHandler, int, bool>;
     static constexpr int OPCODE_COUNT = 0xFF;
@@ -122,6 +179,10 @@ private:
         bus().writeMem(addr, val);
     }
 
+    /// Take the pending IRQ or run the next instruction, if it fits within the clock limit.
+    /// @return Clocks spent, zero ends the run.
+    int runNext(const int clk) noexcept;
+
     /// Run single processor instruction if it fits within provided clock limit.
     /// @param clk Maximum number of clocks the processor can use.
     /// @return Actual number of clocks spent. Zero while state is still STATE_RUN
@@ -0,0 +1,131 @@
+/*
+ * Composing lines of a frame after it was emulated, in bands on a thread pool.
+ */
+
+#ifndef DEFERREDRENDERER_H
+#define DEFERREDRENDERER_H
+
+#include "PPU.h"
+#include "threadpool.h"
+#include <functional>
+#include <memory>
+#include <vector>
+
+class Bus;
+
+/*!
+ * While a frame is emulated, the PPU only records the state every line starts with,
+ * and the Bus records writes to the nametables, palettes and sprite memory with
+ * the line they happen before. Pattern tables are copied again at a line only when
+ * the cartridge was written to since the previous one (bank switch, CHR RAM).
+ *
+ * At the end of the frame the lines are split into bands, each band is composed
+ * by a worker from the memory copied at the start of the frame with the log applied
+ * up to its lines. Composed lines are passed to the backend in order afterwards,
+ * on the emulation thread.
+ *
+ * In the overlapped mode the frame is composed while the next one is emulated
+ * and passed to the backend at the end of that one, a frame later.
+ */
+class DeferredRenderer
+{
+public:
+    enum class Mode
+    {
+        AfterFrame,
+        Overlapped
+    };
+
+    // Memory the writes are logged for
+    enum Target: uint8_t
+    {
+        NAMETABLES,
+        PALETTES,
+        SPRITES
+    };
+
+    /// @param pool Workers composing the bands, must not run anything else meanwhile.
+    /// @param nBands Number of parts the frame is split into, 0 - one per worker.
+    DeferredRenderer(ThreadPool &pool, uint nBands = 0u, Mode mode = Mode::AfterFrame);
+    ~DeferredRenderer();
+
+    DeferredRenderer(const DeferredRenderer&) = delete;
+    DeferredRenderer &operator=(const DeferredRenderer&) = delete;
+
+    Mode mode() const noexcept
+    {
+        return m_mode;
+    }
+
+    // Recording, called by the PPU and the Bus
+    void beginFrame(Bus &bus) noexcept;
+    void recordLine(const PPU::LineState &ls) noexcept;
+
+    void recordWrite(Target t, c6502_word_t addr, c6502_byte_t val) noexcept
+    {
+        m_pRecorded->writes.push_back({ static_cast<uint8_t>(m_pRecorded->nLines), t, addr, val });
+    }
+
+    /// Pattern tables may differ at the next line.
+    void invalidatePatterns() noexcept
+    {
+        m_patternsChanged = true;
+    }
+
+    /// Compose the recorded frame, or start composing it in the overlapped mode.
+    void endFrame(RenderingBackend &rbe) noexcept;
+
+    /// Wait for the frame being composed in the overlapped mode and pass it to the backend.
+    void flush(RenderingBackend &rbe) noexcept;
+
+private:
+    static constexpr int LINES = 240,
+                         LINE_WIDTH = 256;
+    static constexpr c6502_word_t PATTERNS_SIZE = 0x2000u;
+
+    struct Write
+    {
+        uint8_t line;   // first line that sees the value
+        Target target;
+        c6502_word_t addr;
+        c6502_byte_t val;
+    };
+
+    struct Patterns
+    {
+        int line;
+        c6502_byte_t data[PATTERNS_SIZE];
+    };
+
+    struct Frame
+    {
+        // Recorded
+        PPU::LineState lines[LINES];
+        int nLines = 0;
+        PPU::VideoMemory memory;        // at the start of the frame
+        std::vector<Write> writes;
+        std::vector<Patterns> patterns; // ordered by line, the first one is for line 0
+
+        // Composed
+        c6502_byte_t pixels[LINES * LINE_WIDTH];
+        c6502_byte_t bgColors[LINES];
+    };
+
+    ThreadPool &m_pool;
+    const uint m_nBands;
+    const Mode m_mode;
+
+    std::unique_ptr<Frame> m_frames[2];
+    Frame *m_pRecorded = nullptr,
+          *m_pInFlight = nullptr;
+    Bus *m_pBus = nullptr;
+    bool m_patternsChanged = false;
+
+    // Bound once, the pool keeps a pointer to it while a batch runs
+    const std::function<void(uint)> m_composeBand;
+
+    void composeBand(Frame &f, uint band) noexcept;
+    void present(const Frame &f, RenderingBackend &rbe) noexcept;
+};
+
+#endif
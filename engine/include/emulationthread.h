@@ -0,0 +1,91 @@
+/*
+ * Emulation running on its own thread, decoupled from presenting the picture.
+ */
+
+#ifndef EMULATIONTHREAD_H
+#define EMULATIONTHREAD_H
+
+#include "PPU.h"
+#include "triplebuffer.h"
+#include <atomic>
+#include <functional>
+#include <thread>
+
+/*!
+ * Rendering backend for the PPU running on the emulation thread. Lines of
+ * a frame are collected in a buffer which is handed over to the render thread
+ * at draw(). The render thread passes the newest frame to the real backend
+ * with present(), so neither thread waits for the other one.
+ */
+class FrameHandoff: public RenderingBackend
+{
+public:
+    struct Frame
+    {
+        c6502_byte_t pixels[TEX_WIDTH * TEX_HEIGHT];
+        c6502_byte_t bgColors[TEX_HEIGHT];
+        bool idle;
+    };
+
+    FrameHandoff() = default;
+
+    // Emulation thread
+    void setLine(const int n, const c6502_byte_t *pColorData, const c6502_byte_t bgColor) override;
+    void draw() override;
+    void drawIdle() override;
+
+    /// Render thread: draw the newest frame with the backend. If nothing new
+    /// was published since the last call, the backend draws its last frame again.
+    /// @return true if the frame is a new one.
+    bool present(RenderingBackend &rbe);
+
+private:
+    TripleBuffer<Frame> m_frames;
+    bool m_hasFrame = false;    // render thread
+};
+
+/*!
+ * Calls the frame function at the given rate on a separate thread.
+ * The thread sleeps between frames until the next frame is due and skips
+ * ahead instead of catching up when it falls behind by more than a few frames.
+ *
+ * Everything the frame function touches belongs to the emulation thread while
+ * it is running; other threads talk to it through lock-free queues or stop() it.
+ */
+class EmulationThread
+{
+public:
+    EmulationThread() = default;
+    ~EmulationThread();
+
+    EmulationThread(const EmulationThread&) = delete;
+    EmulationThread &operator=(const EmulationThread&) = delete;
+
+    /// @param fps Frames per second, e.g. 60 for NTSC.
+    void start(std::function<void()> frameFunc, uint fps);
+
+    /// Wait for the current frame to finish and stop the thread.
+    void stop();
+
+    /// False once stopped, or after the frame function has thrown.
+    bool isRunning() const noexcept
+    {
+        return m_thread.joinable() && !m_finished.load(std::memory_order_acquire);
+    }
+
+    /// Frames actually emulated per second, measured over the last second.
+    float fps() const noexcept
+    {
+        return m_fps.load(std::memory_order_relaxed);
+    }
+
+private:
+    std::thread m_thread;
+    std::atomic<bool> m_stop { false },
+                      m_finished { false };
+    std::atomic<float> m_fps { 0.0f };
+
+    void run(std::function<void()> frameFunc, uint fps);
+};
+
+#endif
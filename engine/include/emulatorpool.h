@@ -0,0 +1,81 @@
+/*
+ * Batch of independent emulator instances running the same ROM,
+ * stepped together on a thread pool.
+ */
+
+#ifndef EMULATORPOOL_H
+#define EMULATORPOOL_H
+
+#include "batchcpu.h"
+#include "threadpool.h"
+#include <memory>
+#include <vector>
+
+/*!
+ * Each instance is a complete machine with its own cartridge; the ROM image
+ * is loaded once and shared, only cartridge RAM is per instance. step() applies
+ * an action (pad 1 buttons) to every instance and runs one frame on all of
+ * them in parallel; the picture of the frame is kept as the observation.
+ *
+ * Instances are created by the workers that later step them, so with
+ * the first touch page placement of the OS their memory is local to
+ * the NUMA node of the worker. Work stealing may still move an instance
+ * to another node when the load gets uneven.
+ *
+ * In the lockstep mode instances are stepped in groups of BatchCPU::LANES,
+ * a worker running the CPUs of a group together; results are the same.
+ */
+class EmulatorPool
+{
+public:
+    static constexpr uint FRAME_WIDTH = 256u,
+                          FRAME_HEIGHT = 240u,
+                          FRAME_SIZE = FRAME_WIDTH * FRAME_HEIGHT;
+
+    struct Config
+    {
+        uint nInstances,
+             nThreads;      // 0 - one per hardware thread
+        bool pinThreads;
+        OutputMode mode;
+        bool lockstep;
+    };
+
+    /// @throw Exception if the ROM can't be loaded.
+    EmulatorPool(const char *romFileName, const Config &cfg);
+    ~EmulatorPool();
+
+    EmulatorPool(const EmulatorPool&) = delete;
+    EmulatorPool &operator=(const EmulatorPool&) = delete;
+
+    uint size() const noexcept
+    {
+        return static_cast<uint>(m_instances.size());
+    }
+
+    uint threadCount() const noexcept
+    {
+        return m_pool.size();
+    }
+
+    /// Power cycle every instance.
+    void reset();
+
+    /// Run one frame on every instance.
+    /// @param actions Pad 1 buttons for every instance, bit per Button.
+    void step(const c6502_byte_t *actions);
+
+    /// Last frame of the instance: FRAME_HEIGHT rows of FRAME_WIDTH NES color indices.
+    const c6502_byte_t *observation(uint i) const noexcept;
+
+    Bus &bus(uint i) noexcept;
+
+private:
+    struct Instance;
+
+    ThreadPool m_pool;
+    std::vector<std::unique_ptr<Instance>> m_instances;
+    std::vector<std::unique_ptr<BatchCPU>> m_batches;   // lockstep mode only
+};
+
+#endif
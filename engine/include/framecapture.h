@@ -0,0 +1,98 @@
+/*
+ * Capture of the video output: frames are queued by the emulation thread
+ * and encoded into files by a background thread.
+ */
+
+#ifndef FRAME_CAPTURE_H
+#define FRAME_CAPTURE_H
+
+#include "asyncslots.h"
+#include <atomic>
+#include <fstream>
+#include <string>
+#include <vector>
+
+/*!
+ * Frames are color indices as MemoryRenderingBackend keeps them. submit() copies
+ * a frame into the next free slot of a bounded ring and returns; a frame that
+ * finds the ring full is dropped, unless the capture was started to wait for
+ * the writer then (nothing gets lost, the emulation runs at the writer's pace).
+ */
+class FrameCapture
+{
+public:
+    enum class Format
+    {
+        PNG,    // file per frame <path>_<frame>.png, 8-bit palette
+        RAW,    // RGBA8 frames one after another in <path>.raw
+        Y4M     // YUV4MPEG2 stream <path>.y4m, 4:4:4 8-bit BT.601
+    };
+
+    static constexpr uint WIDTH = 256u,
+                          HEIGHT = 240u,
+                          FRAME_SIZE = WIDTH * HEIGHT;
+
+    FrameCapture() = default;
+    ~FrameCapture();
+
+    FrameCapture(const FrameCapture&) = delete;
+    FrameCapture &operator=(const FrameCapture&) = delete;
+
+    /// Create the output (the stream file for RAW and Y4M) and start the writer thread.
+    /// @param fps Frame rate stored in Y4M streams.
+    /// @param nSlots Frames the queue holds.
+    /// @param waitWhenFull Block submit() instead of dropping frames.
+    void start(const std::string &path, Format fmt, uint fps = 60u, uint nSlots = 8u, bool waitWhenFull = false);
+
+    /// Write out the queued frames and close the output.
+    void stop();
+
+    bool isRunning() const noexcept
+    {
+        return m_running;
+    }
+
+    /// Queue a frame of FRAME_SIZE color indices. Called from the emulation thread.
+    /// @return false if the frame is dropped.
+    bool submit(const c6502_byte_t *pFrame) noexcept;
+
+    uint droppedFrames() const noexcept
+    {
+        return m_nDropped;
+    }
+
+    uint writtenFrames() const noexcept
+    {
+        return m_nWritten;
+    }
+
+private:
+    struct Slot
+    {
+        c6502_byte_t pixels[FRAME_SIZE];
+        uint number;    // frames submitted before, dropped ones included
+    };
+
+    AsyncSlots<Slot> m_slots;
+    bool m_waitWhenFull = false;
+    std::atomic<bool> m_running { false };
+    uint m_nSubmitted = 0u;
+    std::atomic<uint> m_nDropped { 0u },
+                      m_nWritten { 0u };
+    std::atomic<bool> m_failed { false };
+    std::string m_error;
+
+    // Touched by the writer thread only while running
+    std::string m_path;
+    Format m_fmt = Format::PNG;
+    std::ofstream m_out;
+    std::vector<uint8_t> m_buf;
+
+    void processSlot(const Slot &slot) noexcept;
+    void writeFrame(const Slot &slot);
+    void encodePNG(const c6502_byte_t *pPixels);
+    void encodeY4M(const c6502_byte_t *pPixels);
+    void encodeRGBA8(const c6502_byte_t *pPixels);
+};
+
+#endif
@@ -41,6 +41,49 @@ public:
 
     c6502_byte_t readRegister() noexcept;
 
+    // Everything the player controls, for replicating and recording the input
+    struct Input
+    {
+        uint16_t pressed,   // bit per button, pad 2 buttons of a doubled pad start at bit 8
+                 turbo;
+        bool lightGunDetector,
+             lightGunTrigger;
+
+        bool operator==(const Input &o) const noexcept
+        {
+            return pressed == o.pressed && turbo == o.turbo &&
+                   lightGunDetector == o.lightGunDetector && lightGunTrigger == o.lightGunTrigger;
+        }
+
+        bool operator!=(const Input &o) const noexcept
+        {
+            return !(*this == o);
+        }
+    };
+
+    Input input() const noexcept;
+    void setInput(const Input &in) noexcept;
+
+    /// Buttons of the pad as the guest reads them during the given frame,
+    /// with turbo applied. Bit per button, doubled pad buttons are not included.
+    c6502_byte_t buttonsAt(int frame) const noexcept;
+
+    // Buttons follow the input, only the serial read position is machine state
+    struct Snapshot
+    {
+        int ind;
+    };
+
+    void snapshot(Snapshot &ss) const noexcept
+    {
+        ss.ind = m_ind;
+    }
+
+    void restore(const Snapshot &ss) noexcept
+    {
+        m_ind = ss.ind;
+    }
+
 private:
     bool m_buttonState[16] = { };
 
@@ -52,7 +95,7 @@ private:
 
     int m_ind = 0;
 
-    bool turboTest(int btnInd) const noexcept;
+    bool turboTest(int btnInd, int frame) const noexcept;
 };
 
 #endif
@@ -0,0 +1,41 @@
+/*
+ * Host time stamps for measuring the emulation.
+ */
+
+#ifndef HOSTCLOCK_H
+#define HOSTCLOCK_H
+
+#include <chrono>
+#include <cstdint>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#define HOST_CYCLES_TSC
+#elif defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86))
+#include <intrin.h>
+#define HOST_CYCLES_TSC
+#endif
+
+/// Host clock cycles: the time stamp counter on x86, which ticks at a constant
+/// rate close to the nominal CPU frequency; nanoseconds elsewhere.
+inline uint64_t hostCycles() noexcept
+{
+#ifdef HOST_CYCLES_TSC
+    return __rdtsc();
+#else
+    using namespace std::chrono;
+    return static_cast<uint64_t>(duration_cast<nanoseconds>(steady_clock::now().time_since_epoch()).count());
+#endif
+}
+
+/// Whether hostCycles() counts cycles rather than nanoseconds.
+constexpr bool hostCyclesAreTSC() noexcept
+{
+#ifdef HOST_CYCLES_TSC
+    return true;
+#else
+    return false;
+#endif
+}
+
+#endif
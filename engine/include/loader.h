@@ -65,10 +65,33 @@ struct NESHeader
     uint8_t isPal;      // only {0, 1}, otherwise error
 
     bool checkValid() const;
+
+    uint8_t mapperType() const
+    {
+        return static_cast<uint8_t>(mapperLo | (mapperHi << 4));
+    }
+
+    Mirroring mirroring() const
+    {
+        return fourScreenVRAM ? Mirroring::FourScreen :
+               mirror ? Mirroring::Vertical : Mirroring::Horizontal;
+    }
+
+    int numRAMs() const
+    {
+        // RAM counter fixup for compatibility
+        return (hasRAM && nRAMs == 0) ? 1 : nRAMs;
+    }
 };
 
 static_assert(sizeof(NESHeader) == 10, "NESHeader is padded incorrectly");
 
+// Header is followed by 6 zero bytes, then the trainer and the banks
+static constexpr size_t NES_HEADER_SIZE = 16u,
+                        NES_TRAINER_SIZE = 512u;
+
+class RomPack;
+
 /*!
  * \brief Allows reading of NES ROMs and raw data blocks from a file to
  * the cartridge.
@@ -93,6 +116,27 @@ public:
      */
     void loadNES(const char *file);
 
+    /*!
+     * Maps (or, for non-regular files, reads) and validates the NES file without
+     * touching any cartridge. The image can then be loaded into any number of
+     * cartridges, they all share it.
+     * \param file NES file path.
+     */
+    static RomImage::Ptr readNES(const char *file);
+
+    /*!
+     * Sets the cartridge up from an image made by readNES().
+     * \param pImage NES file contents.
+     */
+    void loadNES(const RomImage::Ptr &pImage);
+
+    /*!
+     * Loads a ROM from the pack. Nothing is parsed, the pack index has
+     * everything the cartridge needs.
+     * \param hash ROM hash, as given by Cartrige::romHash().
+     */
+    void loadFromPack(const RomPack &pack, uint64_t hash);
+
     /*!
      * Load a binary file contents as cartridge ROM data.
      * \param file Raw data file path.
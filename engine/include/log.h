@@ -4,6 +4,7 @@
 #include <iostream>
 #include <string>
 #include <chrono>
+#include <mutex>
 
 class Log
 {
@@ -40,11 +41,12 @@ public:
 
     void print(Severity sl, const char *msg, ...);
     
+    // Messages may come from any thread, each is printed as a whole.
+    // Config is not guarded, change it before starting other threads.
     static Log &instance() noexcept
     {
-        if (!s_pInst)
-            s_pInst = new Log;
-        return *s_pInst;
+        static Log s_inst;
+        return s_inst;
     }
 
     template <typename... Args>
@@ -78,7 +80,7 @@ public:
     }
 
 private:
-    static Log *s_pInst;
+    std::mutex m_lock;
 
     Config m_config = {
         &std::cout,
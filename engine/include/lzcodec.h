@@ -0,0 +1,36 @@
+/*
+ * Fast byte-oriented LZ77 compression in the manner of LZ4 block format.
+ */
+
+#ifndef LZCODEC_H
+#define LZCODEC_H
+
+#include "common.h"
+
+/*!
+ * Stream is a sequence of (literals, match) pairs. Each starts with a token byte:
+ * high nibble is the literal count, low nibble is the match length - 4; value 15
+ * means more length bytes follow, each adding up to 255. Then go the literals and
+ * 2 bytes of little endian match offset. The last sequence has literals only.
+ */
+class LZCodec
+{
+public:
+    static constexpr size_t MIN_MATCH = 4u,
+                            MAX_OFFSET = 0xFFFFu;
+
+    /// Worst case compressed size of n bytes (incompressible data)
+    static size_t maxCompressedSize(size_t n) noexcept
+    {
+        return n + n / 255u + 16u;
+    }
+
+    /// @param pOut Buffer of maxCompressedSize(n) bytes.
+    /// @return Number of bytes written to pOut.
+    static size_t compress(const uint8_t *pIn, size_t n, uint8_t *pOut) noexcept;
+
+    /// @return false if the stream is malformed or doesn't decompress to exactly n bytes.
+    static bool decompress(const uint8_t *pIn, size_t inSize, uint8_t *pOut, size_t n) noexcept;
+};
+
+#endif
@@ -0,0 +1,105 @@
+/*
+ * Complete machine in one object, cheap to branch into copies.
+ */
+
+#ifndef MACHINE_H
+#define MACHINE_H
+
+#include "bus.h"
+#include "cpu6502.h"
+#include "PPU.h"
+#include "APU.h"
+#include "Cartridge.h"
+#include "gamepad.h"
+#include <memory>
+
+/*!
+ * Owns the bus, CPU, PPU, APU, cartridge and both pads, wired together.
+ * The cartridge refers to a ROM image that may be shared with other machines.
+ *
+ * clone() copies the state into another machine with the same ROM image:
+ * only the snapshot block (memory, registers of all components and the mapper
+ * state) goes through a buffer the target allocated beforehand, nothing else
+ * is allocated or copied. Made for tree search, where a state is branched into
+ * many machines that each run with their own input.
+ *
+ * No rendering backend is set, frames need to be run without video output
+ * until one is given with ppu().setBackend().
+ */
+class Machine
+{
+public:
+    /// Power on with a cartridge made of the image.
+    /// @throw Exception if the image can't be mapped.
+    Machine(const RomImage::Ptr &pImage, OutputMode mode);
+
+    Machine(const Machine&) = delete;
+    Machine &operator=(const Machine&) = delete;
+
+    Bus &bus() noexcept
+    {
+        return m_bus;
+    }
+
+    const Bus &bus() const noexcept
+    {
+        return m_bus;
+    }
+
+    CPU6502 &cpu() noexcept
+    {
+        return m_cpu;
+    }
+
+    PPU &ppu() noexcept
+    {
+        return m_ppu;
+    }
+
+    APU &apu() noexcept
+    {
+        return m_apu;
+    }
+
+    Cartrige &cartrige() noexcept
+    {
+        return m_cart;
+    }
+
+    Gamepad &pad(int n) noexcept
+    {
+        assert(n >= 0 && n < 2);
+        return m_pads[n];
+    }
+
+    const RomImage::Ptr &romImage() const
+    {
+        return m_cart.romImage();
+    }
+
+    void runFrame(uint output = Bus::FRAME_ALL)
+    {
+        m_bus.runFrame(output);
+    }
+
+    /// Bring the target to the state of this machine, pad input included.
+    /// Rendering backends stay as they are.
+    /// @throw Exception if the target has another ROM image.
+    void clone(Machine &target) const;
+
+    /// New machine in the state of this one, sharing the ROM image.
+    std::unique_ptr<Machine> clone() const;
+
+private:
+    Bus m_bus;
+    CPU6502 m_cpu;
+    PPU m_ppu;
+    APU m_apu;
+    Cartrige m_cart;
+    Gamepad m_pads[2];
+
+    // Receives the state of the machine cloned into this one
+    SnapshotBuffer m_clone;
+};
+
+#endif
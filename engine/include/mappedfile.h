@@ -0,0 +1,46 @@
+/*
+ * Read-only view of a whole file: memory mapped where the platform allows,
+ * read into a buffer otherwise (also for pipes and other non-regular files).
+ */
+
+#ifndef MAPPEDFILE_H
+#define MAPPEDFILE_H
+
+#include "common.h"
+#include <vector>
+
+class MappedFile
+{
+public:
+    /// @throw Exception IOFailure if the file can't be opened or read.
+    explicit MappedFile(const char *fileName);
+    ~MappedFile();
+
+    MappedFile(const MappedFile&) = delete;
+    MappedFile &operator=(const MappedFile&) = delete;
+
+    const uint8_t *data() const noexcept
+    {
+        return m_pData;
+    }
+
+    size_t size() const noexcept
+    {
+        return m_size;
+    }
+
+    bool isMapped() const noexcept
+    {
+        return m_isMapped;
+    }
+
+private:
+    const uint8_t *m_pData = nullptr;
+    size_t m_size = 0u;
+    bool m_isMapped = false;
+
+    // Contents when mapping isn't available
+    std::vector<uint8_t> m_buf;
+};
+
+#endif
@@ -15,18 +15,41 @@ class MMC1: public Mapper
         m_curPrg = 0;
     Maybe<Mirroring> m_mirrOverride;
 
+    struct Registers
+    {
+        uint shiftReg,
+             modeChr,
+             modePrg;
+        int curChr[2],
+            curPrg;
+        bool hasMirr;
+        Mirroring mirr;
+    };
+
     void writeRegister(c6502_word_t addr, c6502_byte_t val);
 
 public:
-    MMC1(int nROMs, int nVROMs, int nRAMs);
+    MMC1(RomImage::Ptr pImage, int nRAMs);
 
     c6502_byte_t readMem(c6502_word_t addr) override;
 
     c6502_byte_t readVideoMem(c6502_word_t addr) override;
 
+    void readPatterns(c6502_byte_t *pDst) override;
+
+    const c6502_byte_t *romPage(c6502_word_t addr) const noexcept override;
+
     void writeMem(c6502_word_t addr, c6502_byte_t val) override;
 
     Mirroring updateMirroring(Mirroring cur) noexcept override;
+
+    size_t stateSize() const noexcept override
+    {
+        return Mapper::stateSize() + sizeof(Registers);
+    }
+
+    void snapshot(void *pDst) const noexcept override;
+    void restore(const void *pSrc) noexcept override;
 };
 
 #endif
@@ -0,0 +1,82 @@
+#ifndef __MMC3_H__
+#define __MMC3_H__
+
+#include "Cartridge.h"
+#include <memory>
+
+/*
+ * Super Mario Bros. 3, Super Contra, Kirby's Adventure, Mega Man 3-6...
+ */
+class MMC3: public Mapper
+{
+    static constexpr c6502_d_word_t PRG_PAGE_SIZE = 0x2000u,
+                                    CHR_PAGE_SIZE = 0x400u;
+
+    // Bank data registers R0..R7
+    c6502_byte_t m_regs[8] = { 0u, 2u, 4u, 5u, 6u, 7u, 0u, 1u };
+    c6502_byte_t m_bankSelect = 0u;
+
+    bool m_ramEnabled = true,
+         m_ramWriteProtect = false;
+    Maybe<Mirroring> m_mirrOverride;
+
+    // Scanline counter
+    c6502_byte_t m_irqLatch = 0u,
+                 m_irqCounter = 0u;
+    bool m_irqReload = false,
+         m_irqEnabled = false;
+
+    // Currently mapped pages, updated on every bank switch
+    const c6502_byte_t *m_prg[4] = { };
+    const c6502_byte_t *m_chr[8] = { };
+
+    // Only allocated when the cartridge has no CHR ROM
+    std::unique_ptr<VROM_BANK> m_pChrRAM;
+
+    struct Registers
+    {
+        c6502_byte_t regs[8],
+                     bankSelect,
+                     irqLatch,
+                     irqCounter;
+        bool ramEnabled,
+             ramWriteProtect,
+             irqReload,
+             irqEnabled,
+             hasMirr;
+        Mirroring mirr;
+    };
+
+    void updateBanks() noexcept;
+    void writeRegister(c6502_word_t addr, c6502_byte_t val) noexcept;
+
+    const c6502_byte_t *prgPage(int n) noexcept;
+    const c6502_byte_t *chrPage(int n) noexcept;
+
+public:
+    MMC3(RomImage::Ptr pImage, int nRAMs);
+
+    c6502_byte_t readMem(c6502_word_t addr) override;
+
+    c6502_byte_t readVideoMem(c6502_word_t addr) override;
+
+    void readPatterns(c6502_byte_t *pDst) override;
+
+    const c6502_byte_t *romPage(c6502_word_t addr) const noexcept override;
+
+    void writeMem(c6502_word_t addr, c6502_byte_t val) override;
+
+    Mirroring updateMirroring(Mirroring cur) noexcept override;
+
+    void onA12Rise() noexcept override;
+
+    size_t stateSize() const noexcept override
+    {
+        return Mapper::stateSize() + sizeof(Registers) + (hasFeature<RAM>() ? VROM_SIZE : 0u);
+    }
+
+    void snapshot(void *pDst) const noexcept override;
+    void restore(const void *pSrc) noexcept override;
+};
+
+#endif
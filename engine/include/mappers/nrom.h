@@ -6,8 +6,8 @@
 class DefaultMapper: public Mapper
 {
 public:
-    DefaultMapper(int nROMs, int nVROMs):
-        Mapper { nROMs, nVROMs, 0 }
+    explicit DefaultMapper(RomImage::Ptr pImage):
+        Mapper { std::move(pImage), 0 }
     {
     }
 
@@ -15,13 +15,15 @@ public:
 
     c6502_byte_t readVideoMem(c6502_word_t addr) override;
 
+    void readPatterns(c6502_byte_t *pDst) override;
+
+    const c6502_byte_t *romPage(c6502_word_t addr) const noexcept override;
+
     /* N.B.: some addresses control mapper behaviour (i. e.
      * force bank switching) so, despite the memory itself is r/o,
      * this operation with the mapper is legal.
      */
     void writeMem(c6502_word_t addr, c6502_byte_t val) override;
-
-    void flash(c6502_word_t addr, c6502_byte_t *p, c6502_d_word_t size);
 };
 
 #endif
@@ -0,0 +1,72 @@
+/*
+ * Rendering backend writing frames to memory, for running without a GPU.
+ */
+
+#ifndef MEMORYBACKEND_H
+#define MEMORYBACKEND_H
+
+#include "PPU.h"
+
+class FrameCapture;
+
+/*!
+ * Lines are written to a buffer given by the caller as they come, either as
+ * NES color indices with the background resolved or as RGBA pixels; rows go
+ * from the top. A frame complete at draw() can also be handed to a FrameCapture.
+ */
+class MemoryRenderingBackend: public RenderingBackend
+{
+public:
+    static constexpr int WIDTH = TEX_WIDTH,
+                         HEIGHT = TEX_HEIGHT;
+
+    enum class Format
+    {
+        INDEXED,    // byte per pixel, NES color index 0..63
+        RGBA8       // 4 bytes per pixel: R, G, B, A
+    };
+
+    MemoryRenderingBackend() = default;
+
+    /// @param pBuf WIDTH x HEIGHT pixels of the format, nullptr - frames are only captured.
+    void setBuffer(void *pBuf, Format fmt = Format::INDEXED) noexcept
+    {
+        m_pBuf = static_cast<uint8_t*>(pBuf);
+        m_fmt = fmt;
+    }
+
+    /// Pass every frame drawn to the capture, nullptr stops.
+    void setCapture(FrameCapture *pCapture) noexcept
+    {
+        m_pCapture = pCapture;
+    }
+
+    /// Frames drawn since the backend was created.
+    uint frameCount() const noexcept
+    {
+        return m_nFrames;
+    }
+
+    /// Last frame drawn (or the one being drawn) as color indices.
+    const c6502_byte_t *frame() const noexcept
+    {
+        return m_frame;
+    }
+
+    /// NES color as R, G, B, A bytes.
+    static const uint8_t *colorRGBA8(c6502_byte_t color) noexcept;
+
+    void setLine(const int n, const c6502_byte_t *pColorData, const c6502_byte_t bgColor) override;
+    void draw() override;
+    void drawIdle() override;
+
+private:
+    uint8_t *m_pBuf = nullptr;
+    Format m_fmt = Format::INDEXED;
+    FrameCapture *m_pCapture = nullptr;
+    uint m_nFrames = 0u;
+
+    c6502_byte_t m_frame[WIDTH * HEIGHT] = { };
+};
+
+#endif
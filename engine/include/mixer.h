@@ -0,0 +1,172 @@
+/*
+ * APU output stage: nonlinear channel mixer and sample rate converter.
+ * Neither class depends on the Bus, so they can be driven (and benchmarked)
+ * without the rest of the emulator.
+ */
+
+#ifndef MIXER_H
+#define MIXER_H
+
+#include "common.h"
+#include <vector>
+
+// Per-clock output levels of all APU channels, one stream per channel
+class LevelStream
+{
+public:
+    enum Channel
+    {
+        PULSE1,
+        PULSE2,
+        TRIANGLE,
+        NOISE,
+        DMC,
+        CHANNEL_COUNT
+    };
+
+    // Make sure every stream can hold at least n levels.
+    // Storage only grows, so it does not allocate once the frame size is settled.
+    void reserve(uint n)
+    {
+        if (n > m_capacity)
+        {
+            for (auto &s: m_streams)
+                s.resize(n);
+            m_capacity = n;
+        }
+    }
+
+    uint capacity() const noexcept
+    {
+        return m_capacity;
+    }
+
+    void set(uint i, uint p1, uint p2, uint tri, uint noise, uint dmc) noexcept
+    {
+        assert(i < m_capacity);
+        m_streams[PULSE1][i] = static_cast<c6502_byte_t>(p1);
+        m_streams[PULSE2][i] = static_cast<c6502_byte_t>(p2);
+        m_streams[TRIANGLE][i] = static_cast<c6502_byte_t>(tri);
+        m_streams[NOISE][i] = static_cast<c6502_byte_t>(noise);
+        m_streams[DMC][i] = static_cast<c6502_byte_t>(dmc);
+    }
+
+    const c6502_byte_t *channel(Channel c) const noexcept
+    {
+        assert(c < CHANNEL_COUNT);
+        return m_streams[c].data();
+    }
+
+private:
+    std::vector<c6502_byte_t> m_streams[CHANNEL_COUNT];
+    uint m_capacity = 0u;
+};
+
+// Nonlinear APU mixer based on the precomputed lookup tables
+class Mixer
+{
+public:
+    static constexpr uint PULSE_TABLE_SIZE = 31u,
+                          TND_TABLE_SIZE = 203u;
+
+    // Output of both pulse channels, p1p2 = pulse1 + pulse2 (0..30)
+    static float pulse(uint p1p2) noexcept
+    {
+        assert(p1p2 < PULSE_TABLE_SIZE);
+        return s_pulseTable[p1p2];
+    }
+
+    // Output of triangle, noise and DMC channels, i = 3 * tri + 2 * noise + dmc (0..202)
+    static float tnd(uint i) noexcept
+    {
+        assert(i < TND_TABLE_SIZE);
+        return s_tndTable[i];
+    }
+
+    // Mix n levels of the stream into the output buffer
+    static void mix(const LevelStream &ls, uint n, float *pOut) noexcept;
+
+private:
+    // Filled once by the static initializer in mixer.cpp
+    static float s_pulseTable[PULSE_TABLE_SIZE],
+                 s_tndTable[TND_TABLE_SIZE];
+
+    friend struct MixerTablesInit;
+};
+
+/*!
+ * Decimating sample rate converter from the APU clock domain to the playback rate.
+ *
+ * Works in three stages: integrate-and-dump decimation by an integer factor
+ * down to roughly twice the output rate, polyphase FIR interpolation to the
+ * exact output rate and a first order DC-blocking high-pass filter.
+ */
+class Resampler
+{
+public:
+    static constexpr uint TAPS = 16u,
+                          PHASES = 64u;
+
+    // High-pass cutoff frequency of the output stage, Hz
+    static constexpr float HIGHPASS_FREQ = 90.0f;
+
+    Resampler() = default;
+
+    Resampler(const Resampler&) = delete;
+    Resampler &operator=(const Resampler&) = delete;
+
+    /// Configure input (APU clocks per second) and output (samples per second) rates.
+    /// Resets the filter state if any of the rates has changed.
+    void setRates(uint inRate, uint outRate);
+
+    uint inputRate() const noexcept
+    {
+        return m_inRate;
+    }
+
+    uint outputRate() const noexcept
+    {
+        return m_outRate;
+    }
+
+    /// Upper bound of the number of samples produced from nIn input levels.
+    uint maxOutput(uint nIn) const noexcept;
+
+    /// Convert a block of input levels.
+    /// @param pOut Destination buffer, must hold at least maxOutput(nIn) samples.
+    /// @return Number of samples written.
+    uint process(const float *pIn, uint nIn, float *pOut) noexcept;
+
+    void reset() noexcept;
+
+    static void toInt16(const float *pIn, int16_t *pOut, uint n) noexcept;
+
+private:
+    uint m_inRate = 0u,
+         m_outRate = 0u,
+         m_decim = 1u;
+
+    // Step between output samples, in decimated samples
+    double m_step = 1.0,
+           m_pos = 0.0;
+
+    // Integrator of the first stage
+    float m_acc = 0.0f;
+    uint m_accCnt = 0u;
+
+    // Decimated samples waiting for the FIR stage; the first TAPS - 1 are the history
+    std::vector<float> m_mid;
+    uint m_midSize = 0u;
+
+    // Coefficients, PHASES rows of TAPS values each
+    std::vector<float> m_coefs;
+
+    // DC blocker state
+    float m_hpCoef = 0.0f,
+          m_hpPrevIn = 0.0f,
+          m_hpPrevOut = 0.0f;
+
+    void buildFilter();
+};
+
+#endif
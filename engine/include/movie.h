@@ -0,0 +1,143 @@
+/*
+ * Input movies: recording of the pad states of every frame, replayed
+ * to reproduce a session exactly.
+ */
+
+#ifndef MOVIE_H
+#define MOVIE_H
+
+#include "bus.h"
+#include <string>
+#include <vector>
+
+/* Movie file, all integers are little endian:
+ * 0000: MAGIC (8 bytes)
+ * 0008: format version (4 bytes)
+ * 000C: output mode, 0 - PAL, 1 - NTSC (4 bytes)
+ * 0010: ROM hash, Cartrige::romHash() (8 bytes)
+ * 0018: number of frames (8 bytes)
+ * 0020: initial state size, 0 if the movie starts from reset (8 bytes)
+ * 0028: input stream size (8 bytes)
+ * 0030: number of checkpoints (8 bytes)
+ * 0038: checkpoint period in frames (4 bytes)
+ * 0040: Initial state, compressed state file
+ * ....: Input stream: runs of frames with the same input,
+ *       varint run length followed by the buttons of pad 1 and pad 2
+ * ....: Checkpoints, 16 bytes each: frame number, Bus::memoryHash() after it
+ */
+
+struct MovieCheckpoint
+{
+    uint64_t frame,     // number of frames played since the movie start
+             hash;
+};
+
+class MovieRecorder
+{
+public:
+    explicit MovieRecorder(Bus &bus);
+
+    MovieRecorder(const MovieRecorder&) = delete;
+    MovieRecorder &operator=(const MovieRecorder&) = delete;
+
+    /// Start recording. The movie starts either from the current state,
+    /// which is stored in it, or from reset done right away.
+    /// @param checkpointPeriod Store the memory hash every that many frames, 0 - never.
+    void start(const std::string &fileName, bool fromReset, uint checkpointPeriod = 60u);
+
+    /// Record the input of the frame about to run. Call right before Bus::runFrame().
+    void beforeFrame();
+
+    /// Call right after the frame, makes checkpoints.
+    void afterFrame();
+
+    /// Write the movie file.
+    void stop();
+
+    bool isRecording() const noexcept
+    {
+        return m_recording;
+    }
+
+private:
+    Bus &m_bus;
+    std::string m_fileName;
+    bool m_recording = false;
+
+    std::vector<uint8_t> m_state,
+                         m_input;
+    std::vector<MovieCheckpoint> m_checkpoints;
+    uint m_period = 0u;
+    uint64_t m_nFrames = 0u,
+             m_romHash = 0u;
+
+    // Current run of the same input
+    c6502_byte_t m_pads[2] = { };
+    uint64_t m_runLength = 0u;
+
+    void flushRun();
+};
+
+class MoviePlayer
+{
+public:
+    explicit MoviePlayer(Bus &bus);
+
+    MoviePlayer(const MoviePlayer&) = delete;
+    MoviePlayer &operator=(const MoviePlayer&) = delete;
+
+    /// Load the movie and bring the machine to its start.
+    /// @throw Exception if the movie is malformed or made with another ROM.
+    void start(const char *fileName);
+
+    /// Set the recorded input for the next frame. Call right before Bus::runFrame().
+    /// @return false if the movie is over.
+    bool beforeFrame() noexcept;
+
+    /// Check the memory hash after the frame if there's a checkpoint for it.
+    /// @return false on mismatch.
+    bool afterFrame() noexcept;
+
+    uint64_t frameCount() const noexcept
+    {
+        return m_nFrames;
+    }
+
+    uint64_t framesPlayed() const noexcept
+    {
+        return m_nPlayed;
+    }
+
+    uint checkpointCount() const noexcept
+    {
+        return static_cast<uint>(m_checkpoints.size());
+    }
+
+    uint checkpointsPassed() const noexcept
+    {
+        return m_nPassed;
+    }
+
+    /// Frame of the first failed checkpoint, or UINT64_MAX.
+    uint64_t firstMismatch() const noexcept
+    {
+        return m_firstMismatch;
+    }
+
+private:
+    Bus &m_bus;
+
+    std::vector<uint8_t> m_input;
+    std::vector<MovieCheckpoint> m_checkpoints;
+    uint64_t m_nFrames = 0u,
+             m_nPlayed = 0u,
+             m_firstMismatch = UINT64_MAX;
+    uint m_nPassed = 0u;
+
+    size_t m_inputPos = 0u,
+           m_nextCheckpoint = 0u;
+    uint64_t m_runLeft = 0u;
+    c6502_byte_t m_pads[2] = { };
+};
+
+#endif
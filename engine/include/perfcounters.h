@@ -0,0 +1,183 @@
+/*
+ * Counters of the work done in a frame and of the host time spent on it.
+ * Only built with ENABLE_PERF_COUNTERS (cmake -DPERF_COUNTERS=ON), otherwise
+ * the PERF_* macros expand to nothing and the engine has no trace of them.
+ */
+
+#ifndef PERF_COUNTERS_H
+#define PERF_COUNTERS_H
+
+#ifdef ENABLE_PERF_COUNTERS
+
+#include "common.h"
+#include "hostclock.h"
+
+/*!
+ * Counts of one frame, or a sum of frames. Bus accesses are those of the CPU
+ * (OAM DMA included); PPU fetches from the cartridge aren't counted. Host time
+ * is in hostCycles() units and exclusive: the time a backend takes, called
+ * from the PPU or APU, isn't counted for them.
+ */
+struct PerfCounters
+{
+    enum Region: int
+    {
+        REGION_RAM,
+        REGION_PPU,
+        REGION_APU,     // pads included
+        REGION_CART,
+        NUM_REGIONS
+    };
+
+    enum Section: int
+    {
+        SECTION_CPU,
+        SECTION_PPU,
+        SECTION_APU,
+        SECTION_BACKEND,    // rendering and playback backends
+        NUM_SECTIONS
+    };
+
+    uint64_t instructions,
+             cycles,
+             reads[NUM_REGIONS],
+             writes[NUM_REGIONS],
+             bankSwitches,      // mapper register writes that change the banks
+             spriteLines,       // lines whose sprites were evaluated
+             hostTime[NUM_SECTIONS];
+
+    static const char *regionName(int r) noexcept
+    {
+        static const char *const s_names[NUM_REGIONS] = { "RAM", "PPU", "APU", "cart" };
+        return s_names[r];
+    }
+
+    static const char *sectionName(int s) noexcept
+    {
+        static const char *const s_names[NUM_SECTIONS] = { "CPU", "PPU", "APU", "backend" };
+        return s_names[s];
+    }
+
+    PerfCounters &operator+=(const PerfCounters &other) noexcept
+    {
+        instructions += other.instructions;
+        cycles += other.cycles;
+        for (int r = 0; r < NUM_REGIONS; r++)
+        {
+            reads[r] += other.reads[r];
+            writes[r] += other.writes[r];
+        }
+        bankSwitches += other.bankSwitches;
+        spriteLines += other.spriteLines;
+        for (int s = 0; s < NUM_SECTIONS; s++)
+            hostTime[s] += other.hostTime[s];
+        return *this;
+    }
+};
+
+/*!
+ * Counters of the frame being run and of the last complete one, kept by the Bus.
+ * Host time goes to the innermost section entered: on a switch the time since
+ * the previous one is added to the section that was current.
+ */
+class PerfMeter
+{
+public:
+    PerfMeter() noexcept
+    {
+        m_current = { };
+        m_last = { };
+    }
+
+    PerfCounters &counters() noexcept
+    {
+        return m_current;
+    }
+
+    /// Counters of the last complete frame
+    const PerfCounters &lastFrame() const noexcept
+    {
+        return m_last;
+    }
+
+    /// Clear the counters, the CPU totals are taken to get the frame's share.
+    void beginFrame(uint64_t instructions, uint64_t cycles) noexcept
+    {
+        m_current = { };
+        m_instructions = instructions;
+        m_cycles = cycles;
+    }
+
+    void endFrame(uint64_t instructions, uint64_t cycles) noexcept
+    {
+        m_current.instructions = instructions - m_instructions;
+        m_current.cycles = cycles - m_cycles;
+        m_last = m_current;
+    }
+
+    /// @return Section to go back to, for leave().
+    int enter(PerfCounters::Section section) noexcept
+    {
+        const int prev = m_section;
+        switchTo(section);
+        return prev;
+    }
+
+    void leave(int prev) noexcept
+    {
+        switchTo(prev);
+    }
+
+private:
+    PerfCounters m_current,
+                 m_last;
+    uint64_t m_instructions = 0u,
+             m_cycles = 0u;
+
+    int m_section = -1;     // none outside of the sections
+    uint64_t m_mark = 0u;
+
+    void switchTo(int section) noexcept
+    {
+        const uint64_t now = hostCycles();
+        if (m_section >= 0)
+            m_current.hostTime[m_section] += now - m_mark;
+        m_section = section;
+        m_mark = now;
+    }
+};
+
+// Host time of the rest of the enclosing block goes to the section
+class PerfScope
+{
+public:
+    PerfScope(PerfMeter &meter, PerfCounters::Section section) noexcept:
+        m_meter { meter },
+        m_prev { meter.enter(section) }
+    {
+    }
+
+    ~PerfScope()
+    {
+        m_meter.leave(m_prev);
+    }
+
+    PerfScope(const PerfScope&) = delete;
+    PerfScope &operator=(const PerfScope&) = delete;
+
+private:
+    PerfMeter &m_meter;
+    const int m_prev;
+};
+
+#define PERF_COUNT(meter, counter) ((meter).counters().counter++)
+#define PERF_SCOPE(meter, section) PerfScope perfScope_ { (meter), PerfCounters::section }
+
+#else
+
+#define PERF_COUNT(meter, counter) ((void)0)
+#define PERF_SCOPE(meter, section) ((void)0)
+
+#endif
+
+#endif
@@ -0,0 +1,121 @@
+/*
+ * Rewind history: per-frame machine snapshots kept in a fixed-size ring.
+ */
+
+#ifndef REWINDER_H
+#define REWINDER_H
+
+#include "bus.h"
+#include <vector>
+
+/*!
+ * Run-length codec for snapshots. Optionally XORs the input against a reference
+ * block first, so unchanged bytes turn into long zero runs.
+ *
+ * Stream is a sequence of runs, each starting with a varint (length << 1 | literal).
+ * Zero runs carry no data, literal runs are followed by the bytes.
+ */
+class DeltaCodec
+{
+public:
+    /// Worst case encoded size of n bytes
+    static size_t maxEncodedSize(size_t n) noexcept
+    {
+        return n + n / 64u + 16u;
+    }
+
+    /// @param pRef Reference block of n bytes or nullptr.
+    /// @return Number of bytes written to pOut.
+    static size_t encode(const uint8_t *pIn, const uint8_t *pRef, size_t n, uint8_t *pOut) noexcept;
+
+    /// @return false if the stream is malformed or doesn't decode to exactly n bytes.
+    static bool decode(const uint8_t *pIn, size_t inSize, const uint8_t *pRef, size_t n, uint8_t *pOut) noexcept;
+};
+
+/*!
+ * Keeps Bus snapshots of the last frames. Every keyframeInterval-th state is stored
+ * as a keyframe, the rest as deltas against the last keyframe, all in one arena
+ * of the configured size. Oldest states are evicted when the arena is full.
+ *
+ * Memory is only allocated by configure() and when the snapshot size changes
+ * (another cartridge), so stepping back and forth at full frame rate doesn't allocate.
+ */
+class Rewinder
+{
+public:
+    struct Config
+    {
+        size_t budget;              // arena size, bytes
+        uint maxFrames,             // history length limit
+             keyframeInterval;
+    };
+
+    static constexpr Config DEFAULT_CONFIG = { 32u << 20u, 60u * 60u, 60u };
+
+    explicit Rewinder(Bus &bus, const Config &cfg = DEFAULT_CONFIG);
+
+    Rewinder(const Rewinder&) = delete;
+    Rewinder &operator=(const Rewinder&) = delete;
+
+    /// Apply new limits, the history is dropped.
+    void configure(const Config &cfg);
+
+    const Config &config() const noexcept
+    {
+        return m_cfg;
+    }
+
+    void clear() noexcept;
+
+    /// Store the current machine state. Call before running each frame.
+    void push();
+
+    /// Bring the machine to the most recent stored state and remove it.
+    /// @return false if the history is empty.
+    bool stepBack() noexcept;
+
+    uint frameCount() const noexcept
+    {
+        return m_nRecords;
+    }
+
+    size_t bytesUsed() const noexcept;
+
+private:
+    struct Record
+    {
+        size_t offset,
+               size;
+        uint64_t seq,       // sequence number of the state
+                 keySeq;    // keyframe the delta refers to, == seq for keyframes
+    };
+
+    Bus &m_bus;
+    Config m_cfg;
+
+    std::vector<uint8_t> m_arena;
+
+    // Ring of record descriptors, oldest first
+    std::vector<Record> m_records;
+    uint m_first = 0u,
+         m_nRecords = 0u;
+    uint64_t m_nextSeq = 0u;
+
+    // Decoded keyframe the newest deltas refer to, and a scratch snapshot
+    size_t m_stateSize = 0u;
+    SnapshotBuffer m_key,
+                   m_work;
+    uint64_t m_keySeq = UINT64_MAX;
+
+    Record &record(uint i) noexcept
+    {
+        assert(i < m_nRecords);
+        return m_records[(m_first + i) % m_records.size()];
+    }
+
+    bool findSpace(size_t need, size_t &offset) noexcept;
+    void dropOldest() noexcept;
+    const Record *findRecord(uint64_t seq) noexcept;
+};
+
+#endif
@@ -0,0 +1,104 @@
+/*
+ * Read-only cartridge ROM contents shared by all machines running the game.
+ */
+
+#ifndef ROMIMAGE_H
+#define ROMIMAGE_H
+
+#include "common.h"
+#include "mappedfile.h"
+#include <memory>
+#include <mutex>
+#include <vector>
+
+/*!
+ * Holds the loaded ROM file (or raw data block) and where the PRG and CHR banks
+ * are inside it. An image never changes after construction, so mappers of any
+ * number of machines, possibly running on different threads, refer to one copy.
+ * Only the writable PRG RAM and CHR RAM belong to each mapper.
+ *
+ * A file image is usually memory mapped: banks are read straight from the page
+ * cache and pages nobody touches are never loaded.
+ *
+ * PRG banks (16 kB) are stored contiguously starting at prgOffset, CHR banks (8 kB)
+ * right after them.
+ */
+class RomImage
+{
+public:
+    using Ptr = std::shared_ptr<const RomImage>;
+
+    static constexpr c6502_d_word_t PRG_BANK_SIZE = 16 * 1024,
+                                    CHR_BANK_SIZE = 8 * 1024;
+
+    /// @throw Exception SizeOverflow if the banks don't fit in the data.
+    RomImage(std::vector<c6502_byte_t> &&data, size_t prgOffset, int nROMs, int nVROMs);
+
+    /// Image is size bytes of the file at offset, banks refer to the file contents directly.
+    /// Several images can share one file, e.g. ROMs of a pack.
+    RomImage(std::shared_ptr<const MappedFile> pFile, size_t offset, size_t size,
+             size_t prgOffset, int nROMs, int nVROMs);
+
+    RomImage(const RomImage&) = delete;
+    RomImage &operator=(const RomImage&) = delete;
+
+    /// Whole image, including the file header if there is one
+    const c6502_byte_t *data() const noexcept
+    {
+        return m_pData;
+    }
+
+    size_t size() const noexcept
+    {
+        return m_size;
+    }
+
+    int numROMs() const noexcept
+    {
+        return m_nROMs;
+    }
+
+    int numVROMs() const noexcept
+    {
+        return m_nVROMs;
+    }
+
+    const c6502_byte_t *prg(int bank) const noexcept
+    {
+        assert(bank >= 0 && bank < m_nROMs);
+        return m_pPRG + static_cast<size_t>(bank) * PRG_BANK_SIZE;
+    }
+
+    const c6502_byte_t *chr(int bank) const noexcept
+    {
+        assert(bank >= 0 && bank < m_nVROMs);
+        return m_pCHR + static_cast<size_t>(bank) * CHR_BANK_SIZE;
+    }
+
+    bool isMapped() const noexcept
+    {
+        return m_pFile && m_pFile->isMapped();
+    }
+
+    /// XXH64 of the PRG banks, used as the seed of XXH64 of the CHR banks.
+    /// Computed on the first call, as it reads the whole image.
+    uint64_t hash() const noexcept;
+
+private:
+    std::vector<c6502_byte_t> m_buf;
+    std::shared_ptr<const MappedFile> m_pFile;
+
+    const c6502_byte_t *m_pData = nullptr;
+    size_t m_size = 0u;
+
+    const int m_nROMs,
+              m_nVROMs;
+    const c6502_byte_t *m_pPRG = nullptr,
+                       *m_pCHR = nullptr;
+    mutable uint64_t m_hash = 0u;
+    mutable std::once_flag m_hashOnce;
+
+    void setLayout(size_t prgOffset);
+};
+
+#endif
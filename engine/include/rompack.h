@@ -0,0 +1,74 @@
+/*
+ * Many ROMs in one file with a sorted index, for test farms and batch jobs.
+ */
+
+#ifndef ROMPACK_H
+#define ROMPACK_H
+
+#include "romimage.h"
+#include "Cartridge.h"
+#include <string>
+#include <vector>
+
+/*!
+ * The pack is mapped once and every ROM in it is a RomImage referring to
+ * the mapping. The index is sorted by ROM hash and holds whatever ROMLoader
+ * would take from the NES header, so loading a ROM from the pack parses nothing.
+ * ROM payloads start at page boundaries.
+ */
+class RomPack
+{
+public:
+    struct Entry
+    {
+        uint64_t hash;          // Cartrige::romHash()
+        uint64_t offset,        // payload: trainer, PRG and CHR banks
+                 size;
+        std::string name;
+        uint8_t mapper;
+        Mirroring mirroring;
+        bool isPal,
+             hasTrainer;
+        int nROMs,
+            nVROMs,
+            nRAMs;
+        uint8_t header[16];     // original NES header
+    };
+
+    /// @throw Exception IOFailure or IllegalFormat.
+    explicit RomPack(const char *fileName);
+
+    RomPack(const RomPack&) = delete;
+    RomPack &operator=(const RomPack&) = delete;
+
+    uint size() const noexcept
+    {
+        return m_nEntries;
+    }
+
+    /// Entries are in the ascending order of hashes.
+    Entry entry(uint i) const;
+
+    /// @return Index of the entry or -1 if there's no ROM with the hash.
+    int find(uint64_t hash) const noexcept;
+
+    /// ROM contents, valid as long as someone holds the pointer, even after the pack is gone.
+    RomImage::Ptr image(const Entry &e) const;
+
+    /*!
+     * Writes a pack of the NES files. Files are read twice, once to build
+     * the index and once to copy the banks, so any number of them is fine.
+     * Files with the same contents are stored once.
+     * \throw Exception if a file can't be read or isn't a valid NES ROM.
+     */
+    static void build(const char *packFile, const std::vector<std::string> &romFiles);
+
+private:
+    std::shared_ptr<const MappedFile> m_pFile;
+    const uint8_t *m_pIndex = nullptr,
+                  *m_pNames = nullptr;
+    uint m_nEntries = 0u;
+    uint64_t m_namesSize = 0u;
+};
+
+#endif
@@ -0,0 +1,75 @@
+/*
+ * Run-ahead input lag reduction: the picture shown is emulated a few frames
+ * in the future, as if the input stays unchanged.
+ */
+
+#ifndef RUNAHEAD_H
+#define RUNAHEAD_H
+
+#include "machine.h"
+#include <memory>
+
+/*!
+ * The machine advances by one frame per host frame and plays its audio,
+ * the picture comes from a frame N frames later.
+ *
+ * In the single instance mode the frames ahead are emulated on the machine
+ * itself, which is then restored from a snapshot. The dual instance mode keeps
+ * a second machine N frames ahead, so while the input stays the same only one
+ * extra frame is emulated and nothing is restored; the second machine is
+ * resynchronized when the prediction fails.
+ */
+class RunAhead
+{
+public:
+    explicit RunAhead(Bus &bus);
+    ~RunAhead();
+
+    RunAhead(const RunAhead&) = delete;
+    RunAhead &operator=(const RunAhead&) = delete;
+
+    /// Number of frames to run ahead, 0 disables.
+    void setFrames(uint n) noexcept;
+
+    uint frames() const noexcept
+    {
+        return m_nFrames;
+    }
+
+    /// Switch to the dual instance mode, the second machine shares the ROM image
+    /// of the cartridge in the main machine. false returns to the single instance mode.
+    void setSecondInstance(bool enable);
+
+    bool hasSecondInstance() const noexcept
+    {
+        return m_pShadow != nullptr;
+    }
+
+    /// Emulate one host frame.
+    void runFrame();
+
+    /// Call after the main machine state is changed from outside (state loaded,
+    /// reset, rewound), frames ahead are emulated again.
+    void invalidate() noexcept
+    {
+        m_isAhead = false;
+    }
+
+private:
+    Bus &m_bus;
+    uint m_nFrames = 0u;
+
+    // The second machine, runs with the main machine's rendering backend and without sound
+    std::unique_ptr<Machine> m_pShadow;
+    Gamepad::Input m_predicted[2] = { };
+    bool m_isAhead = false;
+
+    SnapshotBuffer m_state;
+
+    Gamepad::Input padInput(int n) const noexcept;
+    void saveMain();
+    void runSingle();
+    void runDual();
+};
+
+#endif
@@ -0,0 +1,81 @@
+/*
+ * Bounded lock-free queue for one producer and one consumer thread.
+ */
+
+#ifndef SPSCQUEUE_H
+#define SPSCQUEUE_H
+
+#include "common.h"
+#include <atomic>
+#include <type_traits>
+
+/*!
+ * Ring of N items, N is a power of two. push() and pop() never block;
+ * each side caches the last seen index of the other one, so the shared
+ * cache lines are only touched when the cached value is exhausted.
+ */
+template <typename T, size_t N>
+class SPSCQueue
+{
+    static_assert(N > 0u && (N & (N - 1u)) == 0u, "queue size must be a power of two");
+    static_assert(std::is_trivially_copyable<T>::value, "items are copied with assignment, keep them simple");
+
+public:
+    SPSCQueue() = default;
+
+    SPSCQueue(const SPSCQueue&) = delete;
+    SPSCQueue &operator=(const SPSCQueue&) = delete;
+
+    /// Producer side.
+    /// @return false if the queue is full, the item is not added.
+    bool push(const T &v) noexcept
+    {
+        const size_t head = m_head.load(std::memory_order_relaxed);
+        if (head - m_tailCache == N)
+        {
+            m_tailCache = m_tail.load(std::memory_order_acquire);
+            if (head - m_tailCache == N)
+                return false;
+        }
+
+        m_items[head & (N - 1u)] = v;
+        m_head.store(head + 1u, std::memory_order_release);
+        return true;
+    }
+
+    /// Consumer side.
+    /// @return false if the queue is empty.
+    bool pop(T &v) noexcept
+    {
+        const size_t tail = m_tail.load(std::memory_order_relaxed);
+        if (tail == m_headCache)
+        {
+            m_headCache = m_head.load(std::memory_order_acquire);
+            if (tail == m_headCache)
+                return false;
+        }
+
+        v = m_items[tail & (N - 1u)];
+        m_tail.store(tail + 1u, std::memory_order_release);
+        return true;
+    }
+
+private:
+    // The sides are padded a cache line apart rather than aligned: queues live in
+    // heap allocated windows, and plain new only honours alignas(64) since C++17
+    static constexpr size_t CACHE_LINE = 64u;
+
+    // Producer
+    std::atomic<size_t> m_head { 0u };
+    size_t m_tailCache = 0u;
+    uint8_t m_producerPad[CACHE_LINE];
+
+    // Consumer
+    std::atomic<size_t> m_tail { 0u };
+    size_t m_headCache = 0u;
+    uint8_t m_consumerPad[CACHE_LINE];
+
+    T m_items[N];
+};
+
+#endif
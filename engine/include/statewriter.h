@@ -0,0 +1,84 @@
+/*
+ * Save state persistence off the emulation thread: the machine is only
+ * snapshotted in place, packing, compression and file I/O are done by
+ * a background writer.
+ */
+
+#ifndef STATE_WRITER_H
+#define STATE_WRITER_H
+
+#include "bus.h"
+#include "asyncslots.h"
+#include <mutex>
+#include <string>
+#include <vector>
+
+class StateWriter
+{
+public:
+    struct Stats
+    {
+        uint nWritten,
+             nDropped,      // requests made while both buffers were busy
+             nFailed;
+
+        // Last save
+        float snapshotMs,
+              compressMs,
+              writeMs;
+        size_t rawSize,
+               compressedSize;
+    };
+
+    explicit StateWriter(Bus &bus);
+
+    /// Saves queued before are written out.
+    ~StateWriter();
+
+    StateWriter(const StateWriter&) = delete;
+    StateWriter &operator=(const StateWriter&) = delete;
+
+    /// Snapshot the machine and queue the state for writing to the file.
+    /// Called from the emulation thread between frames.
+    /// @return false if the request is dropped because the writer is busy.
+    bool save(const std::string &fileName);
+
+    /// Save into the file every given number of frames, 0 disables.
+    void setAutosave(const std::string &fileName, uint periodFrames);
+
+    /// Count a frame for the autosave. Call once per emulated frame.
+    void onFrame();
+
+    /// Block until every queued state is written.
+    void flush();
+
+    Stats stats() const;
+
+private:
+    struct Slot
+    {
+        SnapshotBuffer snapshot;
+        size_t size = 0u;
+        std::string fileName;
+        float snapshotMs = 0.0f;
+    };
+
+    Bus &m_bus;
+    AsyncSlots<Slot> m_slots;
+
+    mutable std::mutex m_lock;  // guards the stats
+    Stats m_stats = { };
+
+    std::string m_autosaveFile;
+    uint m_autosavePeriod = 0u,
+         m_nFrames = 0u;
+
+    // Touched by the writer thread only
+    std::vector<uint8_t> m_image,
+                         m_packed;
+
+    void processSlot(const Slot &slot) noexcept;
+    void writeSlot(const Slot &slot);
+};
+
+#endif
@@ -23,6 +23,17 @@ public:
         memset(m_mem, 0, SIZE);
     }
 
+    // Direct access for the hot paths which resolve addresses in advance
+    c6502_byte_t *data() noexcept
+    {
+        return m_mem;
+    }
+
+    const c6502_byte_t *data() const noexcept
+    {
+        return m_mem;
+    }
+
     template <typename OutStreamT>
     void Save(OutStreamT &strm)
     {
@@ -67,5 +78,72 @@ void Storage<SIZE>::Write(c6502_word_t addr, const c6502_byte_t* beg, c6502_d_wo
     memcpy(m_mem + addr, beg, count);
 }
 
+// Heap block aligned to the given boundary, e.g. to hold Bus snapshots
+template <size_t ALIGNMENT>
+class AlignedBuffer
+{
+public:
+    AlignedBuffer() = default;
+
+    explicit AlignedBuffer(size_t size)
+    {
+        resize(size);
+    }
+
+    AlignedBuffer(const AlignedBuffer&) = delete;
+    AlignedBuffer &operator=(const AlignedBuffer&) = delete;
+
+    AlignedBuffer(AlignedBuffer &&b) noexcept:
+        m_pRaw { b.m_pRaw },
+        m_pData { b.m_pData },
+        m_size { b.m_size }
+    {
+        b.m_pRaw = b.m_pData = nullptr;
+        b.m_size = 0u;
+    }
+
+    ~AlignedBuffer()
+    {
+        delete[] m_pRaw;
+    }
+
+    /// Reallocate if the size differs, contents are not preserved
+    void resize(size_t size)
+    {
+        if (size == m_size)
+            return;
+
+        delete[] m_pRaw;
+        m_pRaw = m_pData = nullptr;
+        m_size = size;
+        if (size > 0u)
+        {
+            m_pRaw = new uint8_t[size + ALIGNMENT - 1u];
+            const auto a = reinterpret_cast<uintptr_t>(m_pRaw);
+            m_pData = m_pRaw + ((ALIGNMENT - a % ALIGNMENT) % ALIGNMENT);
+        }
+    }
+
+    uint8_t *data() noexcept
+    {
+        return m_pData;
+    }
+
+    const uint8_t *data() const noexcept
+    {
+        return m_pData;
+    }
+
+    size_t size() const noexcept
+    {
+        return m_size;
+    }
+
+private:
+    uint8_t *m_pRaw = nullptr,
+            *m_pData = nullptr;
+    size_t m_size = 0u;
+};
+
 #endif	// STORAGE_H
 
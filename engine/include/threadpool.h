@@ -0,0 +1,79 @@
+/*
+ * Fixed set of worker threads running batches of indexed tasks.
+ */
+
+#ifndef THREADPOOL_H
+#define THREADPOOL_H
+
+#include "common.h"
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+/*!
+ * Every worker has its own task queue. A batch is split into contiguous
+ * ranges, one per worker; a worker takes tasks from the back of its queue,
+ * and when it is empty steals from the front of the others, so uneven
+ * tasks don't leave cores idle.
+ */
+class ThreadPool
+{
+public:
+    /// @param nThreads Number of workers, 0 - one per hardware thread.
+    /// @param pinThreads Bind each worker to a core where the platform allows.
+    explicit ThreadPool(uint nThreads = 0u, bool pinThreads = false);
+    ~ThreadPool();
+
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool &operator=(const ThreadPool&) = delete;
+
+    uint size() const noexcept
+    {
+        return static_cast<uint>(m_workers.size());
+    }
+
+    /// Run f(i) for every i in [0, n) and wait for all of them.
+    /// Task i is first queued to worker i * size() / n. f must not throw.
+    void parallelFor(uint n, const std::function<void(uint)> &f)
+    {
+        submit(n, f);
+        wait();
+    }
+
+    /// Start running f(i) for every i in [0, n) and return at once. Only one batch
+    /// can be in flight; f must stay alive until wait() returns.
+    void submit(uint n, const std::function<void(uint)> &f);
+
+    /// Wait for the batch started by submit(), returns at once if there is none.
+    void wait();
+
+private:
+    struct Worker
+    {
+        std::mutex lock;
+        std::deque<uint> tasks;
+        std::thread thread;
+    };
+
+    std::vector<std::unique_ptr<Worker>> m_workers;
+
+    std::mutex m_lock;
+    std::condition_variable m_startCond,
+                            m_doneCond;
+    uint64_t m_generation = 0u;
+    bool m_stopRequested = false;
+
+    const std::function<void(uint)> *m_pTask = nullptr;
+    std::atomic<uint> m_remaining { 0u };
+
+    void workerLoop(uint self);
+    bool popLocal(uint self, uint &task);
+    bool steal(uint self, uint &task);
+};
+
+#endif
@@ -0,0 +1,80 @@
+/*
+ * Lock-free handoff of the newest value from one thread to another.
+ */
+
+#ifndef TRIPLEBUFFER_H
+#define TRIPLEBUFFER_H
+
+#include "common.h"
+#include <atomic>
+#include <memory>
+
+/*!
+ * One producer fills the back buffer and publishes it, one consumer takes
+ * the newest published buffer. Neither of them ever waits: a value the consumer
+ * didn't take in time is overwritten by the next one (latest wins).
+ *
+ * The buffers rotate between three roles; the middle one is exchanged atomically
+ * together with the flag telling it holds a value the consumer hasn't seen yet.
+ */
+template <typename T>
+class TripleBuffer
+{
+public:
+    // Value initialised, the consumer may look at the front buffer before anything is published
+    TripleBuffer():
+        m_pBufs { new T[3]() }
+    {
+    }
+
+    TripleBuffer(const TripleBuffer&) = delete;
+    TripleBuffer &operator=(const TripleBuffer&) = delete;
+
+    /// Producer: the buffer to fill.
+    T &back() noexcept
+    {
+        return m_pBufs[m_back];
+    }
+
+    /// Producer: make the back buffer the newest one.
+    void publish() noexcept
+    {
+        const uint8_t prev = m_middle.exchange(static_cast<uint8_t>(m_back | FRESH), std::memory_order_acq_rel);
+        m_back = prev & INDEX_MASK;
+    }
+
+    /// Consumer: switch to the newest buffer, if something was published since the last call.
+    /// @return true if front() has changed.
+    bool update() noexcept
+    {
+        if ((m_middle.load(std::memory_order_relaxed) & FRESH) == 0u)
+            return false;
+
+        const uint8_t prev = m_middle.exchange(m_front, std::memory_order_acq_rel);
+        m_front = prev & INDEX_MASK;
+        return true;
+    }
+
+    /// Consumer: the buffer taken by the last update().
+    const T &front() const noexcept
+    {
+        return m_pBufs[m_front];
+    }
+
+private:
+    static constexpr uint8_t INDEX_MASK = 0x03u,
+                             FRESH = 0x04u;
+    static constexpr size_t CACHE_LINE = 64u;
+
+    std::unique_ptr<T[]> m_pBufs;
+
+    // Each index is only touched by its own thread. Padded apart, not aligned,
+    // so the owner can be allocated with plain new (see SPSCQueue)
+    uint8_t m_back = 0u;
+    uint8_t m_backPad[CACHE_LINE];
+    uint8_t m_front = 1u;
+    uint8_t m_frontPad[CACHE_LINE];
+    std::atomic<uint8_t> m_middle { 2u };
+};
+
+#endif
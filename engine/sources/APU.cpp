@@ -1,5 +1,6 @@
 #include "APU.h"
 #include "log.h"
+#include "checksum.h"
 
 #include <cassert>
 
@@ -183,6 +184,14 @@ c6502_byte_t APU::readRegister(c6502_word_t reg)
             rv |= m_pulse2.lengthCounter() > 0u ? 0b0010u : 0u;
             rv |= m_tri.lengthCounter() > 0u ? 0b0100u : 0u;
             rv |= m_noise.lengthCounter() > 0u ? 0b1000u : 0u;
+            if (bus().isIRQPending(IRQSource::APU_FRAME))
+            {
+                rv |= 0x40u;
+                // Reading the status clears the frame interrupt flag
+                bus().acknowledgeIRQ(IRQSource::APU_FRAME);
+                scheduleFrameIRQ();
+            }
+            rv |= bus().isIRQPending(IRQSource::APU_DMC) ? 0x80u : 0u;
             break;
         default:
             Log::e("Attempt to read from illegal APU register 0x%X (returned zero)", reg);
@@ -198,6 +207,16 @@ void APU::writeRegister(c6502_word_t reg, c6502_byte_t val)
         case FRAME_SEQ:
             m_irqInhibit = val & 0x40u;
             m_5step = val & 0x80u;
+            // Setting the inhibit flag also clears the interrupt flag
+            if (m_irqInhibit)
+                bus().cancelIRQ(IRQSource::APU_FRAME);
+            // The sequence restarts 3 cycles after a write on an APU cycle,
+            // 4 after one in between
+            m_seqStartCycle = bus().currentCycle() + (bus().currentCycle() % 2u == 0u ? 3u : 4u);
+            // The 5-step mode clocks the quarter and half frame units right away
+            if (m_5step)
+                clockSequencer(1);
+            scheduleFrameIRQ();
             break;
         case CTRL_STATUS:
             m_pulse1.setEnabled(val & 0x01u);
@@ -205,6 +224,7 @@ void APU::writeRegister(c6502_word_t reg, c6502_byte_t val)
             m_tri.setEnabled(val & 0x04u);
             m_noise.setEnabled(val & 0x08u);
             m_dmc.setEnabled(val & 0x10u);
+            bus().acknowledgeIRQ(IRQSource::APU_DMC);
             break;
         case RCT1_CTRL:
             {
@@ -302,50 +322,75 @@ void APU::writeRegister(c6502_word_t reg, c6502_byte_t val)
     }
 }
 
-void APU::runFrame()
+void APU::clockSequencer(int step) noexcept
 {
-    assert(m_pBackend != nullptr);
+    assert(step >= 1 && step <= 5);
+    if ((m_5step && (step == 1 || step == 3)) ||
+        (!m_5step && (step == 2 || step == 4)))
+    {
+        m_pulse1.clockLengthCounter();
+        m_pulse1.clockSweep();
+        m_pulse2.clockLengthCounter();
+        m_pulse2.clockSweep();
+        m_tri.clockLengthCounter();
+        m_noise.clockLengthCounter();
+    }
+    m_pulse1.envelope().clock();
+    m_pulse2.envelope().clock();
+    m_noise.envelope().clock();
+    m_tri.clockLinearCounter();
+}
 
-    const auto nClocks = bus().clocksPerFrame();
-    const auto nRecvClocks = bus().getMode() == OutputMode::NTSC ?
-                             divrnd(m_pBackend->getPlaybackFrequency(), 60u) :
-                             divrnd(m_pBackend->getPlaybackFrequency(), 50u);
-    const auto sampleRate = divrnd(nClocks, nRecvClocks);
+uint64_t APU::nextFrameIRQCycle() const noexcept
+{
+    // Sequences are a frame long and follow each other from the last restart,
+    // the interrupt flag of the 4-step mode gets set at the 4th step of each
+    const uint64_t now = bus().currentCycle(),
+                   len = bus().clocksPerFrame(),
+                   first = m_seqStartCycle + 4u * divrnd(bus().clocksPerFrame(), 4);
+    return first > now ? first : first + ((now - first) / len + 1u) * len;
+}
+
+void APU::scheduleFrameIRQ() noexcept
+{
+    // Only the next interrupt is scheduled. The one after it is once the flag
+    // is acknowledged; until then further assertions wouldn't change anything.
+    bus().unscheduleIRQ(IRQSource::APU_FRAME);
+    if (!m_5step && !m_irqInhibit)
+        bus().scheduleIRQ(IRQSource::APU_FRAME, nextFrameIRQCycle());
+}
+
+void APU::runFrame(bool output)
+{
+    PERF_SCOPE(bus().perfMeter(), SECTION_APU);
+    const uint nClocks = bus().clocksPerFrame();
 
     // How much clocks to skip before triggering frame sequencer.
     // Need to align last clock with the last clock of the main timer, so
     // division is rounding to floor.
-    const int fsPeriod = divrnd(nClocks, m_5step ? 5 : 4);
-    int fsStep = 0;
-    m_pBackend->beginFrame(nClocks / sampleRate);
+    const uint fsPeriod = divrnd(nClocks, m_5step ? 5 : 4);
+
+    const bool capturing = output && m_pCapture && m_pCapture->isRunning();
+    m_levelHash = 0u;
+    if (!capturing && !m_hashLevels && (isHeadless() || !output))
+    {
+        // Nothing is going to be heard, so only the sequencer steps matter:
+        // they drive length counters reported by $4015. Channel timers are
+        // skipped, the guest cannot observe them.
+        const int nSteps = (nClocks - 1u) / fsPeriod;
+        for (int step = 1; step <= nSteps; step++)
+            clockSequencer(step);
+        return;
+    }
+
+    const uint fps = bus().getMode() == OutputMode::NTSC ? 60u : 50u;
+    m_levels.reserve(nClocks);
+
     for (uint c = 0; c < nClocks; c++)
     {
         // Clock frame sequencer. Skip immediate triggering at 0
         if (c > 0 && c % fsPeriod == 0)
-        {
-            const int step = c / fsPeriod;
-            assert(step >= 1 && step <= 5);
-            if (c != 5)
-            {
-                if ((m_5step && (step == 1 || step == 3)) ||
-                    (!m_5step && (step == 2 || step == 4)))
-                {
-                    m_pulse1.clockLengthCounter();
-                    m_pulse1.clockSweep();
-                    m_pulse2.clockLengthCounter();
-                    m_pulse2.clockSweep();
-                    m_tri.clockLengthCounter();
-                    m_noise.clockLengthCounter();
-                }
-                m_pulse1.envelope().clock();
-                m_pulse2.envelope().clock();
-                m_noise.envelope().clock();
-                m_tri.clockLinearCounter();
-
-                // TODO: trigger IRQ
-                // if (!m_5step && c == 4)
-            }
-        }
+            clockSequencer(c / fsPeriod);
 
         // Clock channel timers
         if (c % 2 != 0)
@@ -357,28 +402,47 @@ void APU::runFrame()
         m_noise.clockTimer();
         m_dmc.clockTimer();
 
-        if (c % sampleRate == 0u)
-        {
-            // Read channel outputs
-            const auto pul1 = m_pulse1.sample(),
-                       pul2 = m_pulse2.sample(),
-                       tri = m_tri.sample(),
-                       nois = m_noise.sample(),
-                       dmc = m_dmc.sample();
-
-            // Combine outputs
-            const float v = 95.88f / (8128.0f / (pul1 + pul2) + 100.0f) +
-                            159.79f / (1.0f / ((tri / 8227.0f) + (nois / 12241.0f) + (dmc / 22638.0f)) + 100.0f);
-            m_pBackend->queueSample(v);
-        }
+        // Record channel outputs, they are mixed and resampled in one go afterwards
+        m_levels.set(c,
+                     m_pulse1.sample(),
+                     m_pulse2.sample(),
+                     m_tri.sample(),
+                     m_noise.sample(),
+                     m_dmc.sample());
+    }
+
+    if (m_hashLevels)
+        for (uint c = 0u; c < LevelStream::CHANNEL_COUNT; c++)
+            m_levelHash = xxhash64(m_levels.channel(static_cast<LevelStream::Channel>(c)), nClocks, m_levelHash);
+
+    if (capturing)
+        m_pCapture->submit(m_levels, nClocks, nClocks * fps);
+
+    if (isHeadless() || !output)
+        return;
+
+    m_resampler.setRates(nClocks * fps, m_pBackend->getPlaybackFrequency());
+    if (m_mixBuf.size() < nClocks)
+        m_mixBuf.resize(nClocks);
+    Mixer::mix(m_levels, nClocks, m_mixBuf.data());
+
+    const auto maxOut = m_resampler.maxOutput(nClocks);
+    if (m_outBuf.size() < maxOut)
+        m_outBuf.resize(maxOut);
+    const auto nSamples = m_resampler.process(m_mixBuf.data(), nClocks, m_outBuf.data());
+
+    {
+        PERF_SCOPE(bus().perfMeter(), SECTION_BACKEND);
+        m_pBackend->beginFrame(nSamples);
+        m_pBackend->queueSamples(m_outBuf.data(), nSamples);
+        m_pBackend->endFrame();
     }
-    m_pBackend->endFrame();
 }
 
 void APU::reset() noexcept
 {
-    assert(m_pBackend != nullptr);
-    m_pBackend->init();
+    if (m_pBackend)
+        m_pBackend->init();
 
     m_pulse1.setEnabled(false);
     m_pulse2.setEnabled(false);
@@ -386,4 +450,101 @@ void APU::reset() noexcept
     m_noise.setEnabled(false);
     m_noise.setOutputMode(bus().getMode());
     m_dmc.setEnabled(false);
+
+    m_5step = false;
+    m_irqInhibit = false;
+    m_seqStartCycle = bus().currentCycle();
+    scheduleFrameIRQ();
+}
+
+void PulseChannel::snapshot(Snapshot &ss) const noexcept
+{
+    APUChannel::snapshot(ss.base);
+    ss.envelope = m_envelope;
+    ss.duty = m_duty;
+    ss.seqIndex = m_seqIndex;
+    ss.swpReload = m_swpReload;
+    ss.swpEnabled = m_swpEnabled;
+    ss.swpNegate = m_swpNegate;
+    ss.swpPeriod = m_swpPeriod;
+    ss.swpCounter = m_swpCounter;
+    ss.swpShift = m_swpShift;
+    ss.swpTargetPeriod = m_swpTargetPeriod;
+}
+
+void PulseChannel::restore(const Snapshot &ss) noexcept
+{
+    APUChannel::restore(ss.base);
+    m_envelope = ss.envelope;
+    m_duty = ss.duty;
+    m_seqIndex = ss.seqIndex;
+    m_swpReload = ss.swpReload;
+    m_swpEnabled = ss.swpEnabled;
+    m_swpNegate = ss.swpNegate;
+    m_swpPeriod = ss.swpPeriod;
+    m_swpCounter = ss.swpCounter;
+    m_swpShift = ss.swpShift;
+    m_swpTargetPeriod = ss.swpTargetPeriod;
+}
+
+void TriangleChannel::snapshot(Snapshot &ss) const noexcept
+{
+    APUChannel::snapshot(ss.base);
+    ss.linCntReload = m_linCntReload;
+    ss.linCntControl = m_linCntControl;
+    ss.seqIndex = m_seqIndex;
+    ss.linCntSet = m_linCntSet;
+    ss.linCnt = m_linCnt;
+}
+
+void TriangleChannel::restore(const Snapshot &ss) noexcept
+{
+    APUChannel::restore(ss.base);
+    m_linCntReload = ss.linCntReload;
+    m_linCntControl = ss.linCntControl;
+    m_seqIndex = ss.seqIndex;
+    m_linCntSet = ss.linCntSet;
+    m_linCnt = ss.linCnt;
+}
+
+void NoiseChannel::snapshot(Snapshot &ss) const noexcept
+{
+    APUChannel::snapshot(ss.base);
+    ss.envelope = m_envelope;
+    ss.mode = m_mode;
+    ss.shift = m_shift;
+    ss.loop = m_loop;
+}
+
+void NoiseChannel::restore(const Snapshot &ss) noexcept
+{
+    APUChannel::restore(ss.base);
+    m_envelope = ss.envelope;
+    m_mode = ss.mode;
+    m_shift = ss.shift;
+    m_loop = ss.loop;
+}
+
+void APU::snapshot(Snapshot &ss) const noexcept
+{
+    ss.fiveStep = m_5step;
+    ss.irqInhibit = m_irqInhibit;
+    ss.seqStartCycle = m_seqStartCycle;
+    m_pulse1.snapshot(ss.pulse1);
+    m_pulse2.snapshot(ss.pulse2);
+    m_tri.snapshot(ss.tri);
+    m_noise.snapshot(ss.noise);
+    m_dmc.snapshot(ss.dmc);
+}
+
+void APU::restore(const Snapshot &ss) noexcept
+{
+    m_5step = ss.fiveStep;
+    m_irqInhibit = ss.irqInhibit;
+    m_seqStartCycle = ss.seqStartCycle;
+    m_pulse1.restore(ss.pulse1);
+    m_pulse2.restore(ss.pulse2);
+    m_tri.restore(ss.tri);
+    m_noise.restore(ss.noise);
+    m_dmc.restore(ss.dmc);
 }
@@ -4,45 +4,52 @@
 // Mappers
 #include "mappers/nrom.h"
 #include "mappers/mmc1.h"
+#include "mappers/mmc3.h"
 
 #include <algorithm>
 #include <memory>
 
-Mapper::Mapper(int nROMs, int nVROMs, int nRAMs):
-    m_nROMs(nROMs),
-    m_nVROMs(nVROMs),
+Mapper::Mapper(RomImage::Ptr pImage, int nRAMs):
+    m_pImage(std::move(pImage)),
+    m_nROMs(m_pImage->numROMs()),
+    m_nVROMs(m_pImage->numVROMs()),
     m_nRAMs(nRAMs)
 {
-    m_pROM = new ROM_BANK[nROMs];
-    if (nVROMs > 0)
-        m_pVROM = new VROM_BANK[nVROMs];
+    m_pPRG = m_nROMs > 0 ? m_pImage->prg(0) : nullptr;
+    m_pCHR = m_nVROMs > 0 ? m_pImage->chr(0) : nullptr;
     if (nRAMs > 0)
         m_pRAM = new RAM_BANK[nRAMs];
 
-    const int prgSz = nROMs * ROM_SIZE / 1024,
-              chrSz = nVROMs * VROM_SIZE / 1024;
+    const int prgSz = m_nROMs * ROM_SIZE / 1024,
+              chrSz = m_nVROMs * VROM_SIZE / 1024;
     Log::d("[mapper] PRG ROM size = %d kB, CHR ROM size = %d kB", prgSz, chrSz);
 }
 
 Mapper::~Mapper()
 {
-    delete[] m_pROM;
-    delete[] m_pVROM;
     delete[] m_pRAM;
 }
 
-void Mapper::setROMBank(int n, const c6502_byte_t *p)
+void Mapper::readPatterns(c6502_byte_t *pDst)
 {
-    assert(m_pROM);
-    assert(n >= 0 && n < m_nROMs);
-    m_pROM[n].Write(0, p, ROM_SIZE);
+    // Without CHR ROM pattern tables are in the RAM
+    const bool chrRAM = hasFeature<RAM>();
+    for (c6502_word_t addr = 0u; addr < 0x2000u; addr++)
+        pDst[addr] = chrRAM ? readMem(addr) : readVideoMem(addr);
 }
 
-void Mapper::setVROMBank(int n, const c6502_byte_t *p)
+void Mapper::snapshot(void *pDst) const noexcept
 {
-    assert(m_pVROM);
-    assert(n >= 0 && n < m_nVROMs);
-    m_pVROM[n].Write(0, p, VROM_SIZE);
+    auto *p = static_cast<uint8_t*>(pDst);
+    for (int i = 0; i < m_nRAMs; i++, p += RAM_SIZE)
+        memcpy(p, m_pRAM[i].data(), RAM_SIZE);
+}
+
+void Mapper::restore(const void *pSrc) noexcept
+{
+    auto *p = static_cast<const uint8_t*>(pSrc);
+    for (int i = 0; i < m_nRAMs; i++, p += RAM_SIZE)
+        memcpy(m_pRAM[i].data(), p, RAM_SIZE);
 }
 
 void Cartrige::setTrainer(const c6502_byte_t tr[512])
@@ -53,21 +60,25 @@ void Cartrige::setTrainer(const c6502_byte_t tr[512])
 }
 
 void Cartrige::setMapper(uint8_t type,
-                         int nROMs,
-                         int nVROMs,
+                         RomImage::Ptr pImage,
                          int nRAMs)
 {
+    assert(pImage != nullptr);
     Log::i("[cart] mapper type = %u, # ROMs = %d, # CHRs = %d, # RAMs = %d",
-           type, nROMs, nVROMs, nRAMs);
+           type, pImage->numROMs(), pImage->numVROMs(), nRAMs);
 
     std::unique_ptr<Mapper> tmp;
     switch (type)
     {
         case Mapper::Default:
-            tmp.reset(new DefaultMapper { nROMs, nVROMs });
+            tmp.reset(new DefaultMapper { std::move(pImage) });
             break;
         case Mapper::MMC1:
-            tmp.reset(new MMC1 { nROMs, nVROMs, nRAMs });
+            tmp.reset(new MMC1 { std::move(pImage), nRAMs });
+            break;
+        case Mapper::MMC3:
+            // PRG RAM is always there, even if not declared in the header
+            tmp.reset(new MMC3 { std::move(pImage), std::max(nRAMs, 1) });
             break;
         default:
             throw Exception(Exception::IllegalArgument,
@@ -80,5 +91,3 @@ void Cartrige::setMapper(uint8_t type,
         m_pMapper = tmp.release();
     }
 }
-
-
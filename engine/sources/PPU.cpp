@@ -1,6 +1,8 @@
 #include "PPU.h"
 #include "bus.h"
 #include "log.h"
+#include "deferredrenderer.h"
+#include "checksum.h"
 
 #include <cstdlib>
 #include <ctime>
@@ -329,193 +331,379 @@ void PPU::onEndVblank() noexcept
     m_st.vblank = false;
 }
 
-void PPU::startFrame() noexcept
+namespace
 {
-    m_currLine = 0;
-    m_st.sprite0 = false;
-    m_st.over8sprites = false;
 
-    // Pre-rendering scanline emulation
-    if (m_st.backgroundVisible || m_st.spritesVisible)
-        m_st.vramAddr = m_st.tmpAddr;
+// Memory as the PPU sees it during the frame
+struct BusMemory
+{
+    const Bus &bus;
+
+    c6502_byte_t readVideoMem(c6502_word_t addr) const noexcept
+    {
+        return bus.readVideoMem(addr);
+    }
+
+    c6502_byte_t readSpriteMem(c6502_word_t addr) const noexcept
+    {
+        return bus.readSpriteMem(addr);
+    }
+};
+
+// Sprite evaluation results observed by the CPU
+struct SpriteFlags
+{
+    bool sprite0 = false;
+    int nSprites = 0;
+};
+
+// Visible line + 1 tile gap for BG scrolling + 1 tile gap for sprite clipping to the right
+constexpr int LINE_WIDTH = 256 + 8 + 8;
+
+template <typename Memory>
+void readCharacterLine(const Memory &mem,
+                       c6502_byte_t *line,
+                       const c6502_word_t charInd,
+                       const c6502_word_t lineInd,
+                       const c6502_word_t baseAddr,
+                       const bool fliph,
+                       const bool flipv) noexcept
+{
+    assert(line != nullptr);
+    assert(lineInd < 8u);
+
+    const auto ba = baseAddr + charInd * 16u + (flipv ? 7u - lineInd : lineInd);
+    const auto r0 = mem.readVideoMem(ba),
+               r1 = mem.readVideoMem(ba + 8u);
+    for (c6502_word_t j = 0; j < 8; j++)
+    {
+        const auto fj = (fliph ? j : 7u - j);
+        *line++ = (((r1 >> fj) & 1u) << 1u) | ((r0 >> fj) & 1u);
+    }
 }
 
-void PPU::drawNextLine() noexcept
+template <typename Memory>
+void expandColor(const Memory &mem,
+                 c6502_byte_t *p,
+                 c6502_byte_t clrHi,
+                 const c6502_word_t palAddr) noexcept
 {
-    const bool NTSCLineSkip = bus().getMode() == OutputMode::NTSC &&
-                              (m_currLine < 8 || m_currLine > 231);
+    assert(p != nullptr);
 
-    const c6502_word_t fineY = (m_st.vramAddr >> 12u) & 0b111u,
-                       fineX = m_st.fineX;
+    // Combine color values
+    clrHi <<= 2;
+    for (int i = 0; i < 8; i++, p++)
+        *p = *p > 0 ? mem.readVideoMem(palAddr + (*p | clrHi)) : PPU::TRANSPARENT_PXL;
+}
 
-    // Visible line + 1 tile gap for BG scrolling + 1 tile gap for sprite clipping to the right
-    static constexpr auto LINE_WIDTH = PPR + 8 + 8;
-    c6502_byte_t lnData[LINE_WIDTH];
+template <typename Memory>
+bool isSpriteOnLine(const PPU::LineState &ls, const Memory &mem, int ns) noexcept
+{
+    const auto sa = static_cast<c6502_word_t>(ns * 4u);
+    const auto y = static_cast<c6502_byte_t>(mem.readSpriteMem(sa) + 1u),
+               x = mem.readSpriteMem(sa + 3);
+    const c6502_byte_t lastSpriteLine = ls.bigSprites ? 15u : 7u;
+
+    return ls.line >= y && ls.line <= y + lastSpriteLine &&
+           (ls.allSpritesVisible || (x >> 3) != 0);
+}
 
+// Render background and sprites of the line into LINE_WIDTH bytes,
+// the visible part starts at fineX
+template <typename Memory>
+void composeLine(const PPU::LineState &ls, const Memory &mem, c6502_byte_t *lnData, SpriteFlags &flags) noexcept
+{
     // Fill with background color
-    memset(lnData, TRANSPARENT_PXL, LINE_WIDTH);
+    memset(lnData, PPU::TRANSPARENT_PXL, LINE_WIDTH);
 
-    // If PPU is turned off, writing to VRAM is possible
-    const bool enableRendering = m_st.backgroundVisible || m_st.spritesVisible;
-    m_st.enableWrite = !enableRendering;
+    if (ls.skip)
+        return;
 
-    if (enableRendering)
-    {
-        // Copy bits related to horizontal position
-        constexpr c6502_word_t CPYMSK = 0b000010000011111u;
-        m_st.vramAddr &= ~CPYMSK;
-        m_st.vramAddr |= m_st.tmpAddr & CPYMSK;
-    }
+    const c6502_word_t fineY = (ls.vramAddr >> 12u) & 0b111u;
 
     // Render background
-    if (!NTSCLineSkip)
+    if (ls.backgroundVisible)
     {
-        if (m_st.backgroundVisible)
+        auto vramAddr = ls.vramAddr;
+        for (int c = 0; c < 33; c++)
         {
-            for (int c = 0; c < 33; c++)
+            if (ls.fullBackgroundVisible || c > 0)
             {
-                if (m_st.fullBacgroundVisible || c > 0)
-                {
-                    // Read character index from character area
-                    const c6502_word_t charAddr = 0x2000u | (m_st.vramAddr & 0x0FFFu);
-                    const auto charNum = bus().readVideoMem(charAddr);
-
-                    // Read color information from attribute area
-                    const c6502_word_t attrAddr = 0x23C0u |
-                                                (m_st.vramAddr & 0b110000000000u) |
-                                                ((m_st.vramAddr >> 4u) & 0b111000u) |
-                                                ((m_st.vramAddr >> 2u) & 0b111u);
-                    const auto clrGrp = bus().readVideoMem(attrAddr);
-                    const auto offInGrp = ((m_st.vramAddr >> 5u) & 0b10u) |
-                                        ((m_st.vramAddr >> 1u) & 0b01u);
-                    const c6502_byte_t clrHi = (clrGrp >> offInGrp * 2u) & 0b11u;
-
-                    // Load character / attribute data
-                    const c6502_word_t x = c * 8u;
-                    assert(x <= 256u);
-                    readCharacterLine(lnData + x, charNum, fineY, m_st.baBkgnd, false, false);
-                    expandColor(lnData + x, clrHi, PAL_BG);
-                }
-
-                m_st.vramAddr = incrWrpAddrHorz(m_st.vramAddr);
+                // Read character index from character area
+                const c6502_word_t charAddr = 0x2000u | (vramAddr & 0x0FFFu);
+                const auto charNum = mem.readVideoMem(charAddr);
+
+                // Read color information from attribute area
+                const c6502_word_t attrAddr = 0x23C0u |
+                                            (vramAddr & 0b110000000000u) |
+                                            ((vramAddr >> 4u) & 0b111000u) |
+                                            ((vramAddr >> 2u) & 0b111u);
+                const auto clrGrp = mem.readVideoMem(attrAddr);
+                const auto offInGrp = ((vramAddr >> 5u) & 0b10u) |
+                                    ((vramAddr >> 1u) & 0b01u);
+                const c6502_byte_t clrHi = (clrGrp >> offInGrp * 2u) & 0b11u;
+
+                // Load character / attribute data
+                const c6502_word_t x = c * 8u;
+                assert(x <= 256u);
+                readCharacterLine(mem, lnData + x, charNum, fineY, ls.baBkgnd, false, false);
+                expandColor(mem, lnData + x, clrHi, PAL_BG);
             }
+
+            vramAddr = incrWrpAddrHorz(vramAddr);
         }
+    }
 
-        // Render sprites
-        if (m_st.spritesVisible)
-        {
-            c6502_byte_t sprLnData[8];
+    // Render sprites
+    if (ls.spritesVisible)
+    {
+        c6502_byte_t sprLnData[8];
 
-            // Sprites on line counter
-            int nSprites = 0;
-            const c6502_byte_t lastSpriteLine = m_st.bigSprites ? 15u : 7u;
-            for (int ns = 63; ns >= 0; ns--)
+        for (int ns = 63; ns >= 0; ns--)
+        {
+            if (!isSpriteOnLine(ls, mem, ns))
+                continue;
+
+            const auto sa = static_cast<c6502_word_t>(ns * 4u);
+            const auto y = static_cast<c6502_byte_t>(mem.readSpriteMem(sa) + 1u),
+                    nChar = mem.readSpriteMem(sa + 1),
+                    attrs = mem.readSpriteMem(sa + 2),
+                    x = mem.readSpriteMem(sa + 3);
+
+            const bool behindBg = test<5>(attrs);
+            const bool fliph = test<6>(attrs),
+                    flipv = test<7>(attrs);
+            const c6502_byte_t clrHi = attrs & 0b11u;
+
+            auto nEffChar = nChar;
+            auto nEffCharLn = ls.line - y;
+            auto baddr = ls.baSprites;
+            if (ls.bigSprites)
             {
-                const auto sa = static_cast<c6502_word_t>(ns * 4u);
-                const auto y = static_cast<c6502_byte_t>(bus().readSpriteMem(sa) + 1u),
-                        nChar = bus().readSpriteMem(sa + 1),
-                        attrs = bus().readSpriteMem(sa + 2),
-                        x = bus().readSpriteMem(sa + 3);
-
-                if (m_currLine < y || m_currLine > y + lastSpriteLine ||
-                    (!m_st.allSpritesVisible && (x >> 3) == 0))
-                    continue;
-
-                const bool behindBg = test<5>(attrs);
-                const bool fliph = test<6>(attrs),
-                        flipv = test<7>(attrs);
-                const c6502_byte_t clrHi = attrs & 0b11u;
-
-                auto nEffChar = nChar;
-                auto nEffCharLn = m_currLine - y;
-                auto baddr = m_st.baSprites;
-                if (m_st.bigSprites)
+                const auto e = nChar % 2;
+                baddr = e == 0 ? 0u : 0x1000u;
+                nEffChar = nChar - e;
+                if (nEffCharLn >= 8)
                 {
-                    const auto e = nChar % 2;
-                    baddr = e == 0 ? 0u : 0x1000u;
-                    nEffChar = nChar - e;
-                    if (nEffCharLn >= 8)
-                    {
-                        nEffChar++;
-                        nEffCharLn -= 8;
-                    }
+                    nEffChar++;
+                    nEffCharLn -= 8;
                 }
+            }
 
-                // Read symbol, parse attributes
-                readCharacterLine(sprLnData, nEffChar, nEffCharLn, baddr, fliph, flipv);
-                expandColor(sprLnData, clrHi, PAL_SPR);
+            // Read symbol, parse attributes
+            readCharacterLine(mem, sprLnData, nEffChar, nEffCharLn, baddr, fliph, flipv);
+            expandColor(mem, sprLnData, clrHi, PAL_SPR);
 
-                // Compose sprite and background data
-                for (int i = 0; i < 8; i++)
+            // Compose sprite and background data
+            for (int i = 0; i < 8; i++)
+            {
+                assert(x + ls.fineX <= 256 + 8);
+                auto &bp = lnData[x + ls.fineX + i],
+                    &sp = sprLnData[i];
+                if (sp != PPU::TRANSPARENT_PXL)
                 {
-                    assert(x + fineX <= 256 + 8);
-                    auto &bp = lnData[x + fineX + i],
-                        &sp = sprLnData[i];
-                    if (sp != TRANSPARENT_PXL)
-                    {
-                        // Sprite 0 hit test
-                        if (ns == 0 && bp != TRANSPARENT_PXL && x < 255u)
-                            m_st.sprite0 = true;
-
-                        if (!behindBg || bp == TRANSPARENT_PXL)
-                            bp = sp;
-                    }
-                }
+                    // Sprite 0 hit test
+                    if (ns == 0 && bp != PPU::TRANSPARENT_PXL && x < 255u)
+                        flags.sprite0 = true;
 
-                nSprites++;
+                    if (!behindBg || bp == PPU::TRANSPARENT_PXL)
+                        bp = sp;
+                }
             }
-            if (nSprites > 8)
-                m_st.over8sprites = true;
+
+            flags.nSprites++;
         }
     }
+}
 
-    if (enableRendering)
-        m_st.vramAddr = incrWrpAddrVert(m_st.vramAddr);
+}
 
-    assert(m_pBackend != nullptr);
-    m_pBackend->setLine(m_currLine, lnData + fineX, bus().readVideoMem(0x3F00u));
+c6502_byte_t PPU::composeLine(const LineState &ls, const VideoMemory &mem, c6502_byte_t *pColorData) noexcept
+{
+    c6502_byte_t lnData[LINE_WIDTH];
+    SpriteFlags flags;
+    ::composeLine(ls, mem, lnData, flags);
+    memcpy(pColorData, lnData + ls.fineX, PPR);
 
-    m_currLine++;
+    return mem.readVideoMem(0x3F00u);
 }
 
-void PPU::endFrame() noexcept
+void PPU::setDeferredRenderer(DeferredRenderer *pDR) noexcept
 {
-    assert(m_pBackend != nullptr);
-    m_pBackend->draw();
+    // A frame being recorded is finished with the renderer it was started with
+    if (!m_isRecording)
+    {
+        flush();
+        m_pDeferred = pDR;
+    }
 }
 
-void PPU::readCharacterLine(c6502_byte_t *line,
-                            const c6502_word_t charInd,
-                            const c6502_word_t lineInd,
-                            const c6502_word_t baseAddr,
-                            const bool fliph,
-                            const bool flipv)
-    noexcept
+void PPU::flush() noexcept
 {
-    assert(line != nullptr);
-    assert(lineInd < 8u);
+    if (m_pDeferred)
+    {
+        assert(m_pBackend != nullptr);
+        m_pDeferred->flush(*m_pBackend);
+    }
+}
 
-    const auto ba = baseAddr + charInd * 16u + (flipv ? 7u - lineInd : lineInd);
-    const auto r0 = bus().readVideoMem(ba),
-               r1 = bus().readVideoMem(ba + 8u);
-    for (c6502_word_t j = 0; j < 8; j++)
+void PPU::startFrame() noexcept
+{
+    m_currLine = 0;
+    m_st.sprite0 = false;
+    m_st.over8sprites = false;
+    m_pictureHash = 0u;
+
+    // Pre-rendering scanline emulation
+    if (m_st.backgroundVisible || m_st.spritesVisible)
+        m_st.vramAddr = m_st.tmpAddr;
+}
+
+PPU::LineState PPU::lineState() const noexcept
+{
+    LineState ls;
+    ls.line = m_currLine;
+    ls.vramAddr = m_st.vramAddr;
+    ls.fineX = m_st.fineX;
+    ls.baBkgnd = m_st.baBkgnd;
+    ls.baSprites = m_st.baSprites;
+    ls.skip = bus().getMode() == OutputMode::NTSC &&
+              (m_currLine < 8 || m_currLine > 231);
+    ls.backgroundVisible = m_st.backgroundVisible;
+    ls.fullBackgroundVisible = m_st.fullBacgroundVisible;
+    ls.spritesVisible = m_st.spritesVisible;
+    ls.allSpritesVisible = m_st.allSpritesVisible;
+    ls.bigSprites = m_st.bigSprites;
+
+    return ls;
+}
+
+void PPU::evaluateSprites(const LineState &ls) noexcept
+{
+    if (ls.skip || !ls.spritesVisible)
+        return;
+
+    const BusMemory mem { bus() };
+    SpriteFlags flags;
+    if (!m_st.sprite0 && isSpriteOnLine(ls, mem, 0))
     {
-        const auto fj = (fliph ? j : 7u - j);
-        *line++ = (((r1 >> fj) & 1u) << 1u) | ((r0 >> fj) & 1u);
+        // The hit depends on the pixels under sprite 0
+        c6502_byte_t lnData[LINE_WIDTH];
+        ::composeLine(ls, mem, lnData, flags);
+    }
+    else
+    {
+        for (int ns = 0; ns < 64; ns++)
+            if (isSpriteOnLine(ls, mem, ns))
+                flags.nSprites++;
     }
+
+    if (flags.sprite0)
+        m_st.sprite0 = true;
+    if (flags.nSprites > 8)
+        m_st.over8sprites = true;
 }
 
-void PPU::expandColor(c6502_byte_t *p,
-                      c6502_byte_t clrHi,
-                      const c6502_word_t palAddr)
-    noexcept
+void PPU::hashLine(const c6502_byte_t *pColorData, const c6502_byte_t bgColor) noexcept
 {
-    assert(p != nullptr);
+    c6502_byte_t pixels[PPR];
+    for (int i = 0; i < PPR; i++)
+        pixels[i] = static_cast<c6502_byte_t>((pColorData[i] != TRANSPARENT_PXL ? pColorData[i] : bgColor) & 0x3Fu);
+    m_pictureHash = xxhash64(pixels, sizeof(pixels), m_pictureHash);
+}
 
-    // Combine color values
-    clrHi <<= 2;
-    for (int i = 0; i < 8; i++, p++)
-        *p = *p > 0 ? bus().readVideoMem(palAddr + (*p | clrHi)) : TRANSPARENT_PXL;
+void PPU::drawNextLine(bool output) noexcept
+{
+    PERF_SCOPE(bus().perfMeter(), SECTION_PPU);
+
+    // If PPU is turned off, writing to VRAM is possible
+    const bool enableRendering = m_st.backgroundVisible || m_st.spritesVisible;
+    m_st.enableWrite = !enableRendering;
+
+    if (enableRendering)
+    {
+        // Copy bits related to horizontal position
+        constexpr c6502_word_t CPYMSK = 0b000010000011111u;
+        m_st.vramAddr &= ~CPYMSK;
+        m_st.vramAddr |= m_st.tmpAddr & CPYMSK;
+    }
+
+    const LineState ls = lineState();
+    c6502_byte_t lnData[LINE_WIDTH];
+    bool isComposed = false;
+
+    // Recording starts with the first line, so the renderer has the whole frame
+    if (output && m_pDeferred && (m_isRecording || m_currLine == 0))
+    {
+        if (!m_isRecording)
+        {
+            m_pDeferred->beginFrame(bus());
+            m_isRecording = true;
+        }
+        m_pDeferred->recordLine(ls);
+        evaluateSprites(ls);
+    }
+    else if (output)
+    {
+        SpriteFlags flags;
+        ::composeLine(ls, BusMemory { bus() }, lnData, flags);
+        isComposed = true;
+        if (flags.sprite0)
+            m_st.sprite0 = true;
+        if (flags.nSprites > 8)
+            m_st.over8sprites = true;
+
+        assert(m_pBackend != nullptr);
+        PERF_SCOPE(bus().perfMeter(), SECTION_BACKEND);
+        m_pBackend->setLine(m_currLine, lnData + ls.fineX, bus().readVideoMem(0x3F00u));
+    }
+    else
+        evaluateSprites(ls);
+
+    if (!ls.skip && ls.spritesVisible)
+        PERF_COUNT(bus().perfMeter(), spriteLines);
+
+    if (m_hashPicture)
+    {
+        if (!isComposed)
+        {
+            SpriteFlags flags;
+            ::composeLine(ls, BusMemory { bus() }, lnData, flags);
+        }
+        hashLine(lnData + ls.fineX, bus().readVideoMem(0x3F00u));
+    }
+
+    // Move to the next line the way fetching this one does
+    if (!ls.skip && ls.backgroundVisible)
+        for (int c = 0; c < 33; c++)
+            m_st.vramAddr = incrWrpAddrHorz(m_st.vramAddr);
+    if (enableRendering)
+        m_st.vramAddr = incrWrpAddrVert(m_st.vramAddr);
+
+    m_currLine++;
+}
+
+void PPU::endFrame(bool output) noexcept
+{
+    PERF_SCOPE(bus().perfMeter(), SECTION_PPU);
+
+    if (m_isRecording)
+    {
+        assert(m_pBackend != nullptr);
+        m_isRecording = false;
+        m_pDeferred->endFrame(*m_pBackend);
+    }
+    else
+    {
+        // The overlapped frame is due, whether this one has output or not
+        flush();
+        if (output)
+        {
+            assert(m_pBackend != nullptr);
+            PERF_SCOPE(bus().perfMeter(), SECTION_BACKEND);
+            m_pBackend->draw();
+        }
+    }
 }
 
 void writeBool(std::ostream &out, bool v)
@@ -0,0 +1,241 @@
+#include "audiocapture.h"
+#include "log.h"
+
+#include <cstring>
+
+constexpr uint AudioCapture::MAX_FRAME_CLOCKS;
+
+// WAVE_FORMAT_IEEE_FLOAT header with the "fact" chunk, 58 bytes
+static constexpr uint WAV_HEADER_SIZE = 58u;
+
+static void putLE(char *p, uint32_t v, uint nBytes) noexcept
+{
+    for (uint i = 0u; i < nBytes; i++)
+        p[i] = static_cast<char>((v >> (i * 8u)) & 0xFFu);
+}
+
+void AudioCapture::Track::open(const std::string &fileName, uint sampleRate, Format fmt)
+{
+    m_out.open(fileName, std::ios_base::out | std::ios_base::binary | std::ios_base::trunc);
+    if (!m_out)
+        throw Exception { Exception::IOFailure, "failed to create audio capture file" };
+
+    m_fmt = fmt;
+    m_sampleRate = sampleRate;
+    m_nSamples = m_nUnpatched = 0u;
+    if (m_fmt == Format::WAV)
+        writeHeader();
+}
+
+void AudioCapture::Track::writeHeader()
+{
+    const uint32_t dataSize = m_nSamples * sizeof(float);
+
+    char h[WAV_HEADER_SIZE];
+    memcpy(h, "RIFF", 4);
+    putLE(h + 4, WAV_HEADER_SIZE - 8u + dataSize, 4);
+    memcpy(h + 8, "WAVEfmt ", 8);
+    putLE(h + 16, 18u, 4);                          // fmt chunk size
+    putLE(h + 20, 3u, 2);                           // WAVE_FORMAT_IEEE_FLOAT
+    putLE(h + 22, 1u, 2);                           // mono
+    putLE(h + 24, m_sampleRate, 4);
+    putLE(h + 28, m_sampleRate * sizeof(float), 4); // byte rate
+    putLE(h + 32, sizeof(float), 2);                // block align
+    putLE(h + 34, 32u, 2);                          // bits per sample
+    putLE(h + 36, 0u, 2);                           // no extension
+    memcpy(h + 38, "fact", 4);
+    putLE(h + 42, 4u, 4);
+    putLE(h + 46, m_nSamples, 4);
+    memcpy(h + 50, "data", 4);
+    putLE(h + 54, dataSize, 4);
+
+    const auto pos = m_out.tellp();
+    m_out.seekp(0);
+    m_out.write(h, WAV_HEADER_SIZE);
+    if (pos > 0)
+        m_out.seekp(pos);
+    m_nUnpatched = 0u;
+}
+
+void AudioCapture::Track::write(const float *pSamples, uint n)
+{
+    // Samples are stored in the host byte order, which is little endian on all supported targets
+    m_out.write(reinterpret_cast<const char*>(pSamples), n * sizeof(float));
+    m_nSamples += n;
+    m_nUnpatched += n;
+
+    // Keep the file playable even if the process dies: patch the header every second of audio
+    if (m_fmt == Format::WAV && m_nUnpatched >= m_sampleRate)
+        writeHeader();
+
+    if (!m_out)
+        throw Exception { Exception::IOFailure, "failed to write audio capture file" };
+}
+
+void AudioCapture::Track::close()
+{
+    if (!m_out.is_open())
+        return;
+
+    if (m_fmt == Format::WAV)
+        writeHeader();
+    m_out.close();
+}
+
+AudioCapture::~AudioCapture()
+{
+    stop();
+}
+
+const char *AudioCapture::streamName(Stream s) noexcept
+{
+    static const char *const names[STREAM_COUNT] = {
+        "pulse1",
+        "pulse2",
+        "triangle",
+        "noise",
+        "dmc",
+        "mix"
+    };
+    assert(s < STREAM_COUNT);
+    return names[s];
+}
+
+void AudioCapture::start(const std::string &prefix, uint sampleRate, Format fmt)
+{
+    if (m_running)
+        throw Exception { Exception::IllegalOperation, "audio capture is already running" };
+    if (sampleRate == 0u)
+        throw Exception { Exception::IllegalArgument, "sample rate must be positive" };
+
+    const char *ext = fmt == Format::WAV ? ".wav" : ".raw";
+    for (uint s = 0u; s < STREAM_COUNT; s++)
+    {
+        try
+        {
+            m_tracks[s].open(prefix + "_" + streamName(static_cast<Stream>(s)) + ext, sampleRate, fmt);
+        }
+        catch (...)
+        {
+            for (uint i = 0u; i < s; i++)
+                m_tracks[i].close();
+            throw;
+        }
+    }
+
+    m_sampleRate = sampleRate;
+    m_failed = false;
+    m_nDropped = 0u;
+    m_running = true;
+    m_slots.start(2u, [this](const Slot &slot) { processSlot(slot); });
+
+    Log::i("Audio capture started: %s_*%s, %u Hz", prefix.c_str(), ext, sampleRate);
+}
+
+void AudioCapture::stop()
+{
+    if (!m_running)
+        return;
+
+    m_slots.stop();
+
+    for (auto &t: m_tracks)
+        t.close();
+    m_running = false;
+
+    if (m_failed)
+        Log::e("Audio capture failed: %s", m_error.c_str());
+    if (m_nDropped > 0u)
+        Log::w("Audio capture dropped %u frames", m_nDropped.load());
+}
+
+void AudioCapture::submit(const LevelStream &ls, uint nClocks, uint clockRate) noexcept
+{
+    assert(nClocks <= ls.capacity());
+    if (!m_running || m_failed)
+        return;
+
+    Slot *pSlot = nClocks <= MAX_FRAME_CLOCKS ? m_slots.acquire() : nullptr;
+    if (!pSlot)
+    {
+        m_nDropped++;
+        return;
+    }
+
+    for (uint c = 0u; c < LevelStream::CHANNEL_COUNT; c++)
+        memcpy(pSlot->levels[c], ls.channel(static_cast<LevelStream::Channel>(c)), nClocks);
+    pSlot->nClocks = nClocks;
+    pSlot->clockRate = clockRate;
+    m_slots.publish();
+}
+
+void AudioCapture::processSlot(const Slot &slot) noexcept
+{
+    if (m_failed)
+        return;
+
+    try
+    {
+        writeSlot(slot);
+    }
+    catch (const Exception &ex)
+    {
+        m_error = ex.message();
+        m_failed = true;
+    }
+}
+
+void AudioCapture::writeSlot(const Slot &slot)
+{
+    const uint n = slot.nClocks;
+    if (m_inBuf.size() < n)
+        m_inBuf.resize(n);
+
+    const auto *p1 = slot.levels[LevelStream::PULSE1],
+               *p2 = slot.levels[LevelStream::PULSE2],
+               *tri = slot.levels[LevelStream::TRIANGLE],
+               *nois = slot.levels[LevelStream::NOISE],
+               *dmc = slot.levels[LevelStream::DMC];
+
+    for (uint s = 0u; s < STREAM_COUNT; s++)
+    {
+        // Each channel is scaled the same way it contributes to the mix
+        float *pIn = m_inBuf.data();
+        switch (s)
+        {
+            case PULSE1:
+                for (uint i = 0u; i < n; i++)
+                    pIn[i] = Mixer::pulse(p1[i]);
+                break;
+            case PULSE2:
+                for (uint i = 0u; i < n; i++)
+                    pIn[i] = Mixer::pulse(p2[i]);
+                break;
+            case TRIANGLE:
+                for (uint i = 0u; i < n; i++)
+                    pIn[i] = Mixer::tnd(3u * tri[i]);
+                break;
+            case NOISE:
+                for (uint i = 0u; i < n; i++)
+                    pIn[i] = Mixer::tnd(2u * nois[i]);
+                break;
+            case DMC:
+                for (uint i = 0u; i < n; i++)
+                    pIn[i] = Mixer::tnd(dmc[i]);
+                break;
+            case MIX:
+                for (uint i = 0u; i < n; i++)
+                    pIn[i] = Mixer::pulse(p1[i] + p2[i]) +
+                             Mixer::tnd(3u * tri[i] + 2u * nois[i] + dmc[i]);
+                break;
+        }
+
+        auto &rs = m_resamplers[s];
+        rs.setRates(slot.clockRate, m_sampleRate);
+        const auto maxOut = rs.maxOutput(n);
+        if (m_outBuf.size() < maxOut)
+            m_outBuf.resize(maxOut);
+        const auto nOut = rs.process(pIn, n, m_outBuf.data());
+        m_tracks[s].write(m_outBuf.data(), nOut);
+    }
+}
@@ -0,0 +1,1043 @@
+#include "batchcpu.h"
+#include "PPU.h"
+#include "APU.h"
+#include "Cartridge.h"
+
+#include <array>
+#include <cassert>
+#include <cstring>
+
+constexpr uint BatchCPU::LANES;
+
+enum class BatchCPU::Op: uint8_t
+{
+    SCALAR,
+    // Loads and arithmetic
+    LDA, LDX, LDY, ADC, SBC, AND, ORA, EOR, CMP, CPX, CPY, BIT,
+    // Stores
+    STA, STX, STY,
+    // Read-modify-write, on memory or the accumulator
+    ASL, LSR, ROL, ROR, INC, DEC,
+    // Registers and flags
+    INX, INY, DEX, DEY, TAX, TAY, TXA, TYA, TSX, TXS,
+    CLC, SEC, CLI, SEI, CLD, SED, CLV, NOP,
+    // Control flow and stack
+    BPL, BMI, BVC, BVS, BCC, BCS, BNE, BEQ,
+    JMP, JSR, RTS, PHA, PLA, PHP, PLP
+};
+
+// Data access of an instruction, decides whether the lanes can do it
+enum Access: uint8_t
+{
+    ACCESS_NONE,
+    ACCESS_READ,
+    ACCESS_WRITE,
+    ACCESS_MODIFY
+};
+
+struct BatchCPU::Decoded
+{
+    Op op;
+    AM mode;
+    uint8_t length;     // operand bytes
+    Access access;
+    int tacts;
+    bool usePenalty;
+};
+
+// Status register bits
+static constexpr c6502_byte_t FLAG_C = 0x01u,
+                              FLAG_Z = 0x02u,
+                              FLAG_I = 0x04u,
+                              FLAG_D = 0x08u,
+                              FLAG_V = 0x40u,
+                              FLAG_N = 0x80u;
+
+// Lane helpers, written without branches so the loops over lanes vectorize
+static inline c6502_byte_t blend(c6502_byte_t mask, c6502_byte_t v, c6502_byte_t old) noexcept
+{
+    return static_cast<c6502_byte_t>((v & mask) | (old & ~mask));
+}
+
+static inline c6502_byte_t evalNZ(c6502_byte_t p, c6502_byte_t v) noexcept
+{
+    return static_cast<c6502_byte_t>((p & ~(FLAG_N | FLAG_Z)) | (v & FLAG_N) | (v == 0u ? FLAG_Z : 0u));
+}
+
+#define FOR_LANES for (uint l = 0u; l < LANES; l++)
+
+const BatchCPU::Decoded *BatchCPU::decodeTable() noexcept
+{
+    // Timings come from the CPU6502 table, which is filled by the first CPU constructed
+    static const std::array<Decoded, 0x100> table = []
+    {
+        std::array<Decoded, 0x100> t;
+        t.fill({ Op::SCALAR, AM::DEF, 0u, ACCESS_NONE, 0, false });
+
+        auto decoded = [](Op op, AM mode, int opcode) noexcept
+        {
+            Decoded d;
+            d.op = op;
+            d.mode = mode;
+            switch (mode)
+            {
+                case AM::ACC:
+                case AM::DEF:
+                    d.length = 0u;
+                    break;
+                case AM::ABS:
+                case AM::ABS_X:
+                case AM::ABS_Y:
+                case AM::IND:
+                    d.length = 2u;
+                    break;
+                default:
+                    d.length = 1u;
+            }
+
+            if (mode == AM::ACC || mode == AM::DEF || mode == AM::IMM || op == Op::JMP || op == Op::JSR)
+                d.access = ACCESS_NONE;
+            else if (op == Op::STA || op == Op::STX || op == Op::STY)
+                d.access = ACCESS_WRITE;
+            else if (op >= Op::ASL && op <= Op::DEC)
+                d.access = ACCESS_MODIFY;
+            else
+                d.access = ACCESS_READ;
+
+            std::tie(std::ignore, d.tacts, d.usePenalty) = CPU6502::s_opHandlers[opcode];
+            assert(d.tacts > 0);
+            return d;
+        };
+
+#define BIND_OP(name, am, opcode) \
+        t[(opcode)] = decoded(Op::name, AM::am, (opcode));
+
+        // Branches take their displacement like an immediate operand
+        BIND_OP(BPL, IMM,   0x10)
+        BIND_OP(BMI, IMM,   0x30)
+        BIND_OP(BVC, IMM,   0x50)
+        BIND_OP(BVS, IMM,   0x70)
+        BIND_OP(BCC, IMM,   0x90)
+        BIND_OP(BCS, IMM,   0xB0)
+        BIND_OP(BNE, IMM,   0xD0)
+        BIND_OP(BEQ, IMM,   0xF0)
+        // ADC
+        BIND_OP(ADC, IMM,   0x69)
+        BIND_OP(ADC, ZP,    0x65)
+        BIND_OP(ADC, ZP_X,  0x75)
+        BIND_OP(ADC, ABS,   0x6D)
+        BIND_OP(ADC, ABS_X, 0x7D)
+        BIND_OP(ADC, ABS_Y, 0x79)
+        BIND_OP(ADC, IND_X, 0x61)
+        BIND_OP(ADC, IND_Y, 0x71)
+        // AND
+        BIND_OP(AND, IMM,   0x29)
+        BIND_OP(AND, ZP,    0x25)
+        BIND_OP(AND, ZP_X,  0x35)
+        BIND_OP(AND, ABS,   0x2D)
+        BIND_OP(AND, ABS_X, 0x3D)
+        BIND_OP(AND, ABS_Y, 0x39)
+        BIND_OP(AND, IND_X, 0x21)
+        BIND_OP(AND, IND_Y, 0x31)
+        // ASL
+        BIND_OP(ASL, ACC,   0x0A)
+        BIND_OP(ASL, ZP,    0x06)
+        BIND_OP(ASL, ZP_X,  0x16)
+        BIND_OP(ASL, ABS,   0x0E)
+        BIND_OP(ASL, ABS_X, 0x1E)
+        // BIT
+        BIND_OP(BIT, ZP,    0x24)
+        BIND_OP(BIT, ABS,   0x2C)
+        // Flags
+        BIND_OP(CLC, DEF,   0x18)
+        BIND_OP(CLD, DEF,   0xD8)
+        BIND_OP(CLI, DEF,   0x58)
+        BIND_OP(CLV, DEF,   0xB8)
+        BIND_OP(SEC, DEF,   0x38)
+        BIND_OP(SED, DEF,   0xF8)
+        BIND_OP(SEI, DEF,   0x78)
+        // CMP
+        BIND_OP(CMP, IMM,   0xC9)
+        BIND_OP(CMP, ZP,    0xC5)
+        BIND_OP(CMP, ZP_X,  0xD5)
+        BIND_OP(CMP, ABS,   0xCD)
+        BIND_OP(CMP, ABS_X, 0xDD)
+        BIND_OP(CMP, ABS_Y, 0xD9)
+        BIND_OP(CMP, IND_X, 0xC1)
+        BIND_OP(CMP, IND_Y, 0xD1)
+        // CPX
+        BIND_OP(CPX, IMM,   0xE0)
+        BIND_OP(CPX, ZP,    0xE4)
+        BIND_OP(CPX, ABS,   0xEC)
+        // CPY
+        BIND_OP(CPY, IMM,   0xC0)
+        BIND_OP(CPY, ZP,    0xC4)
+        BIND_OP(CPY, ABS,   0xCC)
+        // DEC
+        BIND_OP(DEC, ZP,    0xC6)
+        BIND_OP(DEC, ZP_X,  0xD6)
+        BIND_OP(DEC, ABS,   0xCE)
+        BIND_OP(DEC, ABS_X, 0xDE)
+        // Index registers
+        BIND_OP(DEX, DEF,   0xCA)
+        BIND_OP(DEY, DEF,   0x88)
+        BIND_OP(INX, DEF,   0xE8)
+        BIND_OP(INY, DEF,   0xC8)
+        // EOR
+        BIND_OP(EOR, IMM,   0x49)
+        BIND_OP(EOR, ZP,    0x45)
+        BIND_OP(EOR, ZP_X,  0x55)
+        BIND_OP(EOR, ABS,   0x4D)
+        BIND_OP(EOR, ABS_X, 0x5D)
+        BIND_OP(EOR, ABS_Y, 0x59)
+        BIND_OP(EOR, IND_X, 0x41)
+        BIND_OP(EOR, IND_Y, 0x51)
+        // INC
+        BIND_OP(INC, ZP,    0xE6)
+        BIND_OP(INC, ZP_X,  0xF6)
+        BIND_OP(INC, ABS,   0xEE)
+        BIND_OP(INC, ABS_X, 0xFE)
+        // JMP (indirect is left to the CPU), JSR, RTS
+        BIND_OP(JMP, ABS,   0x4C)
+        BIND_OP(JSR, ABS,   0x20)
+        BIND_OP(RTS, DEF,   0x60)
+        // LDA
+        BIND_OP(LDA, IMM,   0xA9)
+        BIND_OP(LDA, ZP,    0xA5)
+        BIND_OP(LDA, ZP_X,  0xB5)
+        BIND_OP(LDA, ABS,   0xAD)
+        BIND_OP(LDA, ABS_X, 0xBD)
+        BIND_OP(LDA, ABS_Y, 0xB9)
+        BIND_OP(LDA, IND_X, 0xA1)
+        BIND_OP(LDA, IND_Y, 0xB1)
+        // LDX
+        BIND_OP(LDX, IMM,   0xA2)
+        BIND_OP(LDX, ZP,    0xA6)
+        BIND_OP(LDX, ZP_Y,  0xB6)
+        BIND_OP(LDX, ABS,   0xAE)
+        BIND_OP(LDX, ABS_Y, 0xBE)
+        // LDY
+        BIND_OP(LDY, IMM,   0xA0)
+        BIND_OP(LDY, ZP,    0xA4)
+        BIND_OP(LDY, ZP_X,  0xB4)
+        BIND_OP(LDY, ABS,   0xAC)
+        BIND_OP(LDY, ABS_X, 0xBC)
+        // LSR
+        BIND_OP(LSR, ACC,   0x4A)
+        BIND_OP(LSR, ZP,    0x46)
+        BIND_OP(LSR, ZP_X,  0x56)
+        BIND_OP(LSR, ABS,   0x4E)
+        BIND_OP(LSR, ABS_X, 0x5E)
+        // NOP
+        BIND_OP(NOP, DEF,   0xEA)
+        // ORA
+        BIND_OP(ORA, IMM,   0x09)
+        BIND_OP(ORA, ZP,    0x05)
+        BIND_OP(ORA, ZP_X,  0x15)
+        BIND_OP(ORA, ABS,   0x0D)
+        BIND_OP(ORA, ABS_X, 0x1D)
+        BIND_OP(ORA, ABS_Y, 0x19)
+        BIND_OP(ORA, IND_X, 0x01)
+        BIND_OP(ORA, IND_Y, 0x11)
+        // Stack
+        BIND_OP(PHA, DEF,   0x48)
+        BIND_OP(PHP, DEF,   0x08)
+        BIND_OP(PLA, DEF,   0x68)
+        BIND_OP(PLP, DEF,   0x28)
+        // ROL
+        BIND_OP(ROL, ACC,   0x2A)
+        BIND_OP(ROL, ZP,    0x26)
+        BIND_OP(ROL, ZP_X,  0x36)
+        BIND_OP(ROL, ABS,   0x2E)
+        BIND_OP(ROL, ABS_X, 0x3E)
+        // ROR
+        BIND_OP(ROR, ACC,   0x6A)
+        BIND_OP(ROR, ZP,    0x66)
+        BIND_OP(ROR, ZP_X,  0x76)
+        BIND_OP(ROR, ABS,   0x6E)
+        BIND_OP(ROR, ABS_X, 0x7E)
+        // SBC
+        BIND_OP(SBC, IMM,   0xE9)
+        BIND_OP(SBC, ZP,    0xE5)
+        BIND_OP(SBC, ZP_X,  0xF5)
+        BIND_OP(SBC, ABS,   0xED)
+        BIND_OP(SBC, ABS_X, 0xFD)
+        BIND_OP(SBC, ABS_Y, 0xF9)
+        BIND_OP(SBC, IND_X, 0xE1)
+        BIND_OP(SBC, IND_Y, 0xF1)
+        // STA
+        BIND_OP(STA, ZP,    0x85)
+        BIND_OP(STA, ZP_X,  0x95)
+        BIND_OP(STA, ABS,   0x8D)
+        BIND_OP(STA, ABS_X, 0x9D)
+        BIND_OP(STA, ABS_Y, 0x99)
+        BIND_OP(STA, IND_X, 0x81)
+        BIND_OP(STA, IND_Y, 0x91)
+        // STX
+        BIND_OP(STX, ZP,    0x86)
+        BIND_OP(STX, ZP_Y,  0x96)
+        BIND_OP(STX, ABS,   0x8E)
+        // STY
+        BIND_OP(STY, ZP,    0x84)
+        BIND_OP(STY, ZP_X,  0x94)
+        BIND_OP(STY, ABS,   0x8C)
+        // Transfers
+        BIND_OP(TAX, DEF,   0xAA)
+        BIND_OP(TAY, DEF,   0xA8)
+        BIND_OP(TSX, DEF,   0xBA)
+        BIND_OP(TXA, DEF,   0x8A)
+        BIND_OP(TXS, DEF,   0x9A)
+        BIND_OP(TYA, DEF,   0x98)
+
+#undef BIND_OP
+
+        return t;
+    }();
+
+    return table.data();
+}
+
+// Aligned by hand like AlignedBuffer, the raw block is stored right before the object
+void *BatchCPU::operator new(size_t size)
+{
+    constexpr size_t ALIGNMENT = alignof(BatchCPU);
+    auto *pRaw = new uint8_t[size + ALIGNMENT - 1u + sizeof(uint8_t*)];
+    const auto a = reinterpret_cast<uintptr_t>(pRaw + sizeof(uint8_t*));
+    uint8_t *p = pRaw + sizeof(uint8_t*) + ((ALIGNMENT - a % ALIGNMENT) % ALIGNMENT);
+    memcpy(p - sizeof(uint8_t*), &pRaw, sizeof(uint8_t*));
+    return p;
+}
+
+void BatchCPU::operator delete(void *p) noexcept
+{
+    if (!p)
+        return;
+
+    uint8_t *pRaw;
+    memcpy(&pRaw, static_cast<uint8_t*>(p) - sizeof(uint8_t*), sizeof(uint8_t*));
+    delete[] pRaw;
+}
+
+BatchCPU::BatchCPU(Bus *const *ppBuses, uint n):
+    m_n { n }
+{
+    if (n == 0u || n > LANES)
+        throw Exception { Exception::IllegalArgument, "wrong number of lanes" };
+
+    for (uint l = 0u; l < LANES; l++)
+    {
+        Bus *pBus = l < n ? ppBuses[l] : nullptr;
+        if (pBus && pBus->getMode() != ppBuses[0]->getMode())
+            throw Exception { Exception::IllegalArgument, "lanes must have the same output mode" };
+
+        m_pBuses[l] = pBus;
+        m_pCPUs[l] = pBus ? pBus->getCPU() : nullptr;
+        m_pRAM[l] = pBus ? pBus->m_ram.data() : nullptr;
+        for (auto &p: m_pROM[l])
+            p = nullptr;
+
+        m_a[l] = m_x[l] = m_y[l] = m_s[l] = m_p[l] = 0u;
+        m_pc[l] = 0u;
+        m_cycles[l] = m_instructions[l] = 0u;
+        m_clk[l] = 0;
+        m_active[l] = false;
+        m_group[l] = 0u;
+        m_operand[l] = m_ea[l] = 0u;
+        m_val[l] = m_penalty[l] = 0u;
+    }
+
+    m_pDecode = decodeTable();
+}
+
+void BatchCPU::runFrame(uint output)
+{
+    const bool video = output & Bus::FRAME_VIDEO;
+    const float CPL = m_pBuses[0]->cyclesPerLine();
+    const int NMI_LINES = m_pBuses[0]->nmiLines();
+    const uint32_t allLanes = (1u << m_n) - 1u;
+
+    Mapper *pScanlineCounters[LANES];
+    m_traced = false;
+    for (uint l = 0u; l < m_n; l++)
+    {
+        Bus &bus = *m_pBuses[l];
+        m_traced = m_traced || m_pCPUs[l]->m_pTrace != nullptr;
+        bus.m_nFrame++;
+#ifdef ENABLE_PERF_COUNTERS
+        // Lanes count neither the RAM and ROM accesses they make themselves nor their host time
+        bus.m_perf.beginFrame(m_pCPUs[l]->m_nInstructions, m_pCPUs[l]->m_cycles);
+#endif
+        bus.m_pPPU->startFrame();
+
+        pScanlineCounters[l] = bus.m_pCart && bus.m_pCart->mapper()->hasFeature<Mapper::SCANLINE_COUNTER>() ?
+                               bus.m_pCart->mapper() :
+                               nullptr;
+        if (pScanlineCounters[l] && bus.m_pPPU->isA12Rising())
+            pScanlineCounters[l]->onA12Rise();
+    }
+
+    // Visible scanlines, every lane is split at its A12 rise like in Bus::runFrame
+    float clk[LANES];
+    for (int i = 0; i < 240; i++)
+    {
+        uint32_t splitLanes = 0u;
+        for (uint l = 0u; l < m_n; l++)
+        {
+            PPU &ppu = *m_pBuses[l]->m_pPPU;
+            ppu.drawNextLine(video);
+
+            if (pScanlineCounters[l] && ppu.isA12Rising())
+            {
+                clk[l] = ppu.a12RiseDot() * CPL / PPU::DOTS_PER_LINE;
+                splitLanes |= 1u << l;
+            }
+            else
+                clk[l] = CPL;
+        }
+
+        runCPUs(clk, allLanes);
+
+        if (splitLanes != 0u)
+        {
+            for (uint l = 0u; l < m_n; l++)
+            {
+                if (splitLanes & (1u << l))
+                {
+                    pScanlineCounters[l]->onA12Rise();
+                    clk[l] = CPL - clk[l];
+                }
+            }
+            runCPUs(clk, splitLanes);
+        }
+    }
+
+    for (uint l = 0u; l < m_n; l++)
+    {
+        Bus &bus = *m_pBuses[l];
+        bus.m_pPPU->endFrame(video);
+        bus.m_pPPU->onBeginVblank();
+        if (bus.m_pPPU->isNMIEnabled())
+            bus.triggerNMI();
+    }
+
+    for (uint l = 0u; l < m_n; l++)
+        clk[l] = CPL;
+    for (int i = 0; i < NMI_LINES; i++)
+        runCPUs(clk, allLanes);
+
+    for (uint l = 0u; l < m_n; l++)
+    {
+        Bus &bus = *m_pBuses[l];
+        bus.m_pPPU->onEndVblank();
+        bus.m_pAPU->runFrame(output & Bus::FRAME_AUDIO);
+        if (bus.m_hashed != Bus::HASH_NONE)
+            bus.hashFrame();
+#ifdef ENABLE_PERF_COUNTERS
+        bus.m_perf.endFrame(m_pCPUs[l]->m_nInstructions, m_pCPUs[l]->m_cycles);
+#endif
+    }
+}
+
+void BatchCPU::runCPUs(const float *clk, uint32_t laneMask) noexcept
+{
+    float lc[LANES];
+    int clkStart[LANES];
+    for (uint l = 0u; l < m_n; l++)
+    {
+        m_active[l] = (laneMask & (1u << l)) != 0u;
+        if (!m_active[l])
+            continue;
+
+        lc[l] = clk[l] + m_pBuses[l]->m_remClk;
+        clkStart[l] = m_clk[l] = static_cast<int>(lc[l]);
+        assert(m_clk[l] > 0);
+        loadLane(l);
+        updateBanks(l);
+
+        // Halted or failed CPU ends the run at once, logging as usual
+        if (m_pCPUs[l]->m_state != CPU6502::STATE_RUN)
+            stepScalar(l);
+    }
+
+    for (;;)
+    {
+        // The lane furthest behind goes first, lanes at its PC go along
+        int leader = -1,
+            maxClk = -1;
+        for (uint l = 0u; l < m_n; l++)
+        {
+            if (m_active[l] && m_clk[l] > maxClk)
+            {
+                maxClk = m_clk[l];
+                leader = static_cast<int>(l);
+            }
+        }
+        if (leader < 0)
+            break;
+
+        stepGroup(static_cast<uint>(leader));
+    }
+
+    for (uint l = 0u; l < m_n; l++)
+    {
+        if (laneMask & (1u << l))
+        {
+            storeLane(l);
+            m_pBuses[l]->m_remClk = lc[l] - (clkStart[l] - m_clk[l]);
+        }
+    }
+}
+
+// Lanes only access the internal RAM and read the cartridge, the rest goes through the CPU
+static inline bool isLaneAccess(Access access, c6502_word_t ea) noexcept
+{
+    return ea < 0x2000u || (access == ACCESS_READ && ea >= 0x6000u);
+}
+
+void BatchCPU::stepGroup(const uint leader) noexcept
+{
+    const c6502_word_t pc = m_pc[leader];
+    auto irqPending = [this](uint l) noexcept
+    {
+        return m_cycles[l] >= m_pBuses[l]->nextIRQCycle() && (m_p[l] & FLAG_I) == 0u;
+    };
+
+    // Code is never fetched ahead from the registers of the PPU, APU and pads
+    if ((pc >= 0x2000u && pc < 0x6000u) || irqPending(leader))
+        return stepScalar(leader);
+
+    const c6502_byte_t opcode = readLane(leader, pc);
+    const Decoded &d = m_pDecode[opcode];
+    if (d.op == Op::SCALAR)
+        return stepScalar(leader);
+
+    const c6502_word_t next = static_cast<c6502_word_t>(pc + 1u + d.length);
+    c6502_word_t operand = 0u;
+    if (d.length > 0u)
+        operand = readLane(leader, static_cast<c6502_word_t>(pc + 1u));
+    if (d.length > 1u)
+        operand |= static_cast<c6502_word_t>(readLane(leader, static_cast<c6502_word_t>(pc + 2u)) << 8u);
+
+    // Registers are mostly accessed with absolute addresses, the group is run by the CPUs then
+    const bool isRegister = d.mode == AM::ABS && d.access != ACCESS_NONE && !isLaneAccess(d.access, operand);
+
+    // Lanes at the same PC with the same code form the group. Lanes with the same
+    // ROM page mapped there (shared image) share the instruction bytes, the others read them.
+    const c6502_byte_t *pPage = pc >= 0x8000u && (pc & 0x1FFFu) + d.length <= 0x1FFFu ?
+                                m_pROM[leader][(pc >> 13u) & 0b11u] :
+                                nullptr;
+    const int maxClk = d.tacts + (d.usePenalty ? 2 : 0);
+    uint nGroup = 0u;
+    for (uint l = 0u; l < m_n; l++)
+    {
+        m_group[l] = 0u;
+        if (!m_active[l] || m_pc[l] != pc || irqPending(l))
+            continue;
+
+        if (l == leader || (pPage && m_pROM[l][(pc >> 13u) & 0b11u] == pPage))
+            m_operand[l] = operand;
+        else if (readLane(l, pc) == opcode)
+        {
+            m_operand[l] = 0u;
+            if (d.length > 0u)
+                m_operand[l] = readLane(l, static_cast<c6502_word_t>(pc + 1u));
+            if (d.length > 1u)
+                m_operand[l] |= static_cast<c6502_word_t>(readLane(l, static_cast<c6502_word_t>(pc + 2u)) << 8u);
+        }
+        else
+            continue;
+
+        // The instruction doesn't fit, the run of the lane is over
+        if (m_clk[l] < maxClk)
+        {
+            m_active[l] = false;
+            continue;
+        }
+
+        m_group[l] = 0xFFu;
+        nGroup++;
+    }
+    if (nGroup == 0u)
+        return;
+
+    if (isRegister)
+    {
+        for (uint l = 0u; l < m_n; l++)
+            if (m_group[l])
+                stepScalar(l, operand < 0x6000u);
+        return;
+    }
+
+    // Effective addresses; pointers of the indirect modes are in the zero page
+    switch (d.mode)
+    {
+        case AM::ZP_X:
+            FOR_LANES
+                m_ea[l] = (m_operand[l] + m_x[l]) & 0xFFu;
+            break;
+        case AM::ZP_Y:
+            FOR_LANES
+                m_ea[l] = (m_operand[l] + m_y[l]) & 0xFFu;
+            break;
+        case AM::ABS_X:
+        case AM::ABS_Y:
+        {
+            const c6502_byte_t *index = d.mode == AM::ABS_X ? m_x : m_y;
+            FOR_LANES
+            {
+                const c6502_byte_t penalty = (m_operand[l] & 0xFFu) + index[l] > 0xFFu ? 1u : 0u;
+                m_ea[l] = static_cast<c6502_word_t>(m_operand[l] + index[l]);
+                m_penalty[l] = blend(m_group[l], penalty, m_penalty[l]);
+            }
+            break;
+        }
+        case AM::IND_X:
+        case AM::IND_Y:
+            for (uint l = 0u; l < m_n; l++)
+            {
+                if (!m_group[l])
+                    continue;
+
+                const c6502_byte_t *ram = m_pRAM[l];
+                const c6502_word_t base = d.mode == AM::IND_X ? (m_operand[l] + m_x[l]) & 0xFFu : m_operand[l],
+                                   ptr = combine(ram[base], ram[(base + 1u) & 0xFFu]);
+                if (d.mode == AM::IND_X)
+                    m_ea[l] = ptr;
+                else
+                {
+                    m_penalty[l] = (ptr & 0xFFu) + m_y[l] > 0xFFu ? 1u : 0u;
+                    m_ea[l] = static_cast<c6502_word_t>(ptr + m_y[l]);
+                }
+            }
+            break;
+        default:
+            FOR_LANES
+                m_ea[l] = m_operand[l];
+    }
+
+    // Instructions set the penalty only with these modes, otherwise it's cleared
+    if (d.mode != AM::ABS_X && d.mode != AM::ABS_Y && d.mode != AM::IND_Y)
+    {
+        FOR_LANES
+            m_penalty[l] = blend(m_group[l], 0u, m_penalty[l]);
+    }
+
+    if (d.access != ACCESS_NONE)
+    {
+        for (uint l = 0u; l < m_n; l++)
+        {
+            if (!m_group[l])
+                continue;
+
+            if (!isLaneAccess(d.access, m_ea[l]))
+            {
+                m_group[l] = 0u;
+                nGroup--;
+                stepScalar(l);
+            }
+            else if (d.access != ACCESS_WRITE)
+                m_val[l] = readLane(l, m_ea[l]);
+        }
+        if (nGroup == 0u)
+            return;
+    }
+    else if (d.mode == AM::IMM)
+    {
+        FOR_LANES
+            m_val[l] = static_cast<c6502_byte_t>(m_operand[l]);
+    }
+
+    FOR_LANES
+        m_pc[l] = m_group[l] ? next : m_pc[l];
+
+    execute(d);
+
+    if (d.access == ACCESS_WRITE || d.access == ACCESS_MODIFY)
+    {
+        for (uint l = 0u; l < m_n; l++)
+            if (m_group[l])
+                m_pRAM[l][m_ea[l] & 0x7FFu] = m_val[l];
+    }
+
+    FOR_LANES
+    {
+        const int spent = m_group[l] ? d.tacts + (d.usePenalty ? m_penalty[l] : 0) : 0;
+        m_clk[l] -= spent;
+        m_cycles[l] += static_cast<uint64_t>(spent);
+        m_instructions[l] += m_group[l] & 1u;
+    }
+
+    // Lanes that left the group were traced by their CPUs
+    if (m_traced)
+    {
+        for (uint l = 0u; l < m_n; l++)
+        {
+            std::vector<CPU6502::TraceEntry> *pTrace = m_pCPUs[l]->m_pTrace;
+            if (m_group[l] && pTrace)
+            {
+                const int spent = d.tacts + (d.usePenalty ? m_penalty[l] : 0);
+                pTrace->push_back({ m_cycles[l] - static_cast<uint64_t>(spent), pc, CPU6502::TRACE_STEP,
+                                    { m_a[l], m_x[l], m_y[l], m_s[l], m_p[l], m_pc[l] } });
+            }
+        }
+    }
+
+    m_stats.groupSteps++;
+    m_stats.laneSteps += nGroup;
+}
+
+void BatchCPU::execute(const Decoded &d) noexcept
+{
+    switch (d.op)
+    {
+        case Op::LDA:
+            FOR_LANES
+            {
+                const c6502_byte_t m = m_group[l], v = m_val[l];
+                m_a[l] = blend(m, v, m_a[l]);
+                m_p[l] = blend(m, evalNZ(m_p[l], v), m_p[l]);
+            }
+            break;
+        case Op::LDX:
+            FOR_LANES
+            {
+                const c6502_byte_t m = m_group[l], v = m_val[l];
+                m_x[l] = blend(m, v, m_x[l]);
+                m_p[l] = blend(m, evalNZ(m_p[l], v), m_p[l]);
+            }
+            break;
+        case Op::LDY:
+            FOR_LANES
+            {
+                const c6502_byte_t m = m_group[l], v = m_val[l];
+                m_y[l] = blend(m, v, m_y[l]);
+                m_p[l] = blend(m, evalNZ(m_p[l], v), m_p[l]);
+            }
+            break;
+        case Op::ADC:
+            FOR_LANES
+            {
+                const uint a = m_a[l], op = m_val[l],
+                           r = op + a + (m_p[l] & FLAG_C);
+                const c6502_byte_t br = static_cast<c6502_byte_t>(r);
+                c6502_byte_t p = evalNZ(m_p[l], br) & ~(FLAG_C | FLAG_V);
+                p |= (r > 0xFFu ? FLAG_C : 0u) |
+                     (((a ^ op) & 0x80u) == 0u && ((a ^ r) & 0x80u) != 0u ? FLAG_V : 0u);
+                m_a[l] = blend(m_group[l], br, m_a[l]);
+                m_p[l] = blend(m_group[l], p, m_p[l]);
+            }
+            break;
+        case Op::SBC:
+            FOR_LANES
+            {
+                const uint a = m_a[l], op = m_val[l],
+                           r = a - op - ((m_p[l] & FLAG_C) ^ 1u);
+                const c6502_byte_t br = static_cast<c6502_byte_t>(r);
+                c6502_byte_t p = evalNZ(m_p[l], br) & ~(FLAG_C | FLAG_V);
+                p |= (r < 0x100u ? FLAG_C : 0u) |
+                     (((a ^ r) & 0x80u) != 0u && ((a ^ op) & 0x80u) != 0u ? FLAG_V : 0u);
+                m_a[l] = blend(m_group[l], br, m_a[l]);
+                m_p[l] = blend(m_group[l], p, m_p[l]);
+            }
+            break;
+        case Op::AND:
+            FOR_LANES
+            {
+                const c6502_byte_t m = m_group[l], v = m_a[l] & m_val[l];
+                m_a[l] = blend(m, v, m_a[l]);
+                m_p[l] = blend(m, evalNZ(m_p[l], v), m_p[l]);
+            }
+            break;
+        case Op::ORA:
+            FOR_LANES
+            {
+                const c6502_byte_t m = m_group[l], v = m_a[l] | m_val[l];
+                m_a[l] = blend(m, v, m_a[l]);
+                m_p[l] = blend(m, evalNZ(m_p[l], v), m_p[l]);
+            }
+            break;
+        case Op::EOR:
+            FOR_LANES
+            {
+                const c6502_byte_t m = m_group[l], v = m_a[l] ^ m_val[l];
+                m_a[l] = blend(m, v, m_a[l]);
+                m_p[l] = blend(m, evalNZ(m_p[l], v), m_p[l]);
+            }
+            break;
+        case Op::CMP:
+        case Op::CPX:
+        case Op::CPY:
+        {
+            const c6502_byte_t *reg = d.op == Op::CMP ? m_a : d.op == Op::CPX ? m_x : m_y;
+            FOR_LANES
+            {
+                const uint r = static_cast<uint>(reg[l]) - m_val[l];
+                c6502_byte_t p = evalNZ(m_p[l], static_cast<c6502_byte_t>(r)) & ~FLAG_C;
+                p |= r < 0x100u ? FLAG_C : 0u;
+                m_p[l] = blend(m_group[l], p, m_p[l]);
+            }
+            break;
+        }
+        case Op::BIT:
+            FOR_LANES
+            {
+                const c6502_byte_t v = m_val[l],
+                                   p = (m_p[l] & ~(FLAG_N | FLAG_V | FLAG_Z)) |
+                                       (v & (FLAG_N | FLAG_V)) |
+                                       ((m_a[l] & v) == 0u ? FLAG_Z : 0u);
+                m_p[l] = blend(m_group[l], p, m_p[l]);
+            }
+            break;
+        case Op::STA:
+            FOR_LANES
+                m_val[l] = m_a[l];
+            break;
+        case Op::STX:
+            FOR_LANES
+                m_val[l] = m_x[l];
+            break;
+        case Op::STY:
+            FOR_LANES
+                m_val[l] = m_y[l];
+            break;
+        case Op::ASL:
+        case Op::LSR:
+        case Op::ROL:
+        case Op::ROR:
+        case Op::INC:
+        case Op::DEC:
+        {
+            // Accumulator or the value read from memory, written back by the caller
+            c6502_byte_t *dst = d.mode == AM::ACC ? m_a : m_val;
+            FOR_LANES
+            {
+                const uint v = dst[l], c = m_p[l] & FLAG_C;
+                uint r = v, carry = c;
+                switch (d.op)
+                {
+                    case Op::ASL:
+                        r = v << 1u;
+                        carry = v >> 7u;
+                        break;
+                    case Op::LSR:
+                        r = v >> 1u;
+                        carry = v & 1u;
+                        break;
+                    case Op::ROL:
+                        r = (v << 1u) | c;
+                        carry = v >> 7u;
+                        break;
+                    case Op::ROR:
+                        r = (v >> 1u) | (c << 7u);
+                        carry = v & 1u;
+                        break;
+                    case Op::INC:
+                        r = v + 1u;
+                        break;
+                    default:
+                        r = v - 1u;
+                }
+                const c6502_byte_t br = static_cast<c6502_byte_t>(r),
+                                   p = static_cast<c6502_byte_t>((evalNZ(m_p[l], br) & ~FLAG_C) | carry);
+                dst[l] = blend(m_group[l], br, dst[l]);
+                m_p[l] = blend(m_group[l], p, m_p[l]);
+            }
+            break;
+        }
+        case Op::INX:
+        case Op::DEX:
+        case Op::INY:
+        case Op::DEY:
+        {
+            c6502_byte_t *reg = d.op == Op::INX || d.op == Op::DEX ? m_x : m_y;
+            const c6502_byte_t inc = d.op == Op::INX || d.op == Op::INY ? 1u : 0xFFu;
+            FOR_LANES
+            {
+                const c6502_byte_t m = m_group[l], v = static_cast<c6502_byte_t>(reg[l] + inc);
+                reg[l] = blend(m, v, reg[l]);
+                m_p[l] = blend(m, evalNZ(m_p[l], v), m_p[l]);
+            }
+            break;
+        }
+        case Op::TAX:
+        case Op::TAY:
+        case Op::TXA:
+        case Op::TYA:
+        case Op::TSX:
+        {
+            const c6502_byte_t *src = d.op == Op::TAX || d.op == Op::TAY ? m_a :
+                                      d.op == Op::TXA ? m_x :
+                                      d.op == Op::TYA ? m_y : m_s;
+            c6502_byte_t *dst = d.op == Op::TAX || d.op == Op::TSX ? m_x :
+                                d.op == Op::TAY ? m_y : m_a;
+            FOR_LANES
+            {
+                const c6502_byte_t m = m_group[l], v = src[l];
+                dst[l] = blend(m, v, dst[l]);
+                m_p[l] = blend(m, evalNZ(m_p[l], v), m_p[l]);
+            }
+            break;
+        }
+        case Op::TXS:
+            FOR_LANES
+                m_s[l] = blend(m_group[l], m_x[l], m_s[l]);
+            break;
+        case Op::CLC:
+        case Op::SEC:
+        case Op::CLI:
+        case Op::SEI:
+        case Op::CLD:
+        case Op::SED:
+        case Op::CLV:
+        {
+            const c6502_byte_t flag = d.op == Op::CLC || d.op == Op::SEC ? FLAG_C :
+                                      d.op == Op::CLI || d.op == Op::SEI ? FLAG_I :
+                                      d.op == Op::CLV ? FLAG_V : FLAG_D;
+            const bool set = d.op == Op::SEC || d.op == Op::SEI || d.op == Op::SED;
+            FOR_LANES
+            {
+                const c6502_byte_t p = set ? m_p[l] | flag : m_p[l] & ~flag;
+                m_p[l] = blend(m_group[l], p, m_p[l]);
+            }
+            break;
+        }
+        case Op::NOP:
+            break;
+        case Op::BPL:
+        case Op::BMI:
+        case Op::BVC:
+        case Op::BVS:
+        case Op::BCC:
+        case Op::BCS:
+        case Op::BNE:
+        case Op::BEQ:
+        {
+            const c6502_byte_t flag = d.op == Op::BPL || d.op == Op::BMI ? FLAG_N :
+                                      d.op == Op::BVC || d.op == Op::BVS ? FLAG_V :
+                                      d.op == Op::BCC || d.op == Op::BCS ? FLAG_C : FLAG_Z;
+            const c6502_byte_t expect = d.op == Op::BMI || d.op == Op::BVS ||
+                                        d.op == Op::BCS || d.op == Op::BEQ ? flag : 0u;
+            FOR_LANES
+            {
+                // PC is past the displacement already, the page is compared with the displacement byte
+                const c6502_word_t pc = m_pc[l],
+                                   target = static_cast<c6502_word_t>(pc + static_cast<int8_t>(m_val[l]));
+                const bool taken = m_group[l] && (m_p[l] & flag) == expect;
+                const c6502_byte_t penalty = hi_byte(static_cast<c6502_word_t>(pc - 1u)) != hi_byte(target) ? 2u : 1u;
+                m_pc[l] = taken ? target : pc;
+                m_penalty[l] = taken ? penalty : m_group[l] ? 0u : m_penalty[l];
+            }
+            break;
+        }
+        case Op::JMP:
+            FOR_LANES
+                m_pc[l] = m_group[l] ? m_operand[l] : m_pc[l];
+            break;
+        case Op::JSR:
+            for (uint l = 0u; l < m_n; l++)
+            {
+                if (!m_group[l])
+                    continue;
+                // Return address points to the last byte of the instruction
+                const c6502_word_t ret = static_cast<c6502_word_t>(m_pc[l] - 1u);
+                c6502_byte_t *ram = m_pRAM[l];
+                ram[0x100u | m_s[l]--] = hi_byte(ret);
+                ram[0x100u | m_s[l]--] = lo_byte(ret);
+                m_pc[l] = m_operand[l];
+            }
+            break;
+        case Op::RTS:
+            for (uint l = 0u; l < m_n; l++)
+            {
+                if (!m_group[l])
+                    continue;
+                const c6502_byte_t *ram = m_pRAM[l];
+                const c6502_byte_t ral = ram[0x100u | ++m_s[l]],
+                                   rah = ram[0x100u | ++m_s[l]];
+                m_pc[l] = static_cast<c6502_word_t>(combine(ral, rah) + 1u);
+            }
+            break;
+        case Op::PHA:
+        case Op::PHP:
+            for (uint l = 0u; l < m_n; l++)
+                if (m_group[l])
+                    m_pRAM[l][0x100u | m_s[l]--] = d.op == Op::PHA ? m_a[l] : m_p[l] | 0b00110000u;
+            break;
+        case Op::PLA:
+            for (uint l = 0u; l < m_n; l++)
+            {
+                if (!m_group[l])
+                    continue;
+                m_a[l] = m_pRAM[l][0x100u | ++m_s[l]];
+                m_p[l] = evalNZ(m_p[l], m_a[l]);
+            }
+            break;
+        case Op::PLP:
+            for (uint l = 0u; l < m_n; l++)
+                if (m_group[l])
+                    m_p[l] = m_pRAM[l][0x100u | ++m_s[l]];
+            break;
+        case Op::SCALAR:
+            assert(false && "Instruction is not executed in lanes");
+    }
+}
+
+void BatchCPU::stepScalar(const uint l, const bool banksKept) noexcept
+{
+    storeLane(l);
+    const int clk = m_pCPUs[l]->runNext(m_clk[l]);
+    loadLane(l);
+    if (!banksKept)
+        updateBanks(l);
+
+    m_stats.scalarSteps++;
+    if (clk > 0)
+        m_clk[l] -= clk;
+    else
+        m_active[l] = false;
+}
+
+c6502_byte_t BatchCPU::readLane(const uint l, const c6502_word_t addr) noexcept
+{
+    if (addr < 0x2000u)
+        return m_pRAM[l][addr & 0x7FFu];
+
+    const c6502_byte_t *pPage = addr >= 0x8000u ? m_pROM[l][(addr >> 13u) & 0b11u] : nullptr;
+    return pPage ? pPage[addr & 0x1FFFu] : m_pBuses[l]->readMem(addr);
+}
+
+void BatchCPU::updateBanks(const uint l) noexcept
+{
+    const Cartrige *pCart = m_pBuses[l]->m_pCart;
+    const Mapper *pMapper = pCart ? pCart->mapper() : nullptr;
+    for (uint i = 0u; i < 4u; i++)
+        m_pROM[l][i] = pMapper ? pMapper->romPage(static_cast<c6502_word_t>(0x8000u + i * 0x2000u)) : nullptr;
+}
+
+void BatchCPU::loadLane(const uint l) noexcept
+{
+    const CPU6502 &cpu = *m_pCPUs[l];
+    m_a[l] = cpu.m_regs.a;
+    m_x[l] = cpu.m_regs.x;
+    m_y[l] = cpu.m_regs.y;
+    m_s[l] = cpu.m_regs.s;
+    m_p[l] = cpu.m_regs.p;
+    m_pc[l] = cpu.m_regs.pc;
+    m_penalty[l] = static_cast<c6502_byte_t>(cpu.m_penalty);
+    m_cycles[l] = cpu.m_cycles;
+    m_instructions[l] = cpu.m_nInstructions;
+}
+
+void BatchCPU::storeLane(const uint l) noexcept
+{
+    CPU6502 &cpu = *m_pCPUs[l];
+    cpu.m_regs.a = m_a[l];
+    cpu.m_regs.x = m_x[l];
+    cpu.m_regs.y = m_y[l];
+    cpu.m_regs.s = m_s[l];
+    cpu.m_regs.p = m_p[l];
+    cpu.m_regs.pc = m_pc[l];
+    cpu.m_penalty = m_penalty[l];
+    cpu.m_cycles = m_cycles[l];
+    cpu.m_nInstructions = m_instructions[l];
+}
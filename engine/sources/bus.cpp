@@ -5,10 +5,17 @@
 #include "Cartridge.h"
 #include "gamepad.h"
 #include "log.h"
+#include "checksum.h"
+#include "mappedfile.h"
+#include "lzcodec.h"
+#include "deferredrenderer.h"
 
 #include <cassert>
 #include <fstream>
 #include <cmath>
+#include <algorithm>
+#include <iterator>
+#include <vector>
 
 void Bus::reset(OutputMode mode)
 {
@@ -20,6 +27,10 @@ void Bus::reset(OutputMode mode)
     m_vramPal.Clear();
     m_spriteMem.Clear();
 
+    for (auto &e: m_irq)
+        e.at = e.next = NO_IRQ;
+    m_nextIRQ = NO_IRQ;
+
     // Send reset commands to PPU and CPU
     m_pPPU->reset();
     m_pCPU->reset();
@@ -32,6 +43,8 @@ void Bus::reset(OutputMode mode)
 void Bus::injectCartrige(Cartrige *cart)
 {
     m_pCart = cart;
+    if (cart->mapper())
+        cart->mapper()->setBus(this);
 
     reset();
 }
@@ -74,6 +87,65 @@ void Bus::triggerNMI() noexcept
     m_pCPU->NMI();
 }
 
+constexpr uint64_t Bus::NO_IRQ;
+
+void Bus::updateNextIRQ() noexcept
+{
+    m_nextIRQ = NO_IRQ;
+    for (const auto &e: m_irq)
+        m_nextIRQ = std::min(m_nextIRQ, e.at);
+}
+
+void Bus::scheduleIRQ(IRQSource src, uint64_t cycle) noexcept
+{
+    // An assertion already scheduled stays where it is, pending or not
+    auto &e = m_irq[static_cast<int>(src)];
+    if (e.at == NO_IRQ)
+        e.at = cycle;
+    else
+        e.next = cycle;
+    updateNextIRQ();
+}
+
+void Bus::unscheduleIRQ(IRQSource src) noexcept
+{
+    auto &e = m_irq[static_cast<int>(src)];
+    if (!isIRQPending(src))
+        e.at = NO_IRQ;
+    e.next = NO_IRQ;
+    updateNextIRQ();
+}
+
+void Bus::acknowledgeIRQ(IRQSource src) noexcept
+{
+    auto &e = m_irq[static_cast<int>(src)];
+    if (!isIRQPending(src))
+        return;
+
+    // Reassertion that has already passed merges with the acknowledged one
+    e.at = e.next > currentCycle() ? e.next : NO_IRQ;
+    e.next = NO_IRQ;
+    updateNextIRQ();
+}
+
+void Bus::cancelIRQ(IRQSource src) noexcept
+{
+    auto &e = m_irq[static_cast<int>(src)];
+    e.at = e.next = NO_IRQ;
+    updateNextIRQ();
+}
+
+bool Bus::isIRQPending(IRQSource src) const noexcept
+{
+    const auto at = m_irq[static_cast<int>(src)].at;
+    return at != NO_IRQ && at <= currentCycle();
+}
+
+uint64_t Bus::currentCycle() const noexcept
+{
+    return m_pCPU->cycles();
+}
+
 static constexpr int PAL_FPS = 50,
                      NTSC_FPS = 60,
                      PAL_NMI_LINES = 70,
@@ -82,32 +154,61 @@ static constexpr int PAL_FPS = 50,
 static constexpr float PAL_LINE_CYCLES = 106.0f + 9.0f / 16.0f,
                        NTSC_LINE_CYCLES = 113.0f + 2.0f / 3.0f;
 
+float Bus::cyclesPerLine() const noexcept
+{
+    return m_mode == OutputMode::PAL ? PAL_LINE_CYCLES : NTSC_LINE_CYCLES;
+}
+
+int Bus::nmiLines() const noexcept
+{
+    return m_mode == OutputMode::PAL ? PAL_NMI_LINES : NTSC_NMI_LINES;
+}
+
 int Bus::clocksPerFrame() const noexcept
 {
-    const auto CPL = m_mode == OutputMode::PAL ? PAL_LINE_CYCLES : NTSC_LINE_CYCLES;
-    const auto NMI_LINES = m_mode == OutputMode::PAL ? PAL_NMI_LINES : NTSC_NMI_LINES;
-    return std::lround((240 + NMI_LINES) * CPL);
+    return std::lround((240 + nmiLines()) * cyclesPerLine());
 }
 
-void Bus::runFrame()
+void Bus::runFrame(uint output)
 {
-    const float CPL = m_mode == OutputMode::PAL ? PAL_LINE_CYCLES : NTSC_LINE_CYCLES;
-    const int NMI_LINES = m_mode == OutputMode::PAL ? PAL_NMI_LINES : NTSC_NMI_LINES;
+    const bool video = output & FRAME_VIDEO;
+    const float CPL = cyclesPerLine();
+    const int NMI_LINES = nmiLines();
 
     m_nFrame++;
 
+#ifdef ENABLE_PERF_COUNTERS
+    m_perf.beginFrame(m_pCPU->instructionCount(), m_pCPU->cycles());
+#endif
+
     m_pPPU->startFrame();
 
+    Mapper *pScanlineCounter = m_pCart && m_pCart->mapper()->hasFeature<Mapper::SCANLINE_COUNTER>() ?
+                               m_pCart->mapper() :
+                               nullptr;
+
+    // Pre-render line clocks the counter as well
+    if (pScanlineCounter && m_pPPU->isA12Rising())
+        pScanlineCounter->onA12Rise();
+
     // Visible scanlines
     for (int i = 0; i < 240; i++)
     {
-        m_pPPU->drawNextLine();
+        m_pPPU->drawNextLine(video);
 
-        const float lc = CPL + m_remClk;
-        m_remClk = lc - m_pCPU->run(static_cast<int>(lc));
+        if (pScanlineCounter && m_pPPU->isA12Rising())
+        {
+            // Split the line at the rise, so the counter sees register writes in order
+            const float riseClk = m_pPPU->a12RiseDot() * CPL / PPU::DOTS_PER_LINE;
+            runCPU(riseClk);
+            pScanlineCounter->onA12Rise();
+            runCPU(CPL - riseClk);
+        }
+        else
+            runCPU(CPL);
     }
 
-    m_pPPU->endFrame();
+    m_pPPU->endFrame(video);
 
     // Unlock PPU and send NMI signal
     m_pPPU->onBeginVblank();
@@ -117,15 +218,52 @@ void Bus::runFrame()
 
     // PPU is opened for writinng only during VSYNC
     for (int i = 0; i < NMI_LINES; i++)
-    {
-        const float lc = CPL + m_remClk;
-        m_remClk = lc - m_pCPU->run(static_cast<int>(lc));
-    }
+        runCPU(CPL);
 
     m_pPPU->onEndVblank();
 
     // Clock APU
-    m_pAPU->runFrame();
+    m_pAPU->runFrame(output & FRAME_AUDIO);
+
+    if (m_hashed != HASH_NONE)
+        hashFrame();
+
+#ifdef ENABLE_PERF_COUNTERS
+    m_perf.endFrame(m_pCPU->instructionCount(), m_pCPU->cycles());
+#endif
+}
+
+void Bus::setFrameHashing(uint components) noexcept
+{
+    assert(m_pPPU != nullptr && m_pAPU != nullptr);
+    m_hashed = components & HASH_ALL;
+    m_hashes = { };
+    m_pPPU->setPictureHashing((m_hashed & HASH_PICTURE) != 0u);
+    m_pAPU->setLevelHashing((m_hashed & HASH_AUDIO) != 0u);
+}
+
+void Bus::hashFrame() noexcept
+{
+    FrameHashes &h = m_hashes;
+    h = { };
+    h.frame = m_nFrame;
+    if (m_hashed & HASH_PICTURE)
+        h.picture = m_pPPU->pictureHash();
+    if (m_hashed & HASH_RAM)
+        h.ram = xxhash64(m_ram.data(), sizeof(m_ram));
+    if (m_hashed & HASH_VRAM)
+        h.vram = xxhash64(m_vramPal.data(), sizeof(m_vramPal), xxhash64(m_vramNS.data(), sizeof(m_vramNS)));
+    if (m_hashed & HASH_OAM)
+        h.oam = xxhash64(m_spriteMem.data(), sizeof(m_spriteMem));
+    if (m_hashed & HASH_AUDIO)
+        h.audio = m_pAPU->levelHash();
+}
+
+void Bus::runCPU(float clk) noexcept
+{
+    PERF_SCOPE(m_perf, SECTION_CPU);
+    const float lc = clk + m_remClk;
+    m_remClk = lc - m_pCPU->run(static_cast<int>(lc));
 }
 
 int Bus::currentTimeMs() const noexcept
@@ -140,14 +278,17 @@ c6502_byte_t Bus::readMem(c6502_word_t addr) noexcept
     switch (addr >> 13)
     {
         case 0:
+            PERF_COUNT(m_perf, reads[PerfCounters::REGION_RAM]);
             rv = m_ram.Read(addr & 0x7FFu);
             break;
         case 1:
             // PPU
             assert(m_pPPU != nullptr);
+            PERF_COUNT(m_perf, reads[PerfCounters::REGION_PPU]);
             rv = m_pPPU->readRegister(addr & 0x0Fu);
             break;
         case 2:
+            PERF_COUNT(m_perf, reads[PerfCounters::REGION_APU]);
             switch (addr)
             {
                 case 0x4016u:
@@ -164,6 +305,7 @@ c6502_byte_t Bus::readMem(c6502_word_t addr) noexcept
             break;
         default:
             // Read from the cartridge
+            PERF_COUNT(m_perf, reads[PerfCounters::REGION_CART]);
             try
             {
                 rv = m_pCart->mapper()->readMem(addr);
@@ -183,14 +325,17 @@ void Bus::writeMem(c6502_word_t addr, c6502_byte_t val) noexcept
     {
         case 0:
             // To internal RAM
+            PERF_COUNT(m_perf, writes[PerfCounters::REGION_RAM]);
             m_ram.Write(addr & 0x7FFu, val);
             break;
         case 1:
             // To PPU registers
             assert(m_pPPU != nullptr);
+            PERF_COUNT(m_perf, writes[PerfCounters::REGION_PPU]);
             return m_pPPU->writeRegister(addr & 0x0Fu, val);
             break;
         case 2:
+            PERF_COUNT(m_perf, writes[PerfCounters::REGION_APU]);
             switch (addr)
             {
                 case 0x4014u:
@@ -199,7 +344,7 @@ void Bus::writeMem(c6502_word_t addr, c6502_byte_t val) noexcept
                     const c6502_word_t off = static_cast<c6502_word_t>(val) << 8;
                     assert(off < 0x800u || off >= 0x6000u);
                     for (c6502_word_t i = 0u; i < 0x100u; i++)
-                        m_spriteMem.Write(i, readMem(off + i));
+                        writeSpriteMem(i, readMem(off + i));
 
                     break;
                 }
@@ -223,6 +368,11 @@ void Bus::writeMem(c6502_word_t addr, c6502_byte_t val) noexcept
             }
             break;
         default:
+            // Registers of the mappers are at 0x8000 and above, they may switch pattern banks
+            PERF_COUNT(m_perf, writes[PerfCounters::REGION_CART]);
+            if (m_pFrameRecorder && addr >= 0x8000u)
+                m_pFrameRecorder->invalidatePatterns();
+
             // To the cartridge mapper
             try
             {
@@ -267,28 +417,51 @@ void Bus::writeVideoMem(c6502_word_t addr, c6502_byte_t val) noexcept
     if (addr >= 0x3F00u)
     {
         addr &= 0x1Fu;
+        c6502_word_t mirrAddr = addr;
         m_vramPal.Write(addr, val);
         if ((addr & 0x3u) == 0u)
-            m_vramPal.Write(addr ^ 0x10u, val);
+        {
+            mirrAddr = addr ^ 0x10u;
+            m_vramPal.Write(mirrAddr, val);
+        }
+
+        if (m_pFrameRecorder)
+        {
+            m_pFrameRecorder->recordWrite(DeferredRenderer::PALETTES, addr, val);
+            if (mirrAddr != addr)
+                m_pFrameRecorder->recordWrite(DeferredRenderer::PALETTES, mirrAddr, val);
+        }
     }
     else if (addr >= 0x2000u)
     {
         addr &= 0xFFFu;
+        c6502_word_t mirrAddr = addr;
         m_vramNS.Write(addr, val);
         switch (mt)
         {
             case Mirroring::Horizontal:
-                m_vramNS.Write(addr ^ 0x400u, val);
+                mirrAddr = addr ^ 0x400u;
+                m_vramNS.Write(mirrAddr, val);
                 break;
             case Mirroring::Vertical:
-                m_vramNS.Write(addr ^ 0x800u, val);
+                mirrAddr = addr ^ 0x800u;
+                m_vramNS.Write(mirrAddr, val);
             default:
                 break;
         }
+
+        if (m_pFrameRecorder)
+        {
+            m_pFrameRecorder->recordWrite(DeferredRenderer::NAMETABLES, addr, val);
+            if (mirrAddr != addr)
+                m_pFrameRecorder->recordWrite(DeferredRenderer::NAMETABLES, mirrAddr, val);
+        }
     }
     else
     {
         assert(m_pCart->mapper()->hasFeature<Mapper::RAM>());
+        if (m_pFrameRecorder)
+            m_pFrameRecorder->invalidatePatterns();
         try
         {
             m_pCart->mapper()->writeMem(addr, val);
@@ -300,51 +473,427 @@ void Bus::writeVideoMem(c6502_word_t addr, c6502_byte_t val) noexcept
     }
 }
 
-static const char MAGIC[] = { 'D', 'B', '1', 'M', 'U', 'S', 'S', 'v', '1', 0u };
+void Bus::writeSpriteMem(c6502_word_t addr, c6502_byte_t val) noexcept
+{
+    m_spriteMem.Write(addr, val);
+    if (m_pFrameRecorder)
+        m_pFrameRecorder->recordWrite(DeferredRenderer::SPRITES, addr, val);
+}
 
-/* Binary state format (to be revised):
- * 0000: MAGIC (10 bytes)
- * 000A: CPU state (7 bytes)
- * 0011: PPU state (27 bytes)
- * 002C: RAM snapshot (2048 bytes)
- * 082C: Sprite memory snapshot (256 bytes)
- * 092C: Video memory shapshot (solid array, 8192 bytes)
- * 292C: Power-independent memory snapshot (8192 bytes)
+void Bus::copyVideoMemory(c6502_byte_t *pNametables,
+                          c6502_byte_t *pPalettes,
+                          c6502_byte_t *pSprites) const noexcept
+{
+    memcpy(pNametables, m_vramNS.data(), sizeof(m_vramNS));
+    memcpy(pPalettes, m_vramPal.data(), sizeof(m_vramPal));
+    memcpy(pSprites, m_spriteMem.data(), sizeof(m_spriteMem));
+}
+
+void Bus::readPatternTables(c6502_byte_t *pDst) const noexcept
+{
+    try
+    {
+        m_pCart->mapper()->readPatterns(pDst);
+    }
+    catch (const Exception &ex)
+    {
+        Log::e("[bus] Failed to read cart's pattern tables: %s", ex.message());
+    }
+}
+
+// Fixed part of the snapshot, mapper state follows it.
+// Size of an aligned struct is a multiple of the alignment, so the mapper block stays aligned too.
+struct alignas(SNAPSHOT_ALIGNMENT) Bus::MachineState
+{
+    Storage<0x800> ram;
+    Storage<0x1000> vramNS;
+    Storage<0x20> vramPal;
+    Storage<256> spriteMem;
+
+    struct alignas(SNAPSHOT_ALIGNMENT) Registers
+    {
+        IRQEvent irq[static_cast<int>(IRQSource::COUNT)];
+        uint64_t nextIRQ;
+        int nFrame;
+        float remClk;
+        OutputMode mode;
+        Mirroring mirr;
+        c6502_byte_t strobeReg;
+    } regs;
+
+    CPU6502::Snapshot cpu;
+    PPU::Snapshot ppu;
+    APU::Snapshot apu;
+    alignas(SNAPSHOT_ALIGNMENT) Gamepad::Snapshot pads[2];
+};
+
+uint64_t Bus::memoryHash() const noexcept
+{
+    uint64_t h = xxhash64(m_ram.data(), sizeof(m_ram));
+    h = xxhash64(m_spriteMem.data(), sizeof(m_spriteMem), h);
+    h = xxhash64(m_vramNS.data(), sizeof(m_vramNS), h);
+    return xxhash64(m_vramPal.data(), sizeof(m_vramPal), h);
+}
+
+size_t Bus::snapshotSize() const noexcept
+{
+    const Mapper *pMapper = m_pCart ? m_pCart->mapper() : nullptr;
+    return sizeof(MachineState) + (pMapper ? pMapper->stateSize() : 0u);
+}
+
+void Bus::snapshot(void *pBuf) const noexcept
+{
+    assert(reinterpret_cast<uintptr_t>(pBuf) % SNAPSHOT_ALIGNMENT == 0u);
+    auto &ms = *static_cast<MachineState*>(pBuf);
+
+    ms.ram = m_ram;
+    ms.vramNS = m_vramNS;
+    ms.vramPal = m_vramPal;
+    ms.spriteMem = m_spriteMem;
+
+    for (int i = 0; i < static_cast<int>(IRQSource::COUNT); i++)
+        ms.regs.irq[i] = m_irq[i];
+    ms.regs.nextIRQ = m_nextIRQ;
+    ms.regs.nFrame = m_nFrame;
+    ms.regs.remClk = m_remClk;
+    ms.regs.mode = m_mode;
+    ms.regs.mirr = m_pCart ? m_pCart->currentMirroring() : Mirroring::Horizontal;
+    ms.regs.strobeReg = m_strobeReg;
+
+    m_pCPU->snapshot(ms.cpu);
+    m_pPPU->snapshot(ms.ppu);
+    m_pAPU->snapshot(ms.apu);
+    for (int i = 0; i < 2; i++)
+        if (m_pGamePads[i])
+            m_pGamePads[i]->snapshot(ms.pads[i]);
+
+    if (m_pCart && m_pCart->mapper())
+        m_pCart->mapper()->snapshot(&ms + 1);
+}
+
+void Bus::restore(const void *pBuf) noexcept
+{
+    assert(reinterpret_cast<uintptr_t>(pBuf) % SNAPSHOT_ALIGNMENT == 0u);
+    const auto &ms = *static_cast<const MachineState*>(pBuf);
+
+    m_ram = ms.ram;
+    m_vramNS = ms.vramNS;
+    m_vramPal = ms.vramPal;
+    m_spriteMem = ms.spriteMem;
+
+    for (int i = 0; i < static_cast<int>(IRQSource::COUNT); i++)
+        m_irq[i] = ms.regs.irq[i];
+    m_nextIRQ = ms.regs.nextIRQ;
+    m_nFrame = ms.regs.nFrame;
+    m_remClk = ms.regs.remClk;
+    m_mode = ms.regs.mode;
+    m_strobeReg = ms.regs.strobeReg;
+
+    m_pCPU->restore(ms.cpu);
+    m_pPPU->restore(ms.ppu);
+    m_pAPU->restore(ms.apu);
+    for (int i = 0; i < 2; i++)
+        if (m_pGamePads[i])
+            m_pGamePads[i]->restore(ms.pads[i]);
+
+    if (m_pCart && m_pCart->mapper())
+    {
+        m_pCart->setMirroring(ms.regs.mirr);
+        m_pCart->mapper()->restore(&ms + 1);
+    }
+}
+
+/* Chunked save state format, version 2. All integers are little endian.
+ *
+ * 0000: Header (64 bytes)
+ *       00: MAGIC_V2 (8 bytes)
+ *       08: format version (4 bytes)
+ *       0C: number of chunks (4 bytes)
+ *       10: table of contents offset (8 bytes)
+ *       18: file size (8 bytes)
+ *       20: CRC32C of the table of contents (4 bytes)
+ *       24: CRC32C of the header bytes 00..23 (4 bytes)
+ * 0040: Table of contents, 32 bytes per chunk
+ *       00: chunk ID (4 characters)
+ *       04: chunk version (4 bytes)
+ *       08: data offset, a multiple of 64 (8 bytes)
+ *       10: data size (8 bytes)
+ *       18: CRC32C of the data (4 bytes)
+ * ....: Chunk data, each starting at a 64 bytes boundary
+ *
+ * Chunks hold the snapshot structures as they are in memory, so a loader
+ * copies them straight into the snapshot block. A chunk version is bumped
+ * whenever its structure changes. Chunks with unknown IDs are skipped; a known
+ * one of another version or size, or missing, makes the state unloadable.
+ */
+
+/* Compressed state file:
+ * 0000: MAGIC_Z (8 bytes)
+ * 0008: state file image size (8 bytes)
+ * 0010: compressed data size (8 bytes)
+ * 0018: CRC32C of the compressed data (4 bytes)
+ * 0020: Chunked state file image, compressed with LZCodec
  */
 
+static const char MAGIC_V1[] = { 'D', 'B', '1', 'M', 'U', 'S', 'S', 'v', '1', 0u };
+static const char MAGIC_V2[] = { 'D', 'B', '1', 'M', 'U', 'S', 'S', 'C' };
+static const char MAGIC_Z[] = { 'D', 'B', '1', 'M', 'U', 'S', 'S', 'Z' };
+
+static constexpr uint32_t STATE_FORMAT_VERSION = 2u;
+static constexpr size_t STATE_HEADER_SIZE = 64u,
+                        STATE_Z_HEADER_SIZE = 32u,
+                        STATE_TOC_ENTRY_SIZE = 32u,
+                        STATE_CHUNK_ALIGNMENT = 64u;
+
+struct Bus::StateChunk
+{
+    char id[4];
+    uint32_t version;
+    size_t offset,      // in the snapshot block
+           size;
+};
+
+static inline size_t alignChunk(size_t n) noexcept
+{
+    return (n + STATE_CHUNK_ALIGNMENT - 1u) & ~(STATE_CHUNK_ALIGNMENT - 1u);
+}
+
+template <typename T>
+static inline void putLE(uint8_t *p, T v) noexcept
+{
+    for (size_t i = 0u; i < sizeof(T); i++, v >>= 8u)
+        p[i] = static_cast<uint8_t>(v);
+}
+
+template <typename T>
+static inline T getLE(const uint8_t *p) noexcept
+{
+    T v = 0u;
+    for (size_t i = sizeof(T); i-- > 0u; )
+        v = static_cast<T>(v << 8u) | p[i];
+    return v;
+}
+
+void Bus::stateChunks(size_t snapshotSize, StateChunk *pChunks) noexcept
+{
+    // Offsets are taken from a dummy object, offsetof doesn't accept these types
+    static const MachineState ms { };
+    const auto *base = reinterpret_cast<const uint8_t*>(&ms);
+    auto chunk = [base](const char (&id)[5], uint32_t version, const void *pField, size_t size) noexcept
+    {
+        StateChunk c;
+        memcpy(c.id, id, sizeof(c.id));
+        c.version = version;
+        c.offset = static_cast<size_t>(static_cast<const uint8_t*>(pField) - base);
+        c.size = size;
+        return c;
+    };
+
+    StateChunk *p = pChunks;
+    *p++ = chunk("CPU ", 1u, &ms.cpu, sizeof(ms.cpu));
+    *p++ = chunk("PPU ", 1u, &ms.ppu, sizeof(ms.ppu));
+    *p++ = chunk("APU ", 1u, &ms.apu, sizeof(ms.apu));
+    *p++ = chunk("BUS ", 1u, &ms.regs, sizeof(ms.regs));
+    *p++ = chunk("PADS", 1u, &ms.pads, sizeof(ms.pads));
+    *p++ = chunk("RAM ", 1u, &ms.ram, sizeof(ms.ram));
+    *p++ = chunk("VRAM", 1u, &ms.vramNS, sizeof(ms.vramNS));
+    *p++ = chunk("PAL ", 1u, &ms.vramPal, sizeof(ms.vramPal));
+    *p++ = chunk("OAM ", 1u, &ms.spriteMem, sizeof(ms.spriteMem));
+
+    // Mapper block, its layout is defined by the mapper of the inserted cartridge
+    StateChunk &m = *p++;
+    memcpy(m.id, "MAPR", sizeof(m.id));
+    m.version = 1u;
+    m.offset = sizeof(MachineState);
+    m.size = snapshotSize - sizeof(MachineState);
+
+    assert(p - pChunks == NUM_STATE_CHUNKS);
+}
+
+size_t Bus::stateFileSize(size_t snapshotSize) noexcept
+{
+    StateChunk chunks[NUM_STATE_CHUNKS];
+    stateChunks(snapshotSize, chunks);
+
+    size_t sz = alignChunk(STATE_HEADER_SIZE + NUM_STATE_CHUNKS * STATE_TOC_ENTRY_SIZE);
+    for (const auto &c: chunks)
+        sz += alignChunk(c.size);
+    return sz;
+}
+
+void Bus::buildStateFile(const void *pSnapshot, size_t snapshotSize, uint8_t *pOut) noexcept
+{
+    StateChunk chunks[NUM_STATE_CHUNKS];
+    stateChunks(snapshotSize, chunks);
+
+    const size_t fileSize = stateFileSize(snapshotSize);
+    memset(pOut, 0, fileSize);
+
+    const auto *pSrc = static_cast<const uint8_t*>(pSnapshot);
+    uint8_t *pTOC = pOut + STATE_HEADER_SIZE;
+    size_t offset = alignChunk(STATE_HEADER_SIZE + NUM_STATE_CHUNKS * STATE_TOC_ENTRY_SIZE);
+    for (const auto &c: chunks)
+    {
+        memcpy(pOut + offset, pSrc + c.offset, c.size);
+
+        memcpy(pTOC, c.id, sizeof(c.id));
+        putLE<uint32_t>(pTOC + 0x04u, c.version);
+        putLE<uint64_t>(pTOC + 0x08u, offset);
+        putLE<uint64_t>(pTOC + 0x10u, c.size);
+        putLE<uint32_t>(pTOC + 0x18u, crc32c(pOut + offset, c.size));
+
+        pTOC += STATE_TOC_ENTRY_SIZE;
+        offset += alignChunk(c.size);
+    }
+    assert(offset == fileSize);
+
+    memcpy(pOut, MAGIC_V2, sizeof(MAGIC_V2));
+    putLE<uint32_t>(pOut + 0x08u, STATE_FORMAT_VERSION);
+    putLE<uint32_t>(pOut + 0x0Cu, NUM_STATE_CHUNKS);
+    putLE<uint64_t>(pOut + 0x10u, STATE_HEADER_SIZE);
+    putLE<uint64_t>(pOut + 0x18u, fileSize);
+    putLE<uint32_t>(pOut + 0x20u, crc32c(pOut + STATE_HEADER_SIZE, NUM_STATE_CHUNKS * STATE_TOC_ENTRY_SIZE));
+    putLE<uint32_t>(pOut + 0x24u, crc32c(pOut, 0x24u));
+}
+
+size_t Bus::maxCompressedStateSize(size_t imageSize) noexcept
+{
+    return STATE_Z_HEADER_SIZE + LZCodec::maxCompressedSize(imageSize);
+}
+
+size_t Bus::compressStateFile(const uint8_t *pImage, size_t size, uint8_t *pOut) noexcept
+{
+    const size_t len = LZCodec::compress(pImage, size, pOut + STATE_Z_HEADER_SIZE);
+
+    memset(pOut, 0, STATE_Z_HEADER_SIZE);
+    memcpy(pOut, MAGIC_Z, sizeof(MAGIC_Z));
+    putLE<uint64_t>(pOut + 0x08u, size);
+    putLE<uint64_t>(pOut + 0x10u, len);
+    putLE<uint32_t>(pOut + 0x18u, crc32c(pOut + STATE_Z_HEADER_SIZE, len));
+
+    return STATE_Z_HEADER_SIZE + len;
+}
+
 void Bus::saveState(const char *fileName)
 {
+    const size_t ssSize = snapshotSize();
+    SnapshotBuffer ss(ssSize);
+    snapshot(ss.data());
+
+    std::vector<uint8_t> file(stateFileSize(ssSize));
+    buildStateFile(ss.data(), ssSize, file.data());
+
     std::ofstream fout { fileName,
                          std::ios_base::out | std::ios_base::binary };
+    if (!fout.write(reinterpret_cast<const char*>(file.data()), static_cast<std::streamsize>(file.size())))
+        throw Exception { Exception::IOFailure, "unable to write the state file" };
+}
 
+void Bus::loadState(const void *pData, size_t size)
+{
+    const auto *pFile = static_cast<const uint8_t*>(pData);
+    if (size >= STATE_Z_HEADER_SIZE && memcmp(pFile, MAGIC_Z, sizeof(MAGIC_Z)) == 0)
+    {
+        const uint64_t imageSize = getLE<uint64_t>(pFile + 0x08u),
+                       len = getLE<uint64_t>(pFile + 0x10u);
+        if (len != size - STATE_Z_HEADER_SIZE)
+            throw Exception { Exception::IllegalFormat, "truncated state file" };
+        if (getLE<uint32_t>(pFile + 0x18u) != crc32c(pFile + STATE_Z_HEADER_SIZE, len))
+            throw Exception { Exception::IllegalFormat, "corrupted state file" };
+        // Every length byte adds at most 255, a bogus size is caught before allocating
+        if (imageSize / 256u > len)
+            throw Exception { Exception::IllegalFormat, "wrong state file size" };
+
+        std::vector<uint8_t> image(imageSize);
+        if (!LZCodec::decompress(pFile + STATE_Z_HEADER_SIZE, len, image.data(), image.size()))
+            throw Exception { Exception::IllegalFormat, "corrupted state file" };
+        loadState(image.data(), image.size());
+        return;
+    }
 
-    // Write magic
-    fout.write(MAGIC, sizeof(MAGIC));
+    if (size < STATE_HEADER_SIZE || memcmp(pFile, MAGIC_V2, sizeof(MAGIC_V2)) != 0)
+        throw Exception { Exception::IllegalFormat, "wrong magic number" };
+    if (getLE<uint32_t>(pFile + 0x24u) != crc32c(pFile, 0x24u))
+        throw Exception { Exception::IllegalFormat, "corrupted state header" };
+    if (getLE<uint32_t>(pFile + 0x08u) != STATE_FORMAT_VERSION)
+        throw Exception { Exception::IllegalFormat, "unsupported state format version" };
+
+    const uint32_t nTOC = getLE<uint32_t>(pFile + 0x0Cu);
+    const uint64_t tocOffset = getLE<uint64_t>(pFile + 0x10u);
+    if (getLE<uint64_t>(pFile + 0x18u) != size ||
+        tocOffset > size ||
+        nTOC > (size - tocOffset) / STATE_TOC_ENTRY_SIZE)
+        throw Exception { Exception::IllegalFormat, "truncated state file" };
+
+    const uint8_t *pTOC = pFile + tocOffset;
+    if (getLE<uint32_t>(pFile + 0x20u) != crc32c(pTOC, nTOC * STATE_TOC_ENTRY_SIZE))
+        throw Exception { Exception::IllegalFormat, "corrupted state table of contents" };
+
+    // Every known chunk has to be there, so nothing of the current state is left over
+    const size_t ssSize = snapshotSize();
+    SnapshotBuffer ss(ssSize);
+
+    StateChunk chunks[NUM_STATE_CHUNKS];
+    stateChunks(ssSize, chunks);
+    bool loaded[NUM_STATE_CHUNKS] = { };
+
+    for (uint32_t i = 0u; i < nTOC; i++, pTOC += STATE_TOC_ENTRY_SIZE)
+    {
+        const uint32_t version = getLE<uint32_t>(pTOC + 0x04u);
+        const uint64_t offset = getLE<uint64_t>(pTOC + 0x08u),
+                       len = getLE<uint64_t>(pTOC + 0x10u);
+        if (offset > size || len > size - offset)
+            throw Exception { Exception::IllegalFormat, "truncated state file" };
+
+        const auto pc = std::find_if(std::begin(chunks), std::end(chunks),
+                                     [pTOC](const StateChunk &c) { return memcmp(c.id, pTOC, sizeof(c.id)) == 0; });
+        if (pc == std::end(chunks))
+        {
+            Log::d("[bus] state chunk '%.4s' is unknown, skipped", pTOC);
+            continue;
+        }
 
-    // Dump CPU state
-    m_pCPU->saveState(fout);
+        if (getLE<uint32_t>(pTOC + 0x18u) != crc32c(pFile + offset, len))
+            throw Exception { Exception::IllegalFormat, "corrupted state chunk" };
 
-    // Dump PPU state
-    m_pPPU->saveState(fout);
+        if (memcmp(pc->id, "MAPR", sizeof(pc->id)) == 0 && len != pc->size)
+            throw Exception { Exception::IllegalArgument, "state is saved with another cartridge" };
+        if (version != pc->version || len != pc->size)
+        {
+            Log::w("[bus] state chunk '%.4s' version %u is incompatible", pTOC, version);
+            throw Exception { Exception::IllegalFormat, "incompatible state chunk" };
+        }
 
-    // Dump memory
-    m_ram.Save(fout);
-    m_spriteMem.Save(fout);
-    m_vramNS.Save(fout);
-    m_vramPal.Save(fout);
+        memcpy(ss.data() + pc->offset, pFile + offset, len);
+        loaded[pc - chunks] = true;
+    }
 
-    // TODO: add mapper state
+    for (uint i = 0u; i < NUM_STATE_CHUNKS; i++)
+        if (!loaded[i] && chunks[i].size > 0u)
+        {
+            Log::w("[bus] state chunk '%.4s' is missing", chunks[i].id);
+            throw Exception { Exception::IllegalFormat, "missing state chunk" };
+        }
+
+    restore(ss.data());
 }
 
-void Bus::loadState(const char *fileName)
-{
-    std::ifstream fin { fileName,
-                        std::ios_base::in | std::ios_base::binary };
+/* Legacy binary state format:
+ * 0000: MAGIC_V1 (10 bytes)
+ * 000A: CPU state (7 bytes)
+ * 0011: PPU state (27 bytes)
+ * 002C: RAM snapshot (2048 bytes)
+ * 082C: Sprite memory snapshot (256 bytes)
+ * 092C: Video memory shapshot (solid array, 8192 bytes)
+ * 292C: Power-independent memory snapshot (8192 bytes)
+ */
 
+void Bus::loadLegacyState(std::istream &fin)
+{
     // Validate magic
-    char magicBuf[sizeof(MAGIC)];
-    fin.read(magicBuf, sizeof(MAGIC));
-    if (memcmp(magicBuf, MAGIC, sizeof(MAGIC)) != 0)
+    char magicBuf[sizeof(MAGIC_V1)];
+    fin.read(magicBuf, sizeof(MAGIC_V1));
+    if (memcmp(magicBuf, MAGIC_V1, sizeof(MAGIC_V1)) != 0)
         throw Exception { Exception::IllegalFormat, "wrong magic number" };
 
     // Read CPU state
@@ -359,5 +908,21 @@ void Bus::loadState(const char *fileName)
     m_vramNS.Load(fin);
     m_vramPal.Load(fin);
 
-    // TODO: add mapper state
+    // Pending interrupts are not stored, sources schedule them again
+    for (auto &e: m_irq)
+        e.at = e.next = NO_IRQ;
+    m_nextIRQ = NO_IRQ;
+}
+
+void Bus::loadState(const char *fileName)
+{
+    const MappedFile file { fileName };
+    if (file.size() >= sizeof(MAGIC_V1) && memcmp(file.data(), MAGIC_V1, sizeof(MAGIC_V1)) == 0)
+    {
+        std::ifstream fin { fileName,
+                            std::ios_base::in | std::ios_base::binary };
+        loadLegacyState(fin);
+    }
+    else
+        loadState(file.data(), file.size());
 }
@@ -0,0 +1,222 @@
+#include "checksum.h"
+
+#include <cstring>
+
+#if (defined(__x86_64__) || defined(__i386__)) && defined(__GNUC__)
+#include <nmmintrin.h>
+#define CRC32C_USE_SSE42
+#endif
+
+// Reflected polynomial 0x1EDC6F41
+static constexpr uint32_t CRC32C_POLY = 0x82F63B78u;
+
+struct CRC32CTable
+{
+    uint32_t t[8][256];
+
+    CRC32CTable() noexcept
+    {
+        for (uint32_t i = 0u; i < 256u; i++)
+        {
+            uint32_t c = i;
+            for (int k = 0; k < 8; k++)
+                c = (c >> 1u) ^ (c & 1u ? CRC32C_POLY : 0u);
+            t[0][i] = c;
+        }
+
+        // Tables for slicing by 8
+        for (uint32_t i = 0u; i < 256u; i++)
+            for (int s = 1; s < 8; s++)
+                t[s][i] = (t[s - 1][i] >> 8u) ^ t[0][t[s - 1][i] & 0xFFu];
+    }
+};
+
+static const CRC32CTable s_crcTable;
+
+static uint32_t crc32cSoft(const uint8_t *p, size_t n, uint32_t c) noexcept
+{
+    const auto &t = s_crcTable.t;
+    for (; n >= 8u; n -= 8u, p += 8u)
+    {
+        uint32_t lo, hi;
+        memcpy(&lo, p, 4u);
+        memcpy(&hi, p + 4u, 4u);
+        lo ^= c;
+        c = t[7][lo & 0xFFu] ^ t[6][(lo >> 8u) & 0xFFu] ^
+            t[5][(lo >> 16u) & 0xFFu] ^ t[4][lo >> 24u] ^
+            t[3][hi & 0xFFu] ^ t[2][(hi >> 8u) & 0xFFu] ^
+            t[1][(hi >> 16u) & 0xFFu] ^ t[0][hi >> 24u];
+    }
+    while (n-- > 0u)
+        c = (c >> 8u) ^ t[0][(c ^ *p++) & 0xFFu];
+
+    return c;
+}
+
+#ifdef CRC32C_USE_SSE42
+__attribute__((target("sse4.2")))
+static uint32_t crc32cHard(const uint8_t *p, size_t n, uint32_t c) noexcept
+{
+#ifdef __x86_64__
+    uint64_t c64 = c;
+    for (; n >= 8u; n -= 8u, p += 8u)
+    {
+        uint64_t v;
+        memcpy(&v, p, 8u);
+        c64 = _mm_crc32_u64(c64, v);
+    }
+    c = static_cast<uint32_t>(c64);
+#endif
+    for (; n >= 4u; n -= 4u, p += 4u)
+    {
+        uint32_t v;
+        memcpy(&v, p, 4u);
+        c = _mm_crc32_u32(c, v);
+    }
+    while (n-- > 0u)
+        c = _mm_crc32_u8(c, *p++);
+
+    return c;
+}
+
+static const bool s_hasSSE42 = __builtin_cpu_supports("sse4.2");
+#endif
+
+uint32_t crc32c(const void *pData, size_t size, uint32_t crc) noexcept
+{
+    const auto *p = static_cast<const uint8_t*>(pData);
+    crc = ~crc;
+#ifdef CRC32C_USE_SSE42
+    if (s_hasSSE42)
+        return ~crc32cHard(p, size, crc);
+#endif
+    return ~crc32cSoft(p, size, crc);
+}
+
+// Reflected polynomial 0x04C11DB7
+static constexpr uint32_t CRC32_POLY = 0xEDB88320u;
+
+struct CRC32Table
+{
+    uint32_t t[256];
+
+    CRC32Table() noexcept
+    {
+        for (uint32_t i = 0u; i < 256u; i++)
+        {
+            uint32_t c = i;
+            for (int k = 0; k < 8; k++)
+                c = (c >> 1u) ^ (c & 1u ? CRC32_POLY : 0u);
+            t[i] = c;
+        }
+    }
+};
+
+static const CRC32Table s_crc32Table;
+
+uint32_t crc32(const void *pData, size_t size, uint32_t crc) noexcept
+{
+    // Byte at a time, only used off the emulation thread
+    const auto *p = static_cast<const uint8_t*>(pData);
+    crc = ~crc;
+    while (size-- > 0u)
+        crc = (crc >> 8u) ^ s_crc32Table.t[(crc ^ *p++) & 0xFFu];
+
+    return ~crc;
+}
+
+uint32_t adler32(const void *pData, size_t size, uint32_t adler) noexcept
+{
+    // Largest number of bytes the sums don't overflow 32 bits with
+    constexpr size_t NMAX = 5552u;
+    constexpr uint32_t MOD = 65521u;
+
+    const auto *p = static_cast<const uint8_t*>(pData);
+    uint32_t a = adler & 0xFFFFu,
+             b = adler >> 16u;
+    while (size > 0u)
+    {
+        size_t n = size < NMAX ? size : NMAX;
+        size -= n;
+        while (n-- > 0u)
+        {
+            a += *p++;
+            b += a;
+        }
+        a %= MOD;
+        b %= MOD;
+    }
+
+    return (b << 16u) | a;
+}
+
+static constexpr uint64_t XXH_P1 = 0x9E3779B185EBCA87ull,
+                          XXH_P2 = 0xC2B2AE3D27D4EB4Full,
+                          XXH_P3 = 0x165667B19E3779F9ull,
+                          XXH_P4 = 0x85EBCA77C2B2AE63ull,
+                          XXH_P5 = 0x27D4EB2F165667C5ull;
+
+static inline uint64_t rotl64(uint64_t v, uint r) noexcept
+{
+    return (v << r) | (v >> (64u - r));
+}
+
+static inline uint64_t xxhRound(uint64_t acc, uint64_t v) noexcept
+{
+    return rotl64(acc + v * XXH_P2, 31u) * XXH_P1;
+}
+
+static inline uint64_t xxhMerge(uint64_t h, uint64_t acc) noexcept
+{
+    return (h ^ xxhRound(0u, acc)) * XXH_P1 + XXH_P4;
+}
+
+uint64_t xxhash64(const void *pData, size_t size, uint64_t seed) noexcept
+{
+    const auto *p = static_cast<const uint8_t*>(pData),
+               *end = p + size;
+    uint64_t h;
+
+    if (size >= 32u)
+    {
+        uint64_t v[4] = { seed + XXH_P1 + XXH_P2, seed + XXH_P2, seed, seed - XXH_P1 };
+        for (; end - p >= 32; p += 32)
+            for (int i = 0; i < 4; i++)
+            {
+                uint64_t w;
+                memcpy(&w, p + i * 8, 8u);
+                v[i] = xxhRound(v[i], w);
+            }
+
+        h = rotl64(v[0], 1u) + rotl64(v[1], 7u) + rotl64(v[2], 12u) + rotl64(v[3], 18u);
+        for (const auto acc: v)
+            h = xxhMerge(h, acc);
+    }
+    else
+        h = seed + XXH_P5;
+
+    h += size;
+
+    for (; end - p >= 8; p += 8)
+    {
+        uint64_t w;
+        memcpy(&w, p, 8u);
+        h = rotl64(h ^ xxhRound(0u, w), 27u) * XXH_P1 + XXH_P4;
+    }
+    if (end - p >= 4)
+    {
+        uint32_t w;
+        memcpy(&w, p, 4u);
+        h = rotl64(h ^ (w * XXH_P1), 23u) * XXH_P2 + XXH_P3;
+        p += 4;
+    }
+    for (; p < end; p++)
+        h = rotl64(h ^ (*p * XXH_P5), 11u) * XXH_P1;
+
+    h ^= h >> 33u;
+    h *= XXH_P2;
+    h ^= h >> 29u;
+    h *= XXH_P3;
+    h ^= h >> 32u;
+    return h;
+}
@@ -904,20 +904,16 @@ void CPU6502::initOpHandlers() noexcept
 CPU6502::CPU6502()
     : m_state { STATE_HALTED }
 {
-    // Static initializer
-    static bool staticInitComplete = false;
-
-    if (!staticInitComplete)
-    {
-        initOpHandlers();
-        staticInitComplete = true;
-    }
+    // Static initializer, runs once even if CPUs are created in several threads
+    static const bool staticInitComplete = (initOpHandlers(), true);
+    (void)staticInitComplete;
 }
 
 void CPU6502::reset()
 {
     m_regs.a = m_regs.x = m_regs.y = 0;
-    m_regs.p = 0x22;
+    // Interrupts are disabled after reset
+    m_regs.p = 0x22 | (1u << static_cast<int>(Flag::I));
     m_regs.s = 0xFF;
     const auto pcl = readMem(0xFFFC),
                pch = readMem(0xFFFD);
@@ -925,6 +921,7 @@ void CPU6502::reset()
 
     m_state = STATE_RUN;
     m_nmiCount = m_rtiCount = 0;
+    m_cycles = 0u;
 }
 
 // Handle maskable interrupt
@@ -938,6 +935,7 @@ int CPU6502::IRQ()
         // Like BRK opcode, but without B flag
         push(hi_byte(m_regs.pc));
         push(lo_byte(m_regs.pc));
+        setFlag<Flag::B>(0);
         push(m_regs.p);
         setFlag<Flag::I>(1);
 
@@ -954,6 +952,7 @@ int CPU6502::IRQ()
 int CPU6502::NMI()
 {
     Log::v("NMI");
+    const c6502_word_t retAddr = m_regs.pc;
     push(hi_byte(m_regs.pc));
     push(lo_byte(m_regs.pc));
     setFlag<Flag::B>(0);
@@ -966,6 +965,9 @@ int CPU6502::NMI()
 
     m_nmiCount++;
 
+    if (m_pTrace)
+        m_pTrace->push_back({ m_cycles, retAddr, TRACE_NMI, m_regs });
+
     return 7;
 }
 
@@ -976,22 +978,47 @@ int CPU6502::run(int clk) noexcept
     int clkStep = 0, clkTotal = 0;
     do
     {
-        switch (m_state)
+        clkStep = runNext(clk);
+        clkTotal += clkStep;
+        clk -= clkStep;
+    }
+    while (clkStep > 0);
+
+    return clkTotal;
+}
+
+int CPU6502::runNext(const int clk) noexcept
+{
+    int clkStep = 0;
+    switch (m_state)
+    {
+        case STATE_RUN:
         {
-            case STATE_RUN:
+            const c6502_word_t pc = m_regs.pc;
+            TraceKind kind = TRACE_STEP;
+
+            // IRQ sources schedule their assertion in advance,
+            // so a single comparison is enough to detect it
+            if (m_cycles >= bus().nextIRQCycle() && getFlag<Flag::I>() == 0)
+            {
+                clkStep = clk >= 7 ? IRQ() : 0;
+                kind = TRACE_IRQ;
+            }
+            else
                 clkStep = step(clk);
-                clkTotal += clkStep;
-                clk -= clkStep;
-                break;
-            case STATE_ERROR:
-                Log::e("Unexpected CPU state (%d)", m_state);
-            case STATE_HALTED:
-                clkStep = 0;
+
+            if (m_pTrace && clkStep > 0)
+                m_pTrace->push_back({ m_cycles, pc, kind, m_regs });
+            m_cycles += clkStep;
+            break;
         }
+        case STATE_ERROR:
+            Log::e("Unexpected CPU state (%d)", m_state);
+        case STATE_HALTED:
+            clkStep = 0;
     }
-    while (clkStep > 0);
 
-    return clkTotal;
+    return clkStep;
 }
 
 int CPU6502::step(const int clk)
@@ -1017,6 +1044,7 @@ int CPU6502::step(const int clk)
         m_penalty = 0;
         (this->*oph)();
         rt = tacts + (usePenalty ? m_penalty : 0);
+        m_nInstructions++;
     }
 
     return rt;
@@ -1049,3 +1077,23 @@ size_t CPU6502::loadState(std::istream &in)
 
     return 7;
 }
+
+void CPU6502::snapshot(Snapshot &ss) const noexcept
+{
+    ss.regs = m_regs;
+    ss.state = m_state;
+    ss.penalty = m_penalty;
+    ss.nmiCount = m_nmiCount;
+    ss.rtiCount = m_rtiCount;
+    ss.cycles = m_cycles;
+}
+
+void CPU6502::restore(const Snapshot &ss) noexcept
+{
+    m_regs = ss.regs;
+    m_state = ss.state;
+    m_penalty = ss.penalty;
+    m_nmiCount = ss.nmiCount;
+    m_rtiCount = ss.rtiCount;
+    m_cycles = ss.cycles;
+}
@@ -0,0 +1,141 @@
+#include "deferredrenderer.h"
+#include "bus.h"
+
+#include <algorithm>
+
+constexpr int DeferredRenderer::LINES,
+              DeferredRenderer::LINE_WIDTH;
+constexpr c6502_word_t DeferredRenderer::PATTERNS_SIZE;
+
+DeferredRenderer::DeferredRenderer(ThreadPool &pool, uint nBands, Mode mode):
+    m_pool { pool },
+    m_nBands { std::min(nBands > 0u ? nBands : pool.size(), static_cast<uint>(LINES)) },
+    m_mode { mode },
+    m_composeBand { [this](uint band) { composeBand(*m_pInFlight, band); } }
+{
+    m_frames[0].reset(new Frame);
+    if (mode == Mode::Overlapped)
+        m_frames[1].reset(new Frame);
+}
+
+DeferredRenderer::~DeferredRenderer()
+{
+    m_pool.wait();
+}
+
+void DeferredRenderer::beginFrame(Bus &bus) noexcept
+{
+    // The other frame may still be composed
+    m_pRecorded = m_frames[0].get() != m_pInFlight ? m_frames[0].get() : m_frames[1].get();
+    m_pBus = &bus;
+
+    Frame &f = *m_pRecorded;
+    f.nLines = 0;
+    f.writes.clear();
+    bus.copyVideoMemory(f.memory.nametables, f.memory.palettes, f.memory.sprites);
+
+    f.patterns.resize(1u);
+    f.patterns[0].line = 0;
+    bus.readPatternTables(f.patterns[0].data);
+    m_patternsChanged = false;
+
+    bus.setFrameRecorder(this);
+}
+
+void DeferredRenderer::recordLine(const PPU::LineState &ls) noexcept
+{
+    Frame &f = *m_pRecorded;
+    assert(ls.line == f.nLines && f.nLines < LINES);
+
+    if (m_patternsChanged)
+    {
+        // Most of the writes to the cartridge don't touch the pattern tables
+        m_patternsChanged = false;
+        f.patterns.emplace_back();
+        Patterns &p = f.patterns.back();
+        m_pBus->readPatternTables(p.data);
+        p.line = ls.line;
+        if (memcmp(p.data, f.patterns[f.patterns.size() - 2u].data, PATTERNS_SIZE) == 0)
+            f.patterns.pop_back();
+    }
+
+    f.lines[f.nLines++] = ls;
+}
+
+void DeferredRenderer::endFrame(RenderingBackend &rbe) noexcept
+{
+    m_pBus->setFrameRecorder(nullptr);
+
+    Frame *pFrame = m_pRecorded;
+    m_pRecorded = nullptr;
+
+    if (m_mode == Mode::Overlapped)
+    {
+        flush(rbe);
+        m_pInFlight = pFrame;
+        m_pool.submit(m_nBands, m_composeBand);
+    }
+    else
+    {
+        m_pInFlight = pFrame;
+        m_pool.parallelFor(m_nBands, m_composeBand);
+        m_pInFlight = nullptr;
+        present(*pFrame, rbe);
+    }
+}
+
+void DeferredRenderer::flush(RenderingBackend &rbe) noexcept
+{
+    if (!m_pInFlight)
+        return;
+
+    m_pool.wait();
+    const Frame *pFrame = m_pInFlight;
+    m_pInFlight = nullptr;
+    present(*pFrame, rbe);
+}
+
+void DeferredRenderer::composeBand(Frame &f, uint band) noexcept
+{
+    const int beg = static_cast<int>(band * f.nLines / m_nBands),
+              end = static_cast<int>((band + 1u) * f.nLines / m_nBands);
+
+    PPU::VideoMemory mem;
+    memcpy(mem.nametables, f.memory.nametables, sizeof(mem.nametables));
+    memcpy(mem.palettes, f.memory.palettes, sizeof(mem.palettes));
+    memcpy(mem.sprites, f.memory.sprites, sizeof(mem.sprites));
+
+    auto w = f.writes.cbegin();
+    auto p = f.patterns.cbegin();
+    for (int n = beg; n < end; n++)
+    {
+        // Catch up with the writes made before the line
+        for (; w != f.writes.cend() && w->line <= n; ++w)
+        {
+            switch (w->target)
+            {
+                case NAMETABLES:
+                    mem.nametables[w->addr] = w->val;
+                    break;
+                case PALETTES:
+                    mem.palettes[w->addr] = w->val;
+                    break;
+                case SPRITES:
+                    mem.sprites[w->addr] = w->val;
+                    break;
+            }
+        }
+        while (p + 1 != f.patterns.cend() && (p + 1)->line <= n)
+            ++p;
+        mem.pPatterns = p->data;
+
+        f.bgColors[n] = PPU::composeLine(f.lines[n], mem, f.pixels + n * LINE_WIDTH);
+    }
+}
+
+void DeferredRenderer::present(const Frame &f, RenderingBackend &rbe) noexcept
+{
+    for (int n = 0; n < f.nLines; n++)
+        rbe.setLine(n, f.pixels + n * LINE_WIDTH, f.bgColors[n]);
+    rbe.draw();
+}
@@ -0,0 +1,122 @@
+#include "emulationthread.h"
+#include "log.h"
+
+#include <chrono>
+#include <exception>
+
+// Further behind than that, the schedule is moved instead of running frames back to back
+static constexpr int MAX_FRAMES_BEHIND = 3;
+
+void FrameHandoff::setLine(const int n, const c6502_byte_t *pColorData, const c6502_byte_t bgColor)
+{
+    assert(n >= 0 && n < TEX_HEIGHT);
+    Frame &f = m_frames.back();
+    memcpy(f.pixels + n * TEX_WIDTH, pColorData, TEX_WIDTH);
+    f.bgColors[n] = bgColor;
+}
+
+void FrameHandoff::draw()
+{
+    m_frames.back().idle = false;
+    m_frames.publish();
+}
+
+void FrameHandoff::drawIdle()
+{
+    m_frames.back().idle = true;
+    m_frames.publish();
+}
+
+bool FrameHandoff::present(RenderingBackend &rbe)
+{
+    const bool isNew = m_frames.update();
+    m_hasFrame = m_hasFrame || isNew;
+
+    const Frame &f = m_frames.front();
+    if (!m_hasFrame || f.idle)
+        rbe.drawIdle();
+    else
+    {
+        if (isNew)
+            for (int i = 0; i < TEX_HEIGHT; i++)
+                rbe.setLine(i, f.pixels + i * TEX_WIDTH, f.bgColors[i]);
+        rbe.draw();
+    }
+
+    return isNew;
+}
+
+EmulationThread::~EmulationThread()
+{
+    stop();
+}
+
+void EmulationThread::start(std::function<void()> frameFunc, uint fps)
+{
+    assert(fps > 0u);
+    if (isRunning())
+        throw Exception { Exception::IllegalOperation, "emulation thread is already running" };
+
+    // A thread that has ended on an error is still to be joined
+    stop();
+    m_stop = false;
+    m_finished = false;
+    m_thread = std::thread { &EmulationThread::run, this, std::move(frameFunc), fps };
+}
+
+void EmulationThread::stop()
+{
+    if (!m_thread.joinable())
+        return;
+
+    m_stop = true;
+    m_thread.join();
+    m_fps = 0.0f;
+}
+
+void EmulationThread::run(std::function<void()> frameFunc, uint fps)
+{
+    using Clock = std::chrono::steady_clock;
+    const auto period = std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(1.0 / fps));
+
+    auto next = Clock::now(),
+         statStart = next;
+    uint nFrames = 0u;
+    while (!m_stop.load(std::memory_order_relaxed))
+    {
+        try
+        {
+            frameFunc();
+        }
+        catch (const Exception &ex)
+        {
+            Log::e("[emu] emulation stopped: %s", ex.message());
+            break;
+        }
+        catch (const std::exception &ex)
+        {
+            Log::e("[emu] emulation stopped: %s", ex.what());
+            break;
+        }
+
+        const auto now = Clock::now();
+        if (++nFrames == fps)
+        {
+            m_fps.store(nFrames / std::chrono::duration<float>(now - statStart).count(),
+                        std::memory_order_relaxed);
+            statStart = now;
+            nFrames = 0u;
+        }
+
+        next += period;
+        if (now - next > MAX_FRAMES_BEHIND * period)
+        {
+            Log::v("[emu] frame is late, skipping ahead");
+            next = now;
+        }
+        std::this_thread::sleep_until(next);
+    }
+
+    m_fps.store(0.0f, std::memory_order_relaxed);
+    m_finished.store(true, std::memory_order_release);
+}
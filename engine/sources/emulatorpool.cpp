@@ -0,0 +1,120 @@
+#include "emulatorpool.h"
+#include "machine.h"
+#include "memorybackend.h"
+#include "loader.h"
+
+#include <algorithm>
+#include <exception>
+
+constexpr uint EmulatorPool::FRAME_WIDTH,
+               EmulatorPool::FRAME_HEIGHT,
+               EmulatorPool::FRAME_SIZE;
+
+static_assert(EmulatorPool::FRAME_SIZE == MemoryRenderingBackend::WIDTH * MemoryRenderingBackend::HEIGHT,
+              "observations are the frames of the memory backend");
+
+struct EmulatorPool::Instance
+{
+    Machine machine;
+    MemoryRenderingBackend rbe;     // keeps the picture as color indices
+
+    Instance(const RomImage::Ptr &pImage, OutputMode mode):
+        machine { pImage, mode }
+    {
+        machine.ppu().setBackend(&rbe);
+    }
+};
+
+EmulatorPool::EmulatorPool(const char *romFileName, const Config &cfg):
+    m_pool { cfg.nThreads, cfg.pinThreads },
+    m_instances(cfg.nInstances)
+{
+    // ROM is read once, all the cartridges refer to the same image
+    const RomImage::Ptr pImage = ROMLoader::readNES(romFileName);
+
+    // Each instance is allocated by the worker that is going to step it
+    std::exception_ptr pErr;
+    std::mutex errLock;
+    m_pool.parallelFor(cfg.nInstances, [this, &pImage, &cfg, &pErr, &errLock](uint i)
+    {
+        try
+        {
+            m_instances[i].reset(new Instance { pImage, cfg.mode });
+        }
+        catch (...)
+        {
+            std::lock_guard<std::mutex> lk { errLock };
+            if (!pErr)
+                pErr = std::current_exception();
+        }
+    });
+
+    if (pErr)
+        std::rethrow_exception(pErr);
+
+    if (cfg.lockstep)
+    {
+        Bus *buses[BatchCPU::LANES];
+        for (uint i = 0u; i < size(); i += BatchCPU::LANES)
+        {
+            const uint n = std::min(size() - i, BatchCPU::LANES);
+            for (uint l = 0u; l < n; l++)
+                buses[l] = &m_instances[i + l]->machine.bus();
+            m_batches.emplace_back(new BatchCPU { buses, n });
+        }
+    }
+}
+
+EmulatorPool::~EmulatorPool() = default;
+
+void EmulatorPool::reset()
+{
+    m_pool.parallelFor(size(), [this](uint i)
+    {
+        m_instances[i]->machine.bus().reset();
+    });
+}
+
+void EmulatorPool::step(const c6502_byte_t *actions)
+{
+    assert(actions != nullptr);
+    const auto setAction = [this, actions](uint i)
+    {
+        Instance &inst = *m_instances[i];
+        Gamepad &pad = inst.machine.pad(0);
+        auto in = pad.input();
+        in.pressed = actions[i];
+        in.turbo = 0u;
+        pad.setInput(in);
+    };
+
+    if (!m_batches.empty())
+    {
+        m_pool.parallelFor(static_cast<uint>(m_batches.size()), [this, &setAction](uint b)
+        {
+            BatchCPU &batch = *m_batches[b];
+            for (uint l = 0u; l < batch.size(); l++)
+                setAction(b * BatchCPU::LANES + l);
+            batch.runFrame(Bus::FRAME_VIDEO);
+        });
+        return;
+    }
+
+    m_pool.parallelFor(size(), [this, &setAction](uint i)
+    {
+        setAction(i);
+        m_instances[i]->machine.runFrame(Bus::FRAME_VIDEO);
+    });
+}
+
+const c6502_byte_t *EmulatorPool::observation(uint i) const noexcept
+{
+    assert(i < size());
+    return m_instances[i]->rbe.frame();
+}
+
+Bus &EmulatorPool::bus(uint i) noexcept
+{
+    assert(i < size());
+    return m_instances[i]->machine.bus();
+}
@@ -0,0 +1,252 @@
+#include "framecapture.h"
+#include "memorybackend.h"
+#include "checksum.h"
+#include "log.h"
+
+#include <cstdio>
+#include <cstring>
+
+constexpr uint FrameCapture::WIDTH,
+               FrameCapture::HEIGHT,
+               FrameCapture::FRAME_SIZE;
+
+static void putBE(uint8_t *p, uint32_t v) noexcept
+{
+    for (uint i = 0u; i < 4u; i++)
+        p[i] = static_cast<uint8_t>(v >> (24u - i * 8u));
+}
+
+// PNG chunk: length, type, data, CRC-32 of the type and data.
+// Returns offset of the data, size bytes are reserved for it.
+static size_t beginChunk(std::vector<uint8_t> &buf, const char *type, uint32_t size)
+{
+    const size_t pos = buf.size();
+    buf.resize(pos + 8u + size);
+    putBE(&buf[pos], size);
+    memcpy(&buf[pos + 4u], type, 4u);
+    return pos + 8u;
+}
+
+static void endChunk(std::vector<uint8_t> &buf, size_t dataPos)
+{
+    const size_t typePos = dataPos - 4u;
+    const uint32_t crc = crc32(&buf[typePos], buf.size() - typePos);
+    buf.resize(buf.size() + 4u);
+    putBE(&buf[buf.size() - 4u], crc);
+}
+
+// NES colors in BT.601 studio range
+struct YUVTable
+{
+    uint8_t y[64], u[64], v[64];
+
+    YUVTable() noexcept
+    {
+        for (c6502_byte_t c = 0u; c < 64u; c++)
+        {
+            const uint8_t *rgb = MemoryRenderingBackend::colorRGBA8(c);
+            const int r = rgb[0], g = rgb[1], b = rgb[2];
+            y[c] = static_cast<uint8_t>(((66 * r + 129 * g + 25 * b + 128) >> 8) + 16);
+            u[c] = static_cast<uint8_t>(((-38 * r - 74 * g + 112 * b + 128) >> 8) + 128);
+            v[c] = static_cast<uint8_t>(((112 * r - 94 * g - 18 * b + 128) >> 8) + 128);
+        }
+    }
+};
+
+FrameCapture::~FrameCapture()
+{
+    stop();
+}
+
+void FrameCapture::start(const std::string &path, Format fmt, uint fps, uint nSlots, bool waitWhenFull)
+{
+    if (m_running)
+        throw Exception { Exception::IllegalOperation, "frame capture is already running" };
+    if (fps == 0u || nSlots == 0u)
+        throw Exception { Exception::IllegalArgument, "frame rate and queue size must be positive" };
+
+    if (fmt != Format::PNG)
+    {
+        m_out.open(path + (fmt == Format::RAW ? ".raw" : ".y4m"),
+                   std::ios_base::out | std::ios_base::binary | std::ios_base::trunc);
+        if (!m_out)
+            throw Exception { Exception::IOFailure, "failed to create frame capture file" };
+
+        if (fmt == Format::Y4M)
+        {
+            char header[64];
+            const int n = snprintf(header, sizeof(header), "YUV4MPEG2 W%u H%u F%u:1 Ip A1:1 C444\n", WIDTH, HEIGHT, fps);
+            m_out.write(header, n);
+        }
+    }
+
+    m_path = path;
+    m_fmt = fmt;
+    m_waitWhenFull = waitWhenFull;
+    m_failed = false;
+    m_nSubmitted = 0u;
+    m_nDropped = 0u;
+    m_nWritten = 0u;
+    m_running = true;
+    m_slots.start(nSlots, [this](const Slot &slot) { processSlot(slot); });
+
+    Log::i("[capture] started: %s, %u frames queued at most", path.c_str(), nSlots);
+}
+
+void FrameCapture::stop()
+{
+    if (!m_running)
+        return;
+
+    m_slots.stop();
+
+    if (m_out.is_open())
+        m_out.close();
+    m_running = false;
+
+    if (m_failed)
+        Log::e("[capture] failed: %s", m_error.c_str());
+    if (m_nDropped > 0u)
+        Log::w("[capture] dropped %u frames", m_nDropped.load());
+    Log::i("[capture] %u frames written", m_nWritten.load());
+}
+
+bool FrameCapture::submit(const c6502_byte_t *pFrame) noexcept
+{
+    if (!m_running || m_failed)
+        return false;
+
+    const uint number = m_nSubmitted++;
+    Slot *pSlot = m_slots.acquire(m_waitWhenFull);
+    if (!pSlot)
+    {
+        m_nDropped++;
+        return false;
+    }
+
+    memcpy(pSlot->pixels, pFrame, FRAME_SIZE);
+    pSlot->number = number;
+    m_slots.publish();
+    return true;
+}
+
+void FrameCapture::processSlot(const Slot &slot) noexcept
+{
+    if (m_failed)
+        return;
+
+    try
+    {
+        writeFrame(slot);
+        m_nWritten++;
+    }
+    catch (const Exception &ex)
+    {
+        m_error = ex.message();
+        m_failed = true;
+    }
+}
+
+void FrameCapture::writeFrame(const Slot &slot)
+{
+    m_buf.clear();
+    switch (m_fmt)
+    {
+        case Format::PNG:
+        {
+            encodePNG(slot.pixels);
+
+            char suffix[32];
+            snprintf(suffix, sizeof(suffix), "_%06u.png", slot.number);
+            std::ofstream out { m_path + suffix, std::ios_base::out | std::ios_base::binary | std::ios_base::trunc };
+            out.write(reinterpret_cast<const char*>(m_buf.data()), static_cast<std::streamsize>(m_buf.size()));
+            if (!out)
+                throw Exception { Exception::IOFailure, "failed to write PNG file" };
+            return;
+        }
+        case Format::RAW:
+            encodeRGBA8(slot.pixels);
+            break;
+        case Format::Y4M:
+            encodeY4M(slot.pixels);
+            break;
+    }
+
+    m_out.write(reinterpret_cast<const char*>(m_buf.data()), static_cast<std::streamsize>(m_buf.size()));
+    if (!m_out)
+        throw Exception { Exception::IOFailure, "failed to write frame capture file" };
+}
+
+void FrameCapture::encodePNG(const c6502_byte_t *pPixels)
+{
+    static const uint8_t SIGNATURE[8] = { 0x89u, 'P', 'N', 'G', '\r', '\n', 0x1Au, '\n' };
+
+    // Rows start with the filter type; the image is stored uncompressed in a single deflate block
+    constexpr uint ROW_SIZE = WIDTH + 1u,
+                   IMAGE_SIZE = ROW_SIZE * HEIGHT;
+    static_assert(IMAGE_SIZE <= 0xFFFFu, "image doesn't fit a stored deflate block");
+
+    m_buf.insert(m_buf.end(), SIGNATURE, SIGNATURE + sizeof(SIGNATURE));
+
+    size_t p = beginChunk(m_buf, "IHDR", 13u);
+    putBE(&m_buf[p], WIDTH);
+    putBE(&m_buf[p + 4u], HEIGHT);
+    m_buf[p + 8u] = 8u;     // bits per index
+    m_buf[p + 9u] = 3u;     // palette
+    m_buf[p + 10u] = m_buf[p + 11u] = m_buf[p + 12u] = 0u;
+    endChunk(m_buf, p);
+
+    p = beginChunk(m_buf, "PLTE", 64u * 3u);
+    for (c6502_byte_t c = 0u; c < 64u; c++)
+        memcpy(&m_buf[p + c * 3u], MemoryRenderingBackend::colorRGBA8(c), 3u);
+    endChunk(m_buf, p);
+
+    // zlib stream: header, the block, Adler-32 of the image
+    p = beginChunk(m_buf, "IDAT", 2u + 5u + IMAGE_SIZE + 4u);
+    uint8_t *pOut = &m_buf[p];
+    *pOut++ = 0x78u;
+    *pOut++ = 0x01u;
+    *pOut++ = 0x01u;        // final stored block
+    *pOut++ = static_cast<uint8_t>(IMAGE_SIZE & 0xFFu);
+    *pOut++ = static_cast<uint8_t>(IMAGE_SIZE >> 8u);
+    *pOut++ = static_cast<uint8_t>(~IMAGE_SIZE & 0xFFu);
+    *pOut++ = static_cast<uint8_t>((~IMAGE_SIZE >> 8u) & 0xFFu);
+    const uint8_t *pImage = pOut;
+    for (uint y = 0u; y < HEIGHT; y++)
+    {
+        *pOut++ = 0u;
+        memcpy(pOut, pPixels + y * WIDTH, WIDTH);
+        pOut += WIDTH;
+    }
+    putBE(pOut, adler32(pImage, IMAGE_SIZE));
+    endChunk(m_buf, p);
+
+    endChunk(m_buf, beginChunk(m_buf, "IEND", 0u));
+}
+
+void FrameCapture::encodeY4M(const c6502_byte_t *pPixels)
+{
+    static const YUVTable t;
+    static const char FRAME_HEADER[] = "FRAME\n";
+
+    m_buf.resize(sizeof(FRAME_HEADER) - 1u + FRAME_SIZE * 3u);
+    memcpy(m_buf.data(), FRAME_HEADER, sizeof(FRAME_HEADER) - 1u);
+    uint8_t *pY = m_buf.data() + sizeof(FRAME_HEADER) - 1u,
+            *pU = pY + FRAME_SIZE,
+            *pV = pU + FRAME_SIZE;
+    for (uint i = 0u; i < FRAME_SIZE; i++)
+    {
+        const c6502_byte_t c = pPixels[i];
+        pY[i] = t.y[c];
+        pU[i] = t.u[c];
+        pV[i] = t.v[c];
+    }
+}
+
+void FrameCapture::encodeRGBA8(const c6502_byte_t *pPixels)
+{
+    m_buf.resize(FRAME_SIZE * 4u);
+    uint8_t *pDst = m_buf.data();
+    for (uint i = 0u; i < FRAME_SIZE; i++, pDst += 4)
+        memcpy(pDst, MemoryRenderingBackend::colorRGBA8(pPixels[i]), 4u);
+}
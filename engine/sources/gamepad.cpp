@@ -17,12 +17,45 @@ void Gamepad::buttonEvent(Button b, bool pressed, bool turbo, bool pad2) noexcep
     m_turboOn[i] = turbo;
 }
 
-bool Gamepad::turboTest(int btnInd) const noexcept
+bool Gamepad::turboTest(int btnInd, int frame) const noexcept
 {
     if (!m_turboOn[btnInd])
         return true;
 
-    return divrnd(bus().currentTimeMs() * TURBO_FREQ, 1000) % 2 == 0;
+    // Counted in frames, not in time, so recorded input replays the same way
+    const int fps = bus().getMode() == OutputMode::NTSC ? 60 : 50;
+    return divrnd(frame * TURBO_FREQ, fps) % 2 == 0;
+}
+
+c6502_byte_t Gamepad::buttonsAt(int frame) const noexcept
+{
+    c6502_byte_t v = 0u;
+    for (int i = 0; i < 8; i++)
+        if (m_buttonState[i] && turboTest(i, frame))
+            v |= 1u << i;
+    return v;
+}
+
+Gamepad::Input Gamepad::input() const noexcept
+{
+    Input in = { 0u, 0u, m_lightGunDetector, m_lightGunTrigger };
+    for (int i = 0; i < 16; i++)
+    {
+        in.pressed |= static_cast<uint16_t>(m_buttonState[i]) << i;
+        in.turbo |= static_cast<uint16_t>(m_turboOn[i]) << i;
+    }
+    return in;
+}
+
+void Gamepad::setInput(const Input &in) noexcept
+{
+    for (int i = 0; i < 16; i++)
+    {
+        m_buttonState[i] = (in.pressed >> i) & 1u;
+        m_turboOn[i] = (in.turbo >> i) & 1u;
+    }
+    m_lightGunDetector = in.lightGunDetector;
+    m_lightGunTrigger = in.lightGunTrigger;
 }
 
 c6502_byte_t Gamepad::readRegister() noexcept
@@ -31,7 +64,7 @@ c6502_byte_t Gamepad::readRegister() noexcept
 
     const int ind = std::min(m_ind++, IND_LIM);
     c6502_byte_t v = 0u;
-    if (m_buttonState[ind] && turboTest(ind))
+    if (m_buttonState[ind] && turboTest(ind, bus().currentFrame()))
         v = 1u;
 
     if (m_lightGunTrigger)
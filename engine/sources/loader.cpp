@@ -1,13 +1,12 @@
 #include "loader.h"
-#include "mappers/nrom.h"
+#include "rompack.h"
 #include <cstring>
-#include <fstream>
 #include <cassert>
 #include <algorithm>
+#include <vector>
 
 using std::ios;
 using std::istream;
-using std::ifstream;
 
 bool NESHeader::checkValid() const
 {
@@ -37,6 +36,31 @@ static void sread(void *pDest, size_t nBytes, istream &in)
         throw Exception(Exception::IllegalFormat, "unexpected end of file");
 }
 
+static NESHeader parseHeader(const c6502_byte_t *p, size_t size)
+{
+    if (size < NES_HEADER_SIZE)
+        throw Exception(Exception::IllegalFormat, "unexpected end of file");
+
+    NESHeader hdr;
+    memcpy(&hdr, p, sizeof(NESHeader));
+    if (!hdr.checkValid())
+        throw Exception(Exception::IllegalFormat, "incorrect NES ROM header");
+
+    for (size_t i = sizeof(NESHeader); i < NES_HEADER_SIZE; i++)
+        if (p[i] != 0)
+            throw Exception(Exception::IllegalFormat, "unexpected data");
+
+    const size_t expected = NES_HEADER_SIZE + (hdr.hasTrainer ? NES_TRAINER_SIZE : 0u) +
+                            static_cast<size_t>(hdr.nROMs) * Mapper::ROM_SIZE +
+                            static_cast<size_t>(hdr.nVROMs) * Mapper::VROM_SIZE;
+    if (size < expected)
+        throw Exception(Exception::IllegalFormat, "unexpected end of file");
+    if (size > expected)
+        throw Exception(Exception::IllegalFormat, "enormous file size excession");
+
+    return hdr;
+}
+
 void ROMLoader::loadRawData(istream &in,
                             c6502_word_t addr,
                             c6502_word_t len)
@@ -51,91 +75,61 @@ void ROMLoader::loadRawData(istream &in,
     // Go to the start pf the block
     in.seekg(0, ios::beg);
 
-    m_cart.setMapper(Mapper::Default);
-    DefaultMapper *dm = static_cast<DefaultMapper*>(m_cart.mapper());
+    // Two banks of the default mapper, zeroes where there's no data,
+    // and the blank CHR bank it reads patterns from
+    std::vector<c6502_byte_t> rom(2u * Mapper::ROM_SIZE + Mapper::VROM_SIZE, 0u);
+    sread(rom.data() + (addr - 0x8000u), sourceSize, in);
 
-    c6502_byte_t buf[1024];
-    c6502_d_word_t left = sourceSize;
-    while (in.good() && left > 0)
-    {
-        in.read(reinterpret_cast<char*>(buf), 1024);
-        c6502_d_word_t read = in.gcount();
-        if (read > left)
-            // Write the remainder and quit
-            read = left;
+    m_cart.setMapper(Mapper::Default,
+                     std::make_shared<RomImage>(std::move(rom), 0u, 2, 1));
+}
 
-        dm->flash(addr, buf, read);
+RomImage::Ptr ROMLoader::readNES(const char *file)
+{
+    // Mapped when possible, the header is checked in place and the banks are never copied
+    std::shared_ptr<const MappedFile> pFile { new MappedFile { file } };
 
-        addr += read;
-        left -= read;
-    }
+    const NESHeader hdr = parseHeader(pFile->data(), pFile->size());
+    const size_t prgOffset = NES_HEADER_SIZE + (hdr.hasTrainer ? NES_TRAINER_SIZE : 0u);
+    return std::make_shared<RomImage>(pFile, 0u, pFile->size(), prgOffset, hdr.nROMs, hdr.nVROMs);
 }
 
 void ROMLoader::loadNES(const char *file)
 {
-    ifstream in(file, ios::in | ios::binary);
-    if (!in.is_open())
-        throw Exception(Exception::IOFailure, "unable to open the file");
-
-    // Read & check header
-    try
-    {
-        sread(&m_hdr, sizeof(NESHeader), in);
-
-        if (!m_hdr.checkValid())
-            throw Exception(Exception::IllegalFormat, "incorrect NES ROM header");
-
-        c6502_byte_t zeroes[6];
-        sread(zeroes, 6, in);
-
-        for (int i = 0; i < 6; i++)
-            if (zeroes[i] != 0)
-                throw Exception(Exception::IllegalFormat, "unexpected data");
-
-        if (m_hdr.hasTrainer)
-        {
-            c6502_byte_t train[512];
-            sread(train, 512, in);
-            m_cart.setTrainer(train);
-        }
-
-        if (m_hdr.fourScreenVRAM)
-            m_cart.setMirroring(Mirroring::FourScreen);
-        else if (m_hdr.mirror)
-            m_cart.setMirroring(Mirroring::Vertical);
-        else
-            m_cart.setMirroring(Mirroring::Horizontal);
-
-        // RAM counter fixup for compatibility
-        const int nRAMs = (m_hdr.hasRAM && m_hdr.nRAMs == 0) ? 1 : m_hdr.nRAMs;
-        m_cart.setMapper(m_hdr.mapperLo | (m_hdr.mapperHi << 4),
-                         m_hdr.nROMs,
-                         m_hdr.nVROMs,
-                         nRAMs);
-        Mapper *map = m_cart.mapper();
-
-        c6502_byte_t rom[Mapper::ROM_SIZE];
-        for (int i = 0; i < m_hdr.nROMs; i++)
-        {
-            sread(rom, Mapper::ROM_SIZE, in);
-            map->setROMBank(i, rom);
-        }
-
-        c6502_byte_t vrom[Mapper::VROM_SIZE];
-        for (int i = 0; i < m_hdr.nVROMs; i++)
-        {
-            sread(vrom, Mapper::VROM_SIZE, in);
-            map->setVROMBank(i, vrom);
-        }
-
-        // No data left
-        if (in.get() != ifstream::traits_type::eof())
-            throw Exception(Exception::IllegalFormat, "enormous file size excession");
-    }
-    catch (const Exception&)
-    {
-        in.close();
-        throw;
-    }
-    in.close();
+    loadNES(readNES(file));
+}
+
+void ROMLoader::loadNES(const RomImage::Ptr &pImage)
+{
+    assert(pImage != nullptr);
+    m_hdr = parseHeader(pImage->data(), pImage->size());
+
+    if (m_hdr.hasTrainer)
+        m_cart.setTrainer(pImage->data() + NES_HEADER_SIZE);
+
+    m_cart.setMirroring(m_hdr.mirroring());
+    m_cart.setMapper(m_hdr.mapperType(),
+                     pImage,
+                     m_hdr.numRAMs());
+}
+
+void ROMLoader::loadFromPack(const RomPack &pack, uint64_t hash)
+{
+    const int ind = pack.find(hash);
+    if (ind < 0)
+        throw Exception(Exception::IllegalArgument, "ROM is not in the pack");
+
+    const RomPack::Entry e = pack.entry(ind);
+    RomImage::Ptr pImage = pack.image(e);
+
+    // The original header was validated when the pack was built
+    memcpy(&m_hdr, e.header, sizeof(NESHeader));
+
+    if (e.hasTrainer)
+        m_cart.setTrainer(pImage->data());
+
+    m_cart.setMirroring(e.mirroring);
+    m_cart.setMapper(e.mapper,
+                     std::move(pImage),
+                     e.nRAMs);
 }
@@ -3,8 +3,6 @@
 #include <cstdarg>
 #include <cassert>
 
-Log *Log::s_pInst = nullptr;
-
 void Log::print(Severity sl, const char *fmt, ...)
 {
     if ((m_config.filter & sl) == 0)
@@ -13,6 +11,9 @@ void Log::print(Severity sl, const char *fmt, ...)
     assert(m_config.pOutput != nullptr && m_config.pOutput->good());
     constexpr int BUF_MAX = 2048;
     char buf[BUF_MAX];
+
+    // Time conversion uses a static buffer, so everything is done under the lock
+    std::lock_guard<std::mutex> lk { m_lock };
     if (m_config.printTime)
     {
         using std::chrono::system_clock;
@@ -0,0 +1,176 @@
+#include "lzcodec.h"
+
+#include <algorithm>
+#include <cstring>
+
+constexpr size_t LZCodec::MIN_MATCH,
+                 LZCodec::MAX_OFFSET;
+
+// Positions of the last occurrences of 4-byte sequences
+static constexpr uint HASH_BITS = 13u;
+
+// Input tail that is always stored as literals, keeps the match search in bounds
+static constexpr size_t LAST_LITERALS = 8u;
+
+static constexpr uint NIBBLE_MAX = 15u;
+
+static inline uint32_t load32(const uint8_t *p) noexcept
+{
+    uint32_t v;
+    memcpy(&v, p, sizeof(v));
+    return v;
+}
+
+static inline uint64_t load64(const uint8_t *p) noexcept
+{
+    uint64_t v;
+    memcpy(&v, p, sizeof(v));
+    return v;
+}
+
+static inline uint hashOf(uint32_t seq) noexcept
+{
+    return (seq * 2654435761u) >> (32u - HASH_BITS);
+}
+
+static inline uint8_t *putLength(uint8_t *p, size_t len) noexcept
+{
+    for (; len >= 255u; len -= 255u)
+        *p++ = 255u;
+    *p++ = static_cast<uint8_t>(len);
+    return p;
+}
+
+static inline bool getLength(const uint8_t *&p, const uint8_t *end, size_t &len) noexcept
+{
+    uint8_t b;
+    do
+    {
+        if (p == end)
+            return false;
+        b = *p++;
+        len += b;
+    }
+    while (b == 255u);
+    return true;
+}
+
+static uint8_t *putSequence(uint8_t *o, const uint8_t *pLit, size_t nLit, size_t offset, size_t matchLen) noexcept
+{
+    uint8_t &token = *o++;
+    token = static_cast<uint8_t>(std::min<size_t>(nLit, NIBBLE_MAX) << 4u);
+    if (nLit >= NIBBLE_MAX)
+        o = putLength(o, nLit - NIBBLE_MAX);
+    memcpy(o, pLit, nLit);
+    o += nLit;
+
+    if (matchLen > 0u)
+    {
+        *o++ = static_cast<uint8_t>(offset);
+        *o++ = static_cast<uint8_t>(offset >> 8u);
+
+        const size_t ml = matchLen - LZCodec::MIN_MATCH;
+        token |= static_cast<uint8_t>(std::min<size_t>(ml, NIBBLE_MAX));
+        if (ml >= NIBBLE_MAX)
+            o = putLength(o, ml - NIBBLE_MAX);
+    }
+    return o;
+}
+
+size_t LZCodec::compress(const uint8_t *pIn, size_t n, uint8_t *pOut) noexcept
+{
+    assert(pIn != nullptr && pOut != nullptr);
+
+    uint32_t table[1u << HASH_BITS] = { };
+
+    const uint8_t *ip = pIn,
+                  *anchor = pIn,
+                  *limit = n > LAST_LITERALS ? pIn + n - LAST_LITERALS : pIn;
+    uint8_t *o = pOut;
+
+    while (ip + MIN_MATCH <= limit)
+    {
+        const uint32_t seq = load32(ip);
+        uint32_t &slot = table[hashOf(seq)];
+        const uint8_t *ref = pIn + slot;
+        slot = static_cast<uint32_t>(ip - pIn);
+
+        if (ref >= ip || static_cast<size_t>(ip - ref) > MAX_OFFSET || load32(ref) != seq)
+        {
+            // Step faster through data that doesn't compress
+            ip += 1u + (static_cast<size_t>(ip - anchor) >> 6u);
+            continue;
+        }
+
+        // Extend the match word by word, then byte by byte
+        const uint8_t *m = ip + MIN_MATCH,
+                      *r = ref + MIN_MATCH;
+        while (m + 8u <= limit && load64(m) == load64(r))
+        {
+            m += 8u;
+            r += 8u;
+        }
+        while (m < limit && *m == *r)
+        {
+            m++;
+            r++;
+        }
+
+        o = putSequence(o, anchor, ip - anchor, ip - ref, m - ip);
+        ip = anchor = m;
+    }
+
+    o = putSequence(o, anchor, pIn + n - anchor, 0u, 0u);
+
+    assert(static_cast<size_t>(o - pOut) <= maxCompressedSize(n));
+    return o - pOut;
+}
+
+bool LZCodec::decompress(const uint8_t *pIn, size_t inSize, uint8_t *pOut, size_t n) noexcept
+{
+    const uint8_t *p = pIn,
+                  *end = pIn + inSize;
+    size_t o = 0u;
+    while (p < end)
+    {
+        const uint8_t token = *p++;
+
+        size_t nLit = token >> 4u;
+        if (nLit == NIBBLE_MAX && !getLength(p, end, nLit))
+            return false;
+        if (nLit > static_cast<size_t>(end - p) || nLit > n - o)
+            return false;
+        memcpy(pOut + o, p, nLit);
+        p += nLit;
+        o += nLit;
+
+        // The last sequence has no match
+        if (p == end)
+            break;
+
+        if (end - p < 2)
+            return false;
+        const size_t offset = p[0] | (static_cast<size_t>(p[1]) << 8u);
+        p += 2;
+
+        size_t len = token & NIBBLE_MAX;
+        if (len == NIBBLE_MAX && !getLength(p, end, len))
+            return false;
+        len += MIN_MATCH;
+
+        if (offset == 0u || offset > o || len > n - o)
+            return false;
+
+        uint8_t *d = pOut + o;
+        const uint8_t *s = d - offset;
+        if (offset >= len)
+            memcpy(d, s, len);
+        else
+            // Overlapping match repeats the last offset bytes
+            for (size_t i = 0u; i < len; i++)
+                d[i] = s[i];
+        o += len;
+    }
+
+    return o == n;
+}
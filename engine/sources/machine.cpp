@@ -0,0 +1,41 @@
+#include "machine.h"
+#include "loader.h"
+
+Machine::Machine(const RomImage::Ptr &pImage, const OutputMode mode):
+    m_bus { mode }
+{
+    m_bus.setCPU(&m_cpu);
+    m_bus.setPPU(&m_ppu);
+    m_bus.setAPU(&m_apu);
+    m_bus.setGamePad(0, &m_pads[0]);
+    m_bus.setGamePad(1, &m_pads[1]);
+
+    ROMLoader loader { m_cart };
+    loader.loadNES(pImage);
+    m_bus.injectCartrige(&m_cart);
+
+    m_clone.resize(m_bus.snapshotSize());
+}
+
+void Machine::clone(Machine &target) const
+{
+    if (&target == this)
+        return;
+
+    if (target.romImage() != romImage())
+        throw Exception { Exception::IllegalArgument, "clone target has another ROM image" };
+
+    assert(target.m_clone.size() == m_bus.snapshotSize());
+    m_bus.snapshot(target.m_clone.data());
+    target.m_bus.restore(target.m_clone.data());
+
+    for (int i = 0; i < 2; i++)
+        target.m_pads[i].setInput(m_pads[i].input());
+}
+
+std::unique_ptr<Machine> Machine::clone() const
+{
+    std::unique_ptr<Machine> pTarget { new Machine { romImage(), m_bus.getMode() } };
+    clone(*pTarget);
+    return pTarget;
+}
@@ -0,0 +1,85 @@
+#include "mappedfile.h"
+#include "log.h"
+
+#include <algorithm>
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <cerrno>
+#include <fcntl.h>
+#include <unistd.h>
+#define HAVE_MMAP
+#else
+#include <fstream>
+#endif
+
+// Size of pipes and devices is unknown, so no seeking: read until the end
+static constexpr size_t READ_CHUNK_SIZE = 64u * 1024u;
+
+MappedFile::MappedFile(const char *fileName)
+{
+#ifdef HAVE_MMAP
+    const int fd = open(fileName, O_RDONLY);
+    if (fd < 0)
+        throw Exception { Exception::IOFailure, "unable to open the file" };
+
+    struct stat st;
+    if (fstat(fd, &st) == 0 && S_ISREG(st.st_mode))
+    {
+        m_size = static_cast<size_t>(st.st_size);
+        void *p = m_size > 0u ? mmap(nullptr, m_size, PROT_READ, MAP_PRIVATE, fd, 0) : MAP_FAILED;
+        if (p != MAP_FAILED)
+        {
+            m_pData = static_cast<const uint8_t*>(p);
+            m_isMapped = true;
+            close(fd);
+            return;
+        }
+    }
+    Log::d("[file] %s is not mapped, reading", fileName);
+
+    // Read from the descriptor already open: opening a FIFO again would
+    // disconnect its writer in between
+    bool failed = false;
+    for (;;)
+    {
+        const size_t off = m_buf.size();
+        m_buf.resize(off + READ_CHUNK_SIZE);
+        const ssize_t n = read(fd, m_buf.data() + off, READ_CHUNK_SIZE);
+        m_buf.resize(off + static_cast<size_t>(std::max<ssize_t>(n, 0)));
+        if (n > 0 || (n < 0 && errno == EINTR))
+            continue;
+        failed = n < 0;
+        break;
+    }
+    close(fd);
+    if (failed)
+        throw Exception { Exception::IOFailure, "unable to read the file" };
+#else
+    std::ifstream fin { fileName, std::ios_base::in | std::ios_base::binary };
+    if (!fin)
+        throw Exception { Exception::IOFailure, "unable to open the file" };
+
+    while (fin)
+    {
+        const size_t off = m_buf.size();
+        m_buf.resize(off + READ_CHUNK_SIZE);
+        fin.read(reinterpret_cast<char*>(m_buf.data() + off), READ_CHUNK_SIZE);
+        m_buf.resize(off + static_cast<size_t>(fin.gcount()));
+    }
+    if (fin.bad())
+        throw Exception { Exception::IOFailure, "unable to read the file" };
+#endif
+
+    m_pData = m_buf.data();
+    m_size = m_buf.size();
+}
+
+MappedFile::~MappedFile()
+{
+#ifdef HAVE_MMAP
+    if (m_isMapped)
+        munmap(const_cast<uint8_t*>(m_pData), m_size);
+#endif
+}
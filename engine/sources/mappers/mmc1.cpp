@@ -1,7 +1,8 @@
 #include "mappers/mmc1.h"
+#include "bus.h"
 
-MMC1::MMC1(int nROMs, int nVROMs, int nRAMs):
-    Mapper { nROMs, nVROMs, nRAMs }
+MMC1::MMC1(RomImage::Ptr pImage, int nRAMs):
+    Mapper { std::move(pImage), nRAMs }
 {
     setFeature<RAM>(nRAMs > 0);
 }
@@ -10,16 +11,16 @@ c6502_byte_t MMC1::readMem(c6502_word_t addr)
 {
     if (addr >= 0xC000u)
     {
-        auto &bh = romBank(m_modePrg == 3u ? numROMs() - 1  :
-                           m_modePrg == 2u ? m_curPrg       :
-                           m_curPrg + 1);
-        return bh.Read(addr - 0xC000u);
+        const c6502_byte_t *bh = romBank(m_modePrg == 3u ? numROMs() - 1  :
+                                         m_modePrg == 2u ? m_curPrg       :
+                                         m_curPrg + 1);
+        return bh[addr - 0xC000u];
     }
     else if (addr >= 0x8000u)
     {
-        auto &bl = romBank(m_modePrg == 2u ? 0 :
-                           m_curPrg);
-        return bl.Read(addr - 0x8000u);
+        const c6502_byte_t *bl = romBank(m_modePrg == 2u ? 0 :
+                                         m_curPrg);
+        return bl[addr - 0x8000u];
     }
     else if (addr >= 0x6000u && numRAMs() >= 1)
     {
@@ -56,7 +57,34 @@ c6502_byte_t MMC1::readVideoMem(c6502_word_t addr)
         }
     }
 
-    return vromBank(ind).Read(off);
+    return vromBank(ind)[off];
+}
+
+void MMC1::readPatterns(c6502_byte_t *pDst)
+{
+    if (hasFeature<RAM>())
+        return Mapper::readPatterns(pDst);
+
+    // Same banks as readVideoMem(): 4K halves of the 8K banks in the 4K mode
+    for (int h = 0; h < 2; h++)
+    {
+        const c6502_byte_t *pSrc = m_modeChr == 1u ?
+                                   vromBank(m_curChr[h] / 2) + (m_curChr[h] % 2) * 0x1000u :
+                                   vromBank(m_curChr[0]) + h * 0x1000u;
+        memcpy(pDst + h * 0x1000u, pSrc, 0x1000u);
+    }
+}
+
+const c6502_byte_t *MMC1::romPage(c6502_word_t addr) const noexcept
+{
+    assert(addr >= 0x8000u);
+    // Same banks as readMem()
+    const c6502_byte_t *pBank = addr >= 0xC000u ?
+                                romBank(m_modePrg == 3u ? numROMs() - 1  :
+                                        m_modePrg == 2u ? m_curPrg       :
+                                        m_curPrg + 1) :
+                                romBank(m_modePrg == 2u ? 0 : m_curPrg);
+    return pBank + (addr & 0x2000u);
 }
 
 Mirroring MMC1::updateMirroring(Mirroring cur) noexcept
@@ -92,6 +120,7 @@ void MMC1::writeMem(c6502_word_t addr, c6502_byte_t val)
             {
                 writeRegister(addr, pv | (m_shiftReg >> 1u));
                 m_shiftReg = 0x10u;
+                PERF_COUNT(bus().perfMeter(), bankSwitches);
             }
             else
                 m_shiftReg = pv | (m_shiftReg >> 1u);
@@ -139,3 +168,37 @@ void MMC1::writeRegister(c6502_word_t addr, c6502_byte_t val)
         // TODO: MMC1A, MMC1B logic
     }
 }
+
+void MMC1::snapshot(void *pDst) const noexcept
+{
+    Mapper::snapshot(pDst);
+
+    Registers r;
+    r.shiftReg = m_shiftReg;
+    r.modeChr = m_modeChr;
+    r.modePrg = m_modePrg;
+    r.curChr[0] = m_curChr[0];
+    r.curChr[1] = m_curChr[1];
+    r.curPrg = m_curPrg;
+    r.hasMirr = !m_mirrOverride.isNothing();
+    r.mirr = m_mirrOverride.value(Mirroring::Horizontal);
+    snapshotRegisters(pDst, r);
+}
+
+void MMC1::restore(const void *pSrc) noexcept
+{
+    Mapper::restore(pSrc);
+
+    Registers r;
+    restoreRegisters(pSrc, r);
+    m_shiftReg = r.shiftReg;
+    m_modeChr = r.modeChr;
+    m_modePrg = r.modePrg;
+    m_curChr[0] = r.curChr[0];
+    m_curChr[1] = r.curChr[1];
+    m_curPrg = r.curPrg;
+    if (r.hasMirr)
+        m_mirrOverride = r.mirr;
+    else
+        m_mirrOverride.unset();
+}
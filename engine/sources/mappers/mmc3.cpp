@@ -0,0 +1,228 @@
+#include "mappers/mmc3.h"
+#include "bus.h"
+
+constexpr c6502_d_word_t MMC3::PRG_PAGE_SIZE,
+                         MMC3::CHR_PAGE_SIZE;
+
+MMC3::MMC3(RomImage::Ptr pImage, int nRAMs):
+    Mapper { std::move(pImage), nRAMs }
+{
+    assert(nRAMs >= 1);
+
+    // Without CHR ROM pattern tables are in RAM, the Bus routes them to readMem / writeMem
+    if (numVROMs() == 0)
+    {
+        m_pChrRAM.reset(new VROM_BANK);
+        m_pChrRAM->Clear();
+    }
+    setFeature<RAM>(m_pChrRAM != nullptr);
+    setFeature<SCANLINE_COUNTER>(true);
+
+    updateBanks();
+}
+
+const c6502_byte_t *MMC3::prgPage(int n) noexcept
+{
+    // We store PRG ROMs in 16K banks, MMC3 switches 8K pages
+    constexpr int PAGES_PER_BANK = ROM_SIZE / PRG_PAGE_SIZE;
+    n %= numROMs() * PAGES_PER_BANK;
+    return romBank(n / PAGES_PER_BANK) + (n % PAGES_PER_BANK) * PRG_PAGE_SIZE;
+}
+
+const c6502_byte_t *MMC3::chrPage(int n) noexcept
+{
+    constexpr int PAGES_PER_BANK = VROM_SIZE / CHR_PAGE_SIZE;
+    if (m_pChrRAM)
+        return m_pChrRAM->data() + (n % PAGES_PER_BANK) * CHR_PAGE_SIZE;
+
+    n %= numVROMs() * PAGES_PER_BANK;
+    return vromBank(n / PAGES_PER_BANK) + (n % PAGES_PER_BANK) * CHR_PAGE_SIZE;
+}
+
+void MMC3::updateBanks() noexcept
+{
+    const int nPrg = numROMs() * static_cast<int>(ROM_SIZE / PRG_PAGE_SIZE);
+
+    // PRG mode 1 swaps 0x8000 and 0xC000 pages
+    const int swp = (m_bankSelect & 0x40u) ? 2 : 0;
+    m_prg[0 ^ swp] = prgPage(m_regs[6]);
+    m_prg[1] = prgPage(m_regs[7]);
+    m_prg[2 ^ swp] = prgPage(nPrg - 2);
+    m_prg[3] = prgPage(nPrg - 1);
+
+    // CHR inversion swaps 0x0000 and 0x1000 halves
+    const int inv = (m_bankSelect & 0x80u) ? 4 : 0;
+    m_chr[0 ^ inv] = chrPage(m_regs[0] & 0xFEu);
+    m_chr[1 ^ inv] = chrPage(m_regs[0] | 0x01u);
+    m_chr[2 ^ inv] = chrPage(m_regs[1] & 0xFEu);
+    m_chr[3 ^ inv] = chrPage(m_regs[1] | 0x01u);
+    m_chr[4 ^ inv] = chrPage(m_regs[2]);
+    m_chr[5 ^ inv] = chrPage(m_regs[3]);
+    m_chr[6 ^ inv] = chrPage(m_regs[4]);
+    m_chr[7 ^ inv] = chrPage(m_regs[5]);
+}
+
+c6502_byte_t MMC3::readMem(c6502_word_t addr)
+{
+    if (addr >= 0x8000u)
+        return m_prg[(addr >> 13u) & 0b11u][addr & (PRG_PAGE_SIZE - 1u)];
+    else if (addr >= 0x6000u)
+        return m_ramEnabled ? ramBank(0).Read(addr - 0x6000u) : 0u;
+    else if (addr < 0x2000u)
+        // CHR RAM, as seen from the PPU
+        return m_chr[addr >> 10u][addr & (CHR_PAGE_SIZE - 1u)];
+    else
+        throw Exception(Exception::IllegalArgument,
+                        "illegal mapper memory address");
+}
+
+c6502_byte_t MMC3::readVideoMem(c6502_word_t addr)
+{
+    if (addr >= 0x2000u)
+        throw Exception { Exception::IllegalArgument,
+                          "illegal VROM address" };
+
+    return m_chr[addr >> 10u][addr & (CHR_PAGE_SIZE - 1u)];
+}
+
+void MMC3::readPatterns(c6502_byte_t *pDst)
+{
+    for (int i = 0; i < 8; i++)
+        memcpy(pDst + i * CHR_PAGE_SIZE, m_chr[i], CHR_PAGE_SIZE);
+}
+
+const c6502_byte_t *MMC3::romPage(c6502_word_t addr) const noexcept
+{
+    assert(addr >= 0x8000u);
+    return m_prg[(addr >> 13u) & 0b11u];
+}
+
+void MMC3::writeMem(c6502_word_t addr, c6502_byte_t val)
+{
+    if (addr >= 0x8000u)
+        writeRegister(addr, val);
+    else if (addr >= 0x6000u)
+    {
+        if (m_ramEnabled && !m_ramWriteProtect)
+            ramBank(0).Write(addr - 0x6000u, val);
+    }
+    else if (addr < 0x2000u && m_pChrRAM)
+    {
+        // Mapped pages point into the CHR RAM, ROM pages are never written
+        const auto off = static_cast<c6502_word_t>(m_chr[addr >> 10u] - m_pChrRAM->data());
+        m_pChrRAM->Write(off + (addr & (CHR_PAGE_SIZE - 1u)), val);
+    }
+    else
+        throw Exception { Exception::IllegalOperation,
+                          "incorrect write to MMC3 memory" };
+}
+
+void MMC3::writeRegister(c6502_word_t addr, c6502_byte_t val) noexcept
+{
+    // Registers are selected by the address range and A0
+    const bool odd = addr & 0x01u;
+    switch (addr & 0xE000u)
+    {
+        case 0x8000u:
+            if (odd)
+                m_regs[m_bankSelect & 0b111u] = val;
+            else
+                m_bankSelect = val;
+            updateBanks();
+            PERF_COUNT(bus().perfMeter(), bankSwitches);
+            break;
+        case 0xA000u:
+            if (odd)
+            {
+                m_ramWriteProtect = val & 0x40u;
+                m_ramEnabled = val & 0x80u;
+            }
+            else
+                m_mirrOverride = (val & 0x01u) ? Mirroring::Horizontal : Mirroring::Vertical;
+            break;
+        case 0xC000u:
+            if (odd)
+            {
+                m_irqCounter = 0u;
+                m_irqReload = true;
+            }
+            else
+                m_irqLatch = val;
+            break;
+        case 0xE000u:
+            m_irqEnabled = odd;
+            if (!m_irqEnabled)
+                bus().cancelIRQ(IRQSource::MAPPER);
+            break;
+    }
+}
+
+Mirroring MMC3::updateMirroring(Mirroring cur) noexcept
+{
+    // Four screen layout is hardwired on the board
+    return cur == Mirroring::FourScreen ? cur : m_mirrOverride.value(cur);
+}
+
+void MMC3::onA12Rise() noexcept
+{
+    if (m_irqCounter == 0u || m_irqReload)
+    {
+        m_irqCounter = m_irqLatch;
+        m_irqReload = false;
+    }
+    else
+        m_irqCounter--;
+
+    if (m_irqCounter == 0u && m_irqEnabled)
+        bus().scheduleIRQ(IRQSource::MAPPER, bus().currentCycle());
+}
+
+void MMC3::snapshot(void *pDst) const noexcept
+{
+    Mapper::snapshot(pDst);
+
+    Registers r;
+    memcpy(r.regs, m_regs, sizeof(m_regs));
+    r.bankSelect = m_bankSelect;
+    r.irqLatch = m_irqLatch;
+    r.irqCounter = m_irqCounter;
+    r.ramEnabled = m_ramEnabled;
+    r.ramWriteProtect = m_ramWriteProtect;
+    r.irqReload = m_irqReload;
+    r.irqEnabled = m_irqEnabled;
+    r.hasMirr = !m_mirrOverride.isNothing();
+    r.mirr = m_mirrOverride.value(Mirroring::Vertical);
+    snapshotRegisters(pDst, r);
+
+    if (m_pChrRAM)
+        memcpy(static_cast<uint8_t*>(pDst) + Mapper::stateSize() + sizeof(Registers),
+               m_pChrRAM->data(),
+               VROM_SIZE);
+}
+
+void MMC3::restore(const void *pSrc) noexcept
+{
+    Mapper::restore(pSrc);
+
+    Registers r;
+    restoreRegisters(pSrc, r);
+    memcpy(m_regs, r.regs, sizeof(m_regs));
+    m_bankSelect = r.bankSelect;
+    m_irqLatch = r.irqLatch;
+    m_irqCounter = r.irqCounter;
+    m_ramEnabled = r.ramEnabled;
+    m_ramWriteProtect = r.ramWriteProtect;
+    m_irqReload = r.irqReload;
+    m_irqEnabled = r.irqEnabled;
+    if (r.hasMirr)
+        m_mirrOverride = r.mirr;
+    else
+        m_mirrOverride.unset();
+
+    if (m_pChrRAM)
+        memcpy(m_pChrRAM->data(),
+               static_cast<const uint8_t*>(pSrc) + Mapper::stateSize() + sizeof(Registers),
+               VROM_SIZE);
+
+    updateBanks();
+}
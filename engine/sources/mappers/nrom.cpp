@@ -4,10 +4,10 @@ c6502_byte_t DefaultMapper::readMem(c6502_word_t addr)
 {
     if (addr >= 0xC000)
         // Fixed bank
-        return romBank(numROMs() - 1).Read(addr - 0xC000);
+        return romBank(numROMs() - 1)[addr - 0xC000];
     else if (addr >= 0x8000)
         // Switchable bank (only one for default mapper)
-        return romBank(0).Read(addr - 0x8000);
+        return romBank(0)[addr - 0x8000];
     else
         throw Exception(Exception::IllegalArgument,
                         "illegal memory address");
@@ -19,36 +19,24 @@ c6502_byte_t DefaultMapper::readVideoMem(c6502_word_t addr)
     assert(addr < 0x2000u);
 
     // Only one VROM bank for default mapper
-    return vromBank(0).Read(addr);
+    return vromBank(0)[addr];
 }
 
-void DefaultMapper::writeMem(c6502_word_t, c6502_byte_t)
+void DefaultMapper::readPatterns(c6502_byte_t *pDst)
 {
-    throw Exception(Exception::IllegalOperation,
-                    "default mapper has no RAM");
+    assert(numVROMs() == 1);
+    memcpy(pDst, vromBank(0), VROM_SIZE);
 }
 
-void DefaultMapper::flash(c6502_word_t addr, c6502_byte_t* p, c6502_d_word_t size)
+const c6502_byte_t *DefaultMapper::romPage(c6502_word_t addr) const noexcept
 {
-    if (addr >= 0xC000)
-    {
-        addr -= 0xC000;
-        if (size > Mapper::ROM_SIZE - addr)
-            throw Exception(Exception::SizeOverflow,
-                            "not enough ROM space");
-        romBank(1).Write(addr, p, size);
-    }
-    else if (addr >= 0x8000)
-    {
-        addr -= 0x8000;
-        const c6502_d_word_t space =Mapper::ROM_SIZE - addr;
-        if (size > space)
-        {
-            flash(0xC000, p + space, size - space);
-            size = space;
-        }
-        romBank(0).Write(addr, p, space);
-    }
-    else
-        throw Exception(Exception::IllegalArgument, "address outside the ROM space");
+    assert(addr >= 0x8000u);
+    const c6502_byte_t *pBank = addr >= 0xC000u ? romBank(numROMs() - 1) : romBank(0);
+    return pBank + (addr & 0x2000u);
+}
+
+void DefaultMapper::writeMem(c6502_word_t, c6502_byte_t)
+{
+    throw Exception(Exception::IllegalOperation,
+                    "default mapper has no RAM");
 }
@@ -0,0 +1,64 @@
+#include "memorybackend.h"
+#include "framecapture.h"
+
+#include <cstring>
+
+constexpr int MemoryRenderingBackend::WIDTH,
+              MemoryRenderingBackend::HEIGHT;
+
+const uint8_t *MemoryRenderingBackend::colorRGBA8(const c6502_byte_t color) noexcept
+{
+    // Converted once the same way setLineToBuf_RGBA8() does
+    struct Table
+    {
+        uint8_t rgba[64][4];
+
+        Table() noexcept
+        {
+            for (int c = 0; c < 64; c++)
+            {
+                const auto s = s_palette[c];
+                constexpr unsigned b5m = 0b11111u;
+                rgba[c][0] = static_cast<uint8_t>(divrnd(((s >> 10) & b5m) * 255, 31));
+                rgba[c][1] = static_cast<uint8_t>(divrnd(((s >> 5) & b5m) * 255, 31));
+                rgba[c][2] = static_cast<uint8_t>(divrnd((s & b5m) * 255, 31));
+                rgba[c][3] = 255u;
+            }
+        }
+    };
+    static const Table t;
+
+    assert(color < 64u);
+    return t.rgba[color];
+}
+
+void MemoryRenderingBackend::setLine(const int n, const c6502_byte_t *pColorData, const c6502_byte_t bgColor)
+{
+    assert(n >= 0 && n < HEIGHT);
+    c6502_byte_t *pLine = m_frame + n * WIDTH;
+    for (int i = 0; i < WIDTH; i++)
+        pLine[i] = static_cast<c6502_byte_t>((pColorData[i] != PPU::TRANSPARENT_PXL ? pColorData[i] : bgColor) & 0x3Fu);
+
+    if (!m_pBuf)
+        return;
+
+    if (m_fmt == Format::INDEXED)
+        memcpy(m_pBuf + n * WIDTH, pLine, WIDTH);
+    else
+    {
+        uint8_t *pDst = m_pBuf + n * WIDTH * 4;
+        for (int i = 0; i < WIDTH; i++, pDst += 4)
+            memcpy(pDst, colorRGBA8(pLine[i]), 4u);
+    }
+}
+
+void MemoryRenderingBackend::draw()
+{
+    m_nFrames++;
+    if (m_pCapture)
+        m_pCapture->submit(m_frame);
+}
+
+void MemoryRenderingBackend::drawIdle()
+{
+}
@@ -0,0 +1,227 @@
+#include "mixer.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+#if defined(__SSE__) || defined(_M_X64)
+#include <xmmintrin.h>
+#define MIXER_USE_SSE
+#endif
+
+float Mixer::s_pulseTable[Mixer::PULSE_TABLE_SIZE],
+      Mixer::s_tndTable[Mixer::TND_TABLE_SIZE];
+
+// Fills the mixer tables before anything else can use them.
+// See https://www.nesdev.org/wiki/APU_Mixer#Lookup_Table
+struct MixerTablesInit
+{
+    MixerTablesInit() noexcept
+    {
+        Mixer::s_pulseTable[0] = 0.0f;
+        for (uint i = 1u; i < Mixer::PULSE_TABLE_SIZE; i++)
+            Mixer::s_pulseTable[i] = 95.88f / (8128.0f / i + 100.0f);
+
+        Mixer::s_tndTable[0] = 0.0f;
+        for (uint i = 1u; i < Mixer::TND_TABLE_SIZE; i++)
+            Mixer::s_tndTable[i] = 163.67f / (24329.0f / i + 100.0f);
+    }
+};
+
+static const MixerTablesInit s_mixerTablesInit;
+
+constexpr uint Mixer::PULSE_TABLE_SIZE,
+               Mixer::TND_TABLE_SIZE;
+
+void Mixer::mix(const LevelStream &ls, uint n, float *pOut) noexcept
+{
+    assert(n <= ls.capacity());
+    assert(pOut != nullptr);
+
+    const auto *p1 = ls.channel(LevelStream::PULSE1),
+               *p2 = ls.channel(LevelStream::PULSE2),
+               *tri = ls.channel(LevelStream::TRIANGLE),
+               *nois = ls.channel(LevelStream::NOISE),
+               *dmc = ls.channel(LevelStream::DMC);
+
+    for (uint i = 0u; i < n; i++)
+    {
+        const uint pi = p1[i] + p2[i],
+                   ti = 3u * tri[i] + 2u * nois[i] + dmc[i];
+        assert(pi < PULSE_TABLE_SIZE && ti < TND_TABLE_SIZE);
+        pOut[i] = s_pulseTable[pi] + s_tndTable[ti];
+    }
+}
+
+constexpr uint Resampler::TAPS,
+               Resampler::PHASES;
+constexpr float Resampler::HIGHPASS_FREQ;
+
+// Dot product of TAPS elements
+static inline float dotTaps(const float *x, const float *c) noexcept
+{
+    static_assert(Resampler::TAPS % 4u == 0u, "number of taps must be a multiple of 4");
+#ifdef MIXER_USE_SSE
+    __m128 acc = _mm_setzero_ps();
+    for (uint t = 0u; t < Resampler::TAPS; t += 4u)
+        acc = _mm_add_ps(acc, _mm_mul_ps(_mm_loadu_ps(x + t), _mm_loadu_ps(c + t)));
+
+    // Horizontal sum
+    __m128 shuf = _mm_shuffle_ps(acc, acc, _MM_SHUFFLE(2, 3, 0, 1));
+    acc = _mm_add_ps(acc, shuf);
+    shuf = _mm_movehl_ps(shuf, acc);
+    acc = _mm_add_ss(acc, shuf);
+    return _mm_cvtss_f32(acc);
+#else
+    // Four independent partial sums let the compiler vectorize the loop
+    float s[4] = { };
+    for (uint t = 0u; t < Resampler::TAPS; t += 4u)
+        for (uint j = 0u; j < 4u; j++)
+            s[j] += x[t + j] * c[t + j];
+    return (s[0] + s[1]) + (s[2] + s[3]);
+#endif
+}
+
+void Resampler::setRates(uint inRate, uint outRate)
+{
+    assert(inRate > 0u && outRate > 0u);
+    if (inRate == m_inRate && outRate == m_outRate)
+        return;
+
+    m_inRate = inRate;
+    m_outRate = outRate;
+
+    // Decimate down to at least twice the output rate before the FIR stage
+    m_decim = std::max(1u, inRate / (2u * outRate));
+    m_step = static_cast<double>(inRate) / (static_cast<double>(m_decim) * outRate);
+
+    buildFilter();
+
+    m_hpCoef = std::exp(-2.0f * static_cast<float>(M_PI) * HIGHPASS_FREQ / outRate);
+
+    reset();
+}
+
+void Resampler::buildFilter()
+{
+    const double midRate = static_cast<double>(m_inRate) / m_decim,
+                 cutoff = std::min(0.45 * m_outRate, 0.45 * midRate) / midRate;
+
+    m_coefs.resize(TAPS * PHASES);
+    for (uint p = 0u; p < PHASES; p++)
+    {
+        float *row = &m_coefs[p * TAPS];
+        double sum = 0.0;
+        for (uint t = 0u; t < TAPS; t++)
+        {
+            // Distance from the tap to the output point, in decimated samples
+            const double tau = static_cast<double>(t) - (TAPS / 2u - 1u) -
+                               static_cast<double>(p) / PHASES;
+            const double x = 2.0 * cutoff * tau,
+                         sinc = std::abs(x) < 1e-9 ? 1.0 : std::sin(M_PI * x) / (M_PI * x),
+                         w = 0.42 + 0.5 * std::cos(2.0 * M_PI * tau / TAPS) +
+                             0.08 * std::cos(4.0 * M_PI * tau / TAPS);
+            const double h = sinc * w;
+            row[t] = static_cast<float>(h);
+            sum += h;
+        }
+
+        // Normalize to unity DC gain for every phase
+        for (uint t = 0u; t < TAPS; t++)
+            row[t] = static_cast<float>(row[t] / sum);
+    }
+}
+
+void Resampler::reset() noexcept
+{
+    m_pos = 0.0;
+    m_acc = 0.0f;
+    m_accCnt = 0u;
+    m_hpPrevIn = m_hpPrevOut = 0.0f;
+
+    // Start with the zero filled history
+    if (m_mid.size() < TAPS)
+        m_mid.resize(TAPS);
+    std::fill(m_mid.begin(), m_mid.begin() + TAPS - 1u, 0.0f);
+    m_midSize = TAPS - 1u;
+}
+
+uint Resampler::maxOutput(uint nIn) const noexcept
+{
+    const double nMid = m_midSize + (m_accCnt + nIn) / m_decim;
+    return static_cast<uint>(nMid / m_step) + 2u;
+}
+
+uint Resampler::process(const float *pIn, uint nIn, float *pOut) noexcept
+{
+    assert(m_outRate > 0u && "sample rates are not configured");
+    assert(pIn != nullptr && pOut != nullptr);
+
+    // Grows only until the block size settles
+    const uint reqMid = m_midSize + (m_accCnt + nIn) / m_decim + 1u;
+    if (m_mid.size() < reqMid)
+        m_mid.resize(reqMid);
+
+    // Stage 1: integrate and dump
+    const float norm = 1.0f / m_decim;
+    uint i = 0u;
+    if (m_accCnt > 0u)
+    {
+        for (; i < nIn && m_accCnt < m_decim; i++, m_accCnt++)
+            m_acc += pIn[i];
+        if (m_accCnt == m_decim)
+        {
+            m_mid[m_midSize++] = m_acc * norm;
+            m_acc = 0.0f;
+            m_accCnt = 0u;
+        }
+    }
+    for (; i + m_decim <= nIn; i += m_decim)
+    {
+        float s = 0.0f;
+        for (uint j = 0u; j < m_decim; j++)
+            s += pIn[i + j];
+        m_mid[m_midSize++] = s * norm;
+    }
+    for (; i < nIn; i++, m_accCnt++)
+        m_acc += pIn[i];
+
+    // Stage 2: polyphase FIR + stage 3: DC blocker
+    uint nOut = 0u;
+    for (;;)
+    {
+        const auto k = static_cast<uint>(m_pos);
+        if (k + TAPS > m_midSize)
+            break;
+
+        const auto ph = std::min(static_cast<uint>((m_pos - k) * PHASES), PHASES - 1u);
+        const float s = dotTaps(&m_mid[k], &m_coefs[ph * TAPS]);
+
+        const float y = s - m_hpPrevIn + m_hpCoef * m_hpPrevOut;
+        m_hpPrevIn = s;
+        m_hpPrevOut = y;
+        pOut[nOut++] = y;
+
+        m_pos += m_step;
+    }
+
+    // Drop consumed samples, keep the history
+    const auto drop = std::min(static_cast<uint>(m_pos), m_midSize);
+    if (drop > 0u)
+    {
+        std::memmove(m_mid.data(), m_mid.data() + drop, (m_midSize - drop) * sizeof(float));
+        m_midSize -= drop;
+        m_pos -= drop;
+    }
+
+    return nOut;
+}
+
+void Resampler::toInt16(const float *pIn, int16_t *pOut, uint n) noexcept
+{
+    for (uint i = 0u; i < n; i++)
+    {
+        const float v = std::min(std::max(pIn[i], -1.0f), 1.0f);
+        pOut[i] = static_cast<int16_t>(v * 32767.0f);
+    }
+}
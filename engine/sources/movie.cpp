@@ -0,0 +1,261 @@
+#include "movie.h"
+#include "Cartridge.h"
+#include "gamepad.h"
+#include "mappedfile.h"
+#include "log.h"
+
+#include <cstring>
+#include <fstream>
+
+static const char MAGIC[] = { 'D', 'B', '1', 'M', 'U', 'M', 'O', 'V' };
+static constexpr uint32_t MOVIE_VERSION = 1u;
+static constexpr size_t HEADER_SIZE = 64u,
+                        CHECKPOINT_SIZE = 16u;
+
+template <typename T>
+static inline void putLE(uint8_t *p, T v) noexcept
+{
+    for (size_t i = 0u; i < sizeof(T); i++, v >>= 8u)
+        p[i] = static_cast<uint8_t>(v);
+}
+
+template <typename T>
+static inline T getLE(const uint8_t *p) noexcept
+{
+    T v = 0u;
+    for (size_t i = sizeof(T); i-- > 0u; )
+        v = static_cast<T>(v << 8u) | p[i];
+    return v;
+}
+
+MovieRecorder::MovieRecorder(Bus &bus):
+    m_bus { bus }
+{
+}
+
+void MovieRecorder::start(const std::string &fileName, bool fromReset, uint checkpointPeriod)
+{
+    if (m_recording)
+        throw Exception { Exception::IllegalOperation, "movie is already being recorded" };
+    if (!m_bus.getCartrige())
+        throw Exception { Exception::IllegalOperation, "no cartridge to record a movie with" };
+
+    m_state.clear();
+    if (fromReset)
+        m_bus.reset();
+    else
+    {
+        const size_t ssSize = m_bus.snapshotSize();
+        SnapshotBuffer ss(ssSize);
+        m_bus.snapshot(ss.data());
+
+        std::vector<uint8_t> image(Bus::stateFileSize(ssSize));
+        Bus::buildStateFile(ss.data(), ssSize, image.data());
+        m_state.resize(Bus::maxCompressedStateSize(image.size()));
+        m_state.resize(Bus::compressStateFile(image.data(), image.size(), m_state.data()));
+    }
+
+    m_fileName = fileName;
+    m_romHash = m_bus.getCartrige()->romHash();
+    m_period = checkpointPeriod;
+    m_input.clear();
+    m_checkpoints.clear();
+    m_nFrames = m_runLength = 0u;
+    m_recording = true;
+
+    Log::i("[movie] recording to %s", fileName.c_str());
+}
+
+void MovieRecorder::flushRun()
+{
+    if (m_runLength == 0u)
+        return;
+
+    for (uint64_t v = m_runLength; ; v >>= 7u)
+    {
+        if (v < 0x80u)
+        {
+            m_input.push_back(static_cast<uint8_t>(v));
+            break;
+        }
+        m_input.push_back(static_cast<uint8_t>(v | 0x80u));
+    }
+    m_input.push_back(m_pads[0]);
+    m_input.push_back(m_pads[1]);
+    m_runLength = 0u;
+}
+
+void MovieRecorder::beforeFrame()
+{
+    if (!m_recording)
+        return;
+
+    // The frame counter is advanced as the frame starts, turbo state is taken for that
+    const int frame = m_bus.currentFrame() + 1;
+    c6502_byte_t pads[2];
+    for (int i = 0; i < 2; i++)
+    {
+        const Gamepad *pPad = m_bus.getGamePad(i);
+        pads[i] = pPad ? pPad->buttonsAt(frame) : 0u;
+    }
+
+    if (m_runLength > 0u && (pads[0] != m_pads[0] || pads[1] != m_pads[1]))
+        flushRun();
+    m_pads[0] = pads[0];
+    m_pads[1] = pads[1];
+    m_runLength++;
+}
+
+void MovieRecorder::afterFrame()
+{
+    if (!m_recording)
+        return;
+
+    m_nFrames++;
+    if (m_period > 0u && m_nFrames % m_period == 0u)
+        m_checkpoints.push_back({ m_nFrames, m_bus.memoryHash() });
+}
+
+void MovieRecorder::stop()
+{
+    if (!m_recording)
+        return;
+    m_recording = false;
+    flushRun();
+
+    uint8_t h[HEADER_SIZE] = { };
+    memcpy(h, MAGIC, sizeof(MAGIC));
+    putLE<uint32_t>(h + 0x08u, MOVIE_VERSION);
+    putLE<uint32_t>(h + 0x0Cu, m_bus.getMode() == OutputMode::NTSC ? 1u : 0u);
+    putLE<uint64_t>(h + 0x10u, m_romHash);
+    putLE<uint64_t>(h + 0x18u, m_nFrames);
+    putLE<uint64_t>(h + 0x20u, m_state.size());
+    putLE<uint64_t>(h + 0x28u, m_input.size());
+    putLE<uint64_t>(h + 0x30u, m_checkpoints.size());
+    putLE<uint32_t>(h + 0x38u, m_period);
+
+    std::vector<uint8_t> cps(m_checkpoints.size() * CHECKPOINT_SIZE);
+    for (size_t i = 0u; i < m_checkpoints.size(); i++)
+    {
+        putLE<uint64_t>(&cps[i * CHECKPOINT_SIZE], m_checkpoints[i].frame);
+        putLE<uint64_t>(&cps[i * CHECKPOINT_SIZE + 8u], m_checkpoints[i].hash);
+    }
+
+    std::ofstream fout { m_fileName, std::ios_base::out | std::ios_base::binary | std::ios_base::trunc };
+    fout.write(reinterpret_cast<const char*>(h), HEADER_SIZE);
+    fout.write(reinterpret_cast<const char*>(m_state.data()), static_cast<std::streamsize>(m_state.size()));
+    fout.write(reinterpret_cast<const char*>(m_input.data()), static_cast<std::streamsize>(m_input.size()));
+    fout.write(reinterpret_cast<const char*>(cps.data()), static_cast<std::streamsize>(cps.size()));
+    if (!fout)
+        throw Exception { Exception::IOFailure, "unable to write the movie file" };
+
+    Log::i("[movie] %s: %llu frames, %zu bytes of input",
+           m_fileName.c_str(), static_cast<unsigned long long>(m_nFrames), m_input.size());
+}
+
+MoviePlayer::MoviePlayer(Bus &bus):
+    m_bus { bus }
+{
+}
+
+void MoviePlayer::start(const char *fileName)
+{
+    if (!m_bus.getCartrige())
+        throw Exception { Exception::IllegalOperation, "no cartridge to play a movie with" };
+
+    const MappedFile file { fileName };
+    const uint8_t *p = file.data();
+    if (file.size() < HEADER_SIZE || memcmp(p, MAGIC, sizeof(MAGIC)) != 0)
+        throw Exception { Exception::IllegalFormat, "wrong magic number" };
+    if (getLE<uint32_t>(p + 0x08u) != MOVIE_VERSION)
+        throw Exception { Exception::IllegalFormat, "unsupported movie version" };
+    if (getLE<uint64_t>(p + 0x10u) != m_bus.getCartrige()->romHash())
+        throw Exception { Exception::IllegalArgument, "movie is recorded with another ROM" };
+
+    const auto mode = getLE<uint32_t>(p + 0x0Cu) ? OutputMode::NTSC : OutputMode::PAL;
+    const uint64_t stateSize = getLE<uint64_t>(p + 0x20u),
+                   inputSize = getLE<uint64_t>(p + 0x28u),
+                   nCheckpoints = getLE<uint64_t>(p + 0x30u);
+    const uint64_t avail = file.size() - HEADER_SIZE;
+    if (stateSize > avail ||
+        inputSize > avail - stateSize ||
+        nCheckpoints > (avail - stateSize - inputSize) / CHECKPOINT_SIZE)
+        throw Exception { Exception::IllegalFormat, "truncated movie file" };
+
+    p += HEADER_SIZE;
+    if (stateSize > 0u)
+        m_bus.loadState(p, stateSize);
+    else
+        m_bus.reset(mode);
+    p += stateSize;
+
+    m_input.assign(p, p + inputSize);
+    p += inputSize;
+
+    m_checkpoints.resize(nCheckpoints);
+    for (auto &cp: m_checkpoints)
+    {
+        cp.frame = getLE<uint64_t>(p);
+        cp.hash = getLE<uint64_t>(p + 8u);
+        p += CHECKPOINT_SIZE;
+    }
+
+    m_nFrames = getLE<uint64_t>(file.data() + 0x18u);
+    m_nPlayed = m_runLeft = 0u;
+    m_inputPos = m_nextCheckpoint = 0u;
+    m_nPassed = 0u;
+    m_firstMismatch = UINT64_MAX;
+}
+
+bool MoviePlayer::beforeFrame() noexcept
+{
+    if (m_nPlayed == m_nFrames)
+        return false;
+
+    if (m_runLeft == 0u)
+    {
+        uint64_t v = 0u;
+        for (uint shift = 0u; ; shift += 7u)
+        {
+            if (m_inputPos >= m_input.size() || shift >= 64u)
+                return false;
+            const uint8_t b = m_input[m_inputPos++];
+            v |= static_cast<uint64_t>(b & 0x7Fu) << shift;
+            if ((b & 0x80u) == 0u)
+                break;
+        }
+        if (v == 0u || m_input.size() - m_inputPos < 2u)
+            return false;
+
+        m_runLeft = v;
+        m_pads[0] = m_input[m_inputPos++];
+        m_pads[1] = m_input[m_inputPos++];
+    }
+
+    // Turbo is already applied in the recording
+    for (int i = 0; i < 2; i++)
+        if (Gamepad *pPad = m_bus.getGamePad(i))
+        {
+            auto in = pPad->input();
+            in.pressed = m_pads[i];
+            in.turbo = 0u;
+            pPad->setInput(in);
+        }
+
+    m_runLeft--;
+    return true;
+}
+
+bool MoviePlayer::afterFrame() noexcept
+{
+    m_nPlayed++;
+    if (m_nextCheckpoint >= m_checkpoints.size() || m_checkpoints[m_nextCheckpoint].frame != m_nPlayed)
+        return true;
+
+    const bool ok = m_checkpoints[m_nextCheckpoint++].hash == m_bus.memoryHash();
+    if (ok)
+        m_nPassed++;
+    else if (m_firstMismatch == UINT64_MAX)
+        m_firstMismatch = m_nPlayed;
+    return ok;
+}
@@ -0,0 +1,313 @@
+#include "rewinder.h"
+#include "log.h"
+
+#include <cstring>
+
+// Shorter zero runs stay inside literals, so the output never grows much
+static constexpr size_t MIN_ZERO_RUN = 4u;
+
+static inline uint8_t *putVarint(uint8_t *p, size_t v) noexcept
+{
+    while (v >= 0x80u)
+    {
+        *p++ = static_cast<uint8_t>(v | 0x80u);
+        v >>= 7u;
+    }
+    *p++ = static_cast<uint8_t>(v);
+    return p;
+}
+
+static inline const uint8_t *getVarint(const uint8_t *p, const uint8_t *end, size_t &v) noexcept
+{
+    v = 0u;
+    for (uint shift = 0u; p < end && shift < 8u * sizeof(size_t); shift += 7u)
+    {
+        const uint8_t b = *p++;
+        v |= static_cast<size_t>(b & 0x7Fu) << shift;
+        if ((b & 0x80u) == 0u)
+            return p;
+    }
+    return nullptr;
+}
+
+static inline uint64_t load64(const uint8_t *p) noexcept
+{
+    uint64_t v;
+    memcpy(&v, p, sizeof(v));
+    return v;
+}
+
+size_t DeltaCodec::encode(const uint8_t *pIn, const uint8_t *pRef, size_t n, uint8_t *pOut) noexcept
+{
+    assert(pIn != nullptr && pOut != nullptr);
+
+    auto delta = [pIn, pRef](size_t i) noexcept -> uint8_t
+    {
+        return pRef ? pIn[i] ^ pRef[i] : pIn[i];
+    };
+
+    uint8_t *o = pOut;
+    size_t i = 0u;
+    while (i < n)
+    {
+        // Measure the zero run, word by word while possible
+        size_t z = i;
+        if (pRef)
+            while (z + 8u <= n && load64(pIn + z) == load64(pRef + z))
+                z += 8u;
+        else
+            while (z + 8u <= n && load64(pIn + z) == 0u)
+                z += 8u;
+        while (z < n && delta(z) == 0u)
+            z++;
+
+        if (z - i >= MIN_ZERO_RUN || z == n)
+        {
+            o = putVarint(o, (z - i) << 1u);
+            i = z;
+            continue;
+        }
+
+        // Literal run lasts until the next long enough zero run
+        size_t j = z, zeros = 0u;
+        while (j < n)
+        {
+            if (delta(j) == 0u)
+            {
+                if (++zeros == MIN_ZERO_RUN)
+                {
+                    j -= MIN_ZERO_RUN - 1u;
+                    break;
+                }
+            }
+            else
+                zeros = 0u;
+            j++;
+        }
+
+        o = putVarint(o, ((j - i) << 1u) | 1u);
+        for (; i < j; i++)
+            *o++ = delta(i);
+    }
+
+    assert(static_cast<size_t>(o - pOut) <= maxEncodedSize(n));
+    return o - pOut;
+}
+
+bool DeltaCodec::decode(const uint8_t *pIn, size_t inSize, const uint8_t *pRef, size_t n, uint8_t *pOut) noexcept
+{
+    const uint8_t *p = pIn,
+                  *end = pIn + inSize;
+    size_t o = 0u;
+    while (p < end)
+    {
+        size_t v;
+        p = getVarint(p, end, v);
+        const size_t len = v >> 1u;
+        if (!p || len > n - o)
+            return false;
+
+        if (v & 1u)
+        {
+            if (len > static_cast<size_t>(end - p))
+                return false;
+            if (pRef)
+                for (size_t k = 0u; k < len; k++)
+                    pOut[o + k] = p[k] ^ pRef[o + k];
+            else
+                memcpy(pOut + o, p, len);
+            p += len;
+        }
+        else if (pRef)
+            memcpy(pOut + o, pRef + o, len);
+        else
+            memset(pOut + o, 0, len);
+
+        o += len;
+    }
+
+    return o == n;
+}
+
+constexpr Rewinder::Config Rewinder::DEFAULT_CONFIG;
+
+Rewinder::Rewinder(Bus &bus, const Config &cfg):
+    m_bus { bus }
+{
+    configure(cfg);
+}
+
+void Rewinder::configure(const Config &cfg)
+{
+    if (cfg.maxFrames == 0u || cfg.keyframeInterval == 0u)
+        throw Exception { Exception::IllegalArgument, "rewind history limits must be positive" };
+
+    m_cfg = cfg;
+    m_arena.assign(cfg.budget, 0u);
+    m_records.resize(cfg.maxFrames);
+    clear();
+}
+
+void Rewinder::clear() noexcept
+{
+    m_first = m_nRecords = 0u;
+    m_keySeq = UINT64_MAX;
+}
+
+size_t Rewinder::bytesUsed() const noexcept
+{
+    if (m_nRecords == 0u)
+        return 0u;
+
+    const auto &first = m_records[m_first],
+               &last = m_records[(m_first + m_nRecords - 1u) % m_records.size()];
+    const size_t tail = last.offset + last.size;
+    return last.offset >= first.offset ? tail - first.offset : m_arena.size() - first.offset + tail;
+}
+
+bool Rewinder::findSpace(size_t need, size_t &offset) noexcept
+{
+    if (m_nRecords == 0u)
+    {
+        offset = 0u;
+        return need <= m_arena.size();
+    }
+
+    const size_t head = record(0).offset;
+    const auto &last = record(m_nRecords - 1u);
+    const size_t tail = last.offset + last.size;
+
+    if (last.offset >= head)
+    {
+        // Free space is after the tail and before the head
+        if (m_arena.size() - tail >= need)
+            offset = tail;
+        else if (head >= need)
+            offset = 0u;
+        else
+            return false;
+    }
+    else if (head - tail >= need)
+        offset = tail;
+    else
+        return false;
+
+    return true;
+}
+
+void Rewinder::dropOldest() noexcept
+{
+    assert(m_nRecords > 0u);
+
+    // Deltas are useless without their keyframe, so the history always starts with one
+    do
+    {
+        m_first = (m_first + 1u) % m_records.size();
+        m_nRecords--;
+    }
+    while (m_nRecords > 0u && record(0).seq != record(0).keySeq);
+}
+
+const Rewinder::Record *Rewinder::findRecord(uint64_t seq) noexcept
+{
+    if (m_nRecords == 0u || seq < record(0).seq)
+        return nullptr;
+
+    const uint64_t i = seq - record(0).seq;
+    return i < m_nRecords ? &record(static_cast<uint>(i)) : nullptr;
+}
+
+void Rewinder::push()
+{
+    const size_t sz = m_bus.snapshotSize();
+    if (sz != m_stateSize)
+    {
+        clear();
+        m_stateSize = sz;
+        m_key.resize(sz);
+        m_work.resize(sz);
+    }
+
+    m_bus.snapshot(m_work.data());
+
+    // Make room first, eviction may take the keyframe away
+    const size_t need = DeltaCodec::maxEncodedSize(sz);
+    size_t offset = 0u;
+    if (m_nRecords == m_records.size())
+        dropOldest();
+    while (!findSpace(need, offset))
+    {
+        if (m_nRecords == 0u)
+        {
+            Log::w("[rewind] budget of %zu bytes is too small for a %zu bytes state",
+                   m_arena.size(), sz);
+            return;
+        }
+        dropOldest();
+    }
+
+    const uint64_t seq = m_nRecords > 0u ? record(m_nRecords - 1u).seq + 1u : m_nextSeq;
+    const bool isKey = m_nRecords == 0u ||
+                       record(m_nRecords - 1u).keySeq != m_keySeq ||
+                       seq - m_keySeq >= m_cfg.keyframeInterval;
+
+    Record r;
+    r.offset = offset;
+    r.seq = seq;
+    r.keySeq = isKey ? seq : m_keySeq;
+    r.size = DeltaCodec::encode(m_work.data(),
+                                isKey ? nullptr : m_key.data(),
+                                sz,
+                                &m_arena[offset]);
+
+    if (isKey)
+    {
+        memcpy(m_key.data(), m_work.data(), sz);
+        m_keySeq = seq;
+    }
+
+    m_nRecords++;
+    record(m_nRecords - 1u) = r;
+    m_nextSeq = seq + 1u;
+}
+
+bool Rewinder::stepBack() noexcept
+{
+    if (m_nRecords == 0u)
+        return false;
+
+    const Record r = record(m_nRecords - 1u);
+    bool ok = true;
+    if (r.seq == r.keySeq)
+    {
+        ok = DeltaCodec::decode(&m_arena[r.offset], r.size, nullptr, m_stateSize, m_key.data());
+        m_keySeq = r.seq;
+        if (ok)
+            m_bus.restore(m_key.data());
+    }
+    else
+    {
+        if (m_keySeq != r.keySeq)
+        {
+            const Record *pKey = findRecord(r.keySeq);
+            assert(pKey != nullptr && "history must start with a keyframe");
+            ok = pKey && DeltaCodec::decode(&m_arena[pKey->offset], pKey->size, nullptr, m_stateSize, m_key.data());
+            m_keySeq = ok ? r.keySeq : UINT64_MAX;
+        }
+
+        ok = ok && DeltaCodec::decode(&m_arena[r.offset], r.size, m_key.data(), m_stateSize, m_work.data());
+        if (ok)
+            m_bus.restore(m_work.data());
+    }
+
+    if (!ok)
+    {
+        Log::e("[rewind] corrupted history, dropped");
+        clear();
+        return false;
+    }
+
+    m_nRecords--;
+    m_nextSeq = r.seq;
+    return true;
+}
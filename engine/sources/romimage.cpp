@@ -0,0 +1,53 @@
+#include "romimage.h"
+#include "checksum.h"
+
+constexpr c6502_d_word_t RomImage::PRG_BANK_SIZE,
+                         RomImage::CHR_BANK_SIZE;
+
+RomImage::RomImage(std::vector<c6502_byte_t> &&data, size_t prgOffset, int nROMs, int nVROMs):
+    m_buf { std::move(data) },
+    m_pData { m_buf.data() },
+    m_size { m_buf.size() },
+    m_nROMs { nROMs },
+    m_nVROMs { nVROMs }
+{
+    setLayout(prgOffset);
+}
+
+RomImage::RomImage(std::shared_ptr<const MappedFile> pFile, size_t offset, size_t size,
+                   size_t prgOffset, int nROMs, int nVROMs):
+    m_pFile { std::move(pFile) },
+    m_nROMs { nROMs },
+    m_nVROMs { nVROMs }
+{
+    if (offset > m_pFile->size() || size > m_pFile->size() - offset)
+        throw Exception { Exception::SizeOverflow, "ROM image is outside the file" };
+
+    m_pData = m_pFile->data() + offset;
+    m_size = size;
+    setLayout(prgOffset);
+}
+
+void RomImage::setLayout(size_t prgOffset)
+{
+    if (m_nROMs < 0 || m_nVROMs < 0)
+        throw Exception { Exception::IllegalArgument, "negative number of ROM banks" };
+
+    const size_t prgSize = static_cast<size_t>(m_nROMs) * PRG_BANK_SIZE,
+                 chrSize = static_cast<size_t>(m_nVROMs) * CHR_BANK_SIZE;
+    if (prgOffset > m_size || prgSize + chrSize > m_size - prgOffset)
+        throw Exception { Exception::SizeOverflow, "ROM banks exceed the image size" };
+
+    m_pPRG = m_pData + prgOffset;
+    m_pCHR = m_pPRG + prgSize;
+}
+
+uint64_t RomImage::hash() const noexcept
+{
+    std::call_once(m_hashOnce, [this]
+    {
+        const uint64_t h = xxhash64(m_pPRG, static_cast<size_t>(m_nROMs) * PRG_BANK_SIZE);
+        m_hash = m_nVROMs > 0 ? xxhash64(m_pCHR, static_cast<size_t>(m_nVROMs) * CHR_BANK_SIZE, h) : h;
+    });
+    return m_hash;
+}
@@ -0,0 +1,285 @@
+#include "rompack.h"
+#include "loader.h"
+#include "checksum.h"
+#include "log.h"
+
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+
+/* ROM pack format. All integers are little endian.
+ *
+ * 0000: Header (64 bytes)
+ *       00: MAGIC (8 bytes)
+ *       08: format version (4 bytes)
+ *       0C: number of entries (4 bytes)
+ *       10: index offset (8 bytes)
+ *       18: name table offset (8 bytes)
+ *       20: name table size (8 bytes)
+ *       28: file size (8 bytes)
+ *       30: CRC32C of the index followed by the name table (4 bytes)
+ *       34: CRC32C of the header bytes 00..33 (4 bytes)
+ * 0040: Index, 64 bytes per entry, in the ascending order of hashes
+ *       00: ROM hash (8 bytes)
+ *       08: payload offset, a multiple of PAGE_SIZE (8 bytes)
+ *       10: payload size (8 bytes)
+ *       18: name offset in the name table (4 bytes)
+ *       1C: name length (4 bytes)
+ *       20: mapper type (1 byte)
+ *       21: mirroring (1 byte)
+ *       22: bit 0 - PAL, bit 1 - trainer (1 byte)
+ *       23: reserved (1 byte)
+ *       24: number of 16 kB PRG banks (2 bytes)
+ *       26: number of 8 kB CHR banks (2 bytes)
+ *       28: number of 8 kB RAM banks (2 bytes)
+ *       2A: reserved (6 bytes)
+ *       30: original NES header (16 bytes)
+ * ....: Name table, file names without directories, not terminated
+ * ....: Payloads: the NES file without the header, each starting at a page boundary
+ */
+
+static const char MAGIC[] = { 'D', 'B', '1', 'M', 'U', 'P', 'A', 'K' };
+static constexpr uint32_t PACK_VERSION = 1u;
+static constexpr size_t HEADER_SIZE = 64u,
+                        ENTRY_SIZE = 64u,
+                        PAGE_SIZE = 4096u;
+
+static constexpr uint8_t FLAG_PAL = 0x01u,
+                         FLAG_TRAINER = 0x02u;
+
+template <typename T>
+static inline void putLE(uint8_t *p, T v) noexcept
+{
+    for (size_t i = 0u; i < sizeof(T); i++, v >>= 8u)
+        p[i] = static_cast<uint8_t>(v);
+}
+
+template <typename T>
+static inline T getLE(const uint8_t *p) noexcept
+{
+    T v = 0u;
+    for (size_t i = sizeof(T); i-- > 0u; )
+        v = static_cast<T>(v << 8u) | p[i];
+    return v;
+}
+
+static inline uint64_t alignPage(uint64_t n) noexcept
+{
+    return (n + PAGE_SIZE - 1u) & ~static_cast<uint64_t>(PAGE_SIZE - 1u);
+}
+
+RomPack::RomPack(const char *fileName):
+    m_pFile { std::make_shared<MappedFile>(fileName) }
+{
+    const uint8_t *p = m_pFile->data();
+    const size_t size = m_pFile->size();
+
+    if (size < HEADER_SIZE || memcmp(p, MAGIC, sizeof(MAGIC)) != 0)
+        throw Exception { Exception::IllegalFormat, "wrong magic number" };
+    if (getLE<uint32_t>(p + 0x34u) != crc32c(p, 0x34u))
+        throw Exception { Exception::IllegalFormat, "corrupted pack header" };
+    if (getLE<uint32_t>(p + 0x08u) != PACK_VERSION)
+        throw Exception { Exception::IllegalFormat, "unsupported pack format version" };
+
+    const uint32_t nEntries = getLE<uint32_t>(p + 0x0Cu);
+    const uint64_t indexOffset = getLE<uint64_t>(p + 0x10u),
+                   namesOffset = getLE<uint64_t>(p + 0x18u),
+                   namesSize = getLE<uint64_t>(p + 0x20u);
+    if (getLE<uint64_t>(p + 0x28u) != size ||
+        indexOffset > size ||
+        nEntries > (size - indexOffset) / ENTRY_SIZE ||
+        namesOffset > size ||
+        namesSize > size - namesOffset)
+        throw Exception { Exception::IllegalFormat, "truncated pack" };
+
+    m_pIndex = p + indexOffset;
+    m_pNames = p + namesOffset;
+    m_nEntries = nEntries;
+    m_namesSize = namesSize;
+
+    const uint32_t crc = crc32c(m_pNames, namesSize, crc32c(m_pIndex, nEntries * ENTRY_SIZE));
+    if (getLE<uint32_t>(p + 0x30u) != crc)
+        throw Exception { Exception::IllegalFormat, "corrupted pack index" };
+
+    Log::d("[pack] %s: %u ROMs", fileName, m_nEntries);
+}
+
+RomPack::Entry RomPack::entry(uint i) const
+{
+    assert(i < m_nEntries);
+    const uint8_t *p = m_pIndex + i * ENTRY_SIZE;
+
+    Entry e;
+    e.hash = getLE<uint64_t>(p);
+    e.offset = getLE<uint64_t>(p + 0x08u);
+    e.size = getLE<uint64_t>(p + 0x10u);
+
+    const uint32_t nameOffset = getLE<uint32_t>(p + 0x18u),
+                   nameLen = getLE<uint32_t>(p + 0x1Cu);
+    if (nameOffset > m_namesSize || nameLen > m_namesSize - nameOffset)
+        throw Exception { Exception::IllegalFormat, "wrong ROM name in the pack" };
+    e.name.assign(reinterpret_cast<const char*>(m_pNames + nameOffset), nameLen);
+
+    if (p[0x21u] > static_cast<uint8_t>(Mirroring::FourScreen))
+        throw Exception { Exception::IllegalFormat, "wrong mirroring in the pack" };
+    e.mapper = p[0x20u];
+    e.mirroring = static_cast<Mirroring>(p[0x21u]);
+    e.isPal = (p[0x22u] & FLAG_PAL) != 0u;
+    e.hasTrainer = (p[0x22u] & FLAG_TRAINER) != 0u;
+    e.nROMs = getLE<uint16_t>(p + 0x24u);
+    e.nVROMs = getLE<uint16_t>(p + 0x26u);
+    e.nRAMs = getLE<uint16_t>(p + 0x28u);
+    memcpy(e.header, p + 0x30u, sizeof(e.header));
+    return e;
+}
+
+int RomPack::find(uint64_t hash) const noexcept
+{
+    uint lo = 0u,
+         hi = m_nEntries;
+    while (lo < hi)
+    {
+        const uint mid = lo + (hi - lo) / 2u;
+        if (getLE<uint64_t>(m_pIndex + mid * ENTRY_SIZE) < hash)
+            lo = mid + 1u;
+        else
+            hi = mid;
+    }
+
+    return lo < m_nEntries && getLE<uint64_t>(m_pIndex + lo * ENTRY_SIZE) == hash ?
+           static_cast<int>(lo) : -1;
+}
+
+RomImage::Ptr RomPack::image(const Entry &e) const
+{
+    return std::make_shared<RomImage>(m_pFile,
+                                      static_cast<size_t>(e.offset),
+                                      static_cast<size_t>(e.size),
+                                      e.hasTrainer ? NES_TRAINER_SIZE : 0u,
+                                      e.nROMs,
+                                      e.nVROMs);
+}
+
+void RomPack::build(const char *packFile, const std::vector<std::string> &romFiles)
+{
+    struct Item
+    {
+        Entry e;
+        const std::string *pPath;
+        uint32_t nameOffset;
+    };
+
+    // First pass: everything for the index, images are dropped right away
+    std::vector<Item> items;
+    items.reserve(romFiles.size());
+    for (const auto &path: romFiles)
+    {
+        const RomImage::Ptr pImage = ROMLoader::readNES(path.c_str());
+        NESHeader hdr;
+        memcpy(&hdr, pImage->data(), sizeof(NESHeader));
+
+        Item it;
+        Entry &e = it.e;
+        e.hash = pImage->hash();
+        e.offset = 0u;
+        e.size = pImage->size() - NES_HEADER_SIZE;
+        e.name = path.substr(path.find_last_of("/\\") + 1u);
+        e.mapper = hdr.mapperType();
+        e.mirroring = hdr.mirroring();
+        e.isPal = hdr.isPal != 0u;
+        e.hasTrainer = hdr.hasTrainer;
+        e.nROMs = hdr.nROMs;
+        e.nVROMs = hdr.nVROMs;
+        e.nRAMs = hdr.numRAMs();
+        memcpy(e.header, pImage->data(), sizeof(e.header));
+        it.pPath = &path;
+        it.nameOffset = 0u;
+        items.push_back(std::move(it));
+    }
+
+    std::stable_sort(items.begin(), items.end(), [](const Item &a, const Item &b)
+    {
+        return a.e.hash < b.e.hash;
+    });
+    auto dup = std::unique(items.begin(), items.end(), [](const Item &a, const Item &b)
+    {
+        if (a.e.hash != b.e.hash)
+            return false;
+        Log::w("[pack] %s is the same ROM as %s, skipped", b.pPath->c_str(), a.pPath->c_str());
+        return true;
+    });
+    items.erase(dup, items.end());
+
+    std::string names;
+    for (auto &it: items)
+    {
+        it.nameOffset = static_cast<uint32_t>(names.size());
+        names += it.e.name;
+    }
+
+    const uint64_t namesOffset = HEADER_SIZE + items.size() * ENTRY_SIZE;
+    uint64_t offset = alignPage(namesOffset + names.size());
+    for (auto &it: items)
+    {
+        it.e.offset = offset;
+        offset = alignPage(offset + it.e.size);
+    }
+    const uint64_t fileSize = offset;
+
+    std::vector<uint8_t> head(static_cast<size_t>(namesOffset), 0u);
+    uint8_t *p = head.data() + HEADER_SIZE;
+    for (const auto &it: items)
+    {
+        const Entry &e = it.e;
+        putLE<uint64_t>(p, e.hash);
+        putLE<uint64_t>(p + 0x08u, e.offset);
+        putLE<uint64_t>(p + 0x10u, e.size);
+        putLE<uint32_t>(p + 0x18u, it.nameOffset);
+        putLE<uint32_t>(p + 0x1Cu, static_cast<uint32_t>(e.name.size()));
+        p[0x20u] = e.mapper;
+        p[0x21u] = static_cast<uint8_t>(e.mirroring);
+        p[0x22u] = (e.isPal ? FLAG_PAL : 0u) | (e.hasTrainer ? FLAG_TRAINER : 0u);
+        putLE<uint16_t>(p + 0x24u, static_cast<uint16_t>(e.nROMs));
+        putLE<uint16_t>(p + 0x26u, static_cast<uint16_t>(e.nVROMs));
+        putLE<uint16_t>(p + 0x28u, static_cast<uint16_t>(e.nRAMs));
+        memcpy(p + 0x30u, e.header, sizeof(e.header));
+        p += ENTRY_SIZE;
+    }
+
+    const auto *pNames = reinterpret_cast<const uint8_t*>(names.data());
+    memcpy(head.data(), MAGIC, sizeof(MAGIC));
+    putLE<uint32_t>(head.data() + 0x08u, PACK_VERSION);
+    putLE<uint32_t>(head.data() + 0x0Cu, static_cast<uint32_t>(items.size()));
+    putLE<uint64_t>(head.data() + 0x10u, HEADER_SIZE);
+    putLE<uint64_t>(head.data() + 0x18u, namesOffset);
+    putLE<uint64_t>(head.data() + 0x20u, names.size());
+    putLE<uint64_t>(head.data() + 0x28u, fileSize);
+    putLE<uint32_t>(head.data() + 0x30u,
+                    crc32c(pNames, names.size(), crc32c(head.data() + HEADER_SIZE, items.size() * ENTRY_SIZE)));
+    putLE<uint32_t>(head.data() + 0x34u, crc32c(head.data(), 0x34u));
+
+    std::ofstream fout { packFile, std::ios_base::out | std::ios_base::binary };
+    fout.write(reinterpret_cast<const char*>(head.data()), static_cast<std::streamsize>(head.size()));
+    fout.write(names.data(), static_cast<std::streamsize>(names.size()));
+
+    // Second pass: the payloads
+    static const char zeroes[PAGE_SIZE] = { };
+    uint64_t pos = namesOffset + names.size();
+    for (const auto &it: items)
+    {
+        const RomImage::Ptr pImage = ROMLoader::readNES(it.pPath->c_str());
+        if (pImage->hash() != it.e.hash)
+            throw Exception { Exception::IllegalFormat, "ROM file has changed while packing" };
+
+        fout.write(zeroes, static_cast<std::streamsize>(it.e.offset - pos));
+        fout.write(reinterpret_cast<const char*>(pImage->data() + NES_HEADER_SIZE),
+                   static_cast<std::streamsize>(it.e.size));
+        pos = it.e.offset + it.e.size;
+    }
+    fout.write(zeroes, static_cast<std::streamsize>(fileSize - pos));
+
+    if (!fout.flush())
+        throw Exception { Exception::IOFailure, "unable to write the pack" };
+
+    Log::i("[pack] %s: %zu ROMs, %llu bytes", packFile, items.size(), static_cast<unsigned long long>(fileSize));
+}
@@ -0,0 +1,104 @@
+#include "runahead.h"
+#include "log.h"
+
+RunAhead::RunAhead(Bus &bus):
+    m_bus { bus }
+{
+}
+
+RunAhead::~RunAhead() = default;
+
+void RunAhead::setFrames(uint n) noexcept
+{
+    m_nFrames = n;
+    m_isAhead = false;
+}
+
+void RunAhead::setSecondInstance(bool enable)
+{
+    m_isAhead = false;
+    if (!enable)
+    {
+        m_pShadow.reset();
+        return;
+    }
+
+    const Cartrige *pCart = m_bus.getCartrige();
+    if (!pCart || !pCart->isReady())
+        throw Exception { Exception::IllegalOperation, "no cartridge in the main machine" };
+
+    std::unique_ptr<Machine> pShadow { new Machine { pCart->romImage(), m_bus.getMode() } };
+    pShadow->ppu().setBackend(m_bus.getPPU()->backend());
+
+    if (pShadow->bus().snapshotSize() != m_bus.snapshotSize())
+        throw Exception { Exception::IllegalArgument, "second instance has another cartridge" };
+
+    m_pShadow = std::move(pShadow);
+    Log::i("[run-ahead] second instance is running");
+}
+
+Gamepad::Input RunAhead::padInput(int n) const noexcept
+{
+    const Gamepad *pPad = m_bus.getGamePad(n);
+    return pPad ? pPad->input() : Gamepad::Input { };
+}
+
+void RunAhead::saveMain()
+{
+    const size_t sz = m_bus.snapshotSize();
+    if (m_state.size() != sz)
+        m_state.resize(sz);
+    m_bus.snapshot(m_state.data());
+}
+
+void RunAhead::runFrame()
+{
+    if (m_nFrames == 0u)
+        m_bus.runFrame();
+    else if (m_pShadow)
+        runDual();
+    else
+        runSingle();
+}
+
+void RunAhead::runSingle()
+{
+    // The real frame is heard but not seen
+    m_bus.runFrame(Bus::FRAME_AUDIO);
+    saveMain();
+
+    for (uint i = 1u; i < m_nFrames; i++)
+        m_bus.runFrame(Bus::FRAME_NO_OUTPUT);
+    m_bus.runFrame(Bus::FRAME_VIDEO);
+
+    m_bus.restore(m_state.data());
+}
+
+void RunAhead::runDual()
+{
+    Machine &s = *m_pShadow;
+    const Gamepad::Input in[2] = { padInput(0), padInput(1) };
+
+    m_bus.runFrame(Bus::FRAME_AUDIO);
+
+    // While the input matches the prediction the second machine is still valid,
+    // advancing it keeps the distance
+    if (m_isAhead && in[0] == m_predicted[0] && in[1] == m_predicted[1])
+    {
+        s.runFrame(Bus::FRAME_VIDEO);
+        return;
+    }
+
+    saveMain();
+    s.bus().restore(m_state.data());
+    for (int i = 0; i < 2; i++)
+    {
+        s.pad(i).setInput(in[i]);
+        m_predicted[i] = in[i];
+    }
+
+    for (uint i = 1u; i < m_nFrames; i++)
+        s.runFrame(Bus::FRAME_NO_OUTPUT);
+    s.runFrame(Bus::FRAME_VIDEO);
+    m_isAhead = true;
+}
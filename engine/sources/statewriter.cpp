@@ -0,0 +1,133 @@
+#include "statewriter.h"
+#include "log.h"
+
+#include <chrono>
+#include <cstdio>
+#include <fstream>
+
+using Clock = std::chrono::steady_clock;
+
+static float msSince(Clock::time_point t0) noexcept
+{
+    return std::chrono::duration<float, std::milli>(Clock::now() - t0).count();
+}
+
+StateWriter::StateWriter(Bus &bus):
+    m_bus { bus }
+{
+    m_slots.start(2u, [this](const Slot &slot) { processSlot(slot); });
+}
+
+StateWriter::~StateWriter()
+{
+    m_slots.stop();
+}
+
+bool StateWriter::save(const std::string &fileName)
+{
+    Slot *pSlot = m_slots.acquire();
+    if (!pSlot)
+    {
+        std::lock_guard<std::mutex> lk { m_lock };
+        m_stats.nDropped++;
+        return false;
+    }
+
+    Slot &slot = *pSlot;
+    const auto t0 = Clock::now();
+    const size_t sz = m_bus.snapshotSize();
+    if (slot.snapshot.size() != sz)
+        slot.snapshot.resize(sz);
+    m_bus.snapshot(slot.snapshot.data());
+    slot.size = sz;
+    slot.snapshotMs = msSince(t0);
+    slot.fileName = fileName;
+    m_slots.publish();
+    return true;
+}
+
+void StateWriter::setAutosave(const std::string &fileName, uint periodFrames)
+{
+    m_autosaveFile = fileName;
+    m_autosavePeriod = periodFrames;
+    m_nFrames = 0u;
+}
+
+void StateWriter::onFrame()
+{
+    if (m_autosavePeriod > 0u && ++m_nFrames >= m_autosavePeriod)
+    {
+        m_nFrames = 0u;
+        save(m_autosaveFile);
+    }
+}
+
+void StateWriter::flush()
+{
+    m_slots.drain();
+}
+
+StateWriter::Stats StateWriter::stats() const
+{
+    std::lock_guard<std::mutex> lk { m_lock };
+    return m_stats;
+}
+
+void StateWriter::processSlot(const Slot &slot) noexcept
+{
+    try
+    {
+        writeSlot(slot);
+    }
+    catch (const Exception &ex)
+    {
+        Log::e("[state] failed to save %s: %s", slot.fileName.c_str(), ex.message());
+        std::lock_guard<std::mutex> lk { m_lock };
+        m_stats.nFailed++;
+    }
+}
+
+void StateWriter::writeSlot(const Slot &slot)
+{
+    auto t0 = Clock::now();
+    m_image.resize(Bus::stateFileSize(slot.size));
+    Bus::buildStateFile(slot.snapshot.data(), slot.size, m_image.data());
+    m_packed.resize(Bus::maxCompressedStateSize(m_image.size()));
+    const size_t packedSize = Bus::compressStateFile(m_image.data(), m_image.size(), m_packed.data());
+    const float compressMs = msSince(t0);
+
+    // Write aside and replace, so a crash never leaves a half written state
+    t0 = Clock::now();
+    const std::string tmpName = slot.fileName + ".tmp";
+    {
+        std::ofstream fout { tmpName, std::ios_base::out | std::ios_base::binary | std::ios_base::trunc };
+        fout.write(reinterpret_cast<const char*>(m_packed.data()), static_cast<std::streamsize>(packedSize));
+        fout.close();
+        if (!fout)
+        {
+            std::remove(tmpName.c_str());
+            throw Exception { Exception::IOFailure, "unable to write the state file" };
+        }
+    }
+#ifdef _WIN32
+    // Windows refuses to rename over an existing file
+    std::remove(slot.fileName.c_str());
+#endif
+    if (std::rename(tmpName.c_str(), slot.fileName.c_str()) != 0)
+    {
+        std::remove(tmpName.c_str());
+        throw Exception { Exception::IOFailure, "unable to replace the state file" };
+    }
+    const float writeMs = msSince(t0);
+
+    Log::d("[state] saved %s: %zu -> %zu bytes, snapshot %.3f ms, compress %.3f ms, write %.3f ms",
+           slot.fileName.c_str(), m_image.size(), packedSize, slot.snapshotMs, compressMs, writeMs);
+
+    std::lock_guard<std::mutex> lk { m_lock };
+    m_stats.nWritten++;
+    m_stats.snapshotMs = slot.snapshotMs;
+    m_stats.compressMs = compressMs;
+    m_stats.writeMs = writeMs;
+    m_stats.rawSize = m_image.size();
+    m_stats.compressedSize = packedSize;
+}
@@ -0,0 +1,134 @@
+#include "threadpool.h"
+#include "log.h"
+
+#include <algorithm>
+
+#ifdef __linux__
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+ThreadPool::ThreadPool(uint nThreads, bool pinThreads)
+{
+    if (nThreads == 0u)
+        nThreads = std::max(std::thread::hardware_concurrency(), 1u);
+
+    for (uint i = 0u; i < nThreads; i++)
+        m_workers.emplace_back(new Worker);
+    for (uint i = 0u; i < nThreads; i++)
+    {
+        auto &t = m_workers[i]->thread;
+        t = std::thread { &ThreadPool::workerLoop, this, i };
+#ifdef __linux__
+        if (pinThreads)
+        {
+            cpu_set_t cpus;
+            CPU_ZERO(&cpus);
+            CPU_SET(i % std::max(std::thread::hardware_concurrency(), 1u), &cpus);
+            if (pthread_setaffinity_np(t.native_handle(), sizeof(cpus), &cpus) != 0)
+                Log::w("[pool] failed to pin worker %u", i);
+        }
+#else
+        (void)pinThreads;
+#endif
+    }
+}
+
+ThreadPool::~ThreadPool()
+{
+    {
+        std::lock_guard<std::mutex> lk { m_lock };
+        m_stopRequested = true;
+    }
+    m_startCond.notify_all();
+    for (auto &w: m_workers)
+        w->thread.join();
+}
+
+void ThreadPool::submit(uint n, const std::function<void(uint)> &f)
+{
+    assert(m_remaining == 0u && "previous batch is still running");
+    if (n == 0u)
+        return;
+
+    // Workers touch the function only after popping a task, so it is safe to replace it here
+    m_pTask = &f;
+    m_remaining = n;
+
+    const uint nw = size();
+    for (uint w = 0u; w < nw; w++)
+    {
+        const uint beg = static_cast<uint>(static_cast<uint64_t>(n) * w / nw),
+                   end = static_cast<uint>(static_cast<uint64_t>(n) * (w + 1u) / nw);
+        std::lock_guard<std::mutex> lk { m_workers[w]->lock };
+        // Owner pops from the back, so put the range in reverse to run it in order
+        for (uint i = end; i > beg; i--)
+            m_workers[w]->tasks.push_back(i - 1u);
+    }
+
+    {
+        std::lock_guard<std::mutex> lk { m_lock };
+        m_generation++;
+    }
+    m_startCond.notify_all();
+}
+
+void ThreadPool::wait()
+{
+    std::unique_lock<std::mutex> lk { m_lock };
+    m_doneCond.wait(lk, [this] { return m_remaining == 0u; });
+}
+
+bool ThreadPool::popLocal(uint self, uint &task)
+{
+    Worker &w = *m_workers[self];
+    std::lock_guard<std::mutex> lk { w.lock };
+    if (w.tasks.empty())
+        return false;
+    task = w.tasks.back();
+    w.tasks.pop_back();
+    return true;
+}
+
+bool ThreadPool::steal(uint self, uint &task)
+{
+    const uint nw = size();
+    for (uint k = 1u; k < nw; k++)
+    {
+        Worker &w = *m_workers[(self + k) % nw];
+        std::lock_guard<std::mutex> lk { w.lock };
+        if (!w.tasks.empty())
+        {
+            task = w.tasks.front();
+            w.tasks.pop_front();
+            return true;
+        }
+    }
+    return false;
+}
+
+void ThreadPool::workerLoop(uint self)
+{
+    uint64_t seen = 0u;
+    for (;;)
+    {
+        {
+            std::unique_lock<std::mutex> lk { m_lock };
+            m_startCond.wait(lk, [this, seen] { return m_stopRequested || m_generation != seen; });
+            if (m_stopRequested)
+                return;
+            seen = m_generation;
+        }
+
+        uint task;
+        while (popLocal(self, task) || steal(self, task))
+        {
+            (*m_pTask)(task);
+            if (--m_remaining == 0u)
+            {
+                std::lock_guard<std::mutex> lk { m_lock };
+                m_doneCond.notify_all();
+            }
+        }
+    }
+}
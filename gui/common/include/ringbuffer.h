@@ -35,7 +35,7 @@ public:
                 // of the new array and restore the m_size modified by
                 // dequeueRange().
                 const auto size = m_size;
-                dequeueRange(newData.get(), m_capacity);
+                dequeueRange(newData.get(), size);
                 m_head = 0u;
                 m_size = size;
             }
@@ -77,6 +77,16 @@ public:
         m_data[(m_head + m_size++) % m_capacity] = elem;
     }
 
+    void enqueueRange(const T *pSrc, uint nElems)
+    {
+        assert(pSrc);
+        if (m_capacity - m_size < nElems)
+            throw Exception::OVERFLOW;
+
+        for (uint i = 0; i < nElems; i++)
+            m_data[(m_head + m_size++) % m_capacity] = *pSrc++;
+    }
+
     T dequeue()
     {
         if (m_size == 0u)
@@ -3,6 +3,7 @@
 
 #include <APU.h>
 #include <QAudioOutput>
+#include <QByteArray>
 #include <QIODevice>
 #include <QVector>
 
@@ -16,8 +17,7 @@ class QtPlaybackBackend: public QObject, public PlaybackBackend
     uint m_frequency = 0u;
 
 public:
-    using QObject::QObject;
-
+    explicit QtPlaybackBackend(QObject *parent = nullptr);
     ~QtPlaybackBackend();
 
     void init() noexcept override;
@@ -30,7 +30,15 @@ public:
 
     void beginFrame(uint nSamples) noexcept override;
     void queueSample(float v) noexcept override;
+    void queueSamples(const float *pSamples, uint n) noexcept override;
     void endFrame() noexcept override;
+
+Q_SIGNALS:
+    // Frames come from the emulation thread, the device is written on the thread owning it
+    void frameReady(const QByteArray &samples);
+
+private Q_SLOTS:
+    void writeFrame(const QByteArray &samples);
 };
 
 #endif
@@ -9,10 +9,15 @@
 #else
     #include <QOpenGLContext>
 #endif
+#include <emulationthread.h>
+#include <spscqueue.h>
+#include <triplebuffer.h>
+#include <perfcounters.h>
+#include <gamepad.h>
 #include <memory>
 
 class Bus;
-class RenderingBackend;
+class Rewinder;
 
 class ScreenWidget: public QWindow
 {
@@ -22,11 +27,14 @@ public:
     ScreenWidget(QWidget *container);
     ~ScreenWidget();
 
-    void setBus(Bus *pBus) noexcept
-    {
-        Q_ASSERT(pBus != nullptr);
-        m_pBus = pBus;
-    }
+    void setBus(Bus *pBus);
+
+    // Input is queued for the emulation thread
+    void setRewinding(bool r);
+    void buttonEvent(int pad, Button button, bool pressed, bool turbo);
+
+    /// The emulation must be paused.
+    void clearRewindHistory() noexcept;
 
     void pause();
     void step();
@@ -34,9 +42,19 @@ public:
 
     bool isRunning() const noexcept;
 
-    RenderingBackend *getRenderingBackend() const noexcept
+#ifdef ENABLE_PERF_COUNTERS
+    /// Counters of the newest frame run. Main thread.
+    const PerfCounters &perfCounters() noexcept
     {
-        return m_RBE.get();
+        m_perf.update();
+        return m_perf.front();
+    }
+#endif
+
+    /// Backend for the PPU, frames are passed to the screen from the emulation thread.
+    RenderingBackend *getRenderingBackend() noexcept
+    {
+        return &m_handoff;
     }
 
 Q_SIGNALS:
@@ -46,17 +64,38 @@ protected:
     bool event(QEvent *e) override;
 
 private:
+    struct Command
+    {
+        enum Type: uint8_t
+        {
+            PadButton,
+            Rewind
+        };
+
+        Type type;
+        uint8_t pad;
+        Button button;
+        bool pressed,
+             turbo;
+    };
+
     QWidget *const m_pContainer;
 
     Bus *m_pBus = nullptr;
     int m_timerId = 0;
     std::unique_ptr<RenderingBackend> m_RBE;
-    bool m_runEmulation = false,
-         m_stepEmulation = false;
+    std::unique_ptr<Rewinder> m_rewinder;
+
+    // Owned by the emulation thread while it runs
+    FrameHandoff m_handoff;
+    SPSCQueue<Command, 256> m_commands;
+    bool m_rewinding = false;
+    EmulationThread m_emuThread;
+#ifdef ENABLE_PERF_COUNTERS
+    TripleBuffer<PerfCounters> m_perf;
+#endif
 
     QElapsedTimer m_clocks;
-    int m_accFrameTimes = 0,
-        m_nFrames = 0;
 
 #ifdef USE_VULKAN
     QVulkanInstance m_vkInstance;
@@ -64,8 +103,13 @@ private:
     QOpenGLContext *m_pGLCtx = nullptr;
 #endif
 
+    void postCommand(const Command &cmd);
+
     void initialize();
     void render();
+
+    // Emulation thread, or the main thread while it is stopped
+    void emulateFrame();
 };
 
 #endif
@@ -141,6 +141,8 @@ b1MainWindow::b1MainWindow()
 
 b1MainWindow::~b1MainWindow()
 {
+    // The screen outlives the engine, stop running it first
+    m_screen->pause();
     delete m_ui;
 }
 
@@ -171,6 +173,7 @@ void b1MainWindow::loadROM(const QString &romName)
     {
         loader.loadNES(romName.toLocal8Bit().data());
         m_eng->bus.injectCartrige(&m_eng->cartridge);
+        m_screen->clearRewindHistory();
         m_screen->resume();
     }
     catch (const Exception &ex)
@@ -228,7 +231,19 @@ void b1MainWindow::updateUI()
 
 void b1MainWindow::fpsUpdated(float fps)
 {
+#ifdef ENABLE_PERF_COUNTERS
+    const PerfCounters &pc = m_screen->perfCounters();
+    QString perf = tr(" | %1 instr, %2 bank sw., %3 sprite lines |")
+                   .arg(pc.instructions).arg(pc.bankSwitches).arg(pc.spriteLines);
+    for (int r = 0; r < PerfCounters::NUM_REGIONS; r++)
+        perf += tr(" %1 %2/%3").arg(PerfCounters::regionName(r)).arg(pc.reads[r]).arg(pc.writes[r]);
+    perf += tr(" | %1:").arg(hostCyclesAreTSC() ? tr("kcycles") : tr("us"));
+    for (int s = 0; s < PerfCounters::NUM_SECTIONS; s++)
+        perf += tr(" %1 %2").arg(PerfCounters::sectionName(s)).arg(pc.hostTime[s] / 1000u);
+    statusBar()->showMessage(tr("%1 FPS").arg(fps, 5, 'f', 0) + perf);
+#else
     statusBar()->showMessage(tr("%1 FPS").arg(fps, 5, 'f', 0));
+#endif
 }
 
 void b1MainWindow::saveState()
@@ -271,6 +286,7 @@ void b1MainWindow::loadState()
         try
         {
             m_eng->bus.loadState(fn.toLocal8Bit().data());
+            m_screen->clearRewindHistory();
         }
         catch (const Exception &ex)
         {
@@ -287,6 +303,22 @@ void b1MainWindow::keyPressEvent(QKeyEvent *e)
 {
     const auto key = e->key();
 
+    // Hold to rewind
+    if (key == Qt::Key_Backspace)
+    {
+        if (!e->isAutoRepeat())
+            m_screen->setRewinding(true);
+        return;
+    }
+
+    // Pads only need the first press and the last release of a held key. Repeats
+    // would pile up in the command queue while the emulation is paused.
+    if (e->isAutoRepeat())
+    {
+        QMainWindow::keyPressEvent(e);
+        return;
+    }
+
     // Pad 1?
     auto i = std::find_if(std::begin(m_eng->keyMapLeft), std::end(m_eng->keyMapLeft),
                           [key](const KeyMap &x)
@@ -295,7 +327,7 @@ void b1MainWindow::keyPressEvent(QKeyEvent *e)
     });
 
     if (i != std::end(m_eng->keyMapLeft))
-        m_eng->padLeft.buttonEvent(i->padKey, true, i->turbo, false);
+        m_screen->buttonEvent(0, i->padKey, true, i->turbo);
     else
     {
         // Pad 2?
@@ -306,7 +338,7 @@ void b1MainWindow::keyPressEvent(QKeyEvent *e)
         });
 
         if (i != std::end(m_eng->keyMapRight))
-            m_eng->padRight.buttonEvent(i->padKey, true, i->turbo, false);
+            m_screen->buttonEvent(1, i->padKey, true, i->turbo);
         else
             QMainWindow::keyPressEvent(e);
     }
@@ -316,6 +348,20 @@ void b1MainWindow::keyReleaseEvent(QKeyEvent *e)
 {
     const auto key = e->key();
 
+    if (key == Qt::Key_Backspace)
+    {
+        if (!e->isAutoRepeat())
+            m_screen->setRewinding(false);
+        return;
+    }
+
+    // Repeats of a held key, see keyPressEvent()
+    if (e->isAutoRepeat())
+    {
+        QMainWindow::keyReleaseEvent(e);
+        return;
+    }
+
     // Pad 1?
     auto i = std::find_if(std::begin(m_eng->keyMapLeft), std::end(m_eng->keyMapLeft),
                           [key](const KeyMap &x)
@@ -324,7 +370,7 @@ void b1MainWindow::keyReleaseEvent(QKeyEvent *e)
     });
 
     if (i != std::end(m_eng->keyMapLeft))
-        m_eng->padLeft.buttonEvent(i->padKey, false, false, false);
+        m_screen->buttonEvent(0, i->padKey, false, false);
     else
     {
         // Pad 2?
@@ -335,7 +381,7 @@ void b1MainWindow::keyReleaseEvent(QKeyEvent *e)
         });
 
         if (i != std::end(m_eng->keyMapRight))
-            m_eng->padRight.buttonEvent(i->padKey, false, false, false);
+            m_screen->buttonEvent(1, i->padKey, false, false);
         else
             QMainWindow::keyReleaseEvent(e);
     }
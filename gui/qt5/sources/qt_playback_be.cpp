@@ -3,6 +3,13 @@
 
 #include <QAudioDeviceInfo>
 #include <QAudioFormat>
+#include <algorithm>
+
+QtPlaybackBackend::QtPlaybackBackend(QObject *parent):
+    QObject { parent }
+{
+    connect(this, &QtPlaybackBackend::frameReady, this, &QtPlaybackBackend::writeFrame);
+}
 
 QtPlaybackBackend::~QtPlaybackBackend()
 {
@@ -51,9 +58,22 @@ void QtPlaybackBackend::queueSample(float v) noexcept
     m_sampleBuf.push_back(v);
 }
 
+void QtPlaybackBackend::queueSamples(const float *pSamples, uint n) noexcept
+{
+    const int off = m_sampleBuf.size();
+    m_sampleBuf.resize(off + n);
+    std::copy(pSamples, pSamples + n, m_sampleBuf.begin() + off);
+}
+
 void QtPlaybackBackend::endFrame() noexcept
 {
-    if (m_dev)
-        m_dev->write(reinterpret_cast<const char*>(m_sampleBuf.data()), m_sampleBuf.size() * 4);
+    Q_EMIT frameReady(QByteArray { reinterpret_cast<const char*>(m_sampleBuf.data()),
+                                   m_sampleBuf.size() * 4 });
     m_sampleBuf.clear();
 }
+
+void QtPlaybackBackend::writeFrame(const QByteArray &samples)
+{
+    if (m_dev)
+        m_dev->write(samples);
+}
@@ -1,6 +1,8 @@
 #include "screenwidget.h"
 
 #include <bus.h>
+#include <rewinder.h>
+#include <log.h>
 #include <QSurfaceFormat>
 #include <QMessageBox>
 #include <QTimerEvent>
@@ -48,38 +50,97 @@ ScreenWidget::ScreenWidget(QWidget *container):
 
 ScreenWidget::~ScreenWidget()
 {
+    m_emuThread.stop();
     m_RBE.reset();
 }
 
+void ScreenWidget::setBus(Bus *pBus)
+{
+    Q_ASSERT(pBus != nullptr);
+    m_pBus = pBus;
+    m_rewinder.reset(new Rewinder { *pBus });
+}
+
+void ScreenWidget::clearRewindHistory() noexcept
+{
+    if (m_rewinder)
+        m_rewinder->clear();
+}
+
+void ScreenWidget::setRewinding(bool r)
+{
+    postCommand(Command { Command::Rewind, 0u, Button::A, r, false });
+}
+
+void ScreenWidget::buttonEvent(int pad, Button button, bool pressed, bool turbo)
+{
+    postCommand(Command { Command::PadButton, static_cast<uint8_t>(pad), button, pressed, turbo });
+}
+
+void ScreenWidget::postCommand(const Command &cmd)
+{
+    if (!m_commands.push(cmd))
+        Log::w("Input queue is full, event dropped");
+}
+
 bool ScreenWidget::isRunning() const noexcept
 {
-    return m_runEmulation;
+    return m_emuThread.isRunning();
 }
 
 void ScreenWidget::pause()
 {
-    Q_ASSERT(m_timerId != 0);
-    m_runEmulation = false;
-    killTimer(m_timerId);
-    m_timerId = 0;
+    m_emuThread.stop();
 }
 
 void ScreenWidget::resume()
 {
-    m_nFrames = m_accFrameTimes = 0;
-    m_runEmulation = true;
+    Q_ASSERT(m_pBus);
     m_clocks.start();
-    if (m_timerId == 0)
-        m_timerId = startTimer(17, Qt::PreciseTimer);
+    if (!m_emuThread.isRunning())
+        m_emuThread.start([this] { emulateFrame(); }, 60u);
 }
 
 void ScreenWidget::step()
 {
-    m_nFrames = m_accFrameTimes = 0;
-    m_stepEmulation = true;
+    // The thread is stopped, so the frame can be run right here
+    Q_ASSERT(!m_emuThread.isRunning());
+    emulateFrame();
     requestUpdate();
 }
 
+void ScreenWidget::emulateFrame()
+{
+    Command cmd;
+    while (m_commands.pop(cmd))
+    {
+        if (cmd.type == Command::Rewind)
+            m_rewinding = cmd.pressed;
+        else if (auto pPad = m_pBus->getGamePad(cmd.pad))
+            pPad->buttonEvent(cmd.button, cmd.pressed, cmd.turbo, false);
+    }
+
+    if (!m_pBus->getCartrige())
+    {
+        m_handoff.drawIdle();
+        return;
+    }
+
+    if (!m_rewinding)
+    {
+        m_rewinder->push();
+        m_pBus->runFrame();
+    }
+    else if (m_rewinder->stepBack())
+        // Replay the restored frame to show it, its state is not stored again
+        m_pBus->runFrame();
+
+#ifdef ENABLE_PERF_COUNTERS
+    m_perf.back() = m_pBus->perfCounters();
+    m_perf.publish();
+#endif
+}
+
 void ScreenWidget::initialize()
 {
 #ifdef USE_VULKAN
@@ -146,33 +207,14 @@ void ScreenWidget::render()
     m_pGLCtx->makeCurrent(this);
 #endif
 
-    Q_ASSERT(m_pBus);
-    if (m_pBus->getCartrige())
-    {
-        if (m_runEmulation || m_stepEmulation)
-        {
-            const int dt = m_clocks.restart();
-            if (m_nFrames++ > 0)
-            {
-                if (m_nFrames < 60)
-                    m_accFrameTimes += dt;
-                else
-                {
-                    Q_EMIT fpsChanged(m_nFrames * 1000.0f / m_accFrameTimes);
-                    m_nFrames = 1;
-                    m_accFrameTimes = dt;
-                }
-            }
-
-            m_pBus->runFrame();
+    // Show the newest frame, the last one is drawn again while paused
+    m_handoff.present(*m_RBE);
 
-            m_stepEmulation = false;
-        }
-        else
-            m_RBE->draw();
+    if (m_emuThread.isRunning() && m_clocks.elapsed() >= 1000)
+    {
+        Q_EMIT fpsChanged(m_emuThread.fps());
+        m_clocks.restart();
     }
-    else
-        m_RBE->drawIdle();
 
 #ifndef USE_VULKAN
     m_pGLCtx->swapBuffers(this);
@@ -8,6 +8,14 @@
 #include <cpu6502.h>
 #include <gamepad.h>
 #include <Cartridge.h>
+#include <rewinder.h>
+#include <statewriter.h>
+#include <runahead.h>
+#include <movie.h>
+#include <emulationthread.h>
+#include <deferredrenderer.h>
+#include <spscqueue.h>
+#include <triplebuffer.h>
 #include <SDL2/SDL.h>
 
 #ifdef USE_VULKAN
@@ -18,6 +26,8 @@
     #include "glbe.h"
 #endif
 
+#include <atomic>
+#include <memory>
 #include <string>
 
 class MainWindow
@@ -29,6 +39,26 @@ class MainWindow
         bool turbo;
     };
 
+    // Input for the emulation thread
+    struct Command
+    {
+        enum Type: uint8_t
+        {
+            PadButton,
+            TogglePause,
+            Step,
+            Rewind,
+            QuickSave,
+            QuickLoad
+        };
+
+        Type type;
+        uint8_t pad;
+        Button button;
+        bool pressed,
+             turbo;
+    };
+
     SDL_Window *m_sdlWin = nullptr;
 
     Bus m_bus { OutputMode::NTSC };
@@ -45,9 +75,31 @@ class MainWindow
     GLFunctionsWrapper m_glFuncWrp;
     GLRenderingBackend<GLFunctionsWrapper> m_RBE;
 #endif
+    FrameHandoff m_handoff;
     SDLPlaybackBackend m_audioBE;
-    bool m_isPaused = false,
-         m_doStep = false;
+    AudioCapture m_audioCapture;
+    Rewinder m_rewinder { m_bus };
+    StateWriter m_stateWriter { m_bus };
+    RunAhead m_runAhead { m_bus };
+    MovieRecorder m_movieRecorder { m_bus };
+    bool m_runAheadDual = false;
+    std::unique_ptr<ThreadPool> m_renderPool;
+    std::unique_ptr<DeferredRenderer> m_deferredRenderer;
+    std::string m_romFileName;
+    int m_autosaveSeconds = 0;
+
+    // Emulation runs on its own thread, the main thread handles events and presents frames
+    EmulationThread m_emuThread;
+    SPSCQueue<Command, 256> m_commands;
+    std::atomic<bool> m_isPaused { false };    // written by the emulation thread only
+    bool m_doStep = false,
+         m_isRewinding = false;
+
+#ifdef ENABLE_PERF_COUNTERS
+    // Counters of the newest frame run, passed to the overlay
+    TripleBuffer<PerfCounters> m_perf;
+    bool m_showPerf = true;
+#endif
 
     KeyMap m_keyMapLeft[10] = {
          { SDL_SCANCODE_W,   Button::UP,     false },
@@ -75,6 +127,27 @@ class MainWindow
 
      std::string m_error;
 
+     std::string stateFileName(const char *suffix) const
+     {
+         return m_romFileName + suffix;
+     }
+
+     void quickLoad();
+
+     /// Write the movie before the machine leaves the recorded history
+     /// (rewind, state load, another ROM); a movie can't follow such a jump.
+     void stopMovieRecording(const char *reason);
+
+     void postCommand(const Command &cmd);
+     void postCommand(Command::Type type, bool pressed = true)
+     {
+         postCommand(Command { type, 0u, Button::A, pressed, false });
+     }
+
+     // Emulation thread
+     void executeCommand(const Command &cmd);
+     void emulateFrame();
+
 #ifdef USE_IMGUI
      void handleUI();
 #endif
@@ -89,6 +162,16 @@ public:
     ~MainWindow();
     void initialize();
     void loadROM(const char *romFileName);
+    void startAudioCapture(const char *prefix);
+    void startMovieRecording(const char *fileName);
+    void setAutosave(int seconds);
+    void setRunAhead(int frames, bool dual);
+    void setRenderThreads(int nThreads, bool overlapped);
+
+    /// Start the emulation thread. Settings above must be changed before that.
+    void start();
+
+    /// Present the newest emulated frame.
     void update();
     void handleEvent(const SDL_Event &evt);
 
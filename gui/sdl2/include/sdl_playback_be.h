@@ -27,6 +27,7 @@ public:
 
     void beginFrame(uint nSamples) noexcept override;
     void queueSample(float v) noexcept override;
+    void queueSamples(const float *pSamples, uint n) noexcept override;
     void endFrame() noexcept override;
 };
 
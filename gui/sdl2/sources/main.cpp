@@ -3,6 +3,13 @@
 struct Options
 {
     const char *romFileName;
+    const char *audioCapturePrefix;
+    const char *movieFileName;
+    int autosaveSeconds;
+    int runAheadFrames;
+    int renderThreads;
+    bool runAheadDual;
+    bool renderOverlapped;
     bool fullScreen;
 };
 
@@ -10,6 +17,13 @@ Options parseArguments(int argc, char *argv[])
 {
     Options opts = {
         nullptr,
+        nullptr,
+        nullptr,
+        0,
+        0,
+        0,
+        false,
+        false,
         false
     };
 
@@ -17,6 +31,37 @@ Options parseArguments(int argc, char *argv[])
     {
         if (strcmp(argv[i], "--fullscreen") == 0)
             opts.fullScreen = true;
+        else if (strcmp(argv[i], "--capture-audio") == 0)
+        {
+            if (++i >= argc)
+                throw "audio capture file prefix was not provided";
+            opts.audioCapturePrefix = argv[i];
+        }
+        else if (strcmp(argv[i], "--record-movie") == 0)
+        {
+            if (++i >= argc)
+                throw "movie file name was not provided";
+            opts.movieFileName = argv[i];
+        }
+        else if (strcmp(argv[i], "--autosave") == 0)
+        {
+            if (++i >= argc || (opts.autosaveSeconds = atoi(argv[i])) <= 0)
+                throw "autosave period in seconds was not provided";
+        }
+        else if (strcmp(argv[i], "--run-ahead") == 0)
+        {
+            if (++i >= argc || (opts.runAheadFrames = atoi(argv[i])) <= 0)
+                throw "number of frames to run ahead was not provided";
+        }
+        else if (strcmp(argv[i], "--run-ahead-dual") == 0)
+            opts.runAheadDual = true;
+        else if (strcmp(argv[i], "--render-threads") == 0)
+        {
+            if (++i >= argc || (opts.renderThreads = atoi(argv[i])) <= 0)
+                throw "number of rendering threads was not provided";
+        }
+        else if (strcmp(argv[i], "--render-overlapped") == 0)
+            opts.renderOverlapped = true;
         else if (argv[i][0] != '-')
             opts.romFileName = argv[i];
         else
@@ -82,8 +127,19 @@ int main(int argc, char *argv[])
 
             // Rendering state setup
             emuWin.initialize();
+            if (opts.autosaveSeconds > 0)
+                emuWin.setAutosave(opts.autosaveSeconds);
+            if (opts.runAheadFrames > 0)
+                emuWin.setRunAhead(opts.runAheadFrames, opts.runAheadDual);
+            if (opts.renderThreads > 0)
+                emuWin.setRenderThreads(opts.renderThreads, opts.renderOverlapped);
             if (opts.romFileName)
                 emuWin.loadROM(opts.romFileName);
+            if (opts.audioCapturePrefix)
+                emuWin.startAudioCapture(opts.audioCapturePrefix);
+            if (opts.movieFileName)
+                emuWin.startMovieRecording(opts.movieFileName);
+            emuWin.start();
 
             float remd = 0.0f;
             bool runLoop = true;
@@ -99,7 +155,8 @@ int main(int argc, char *argv[])
                         emuWin.handleEvent(evt);
                 }
 
-                // Update emulator state and render scene with GL
+                // Emulation runs on its own thread, only the newest frame is rendered here,
+                // so a slow swap doesn't hold the emulation back
                 emuWin.update();
 
                 SDL_GL_SwapWindow(win);
@@ -46,6 +46,9 @@ MainWindow::MainWindow(SDL_Window *win, SDL_GLContext glCtx):
 
 MainWindow::~MainWindow()
 {
+    m_emuThread.stop();
+    stopMovieRecording("quitting");
+
 #ifdef USE_IMGUI
     #ifdef USE_VULKAN
         m_RBE.waitDeviceIdle();
@@ -130,9 +133,11 @@ void MainWindow::initialize()
     ImGui::GetIO();
 #endif
 
-    m_ppu.setBackend(&m_RBE);
+    // The PPU runs on the emulation thread, frames reach m_RBE through the handoff
+    m_ppu.setBackend(&m_handoff);
 
     m_apu.setBackend(&m_audioBE);
+    m_apu.setCapture(&m_audioCapture);
 
     m_bus.setCPU(&m_cpu);
     m_bus.setPPU(&m_ppu);
@@ -146,43 +151,230 @@ void MainWindow::initialize()
     m_RBE.resize(w, h);
 }
 
+void MainWindow::start()
+{
+    m_emuThread.start([this] { emulateFrame(); }, static_cast<uint>(getRefreshRate()));
+}
+
 void MainWindow::loadROM(const char *romFileName)
 {
+    // The machine belongs to the emulation thread while it runs
+    const bool wasRunning = m_emuThread.isRunning();
+    m_emuThread.stop();
+
+    stopMovieRecording("another ROM is loaded");
+
     try
     {
         Log::i("Loading ROM file %s", romFileName);
         ROMLoader loader { m_cartridge };
         loader.loadNES(romFileName);
         m_bus.injectCartrige(&m_cartridge);
+        m_rewinder.clear();
+        m_romFileName = romFileName;
+        setAutosave(m_autosaveSeconds);
+        setRunAhead(static_cast<int>(m_runAhead.frames()), m_runAheadDual);
     }
     catch (const Exception &ex)
     {
         m_error = std::string{ "Failed to load ROM file, " } + ex.message();
         Log::e("%s", m_error.c_str());
     }
+
+    if (wasRunning)
+        start();
 }
 
-void MainWindow::update()
+void MainWindow::setRenderThreads(int nThreads, bool overlapped)
 {
-#ifdef USE_IMGUI
-    handleUI();
-#endif
+    assert(!m_emuThread.isRunning());
+    m_ppu.setDeferredRenderer(nullptr);
+    m_deferredRenderer.reset();
+    m_renderPool.reset();
+    if (nThreads <= 0)
+        return;
 
-    if (m_bus.getCartrige())
+    m_renderPool.reset(new ThreadPool { static_cast<uint>(nThreads) });
+    m_deferredRenderer.reset(new DeferredRenderer { *m_renderPool,
+                                                    0u,
+                                                    overlapped ? DeferredRenderer::Mode::Overlapped :
+                                                                 DeferredRenderer::Mode::AfterFrame });
+    m_ppu.setDeferredRenderer(m_deferredRenderer.get());
+}
+
+void MainWindow::startAudioCapture(const char *prefix)
+{
+    try
     {
-        // If running emulation, perform a full frame iteration,
-        // otherwise just repeat the last frame.
-        if (!m_isPaused || m_doStep)
-            m_bus.runFrame();
-        else
-            m_RBE.draw();
-        m_doStep = false;
+        m_audioCapture.start(prefix);
+    }
+    catch (const Exception &ex)
+    {
+        m_error = std::string{ "Failed to start audio capture, " } + ex.message();
+        Log::e("%s", m_error.c_str());
+    }
+}
+
+void MainWindow::startMovieRecording(const char *fileName)
+{
+    try
+    {
+        // Recording starts from power on, so the movie doesn't need a state
+        m_movieRecorder.start(fileName, true);
+        m_rewinder.clear();
+        m_runAhead.invalidate();
+    }
+    catch (const Exception &ex)
+    {
+        m_error = std::string{ "Failed to start movie recording, " } + ex.message();
+        Log::e("%s", m_error.c_str());
+    }
+}
+
+void MainWindow::setAutosave(int seconds)
+{
+    m_autosaveSeconds = seconds;
+    if (!m_romFileName.empty())
+        m_stateWriter.setAutosave(stateFileName(".autosave.dst"),
+                                  static_cast<uint>(seconds * getRefreshRate()));
+}
+
+void MainWindow::setRunAhead(int frames, bool dual)
+{
+    m_runAhead.setFrames(static_cast<uint>(frames));
+    m_runAheadDual = dual;
+    if (m_romFileName.empty())
+        return;
+
+    try
+    {
+        m_runAhead.setSecondInstance(dual && frames > 0);
+    }
+    catch (const Exception &ex)
+    {
+        Log::e("Failed to start run-ahead second instance: %s", ex.message());
+    }
+}
+
+void MainWindow::quickLoad()
+{
+    const auto fileName = stateFileName(".quick.dst");
+    try
+    {
+        // The quick save may still be on its way to the disk
+        m_stateWriter.flush();
+        stopMovieRecording("state is loaded");
+        m_bus.loadState(fileName.c_str());
+        m_rewinder.clear();
+        m_runAhead.invalidate();
+        Log::i("State loaded from %s", fileName.c_str());
+    }
+    catch (const Exception &ex)
+    {
+        Log::e("Failed to load state from %s: %s", fileName.c_str(), ex.message());
+    }
+}
+
+void MainWindow::stopMovieRecording(const char *reason)
+{
+    if (!m_movieRecorder.isRecording())
+        return;
+
+    try
+    {
+        m_movieRecorder.stop();
+        Log::i("Movie recording stopped, %s", reason);
+    }
+    catch (const Exception &ex)
+    {
+        Log::e("Failed to save the movie: %s", ex.message());
+    }
+}
+
+void MainWindow::postCommand(const Command &cmd)
+{
+    if (!m_commands.push(cmd))
+        Log::w("Input queue is full, event dropped");
+}
+
+void MainWindow::executeCommand(const Command &cmd)
+{
+    switch (cmd.type)
+    {
+        case Command::PadButton:
+            (cmd.pad == 0u ? m_padLeft : m_padRight).buttonEvent(cmd.button, cmd.pressed, cmd.turbo, false);
+            break;
+        case Command::TogglePause:
+            m_isPaused = !m_isPaused;
+            break;
+        case Command::Step:
+            m_doStep = true;
+            break;
+        case Command::Rewind:
+            m_isRewinding = cmd.pressed;
+            break;
+        case Command::QuickSave:
+            m_stateWriter.save(stateFileName(".quick.dst"));
+            break;
+        case Command::QuickLoad:
+            quickLoad();
+            break;
+    }
+}
+
+void MainWindow::emulateFrame()
+{
+    Command cmd;
+    while (m_commands.pop(cmd))
+        executeCommand(cmd);
+
+    if (!m_bus.getCartrige())
+    {
+        m_handoff.drawIdle();
+        return;
+    }
+
+    // When paused, the main thread keeps showing the last frame
+    if (m_isPaused && !m_doStep)
+    {
+        m_ppu.flush();
+        return;
+    }
+    m_doStep = false;
+
+    if (!m_isRewinding)
+    {
+        m_rewinder.push();
+        m_movieRecorder.beforeFrame();
+        m_runAhead.runFrame();
+        m_movieRecorder.afterFrame();
+        m_stateWriter.onFrame();
     }
     else
     {
-        m_RBE.drawIdle();
+        stopMovieRecording("rewinding");
+        if (m_rewinder.stepBack())
+        {
+            // Replay the restored frame to show it, its state is not stored again
+            m_bus.runFrame();
+            m_runAhead.invalidate();
+        }
     }
 
+#ifdef ENABLE_PERF_COUNTERS
+    m_perf.back() = m_bus.perfCounters();
+    m_perf.publish();
+#endif
+}
+
+void MainWindow::update()
+{
+#ifdef USE_IMGUI
+    handleUI();
+#endif
+
+    m_handoff.present(m_RBE);
+
 #if defined(USE_IMGUI) && !defined(USE_VULKAN)
     // For GLES, we just issue commands to paint ImGUI stuff over the main (emulator)
     // commands. For Vulkan, the paint command buffer will be filled indirectly from the
@@ -209,10 +401,10 @@ void MainWindow::handleEvent(const SDL_Event &evt)
                 switch (evt.key.keysym.scancode)
                 {
                     case SDL_SCANCODE_P:
-                        m_isPaused = !m_isPaused;
+                        postCommand(Command::TogglePause);
                         break;
                     case SDL_SCANCODE_S:
-                        m_doStep = true;
+                        postCommand(Command::Step);
                         break;
                 }
             }
@@ -221,6 +413,24 @@ void MainWindow::handleEvent(const SDL_Event &evt)
                 // Handle gamepad mapped keys
                 const auto key = evt.key.keysym.scancode;
                 const bool pressed = evt.key.state == SDL_PRESSED;
+                if (key == SDL_SCANCODE_BACKSPACE)
+                {
+                    // Hold to rewind
+                    if (evt.key.repeat == 0)
+                        postCommand(Command::Rewind, pressed);
+                    break;
+                }
+                if ((key == SDL_SCANCODE_F5 || key == SDL_SCANCODE_F9) && m_bus.getCartrige())
+                {
+                    if (pressed && evt.key.repeat == 0)
+                    {
+                        postCommand(key == SDL_SCANCODE_F5 ? Command::QuickSave : Command::QuickLoad);
+                    }
+                    break;
+                }
+                // A held pad key is already down, its repeats would only fill the queue while paused
+                if (evt.key.repeat != 0)
+                    break;
                 auto i = std::find_if(std::begin(m_keyMapLeft),
                                     std::end(m_keyMapLeft),
                                     [key](const KeyMap &x)
@@ -229,7 +439,7 @@ void MainWindow::handleEvent(const SDL_Event &evt)
                 });
 
                 if (i != std::end(m_keyMapLeft))
-                    m_padLeft.buttonEvent(i->padKey, pressed, i->turbo, false);
+                    postCommand(Command { Command::PadButton, 0u, i->padKey, pressed, i->turbo });
                 else
                 {
                     // Pad 2?
@@ -241,7 +451,7 @@ void MainWindow::handleEvent(const SDL_Event &evt)
                     });
 
                     if (i != std::end(m_keyMapRight))
-                        m_padRight.buttonEvent(i->padKey, pressed, i->turbo, false);
+                        postCommand(Command { Command::PadButton, 1u, i->padKey, pressed, i->turbo });
                 }
             }
             break;
@@ -283,15 +493,44 @@ void MainWindow::handleUI()
         }
         if (ImGui::BeginMenu("Emulation"))
         {
-            ImGui::MenuItem("Pause", "Ctrl+P", &m_isPaused);
+            bool paused = m_isPaused;
+            if (ImGui::MenuItem("Pause", "Ctrl+P", &paused))
+                postCommand(Command::TogglePause);
             if (ImGui::MenuItem("Step", "Ctrl+S"))
-                m_doStep = true;
+                postCommand(Command::Step);
+#ifdef ENABLE_PERF_COUNTERS
+            ImGui::Separator();
+            ImGui::MenuItem("Performance counters", nullptr, &m_showPerf);
+#endif
             ImGui::EndMenu();
         }
 
         ImGui::EndMainMenuBar();
     }
 
+#ifdef ENABLE_PERF_COUNTERS
+    m_perf.update();
+    if (m_showPerf)
+    {
+        const PerfCounters &pc = m_perf.front();
+        const auto u = [](uint64_t v) { return static_cast<unsigned long long>(v); };
+        ImGui::SetNextWindowBgAlpha(0.6f);
+        if (ImGui::Begin("Performance", &m_showPerf, ImGuiWindowFlags_AlwaysAutoResize | ImGuiWindowFlags_NoFocusOnAppearing))
+        {
+            ImGui::Text("%llu instructions, %llu cycles", u(pc.instructions), u(pc.cycles));
+            ImGui::Text("%llu bank switches, %llu sprite lines", u(pc.bankSwitches), u(pc.spriteLines));
+            ImGui::Separator();
+            for (int r = 0; r < PerfCounters::NUM_REGIONS; r++)
+                ImGui::Text("%-5s %6llu reads %6llu writes", PerfCounters::regionName(r), u(pc.reads[r]), u(pc.writes[r]));
+            ImGui::Separator();
+            for (int s = 0; s < PerfCounters::NUM_SECTIONS; s++)
+                ImGui::Text("%-8s %9llu %s", PerfCounters::sectionName(s), u(pc.hostTime[s]),
+                            hostCyclesAreTSC() ? "cycles" : "ns");
+        }
+        ImGui::End();
+    }
+#endif
+
     // Process UI actions
     static ImGuiFs::Dialog dlg;
     const char *romPath = dlg.chooseFileDialog(cmdOpenROM);
@@ -59,6 +59,20 @@ void SDLPlaybackBackend::queueSample(float v) noexcept
     m_sampleBuf.enqueue(v);
 }
 
+void SDLPlaybackBackend::queueSamples(const float *pSamples, uint n) noexcept
+{
+    if (n == 0u)
+        return;
+
+    m_lastSample = pSamples[n - 1u];
+    if (m_sampleBuf.capacity() - m_sampleBuf.size() < n)
+    {
+        m_sampleBuf.reserve(std::max(m_sampleBuf.capacity() * 2u, m_sampleBuf.size() + n));
+        Log::i("Audio: extended buffer size to %u", m_sampleBuf.capacity());
+    }
+    m_sampleBuf.enqueueRange(pSamples, n);
+}
+
 void SDLPlaybackBackend::endFrame() noexcept
 {
     SDL_UnlockAudioDevice(m_devId);
@@ -0,0 +1,384 @@
+; Test program the tools run when no ROM is given, bin/testrom.cpp has it
+; assembled. Drives the CPU, PPU, APU and pads the ways games do, so that
+; runs of differently configured engines can be compared on it: NMI and
+; frame IRQ handlers, OAM DMA, nametable and palette writes in VBLANK,
+; a sprite 0 split with a mid-frame scroll change, pad reads, sound
+; register writes and RAM work through all the addressing modes.
+; CHR ROM is generated there too: tiles $00-$7F are opaque everywhere.
+
+    .inesprg    1
+    .ineschr    1
+    .inesmir    1
+    .inesmap    0
+
+        .rsset  $0000
+frame   .rs     1       ; frames seen by the NMI handler
+nmiDone .rs     1
+buttons .rs     1
+rng     .rs     1
+irqs    .rs     1       ; frame IRQs taken
+ptr     .rs     2       ; nametable cell written next
+scrollX .rs     1
+tmp     .rs     1
+hits    .rs     1       ; sprite 0 hits seen
+buttons2 .rs    1
+work    .rs     2       ; pointer to the work buffer
+
+    .bank   0
+    .org    $C000
+
+Reset:
+    sei
+    cld
+    ldx     #$FF
+    txs
+    lda     #0
+    sta     $2000
+    sta     $2001
+    sta     $4010           ; no DMC IRQ
+    lda     #$40
+    sta     $4017           ; no frame IRQ during setup
+.vbl1:
+    bit     $2002
+    bpl     .vbl1
+
+    lda     #0
+    tax
+.clear:
+    sta     <$00,x
+    sta     $0300,x
+    inx
+    bne     .clear
+    lda     #$A7
+    sta     <rng
+
+    ; Sprite 0 over the background at line $30, the rest spread around
+    ldx     #0
+.sprites:
+    txa
+    sta     $0200,x
+    lda     #1
+    sta     $0201,x
+    txa
+    and     #3
+    sta     $0202,x
+    txa
+    eor     #$5A
+    sta     $0203,x
+    inx
+    inx
+    inx
+    inx
+    bne     .sprites
+    lda     #$30
+    sta     $0200
+    sta     $0203
+
+.vbl2:
+    bit     $2002
+    bpl     .vbl2
+
+    ; Palettes
+    lda     #$3F
+    sta     $2006
+    lda     #0
+    sta     $2006
+    ldx     #0
+.palette:
+    lda     Palette,x
+    sta     $2007
+    inx
+    cpx     #32
+    bne     .palette
+
+    ; Both nametables of random opaque tiles
+    lda     #$20
+    sta     $2006
+    lda     #0
+    sta     $2006
+    ldx     #8
+    ldy     #0
+.names:
+    jsr     Rand
+    and     #$7F
+    sta     $2007
+    iny
+    bne     .names
+    dex
+    bne     .names
+
+    ; Pulse, triangle and noise on, 4-step sequence with the frame IRQ
+    lda     #$0F
+    sta     $4015
+    lda     #$BF
+    sta     $4000
+    lda     #$08
+    sta     $4001
+    lda     #$C9
+    sta     $4002
+    lda     #$00
+    sta     $4003
+    lda     #$FF
+    sta     $4008
+    lda     #$60
+    sta     $400A
+    lda     #$01
+    sta     $400B
+    lda     #$3C
+    sta     $400C
+    lda     #$05
+    sta     $400E
+    lda     #$08
+    sta     $400F
+    lda     #$00
+    sta     $4017
+    cli
+
+    lda     #0
+    sta     $2005
+    sta     $2005
+    lda     #$88            ; NMI on, sprites from $1000
+    sta     $2000
+    lda     #$1E
+    sta     $2001
+
+Main:
+    jsr     Work
+.wait:
+    lda     <nmiDone
+    beq     .wait
+    lda     #0
+    sta     <nmiDone
+
+    ; Sprite 0 flag of the previous frame goes at the end of VBLANK,
+    ; the new one splits the screen
+    ldx     #0
+    ldy     #0
+.s0clear:
+    bit     $2002
+    bvc     .s0wait
+    dey
+    bne     .s0clear
+    dex
+    bne     .s0clear
+.s0wait:
+    bit     $2002
+    bvs     .s0hit
+    dey
+    bne     .s0wait
+    dex
+    bne     .s0wait
+    jmp     .pads
+.s0hit:
+    lda     <scrollX
+    sta     $2005
+    lda     #0
+    sta     $2005
+    inc     <hits
+
+.pads:
+    lda     #1
+    sta     $4016
+    lda     #0
+    sta     $4016
+    ldx     #8
+.pad:
+    lda     $4016
+    lsr     a
+    rol     <buttons
+    lda     $4017
+    lsr     a
+    rol     <buttons2
+    dex
+    bne     .pad
+
+    ; Right and left scroll the lower part
+    lda     <buttons
+    and     #$01
+    beq     .noRight
+    inc     <scrollX
+.noRight:
+    lda     <buttons
+    and     #$02
+    beq     .noLeft
+    dec     <scrollX
+.noLeft:
+
+    ; Sprites but sprite 0 move by the buttons
+    ldx     #4
+.move:
+    lda     $0203,x
+    clc
+    adc     <buttons
+    sta     $0203,x
+    lda     $0200,x
+    sec
+    sbc     <buttons2
+    sta     $0200,x
+    txa
+    and     #$1C
+    bne     .sameTile
+    inc     $0201,x
+.sameTile:
+    inx
+    inx
+    inx
+    inx
+    bne     .move
+
+    ; Pulse follows the frame, noise the random numbers
+    lda     <frame
+    sta     $4002
+    jsr     Rand
+    and     #$0F
+    sta     $400E
+    lda     <frame
+    and     #$0F
+    bne     .noRestart
+    lda     #$01
+    sta     $4003
+.noRestart:
+    jmp     Main
+
+; CPU work on the RAM
+Work:
+    lda     #$00
+    sta     <work
+    lda     #$03
+    sta     <work+1
+    ldy     #0
+    sty     <tmp
+.sum:
+    lda     [work],y
+    clc
+    adc     <tmp
+    rol     a
+    sta     <tmp
+    eor     <buttons
+    sta     [work],y
+    iny
+    bne     .sum
+
+    ldx     #16
+.push:
+    txa
+    pha
+    dex
+    bne     .push
+    ldx     #16
+.pop:
+    pla
+    eor     <rng
+    sta     $0300,x
+    dex
+    bne     .pop
+
+    ldx     #0
+.arith:
+    lda     $0300,x
+    sec
+    sbc     $0301,x
+    ror     a
+    sta     $0380,x
+    lda     <tmp
+    adc     <$10,x
+    sta     <tmp
+    inx
+    cpx     #$7F
+    bne     .arith
+
+    ldx     #4
+    lda     [ptr-4,x]
+    sta     $03FF
+    jsr     Rand
+    bit     <tmp
+    bvc     .done
+    jsr     Rand
+.done:
+    rts
+
+; Galois LFSR
+Rand:
+    lda     <rng
+    asl     a
+    bcc     .noXor
+    eor     #$1D
+.noXor:
+    sta     <rng
+    rts
+
+Nmi:
+    pha
+    txa
+    pha
+    tya
+    pha
+
+    lda     #0
+    sta     $2003
+    lda     #2
+    sta     $4014
+
+    ; A nametable cell per frame
+    lda     $2002
+    lda     <ptr+1
+    and     #$07
+    ora     #$20
+    sta     $2006
+    lda     <ptr
+    sta     $2006
+    lda     <frame
+    and     #$7F
+    sta     $2007
+    lda     <ptr
+    clc
+    adc     #33
+    sta     <ptr
+    lda     <ptr+1
+    adc     #0
+    and     #$03
+    sta     <ptr+1
+
+    ; A color of the background palette cycles
+    lda     #$3F
+    sta     $2006
+    lda     #$01
+    sta     $2006
+    lda     <frame
+    lsr     a
+    lsr     a
+    and     #$3F
+    sta     $2007
+
+    ; Upper part isn't scrolled
+    lda     #0
+    sta     $2005
+    sta     $2005
+    lda     #$88
+    sta     $2000
+
+    inc     <frame
+    lda     #1
+    sta     <nmiDone
+    pla
+    tay
+    pla
+    tax
+    pla
+    rti
+
+Irq:
+    pha
+    lda     $4015           ; acknowledges the frame IRQ
+    inc     <irqs
+    pla
+    rti
+
+Palette:
+    .db     $0F, $16, $27, $38, $0F, $11, $21, $31, $0F, $1A, $2A, $3A, $0F, $14, $24, $34
+    .db     $0F, $06, $17, $28, $0F, $02, $12, $22, $0F, $0B, $1B, $2B, $0F, $05, $15, $25
+
+    .org    $FFFA
+    .dw     Nmi
+    .dw     Reset
+    .dw     Irq